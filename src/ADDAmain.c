@@ -87,6 +87,8 @@ int main(int argc,char **argv)
 	// !!! before this line errors should be printed in simple format, after - in advanced one
 	// Create directory and start logfile (print command line)
 	DirectoryLog(argc,argv);
+	// Split processes into groups for concurrent computation of orientations (if required)
+	InitGroups();
 	// Initialize FFT grid and its subdivision over processors
 	ParSetup();
 	// MakeParticle; initialize dpl and local_nRows
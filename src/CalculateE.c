@@ -68,15 +68,19 @@ extern size_t TotalEFieldPlane;
 #define AMPL_FORMAT EFORM" "EFORM" "EFORM" "EFORM" "EFORM" "EFORM" "EFORM" "EFORM
 #define ANGLE_FORMAT "%.2f"
 #define RMSE_FORMAT "%.3E"
+
 #define COMP44M(a) (a)[0][0],(a)[0][1],(a)[0][2],(a)[0][3],(a)[1][0],(a)[1][1],(a)[1][2],(a)[1][3],(a)[2][0],\
 	(a)[2][1],(a)[2][2],(a)[2][3],(a)[3][0],(a)[3][1],(a)[3][2],(a)[3][3]
 
+static double sweepCext[2],sweepCabs[2]; // cross sections for two incident polarizations (for table of sweep results)
+
 // EXTERNAL FUNCTIONS
 
 // GenerateB.c
 void GenerateB(enum incpol which,doublecomplex *x);
 // iterative.c
 int IterativeSolver(enum iter method,enum incpol which);
+int IterativeSolverBlock(enum iter method,const enum incpol * restrict which,int nrhs);
 
 //======================================================================================================================
 
@@ -753,6 +757,17 @@ static void CalcIntegralScatQuantities(const enum incpol which)
 	else { // not orient_avg
 		if (beamtype==B_DIPOLE) Cdec=DecayCross(); // this is here to be run by all processors
 		if (IFROOT) {
+			/* when only Y polarization is calculated (symmetric particle), the results for X are the same; so they are
+			 * stored as well and overwritten later if X is calculated
+			 */
+			if (sweep_N>0) {
+				sweepCext[which]=Cext;
+				sweepCabs[which]=Cabs;
+				if (which==INCPOL_Y) {
+					sweepCext[INCPOL_X]=Cext;
+					sweepCabs[INCPOL_X]=Cabs;
+				}
+			}
 			SnprintfErr(ONE_POS,fname_cs,MAX_FNAME,"%s/"F_CS"%s",directory,f_suf);
 			CCfile=FOpenErr(fname_cs,"w",ONE_POS);
 			if (calc_Cext) PrintBoth(CCfile,"Cext\t= "GFORM"\nQext\t= "GFORM"\n",Cext,Cext*inv_G);
@@ -841,6 +856,24 @@ static void StoreIntFields(const enum incpol which)
 
 //======================================================================================================================
 
+static void CalculateScattering(const enum incpol which,const enum Eftype type)
+// Calculate all scattering quantities, when polarizations of dipoles (pvec) are known
+{
+	if (yzplane) CalcEplaneYZ(which,type);     // generally plane of incPolY and prop
+	if (scat_plane) CalcScatPlane(which,type); // the scattering plane through ez,prop,incPolX - xz by default
+	// Calculate the scattered field for the whole solid-angle
+	if (all_dir) CalcAlldir();
+	// Calculate the scattered field on the given grid of angles
+	if (scat_grid) CalcScatGrid(which);
+	// Calculate integral scattering quantities (cross sections, asymmetry parameter, electric forces)
+	if (calc_Cext || calc_Cabs || calc_Csca || calc_asym || calc_mat_force) CalcIntegralScatQuantities(which);
+	// saves internal fields and/or dipole polarizations to text file
+	if (store_int_field) StoreIntFields(which);
+	if (store_dip_pol) StoreFields(which,pvec,NULL,F_DIPPOL,F_DIPPOL_TMP,"P","Dipole polarizations");
+}
+
+//======================================================================================================================
+
 int CalculateE(const enum incpol which,const enum Eftype type)
 /* Calculate everything for x or y polarized incident light; or one and use symmetry to determine the rest (determined
  * by type)
@@ -863,23 +896,44 @@ int CalculateE(const enum incpol which,const enum Eftype type)
 	Timing_IntField += Timing_IntFieldOne;
 	// return if checkpoint (normal) occurred
 	if (exit_status==CHP_EXIT) return CHP_EXIT;
-
-	if (yzplane) CalcEplaneYZ(which,type);     // generally plane of incPolY and prop
-	if (scat_plane) CalcScatPlane(which,type); // the scattering plane through ez,prop,incPolX - xz by default
-	// Calculate the scattered field for the whole solid-angle
-	if (all_dir) CalcAlldir();
-	// Calculate the scattered field on the given grid of angles
-	if (scat_grid) CalcScatGrid(which);
-	// Calculate integral scattering quantities (cross sections, asymmetry parameter, electric forces)
-	if (calc_Cext || calc_Cabs || calc_Csca || calc_asym || calc_mat_force) CalcIntegralScatQuantities(which);
-	// saves internal fields and/or dipole polarizations to text file
-	if (store_int_field) StoreIntFields(which);
-	if (store_dip_pol) StoreFields(which,pvec,NULL,F_DIPPOL,F_DIPPOL_TMP,"P","Dipole polarizations");
+	CalculateScattering(which,type);
 	return 0;
 }
 
 //======================================================================================================================
 
+void CalculateEBlock(void)
+/* Calculate everything for both y and x polarized incident light (in that order), solving both linear systems
+ * simultaneously. Main vectors (xvec, pvec, Einc, etc.) should be allocated with two parts, see IterativeSolverBlock.
+ */
+{
+	TIME_TYPE tstart;
+	const enum incpol which[2]={INCPOL_Y,INCPOL_X};
+	doublecomplex * const EincX=Einc+local_nRows;
+
+	tstart=GET_TIME();
+	D("Generating B");
+	GenerateB(INCPOL_Y,Einc);
+	GenerateB(INCPOL_X,EincX);
+	if (store_beam) {
+		StoreFields(INCPOL_Y,Einc,NULL,F_BEAM,F_BEAM_TMP,"Einc","Incident beam");
+		StoreFields(INCPOL_X,EincX,NULL,F_BEAM,F_BEAM_TMP,"Einc","Incident beam");
+	}
+	Timing_IncBeam = GET_TIME() - tstart;
+	D("Iterative solver (lock-step) started");
+	IterativeSolverBlock(IterMethod,which,2);
+	D("Iterative solver (lock-step) finished");
+	Timing_IntFieldOne = GET_TIME() - tstart;
+	Timing_IntField += Timing_IntFieldOne;
+	CalculateScattering(INCPOL_Y,CE_NORMAL);
+	// move the results for x-polarization into the main parts of vectors; the latter are used by all functions above
+	nCopy(Einc,EincX);
+	nCopy(pvec,pvec+local_nRows);
+	CalculateScattering(INCPOL_X,CE_NORMAL);
+}
+
+//======================================================================================================================
+
 void SaveMuellerAndCS(double * restrict in)
 /* saves Mueller matrix and cross sections (averaged) to files; vector in contains values of cross sections and then
  * array of Mueller matrix elements; designed to be called from ROOT only
@@ -916,3 +970,35 @@ void SaveMuellerAndCS(double * restrict in)
 
 	Timing_FileIO += GET_TIME() - tstart;
 }
+
+//======================================================================================================================
+
+void SaveSweepPoint(const int k)
+/* appends a line for sweep point k (wavelength, refractive indices, and cross sections for two incident polarizations)
+ * to the table of sweep results; the table is created (with a header) for the first point. Designed to be called from
+ * ROOT only.
+ */
+{
+	FILE * restrict file;
+	char fname[MAX_FNAME];
+	int i;
+	TIME_TYPE tstart;
+
+	tstart=GET_TIME();
+	SnprintfErr(ONE_POS,fname,MAX_FNAME,"%s/"F_SWEEP,directory);
+	file=FOpenErr(fname,(k==0) ? "w" : "a",ONE_POS);
+	if (k==0) {
+		fprintf(file,"lambda");
+		for (i=0;i<Nmat*Ncomp;i++) fprintf(file," m%d.r m%d.i",i+1,i+1);
+		if (calc_Cext) fprintf(file," Cext.Y Cext.X");
+		if (calc_Cabs) fprintf(file," Cabs.Y Cabs.X");
+		fprintf(file,"\n");
+	}
+	fprintf(file,GFORM,sweep_lambda[k]);
+	for (i=0;i<Nmat*Ncomp;i++) fprintf(file," "GFORM" "GFORM,REIM(sweep_m[k][i]));
+	if (calc_Cext) fprintf(file," "GFORM" "GFORM,sweepCext[INCPOL_Y],sweepCext[INCPOL_X]);
+	if (calc_Cabs) fprintf(file," "GFORM" "GFORM,sweepCabs[INCPOL_Y],sweepCabs[INCPOL_X]);
+	fprintf(file,"\n");
+	FCloseErr(file,F_SWEEP,ONE_POS);
+	Timing_FileIO += GET_TIME() - tstart;
+}
@@ -73,6 +73,10 @@ static double * restrict tv1, // 4^m
 // pointer to the function that is integrated
 static double (*func)(int theta,int phi,double * restrict res);
 static const Parms_1D *input; // parameters of integration
+// pointer to the function that is informed in advance about the points to be evaluated (may be NULL)
+static void (*prefetch)(int n,const int * restrict theta,const int * restrict phi);
+static int pf_n;                              // current number of points in the prefetch list
+static int * restrict pf_th,* restrict pf_ph; // prefetch list (indices of theta and phi)
 
 //======================================================================================================================
 
@@ -201,6 +205,11 @@ static void AllocateAll(void)
 			tv3[i-1]=2*tv1[i-1]-1;
 		}
 	}
+	// prefetch list may contain all points
+	if (prefetch!=NULL) {
+		MALLOC_VECTOR(pf_th,int,input[THETA].Grid_size*input[PHI].Grid_size,ONE);
+		MALLOC_VECTOR(pf_ph,int,input[THETA].Grid_size*input[PHI].Grid_size,ONE);
+	}
 }
 
 //======================================================================================================================
@@ -222,6 +231,60 @@ static void FreeAll(void)
 		Free_dVector2(tv2,1);
 		Free_general(tv3);
 	}
+	if (prefetch!=NULL) {
+		Free_general(pf_th);
+		Free_general(pf_ph);
+	}
+}
+
+//======================================================================================================================
+
+static void PrefetchLevel(const int fixed,const int m)
+/* adds to the prefetch list the points, which are evaluated at m-th refinement of the inner integration for fixed theta
+ * (by InnerInitT and InnerTrapzd for m=0, and by InnerTrapzd only for m>0)
+ */
+{
+	int step;
+	size_t j;
+
+	step=(input[PHI].Grid_size-1)>>m;
+	if (m==0) {
+		pf_th[pf_n]=fixed;
+		pf_ph[pf_n++]=0;
+		if (!input[PHI].equival) {
+			pf_th[pf_n]=fixed;
+			pf_ph[pf_n++]=input[PHI].Grid_size-1;
+		}
+	}
+	for (j=step>>1;j<input[PHI].Grid_size;j+=step) {
+		pf_th[pf_n]=fixed;
+		pf_ph[pf_n++]=j;
+	}
+}
+
+//======================================================================================================================
+
+static void PrefetchInner(const int fixed,const bool onepoint)
+/* adds to the prefetch list all points, which are necessarily evaluated by InnerRomberg for fixed theta, i.e. before
+ * the convergence can be tested
+ */
+{
+	int m;
+
+	if (input[PHI].Grid_size==1 || onepoint) {
+		pf_th[pf_n]=fixed;
+		pf_ph[pf_n++]=0;
+	}
+	else for (m=0;m<MAX(input[PHI].Jmin,1) && m<input[PHI].Jmax;m++) PrefetchLevel(fixed,m);
+}
+
+//======================================================================================================================
+
+static void PrefetchFlush(void)
+// passes the accumulated prefetch list to the corresponding function and empties the list
+{
+	if (pf_n>0) (*prefetch)(pf_n,pf_th,pf_ph);
+	pf_n=0;
 }
 
 //======================================================================================================================
@@ -319,7 +382,11 @@ static double InnerRomberg(const int fixed,double * restrict res,const bool onep
 				m0=m;
 			}
 		}
-		// get new integrand values (M_0^m)
+		// get new integrand values (M_0^m); points of first levels are prefetched by the outer integration
+		if (prefetch!=NULL && m>=MAX(input[PHI].Jmin,1)) {
+			PrefetchLevel(fixed,m);
+			PrefetchFlush();
+		}
 		int_err=0.5*(int_err+InnerTrapzd(fixed,M_in[m0],m));
 		// generate M_1^(m-1), M_2^(m-2), ..., M_(m-1)^1, M_m^0
 		if (m0!=0) RombergIterate(M_in,m);
@@ -394,7 +461,8 @@ static double OuterRomberg(double * restrict res)
  * periodic then only the first column of the table is used - i.e. trapezoid rule
  */
 {
-	int m,m0,comp;
+	int m,m0,comp,step;
+	size_t j;
 	double abs_res,abs_err; // norms of result and error
 	double int_err; // absolute error of previous layer integration
 	double err;
@@ -404,6 +472,10 @@ static double OuterRomberg(double * restrict res)
 
 	if (input[THETA].Grid_size==1) { // if only one point
 		N_eval=0;
+		if (prefetch!=NULL) {
+			PrefetchInner(0,false);
+			PrefetchFlush();
+		}
 		int_err=InnerRomberg(0,res,false);
 		fprintf(file,"single\t\t%d integrand-values were used.\n",N_eval);
 		N_tot_eval+=N_eval;
@@ -411,6 +483,19 @@ static double OuterRomberg(double * restrict res)
 	}
 	m0=0; // equals 0 for periodic, m otherwise
 	for (m=0;m<input[THETA].Jmax;m++) {
+		/* all points of the outer refinement, which are necessarily evaluated by inner integrations, are announced
+		 * together (including the boundary points for m=0), providing the largest possible independent set of points
+		 */
+		if (prefetch!=NULL) {
+			if (m==0) {
+				PrefetchInner(0,input[THETA].min==-1 && full_al_range);
+				if (!input[THETA].equival)
+					PrefetchInner(input[THETA].Grid_size-1,input[THETA].max==1 && full_al_range);
+			}
+			step=(input[THETA].Grid_size-1)>>m;
+			for (j=step>>1;j<input[THETA].Grid_size;j+=step) PrefetchInner(j,false);
+			PrefetchFlush();
+		}
 		// calculate T_0^m
 		if (m==0) {
 			N_eval=0;
@@ -457,11 +542,14 @@ static inline const char *TextTest(const bool cond)
 //======================================================================================================================
 
 void Romberg2D(const Parms_1D parms_input[2],double (*func_input)(int theta,int phi,double * restrict res),
-	const int dim_input,double * restrict res,const char * restrict fname)
+	void (*prefetch_input)(int n,const int * restrict theta,const int * restrict phi),const int dim_input,
+	double * restrict res,const char * restrict fname)
 /* Integrate 2D func with Romberg's method according to input's parameters. Function func_input returns the estimate of
  * the absolute error. Argument dim_input gives the number of components of (double *). Consistency between 'func' and
  * 'dim_input' is the user's responsibility. Result is normalized on the interval widths, i.e. actually averaging takes
- * place.
+ * place. If prefetch_input is not NULL, it is called with lists of (theta,phi) points (indices), which are going to be
+ * requested from func_input soon (before any other points), e.g. to evaluate them in parallel. Some of these points may
+ * be announced more than once.
  */
 {
 	double error;
@@ -471,6 +559,8 @@ void Romberg2D(const Parms_1D parms_input[2],double (*func_input)(int theta,int
 	// initialize global values
 	dim = dim_input;
 	func = func_input;
+	prefetch = prefetch_input;
+	pf_n = 0;
 	input = parms_input;
 	file=FOpenErr(fname,"w",ONE_POS);
 	no_convergence = 0;
@@ -0,0 +1,505 @@
+/* File: aim.c
+ * $Date::                            $
+ * Descr: adaptive integral method (AIM), also known as precorrected FFT, for the matrix-vector product in sparse mode
+ *
+ *        Each dipole is projected onto (order+1)^3 nodes of an auxiliary grid, whose spacing is aim_coarse dipole
+ *        sizes, using the weights of Lagrange interpolation. Interaction between the nodes is a discrete convolution,
+ *        computed through FFT (with the same zero padding as for the main FFT-based algorithm), and the resulting
+ *        fields are interpolated back to the dipoles with the same weights (Bleszynski E., Bleszynski M., and
+ *        Jaroszewicz T. "AIM: Adaptive integral method for solving large-scale electromagnetic scattering and
+ *        radiation problems," Radio Sci. 31, 1225-1251 (1996); Phillips J.R. and White J.K. "A precorrected-FFT method
+ *        for electrostatic analysis of complicated 3-D structures," IEEE Trans. Comput.-Aided Des. 16, 1059-1072
+ *        (1997)). This approximation is accurate only for distant dipoles, so for close pairs (whose cells are
+ *        separated by at most nearN nodes) the grid contribution is replaced by the exact interaction term
+ *        (precorrection). Since all dipoles are on the lattice, the correction depends only on the displacement between
+ *        the dipoles and on the position of the first one inside a grid cell. So it is tabulated once, and the size of
+ *        the table doesn't depend on the particle. For aim_coarse=1 the nodes coincide with the dipoles, then the
+ *        method is exact and no correction is needed.
+ *
+ *        Hence, memory is determined by the number of dipoles and by the number of grid nodes (volume of the bounding
+ *        box divided by aim_coarse^3), while the time of the matrix-vector product scales as O(N+Ng*log(Ng)). In
+ *        parallel mode each processor performs the grid part for all dipoles (using arg_full), while interpolation and
+ *        precorrection are done only for the local ones.
+ *
+ * Copyright (C) 2013 ADDA contributors
+ * This file is part of ADDA.
+ *
+ * ADDA is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ *
+ * ADDA is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with ADDA. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include "const.h" // keep this first
+// project headers
+#include "cmplx.h"
+#include "comm.h"
+#include "interaction.h"
+#include "io.h"
+#include "memory.h"
+#include "sparse_ops.h"
+#include "vars.h"
+// system headers
+#include <limits.h>
+#include <stdlib.h>
+
+#ifdef SPARSE // the whole file is relevant only in sparse mode
+
+// SEMI-GLOBAL VARIABLES
+
+// defined and initialized in calculator.c
+extern const int mvBatch;
+extern doublecomplex * restrict arg_full;
+// defined and initialized in param.c
+extern const int aim_coarse,aim_order;
+
+// LOCAL VARIABLES
+
+/* Distance (in nodes) between stencils of two dipoles, up to which their interaction is precorrected. Smaller values
+ * leave noticeable error of the grid approximation (especially, for aim_order<3), while larger ones increase the time
+ * of the precorrection without improving the accuracy.
+ */
+#define AIM_NEAR 1
+// direction of FFT, the same as in fft.h (which is void in sparse mode)
+#define FFT_FORWARD -1
+#define FFT_BACKWARD 1
+#define IFAX_SIZE 20 // size of arrays of factors for fftmr (at least FFTMR_MAX_FACTORS+1)
+
+#ifdef OPENMP
+#	include <omp.h>
+#	define THREAD_ID omp_get_thread_num()
+#else
+#	define THREAD_ID 0
+#endif
+
+static int cg;      // grid spacing (in dipoles)
+static int ns;      // number of nodes of the stencil along each axis (aim_order+1)
+static int nearN;   // maximum distance between cells (in nodes) of dipoles, whose interaction is precorrected
+static int nC[3];   // size of the grid of cells (distinct positions of the stencil)
+static int nG[3];   // size of the grid of nodes, nG=nC+ns-1
+static int nF[3];   // size of the (zero-padded) FFT grid, nF>=2*nG-1
+static size_t fTot; // total size of the FFT grid
+static double *wt;  // weights of the stencil nodes (ns) for each offset of a dipole inside a cell (cg)
+static int *sh;     // shift of the stencil for each offset, node=floor(x/cg)+sh[x%cg]
+static int *dipN;   // first stencil node (3 coordinates) for each dipole (all dipoles)
+static int *dipO;   // offset inside a cell (3 coordinates) for each dipole (all dipoles)
+static size_t *cellStart,*cellDip; // dipoles, sorted by cells, and the start of each cell in this list
+static int dMax,dDim;               // maximum displacement between close dipoles and the corresponding table dimension
+static doublecomplex *corr;         // precorrection table over offsets of the first dipole and displacements
+static doublecomplex *gHat;         // Fourier transform of the interaction between nodes (6 components)
+static doublecomplex *grid;         // values at the FFT grid (3 components for each of mvBatch vectors)
+static int ifax[3][IFAX_SIZE];      // factors of FFT sizes along each axis
+static double *trigs[3];            // twiddle factors along each axis
+static size_t workSize;             // size (in doubles) of FFT working array of each thread
+static double *fftWork;             // FFT working arrays of all threads
+
+// fftmr.c
+void fftmrInit(int n,int * restrict ifax,double * restrict trigs);
+size_t fftmrWorkSize(int n);
+void fftmr(doublecomplex * restrict data,double * restrict work,const double * restrict trigs,const int * restrict ifax,
+	int inc,int jump,int n,int lot,int isign);
+
+//======================================================================================================================
+
+static inline int FloorDiv(const int a,const int b)
+// floor(a/b) for b>0 and any a
+{
+	return (a>=0) ? a/b : -((b-1-a)/b);
+}
+
+//======================================================================================================================
+
+static int FitSize(int n)
+// finds the first number >=n, which has only 2, 3, and 5 as prime factors
+{
+	int m;
+
+	while (true) {
+		m=n;
+		while (m%2==0) m/=2;
+		while (m%3==0) m/=3;
+		while (m%5==0) m/=5;
+		if (m==1) return n;
+		n++;
+	}
+}
+
+//======================================================================================================================
+
+static void GridFFT(doublecomplex * restrict data,const int narr,const int isign,const int ny,const int nz)
+/* performs in-place 3D FFT of narr arrays (one after another, each of size fTot). Only first nz xy-planes and first ny
+ * rows of each of them are non-zero at input (for forward transform) or required at output (for backward one).
+ */
+{
+	const size_t nXY=(size_t)nF[0]*nF[1];
+	int l;
+
+	if (isign==FFT_FORWARD) {
+#pragma omp parallel for
+		for (l=0;l<narr*nz;l++) {
+			doublecomplex *plane=data+(l/nz)*fTot+(l%nz)*nXY;
+			double *work=fftWork+THREAD_ID*workSize;
+			fftmr(plane,work,trigs[0],ifax[0],1,nF[0],nF[0],ny,isign);
+			fftmr(plane,work,trigs[1],ifax[1],nF[0],1,nF[1],nF[0],isign);
+		}
+	}
+#pragma omp parallel for
+	for (l=0;l<narr*nF[1];l++) fftmr(data+(l/nF[1])*fTot+(l%nF[1])*nF[0],fftWork+THREAD_ID*workSize,trigs[2],ifax[2],
+		nXY,1,nF[2],nF[0],isign);
+	if (isign==FFT_BACKWARD) {
+#pragma omp parallel for
+		for (l=0;l<narr*nz;l++) {
+			doublecomplex *plane=data+(l/nz)*fTot+(l%nz)*nXY;
+			double *work=fftWork+THREAD_ID*workSize;
+			fftmr(plane,work,trigs[1],ifax[1],nF[0],1,nF[1],nF[0],isign);
+			fftmr(plane,work,trigs[0],ifax[0],1,nF[0],nF[0],ny,isign);
+		}
+	}
+}
+
+//======================================================================================================================
+
+static double MemoryAIM(const int * restrict nFFT,const size_t nCl,const size_t tabSize)
+/* estimates the memory for AIM with FFT grid nFFT, nCl cells, and precorrection table of tabSize entries: gHat, grid,
+ * precorrection table, FFT arrays, and per-dipole data
+ */
+{
+	const double fT=(double)nFFT[0]*nFFT[1]*nFFT[2];
+	const size_t wS=fftmrWorkSize(MAX(nFFT[0],MAX(nFFT[1],nFFT[2])));
+
+	return (6+3.0*mvBatch)*fT*sizeof(doublecomplex)+6.0*tabSize*sizeof(doublecomplex)
+		+((double)nthreads*wS+2.0*(nFFT[0]+nFFT[1]+nFFT[2]))*sizeof(double)
+		+((double)nCl+1+nvoid_Ndip)*sizeof(size_t)+6.0*nvoid_Ndip*sizeof(int);
+}
+
+//======================================================================================================================
+
+static void InitCorrection(const bool thrSafe UOIO)
+/* computes the precorrection table, i.e. the difference between the exact interaction term and its grid approximation
+ * for each offset of the first dipole inside a cell and each displacement to the second one
+ */
+{
+	const int rG=nearN+ns-1,gD=2*rG+1; // maximum displacement between nodes of close pairs and the table dimension
+	const int nV=2*ns-1;               // number of displacements between two stencils (along one axis)
+	const size_t dTot=(size_t)dDim*dDim*dDim;
+	doublecomplex *ex,*gn;
+	int l;
+
+	// exact terms over displacements between dipoles and terms between nodes (the same as used in gHat)
+	MALLOC_VECTOR(ex,complex,MultOverflow(6,dTot,ONE_POS_FUNC),ALL);
+	MALLOC_VECTOR(gn,complex,6*(size_t)gD*gD*gD,ALL);
+#pragma omp parallel for schedule(dynamic) if(thrSafe)
+	for (l=0;l<dDim;l++) {
+		const int x=l-dMax;
+		doublecomplex *term=ex+6*(size_t)l*dDim*dDim;
+		for (int y=-dMax;y<=dMax;y++) for (int z=-dMax;z<=dMax;z++,term+=6) {
+			// the table is indexed by the displacement from i to j, while the term is for the opposite one
+			if (x!=0 || y!=0 || z!=0) (*InterTerm_int)(-x,-y,-z,term);
+			else for (int k=0;k<6;k++) term[k]=0;
+		}
+	}
+#pragma omp parallel for schedule(dynamic) if(thrSafe)
+	for (l=0;l<gD;l++) {
+		const int x=l-rG;
+		doublecomplex *term=gn+6*(size_t)l*gD*gD;
+		for (int y=-rG;y<=rG;y++) for (int z=-rG;z<=rG;z++,term+=6) {
+			if (x!=0 || y!=0 || z!=0) (*InterTerm_int)(cg*x,cg*y,cg*z,term);
+			else for (int k=0;k<6;k++) term[k]=0;
+		}
+	}
+	// loop over offsets of the first dipole and x-displacements
+#pragma omp parallel for schedule(dynamic)
+	for (l=0;l<cg*cg*cg*dDim;l++) {
+		const int oi=l/dDim,o[3]={oi/(cg*cg),(oi/cg)%cg,oi%cg};
+		int d[3],dn[3],k,a,b,vx,vy,vz,c;
+		double V[3][2*AIM_MAX_ORDER+1];
+		doublecomplex *term=corr+6*((size_t)l*dDim*dDim);
+		const doublecomplex *exT=ex+6*((size_t)(l%dDim)*dDim*dDim);
+
+		d[0]=l%dDim-dMax;
+		for (d[1]=-dMax;d[1]<=dMax;d[1]++) for (d[2]=-dMax;d[2]<=dMax;d[2]++,term+=6,exT+=6) {
+			for (c=0;c<6;c++) term[c]=0;
+			// distance between cells and products of weights for each displacement between the stencil nodes
+			for (k=0;k<3;k++) {
+				const int xj=o[k]+d[k],q=FloorDiv(xj,cg),oj=xj-cg*q;
+				dn[k]=sh[o[k]]-q-sh[oj];
+				if (abs(dn[k])>nearN) break;
+				for (a=0;a<nV;a++) V[k][a]=0;
+				for (a=0;a<ns;a++) for (b=0;b<ns;b++) V[k][a-b+ns-1]+=wt[o[k]*ns+a]*wt[oj*ns+b];
+			}
+			if (k<3) continue; // the pair is not close, the entry is not used
+			for (c=0;c<6;c++) term[c]=exT[c];
+			for (vx=0;vx<nV;vx++) for (vy=0;vy<nV;vy++) {
+				const double wxy=V[0][vx]*V[1][vy];
+				const doublecomplex *g=gn+6*(((size_t)(dn[0]+vx-ns+1+rG)*gD+dn[1]+vy-ns+1+rG)*gD+dn[2]-ns+1+rG);
+				for (vz=0;vz<nV;vz++,g+=6) {
+					const double w=wxy*V[2][vz];
+					for (c=0;c<6;c++) term[c]-=w*g[c];
+				}
+			}
+		}
+	}
+	Free_cVector(ex);
+	Free_cVector(gn);
+}
+
+//======================================================================================================================
+
+void InitAIM(const bool thrSafe)
+/* Initializes the auxiliary grid, the Fourier transform of the interaction between its nodes, and the precorrection
+ * table. Computation of interaction terms is shared among OpenMP threads, if thrSafe. Honors the 'prognosis' flag (then
+ * only memory is counted).
+ */
+{
+	int k,o,a,b,pmin[3],pmax[3],nmin[3],nmax[3],nF1[3];
+	size_t j,nCells,corrSize;
+	double mem,mem1;
+
+	cg=aim_coarse;
+	if (cg==1) { // nodes coincide with dipoles, so neither interpolation nor correction is required
+		ns=1;
+		nearN=-1;
+	}
+	else {
+		ns=aim_order+1;
+		nearN=ns-1+AIM_NEAR;
+	}
+	// stencil shifts and interpolation weights; the stencil is centered at the dipole
+	MALLOC_VECTOR(sh,int,cg,ALL);
+	MALLOC_VECTOR(wt,double,cg*ns,ALL);
+	for (o=0;o<cg;o++) {
+		sh[o]=FloorDiv(2*o+cg*(ns%2),2*cg)-(ns-1)/2;
+		const double t=(double)(o-cg*sh[o])/cg; // coordinate in units of grid spacing, relative to the first node
+		for (a=0;a<ns;a++) {
+			wt[o*ns+a]=1;
+			for (b=0;b<ns;b++) if (b!=a) wt[o*ns+a]*=(t-b)/(a-b);
+		}
+	}
+	// grid dimensions
+	for (k=0;k<3;k++) {
+		pmin[k]=INT_MAX;
+		pmax[k]=INT_MIN;
+		nmin[k]=INT_MAX;
+		nmax[k]=INT_MIN;
+	}
+	for (j=0;j<nvoid_Ndip;j++) for (k=0;k<3;k++) {
+		if (position_full[3*j+k]<pmin[k]) pmin[k]=position_full[3*j+k];
+		if (position_full[3*j+k]>pmax[k]) pmax[k]=position_full[3*j+k];
+	}
+	for (j=0;j<nvoid_Ndip;j++) for (k=0;k<3;k++) {
+		const int x=position_full[3*j+k]-pmin[k],n=x/cg+sh[x%cg];
+		if (n<nmin[k]) nmin[k]=n;
+		if (n>nmax[k]) nmax[k]=n;
+	}
+	for (k=0;k<3;k++) {
+		nC[k]=nmax[k]-nmin[k]+1;
+		nG[k]=nC[k]+ns-1;
+		nF[k]=FitSize(2*nG[k]-1);
+	}
+	fTot=MultOverflow(MultOverflow(nF[0],nF[1],ONE_POS_FUNC),nF[2],ONE_POS_FUNC);
+	nCells=(size_t)nC[0]*nC[1]*nC[2]; // not larger than fTot
+	if (nearN<0) dMax=dDim=corrSize=0;
+	else {
+		dMax=cg*(nearN+2)-1;
+		dDim=2*dMax+1;
+		corrSize=MultOverflow(MultOverflow(cg*cg*cg,dDim*dDim,ONE_POS_FUNC),dDim,ONE_POS_FUNC);
+	}
+	workSize=fftmrWorkSize(MAX(nF[0],MAX(nF[1],nF[2])));
+	mem=MemoryAIM(nF,nCells,corrSize);
+	if (IFROOT) {
+		PrintBoth(logfile,"AIM (grid spacing %d, interpolation order %d): %dx%dx%d nodes, FFT grid %dx%dx%d\n",cg,
+			ns-1,nG[0],nG[1],nG[2],nF[0],nF[1],nF[2]);
+#ifdef PARALLEL
+		PrintBoth(logfile,"Memory usage for AIM (per processor): "FFORMM" MB\n",mem/MBYTE);
+#else
+		PrintBoth(logfile,"Memory usage for AIM: "FFORMM" MB\n",mem/MBYTE);
+#endif
+	}
+	/* The precorrection table grows as cg^6 (for fixed order), and so does the time of its computation, while the grid
+	 * shrinks only as cg^-3. For compact particles the table thus outweighs the savings already for cg=2.
+	 */
+	if (cg>1) {
+		for (k=0;k<3;k++) nF1[k]=FitSize(2*(pmax[k]-pmin[k])+1);
+		mem1=MemoryAIM(nF1,(size_t)(pmax[0]-pmin[0]+1)*(pmax[1]-pmin[1]+1)*(pmax[2]-pmin[2]+1),0);
+		if (mem>mem1) LogWarning(EC_WARN,ONE_POS,"AIM with grid spacing %d requires more memory ("FFORMM" MB) than "
+			"with spacing 1 ("FFORMM" MB), which is also exact and faster. Coarser grid pays off only for very porous "
+			"particles",cg,mem/MBYTE,mem1/MBYTE);
+	}
+	memory+=mem;
+	if (prognosis) return;
+	if (IFROOT) printf("Initializing adaptive integral method\n");
+	// per-dipole data and dipoles sorted by cells (counting sort)
+	MALLOC_VECTOR(dipN,int,3*nvoid_Ndip,ALL);
+	MALLOC_VECTOR(dipO,int,3*nvoid_Ndip,ALL);
+	MALLOC_VECTOR(cellStart,sizet,nCells+1,ALL);
+	MALLOC_VECTOR(cellDip,sizet,nvoid_Ndip,ALL);
+	for (j=0;j<=nCells;j++) cellStart[j]=0;
+	for (j=0;j<nvoid_Ndip;j++) {
+		for (k=0;k<3;k++) {
+			const int x=position_full[3*j+k]-pmin[k];
+			dipO[3*j+k]=x%cg;
+			dipN[3*j+k]=x/cg+sh[dipO[3*j+k]]-nmin[k];
+		}
+		cellStart[((size_t)dipN[3*j+2]*nC[1]+dipN[3*j+1])*nC[0]+dipN[3*j]+1]++;
+	}
+	for (j=0;j<nCells;j++) cellStart[j+1]+=cellStart[j];
+	for (j=0;j<nvoid_Ndip;j++) {
+		const size_t c=((size_t)dipN[3*j+2]*nC[1]+dipN[3*j+1])*nC[0]+dipN[3*j];
+		cellDip[cellStart[c]++]=j;
+	}
+	for (j=nCells;j>0;j--) cellStart[j]=cellStart[j-1]; // restore the starts, shifted by the above loop
+	cellStart[0]=0;
+	// FFT of the interaction between nodes (normalization of the transforms is included)
+	for (k=0;k<3;k++) {
+		MALLOC_VECTOR(trigs[k],double,2*nF[k],ALL);
+		fftmrInit(nF[k],ifax[k],trigs[k]);
+	}
+	MALLOC_VECTOR(fftWork,double,MultOverflow(nthreads,workSize,ONE_POS_FUNC),ALL);
+	MALLOC_VECTOR(gHat,complex,MultOverflow(6,fTot,ONE_POS_FUNC),ALL);
+	MALLOC_VECTOR(grid,complex,MultOverflow(3*mvBatch,fTot,ONE_POS_FUNC),ALL);
+#pragma omp parallel for schedule(dynamic) if(thrSafe)
+	for (k=0;k<nF[2];k++) {
+		const int z = (k<nG[2]) ? k : k-nF[2];
+		doublecomplex term[6];
+		size_t ind=(size_t)k*nF[0]*nF[1];
+		for (int ky=0;ky<nF[1];ky++) {
+			const int y = (ky<nG[1]) ? ky : ky-nF[1];
+			for (int kx=0;kx<nF[0];kx++,ind++) {
+				const int x = (kx<nG[0]) ? kx : kx-nF[0];
+				// displacements beyond the grid size do not appear in the convolution
+				if ((x==0 && y==0 && z==0) || abs(x)>=nG[0] || abs(y)>=nG[1] || abs(z)>=nG[2])
+					for (int c=0;c<6;c++) term[c]=0;
+				else (*InterTerm_int)(cg*x,cg*y,cg*z,term);
+				for (int c=0;c<6;c++) gHat[c*fTot+ind]=term[c]/(double)fTot;
+			}
+		}
+	}
+	GridFFT(gHat,6,FFT_FORWARD,nF[1],nF[2]);
+	// precorrection table
+	if (corrSize>0) {
+		MALLOC_VECTOR(corr,complex,MultOverflow(6,corrSize,ONE_POS_FUNC),ALL);
+		InitCorrection(thrSafe);
+	}
+}
+
+//======================================================================================================================
+
+static void Project(const int nv)
+/* projects nv vectors in arg_full onto the grid nodes. Each node gathers the contributions from the dipoles in the
+ * cells of its stencil, so the nodes are processed by OpenMP threads independently
+ */
+{
+	const size_t len=3*nvoid_Ndip;
+	size_t i;
+	int l;
+
+#pragma omp parallel for
+	for (i=0;i<3*nv*fTot;i++) grid[i]=0;
+#pragma omp parallel for schedule(dynamic)
+	for (l=0;l<nG[2]*nG[1];l++) {
+		const int z=l/nG[1],y=l%nG[1];
+		const int z0=MAX(0,z-ns+1),z1=MIN(z,nC[2]-1),y0=MAX(0,y-ns+1),y1=MIN(y,nC[1]-1);
+		size_t ind=((size_t)z*nF[1]+y)*nF[0];
+
+		for (int x=0;x<nG[0];x++,ind++) {
+			const int x0=MAX(0,x-ns+1),x1=MIN(x,nC[0]-1);
+			for (int cz=z0;cz<=z1;cz++) for (int cy=y0;cy<=y1;cy++) {
+				const size_t c=((size_t)cz*nC[1]+cy)*nC[0];
+				for (size_t jj=cellStart[c+x0];jj<cellStart[c+x1+1];jj++) {
+					const size_t j=cellDip[jj];
+					const int *n=dipN+3*j,*o=dipO+3*j;
+					const double w=wt[o[0]*ns+x-n[0]]*wt[o[1]*ns+y-n[1]]*wt[o[2]*ns+z-n[2]];
+					for (int v=0;v<nv;v++) for (int a=0;a<3;a++) grid[(3*v+a)*fTot+ind]+=w*arg_full[v*len+3*j+a];
+				}
+			}
+		}
+	}
+}
+
+//======================================================================================================================
+
+void AIMProd(const int nv,doublecomplex * const * restrict resultvecs)
+/* Computes the products of the local rows of the interaction matrix with nv vectors in arg_full (one after another,
+ * each of size 3*nvoid_Ndip) and stores them in resultvecs
+ */
+{
+	const size_t len=3*nvoid_Ndip,cSize=6*(size_t)dDim*dDim*dDim;
+	size_t i;
+
+	Project(nv);
+	GridFFT(grid,3*nv,FFT_FORWARD,nG[1],nG[2]);
+	// multiplication by the (symmetric) interaction tensor in the Fourier space
+#pragma omp parallel for
+	for (i=0;i<fTot;i++) {
+		const doublecomplex g[6]={gHat[i],gHat[fTot+i],gHat[2*fTot+i],gHat[3*fTot+i],gHat[4*fTot+i],gHat[5*fTot+i]};
+		for (int v=0;v<nv;v++) {
+			doublecomplex *q=grid+3*v*fTot+i;
+			const doublecomplex x=q[0],y=q[fTot],z=q[2*fTot];
+			q[0]=g[0]*x+g[1]*y+g[2]*z;
+			q[fTot]=g[1]*x+g[3]*y+g[4]*z;
+			q[2*fTot]=g[2]*x+g[4]*y+g[5]*z;
+		}
+	}
+	GridFFT(grid,3*nv,FFT_BACKWARD,nG[1],nG[2]);
+	// interpolation onto the local dipoles and precorrection
+#pragma omp parallel for schedule(dynamic,64)
+	for (i=0;i<local_nvoid_Ndip;i++) {
+		const size_t gi=local_nvoid_d0+i;
+		const int *n=dipN+3*gi,*o=dipO+3*gi,*pi=position_full+3*gi;
+		const double *wx=wt+o[0]*ns,*wy=wt+o[1]*ns,*wz=wt+o[2]*ns;
+		const doublecomplex *tab=corr+((size_t)o[0]*cg*cg+o[1]*cg+o[2])*cSize;
+		const int z0=MAX(0,n[2]-nearN),z1=MIN(n[2]+nearN,nC[2]-1),y0=MAX(0,n[1]-nearN),y1=MIN(n[1]+nearN,nC[1]-1);
+		const int x0=MAX(0,n[0]-nearN),x1=MIN(n[0]+nearN,nC[0]-1);
+
+		for (int v=0;v<nv;v++) {
+			doublecomplex *res=resultvecs[v]+3*i;
+			res[0]=res[1]=res[2]=0;
+			for (int kz=0;kz<ns;kz++) for (int ky=0;ky<ns;ky++) {
+				const double wyz=wy[ky]*wz[kz];
+				const doublecomplex *q=grid+3*v*fTot+((size_t)(n[2]+kz)*nF[1]+n[1]+ky)*nF[0]+n[0];
+				for (int kx=0;kx<ns;kx++) {
+					const double w=wx[kx]*wyz;
+					res[0]+=w*q[kx];
+					res[1]+=w*q[fTot+kx];
+					res[2]+=w*q[2*fTot+kx];
+				}
+			}
+		}
+		// the loops are empty if nearN<0
+		for (int cz=z0;cz<=z1;cz++) for (int cy=y0;cy<=y1;cy++) {
+			const size_t c=((size_t)cz*nC[1]+cy)*nC[0];
+			for (size_t jj=cellStart[c+x0];jj<cellStart[c+x1+1];jj++) {
+				const size_t j=cellDip[jj];
+				const int *pj=position_full+3*j;
+				const doublecomplex *term=tab+6*(((size_t)(pj[0]-pi[0]+dMax)*dDim+pj[1]-pi[1]+dMax)*dDim
+					+pj[2]-pi[2]+dMax);
+				for (int v=0;v<nv;v++) SymProdAdd(term,arg_full+v*len+3*j,resultvecs[v]+3*i);
+			}
+		}
+	}
+}
+
+//======================================================================================================================
+
+void FreeAIM(void)
+// frees all memory allocated in InitAIM
+{
+	int k;
+
+	Free_general(sh);
+	Free_general(wt);
+	Free_general(dipN);
+	Free_general(dipO);
+	Free_general(cellStart);
+	Free_general(cellDip);
+	Free_cVector(corr);
+	Free_cVector(gHat);
+	Free_cVector(grid);
+	for (k=0;k<3;k++) Free_general(trigs[k]);
+	Free_general(fftWork);
+}
+
+#endif // SPARSE
@@ -33,18 +33,26 @@
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 // SEMI-GLOBAL VARIABLES
 
 // defined and initialized in crosssec.c
 extern const Parms_1D parms[2],parms_alpha;
 extern const angle_set beta_int,gamma_int,theta_int,phi_int;
+// defined and initialized in iterative.c
+extern double recycleSaved;
 // defined and initialized in param.c
-extern const int avg_inc_pol;
+extern const int avg_inc_pol,recycle_size,orient_groups;
 extern const double polNlocRp;
 extern const char *alldir_parms,*scat_grid_parms;
+extern const bool iter_block;
+extern const enum chpoint chp_type;
+extern const time_t chp_time;
+extern const char *chp_dir;
 // defined and initialized in timing.c
 extern TIME_TYPE Timing_Init,Timing_Init_Int;
+extern time_t last_chp_wt;
 #ifdef OPENCL
 extern TIME_TYPE Timing_OCL_Init;
 #endif
@@ -76,24 +84,55 @@ doublecomplex *rvec;                 // current residual
 doublecomplex * restrict Avecbuffer; // used to hold the result of matrix-vector products
 // auxiliary vectors, used in some iterative solvers (with more meaningful names)
 doublecomplex * restrict vec1,* restrict vec2,* restrict vec3,* restrict vec4;
+	// internal fields for the previous sweep point (for two incident polarizations) to start the iterative solver from
+doublecomplex * restrict sweepEY,* restrict sweepEX;
+bool sweepPrev; // whether sweepEY and sweepEX contain the fields for the previous sweep point
+	// recycled solutions of the linear system and their products with the interaction matrix (recycle_size of each)
+doublecomplex * restrict recycleU,* restrict recycleC;
 // used in matvec.c
 #ifdef SPARSE
-doublecomplex * restrict arg_full; // vector to hold argvec for all dipoles
+/* vector to hold argvec for all dipoles (mvBatch vectors one after another); allocated in InitSparseTerms(), unless the
+ * argument is passed around the ring of processors
+ */
+doublecomplex * restrict arg_full;
 #endif
+// used in fft.c and matvec.c
+int mvBatch; // number of vectors, for which the interaction matrix is applied in a single pass (in MatVecBatch)
 
 // LOCAL VARIABLES
 
 static size_t block_theta; // size of one block of mueller matrix - 16*nTheta
 static int finish_avg; // whether to stop orientation averaging; defined as int to simplify MPI casting
 static double * restrict out; // used to collect both mueller matrix and integral scattering quantities when orient_avg
+static bool blockSolve; // whether linear systems for both incident polarizations are solved simultaneously
+// used only for concurrent computation of orientations by several process groups (orient_groups>1)
+static int orN;                                  // number of orientations in the current batch
+static int * restrict orBeta,* restrict orGamma; // indices of beta and gamma for orientations in the batch
+static double * restrict orBuf;   // results (as in 'out') for all orientations in the batch; on roots of groups
+// used for orient_groups>1 or for checkpoints of orientation averaging; only on the world root
+static double * restrict orCache; // results for all grid points of (beta,gamma)
+static bool * restrict orCached;  // whether the corresponding results are already in orCache
+static bool orChpExit;            // checkpoint of orientation averaging occurred - exit
+static bool orIncomplete;         // some orientations were skipped due to checkpoint exit
 
 // EXTERNAL FUNCTIONS
 
 // CalculateE.c
 int CalculateE(enum incpol which,enum Eftype type);
+void CalculateEBlock(void);
 bool TestExtendThetaRange(void);
 void MuellerMatrix(void);
 void SaveMuellerAndCS(double * restrict in);
+void SaveSweepPoint(int k);
+// GenerateB.c
+void InitBeam(void);
+// iterative.c
+void ResetRecycling(void);
+#ifdef SPARSE
+// matvec.c
+void InitSparseTerms(void);
+void FreeSparseTerms(void);
+#endif
 
 //======================================================================================================================
 
@@ -301,37 +340,53 @@ static void calculate_one_orientation(double * restrict res)
 		if (IFROOT) PrintBoth(logfile,"\nORIENTATION STEP beta="GFORMDEF" gamma="GFORMDEF"\n",bet_deg,gam_deg);
 	}
 
-	// calculate scattered field for y - polarized incident light
-	if (IFROOT) {
-		printf("\nhere we go, calc Y\n\n");
-		if (!orient_avg) fprintf(logfile,"\nhere we go, calc Y\n\n");
-	}
-	InitCC(INCPOL_Y);
-	// symR implies that prop is along z (in particle RF). Then it is fine for both definitions of scattering angles
-	if (symR && !scat_grid) {
-		if (CalculateE(INCPOL_Y,CE_PARPER)==CHP_EXIT) return;
-	}
-	else { // no rotational symmetry
-		/* TODO: in case of scat_grid we run twice to get the full electric field with incoming light polarized in X and
-		 * Y direction. In case of rotational symmetry this is not needed but requires lots more programming so we leave
-		 * this optimization to a later time.
-		 */
-		if(CalculateE(INCPOL_Y,CE_NORMAL)==CHP_EXIT) return;
-
+	if (blockSolve) { // both polarizations at once
 		if (IFROOT) {
-			printf("\nhere we go, calc X\n\n");
-			if (!orient_avg) fprintf(logfile,"\nhere we go, calc X\n\n");
+			printf("\nhere we go, calc Y and X\n\n");
+			if (!orient_avg) fprintf(logfile,"\nhere we go, calc Y and X\n\n");
 		}
-		if (PolRelation==POL_LDR && !avg_inc_pol) InitCC(INCPOL_X);
-		/* TO ADD NEW POLARIZABILITY FORMULATION
-		 * If new formulation depends on the incident polarization (unlikely) update the test above.
-		 */
+		InitCC(INCPOL_Y);
+		CalculateEBlock();
+	}
+	else {
+		// calculate scattered field for y - polarized incident light
+		if (IFROOT) {
+			printf("\nhere we go, calc Y\n\n");
+			if (!orient_avg) fprintf(logfile,"\nhere we go, calc Y\n\n");
+		}
+		InitCC(INCPOL_Y);
+		// symR implies that prop is along z (in particle RF). Then it is fine for both definitions of scattering angles
+		if (symR && !scat_grid) {
+			if (CalculateE(INCPOL_Y,CE_PARPER)==CHP_EXIT) return;
+		}
+		else { // no rotational symmetry
+			/* TODO: in case of scat_grid we run twice to get the full electric field with incoming light polarized in X
+			 * and Y direction. In case of rotational symmetry this is not needed but requires lots more programming so
+			 * we leave this optimization to a later time.
+			 */
+			if(CalculateE(INCPOL_Y,CE_NORMAL)==CHP_EXIT) return;
 
-		if(CalculateE(INCPOL_X,CE_NORMAL)==CHP_EXIT) return;
+			if (IFROOT) {
+				printf("\nhere we go, calc X\n\n");
+				if (!orient_avg) fprintf(logfile,"\nhere we go, calc X\n\n");
+			}
+			if (PolRelation==POL_LDR && !avg_inc_pol) InitCC(INCPOL_X);
+			/* TO ADD NEW POLARIZABILITY FORMULATION
+			 * If new formulation depends on the incident polarization (unlikely) update the test above.
+			 */
+
+			if(CalculateE(INCPOL_X,CE_NORMAL)==CHP_EXIT) return;
+		}
 	}
 	D("CalculateE finished");
 	MuellerMatrix();
 	D("MuellerMatrix finished");
+	if (IFROOT && orient_avg && recycle_size>0) {
+		if (recycleSaved>=0.5)
+			PrintBoth(logfile,"Recycling saved about %.0f matrix-vector products for this orientation\n",recycleSaved);
+		else PrintBoth(logfile,"Recycling did not save matrix-vector products for this orientation\n");
+		recycleSaved=0;
+	}
 	if (IFROOT && orient_avg) {
 		tstart=GET_TIME();
 		if (store_mueller) printf("\nError of alpha integration (Mueller) is "GFORMDEF"\n",
@@ -345,9 +400,197 @@ static void calculate_one_orientation(double * restrict res)
 
 //======================================================================================================================
 
+static void SaveOrientChpoint(void)
+/* save a binary checkpoint of orientation averaging (on the world root), containing the results for all orientations
+ * computed so far. Romberg integration is fully determined by these values, so its tables are reconstructed at restart
+ * without new computations. Only limitedly foolproof - user should take care to load checkpoints with the same command
+ * line (except checkpoint options). The file is first written under temporary name and then renamed, so that
+ * termination of the program during writing does not destroy the previous checkpoint.
+ */
+{
+	size_t i,n,nPoints,block;
+	char fname[MAX_FNAME],tmpFname[MAX_FNAME];
+	FILE * restrict chp_file;
+	TIME_TYPE tstart;
+
+	tstart=GET_TIME();
+	// create directory "chp_dir" if needed and open info file
+	SnprintfErr(ONE_POS,fname,MAX_FNAME,"%s/"F_CHP_LOG,chp_dir);
+	if ((chp_file=fopen(fname,"w"))==NULL) {
+		MkDirErr(chp_dir,ONE_POS);
+		chp_file=FOpenErr(fname,"w",ONE_POS);
+	}
+	// write info and close file
+	fprintf(chp_file,"Info about the run, which produced the checkpoint, can be found in ../%s",directory);
+	FCloseErr(chp_file,fname,ONE_POS);
+	// open output file; writing errors are checked only for vectors
+	SnprintfErr(ONE_POS,fname,MAX_FNAME,"%s/"F_CHP_ORIENT,chp_dir);
+	SnprintfErr(ONE_POS,tmpFname,MAX_FNAME,"%s/"F_CHP_ORIENT_TMP,chp_dir);
+	chp_file=FOpenErr(tmpFname,"wb",ONE_POS);
+	block=block_theta+2;
+	nPoints=beta_int.N*gamma_int.N;
+	n=0;
+	for (i=0;i<nPoints;i++) if (orCached[i]) n++;
+	// write grid of orientations, size of results, and their number
+	fwrite(&beta_int.N,sizeof(size_t),1,chp_file);
+	fwrite(&gamma_int.N,sizeof(size_t),1,chp_file);
+	fwrite(&block,sizeof(size_t),1,chp_file);
+	fwrite(beta_int.val,sizeof(double),beta_int.N,chp_file);
+	fwrite(gamma_int.val,sizeof(double),gamma_int.N,chp_file);
+	fwrite(&n,sizeof(size_t),1,chp_file);
+	// write results, each preceded by its index in the grid
+	for (i=0;i<nPoints;i++) if (orCached[i]) {
+		fwrite(&i,sizeof(size_t),1,chp_file);
+		if (fwrite(orCache+i*block,sizeof(double),block,chp_file)!=block)
+			LogError(ONE_POS,"Failed writing to file '%s'",tmpFname);
+	}
+	FCloseErr(chp_file,tmpFname,ONE_POS);
+	if (rename(tmpFname,fname)!=0) LogWarning(EC_WARN,ONE_POS,"Failed to rename file '%s' into '%s'",tmpFname,fname);
+	else PrintBoth(logfile,"Checkpoint (orientation averaging) saved: %zu orientations\n",n);
+	Timing_FileIO+=GET_TIME()-tstart;
+}
+
+//======================================================================================================================
+
+static void LoadOrientChpoint(void)
+/* load a binary checkpoint of orientation averaging (on the world root); only limitedly foolproof - user should take
+ * care to load checkpoints with the same command line (except checkpoint options).
+ */
+{
+	size_t i,k,n,nPoints,block,tmp[3];
+	double * restrict buf;
+	char fname[MAX_FNAME],ch;
+	FILE * restrict chp_file;
+	TIME_TYPE tstart;
+
+	tstart=GET_TIME();
+	SnprintfErr(ONE_POS,fname,MAX_FNAME,"%s/"F_CHP_ORIENT,chp_dir);
+	chp_file=FOpenErr(fname,"rb",ONE_POS);
+	block=block_theta+2;
+	nPoints=beta_int.N*gamma_int.N;
+	// check for consistency; reading errors are checked only for results
+	fread(tmp,sizeof(size_t),3,chp_file);
+	if (tmp[0]!=beta_int.N || tmp[1]!=gamma_int.N)
+		LogError(ONE_POS,"File '%s' is for different grid of orientations",fname);
+	if (tmp[2]!=block) LogError(ONE_POS,"File '%s' is for different set of scattering angles",fname);
+	MALLOC_VECTOR(buf,double,MAX(beta_int.N,gamma_int.N),ONE);
+	fread(buf,sizeof(double),beta_int.N,chp_file);
+	if (memcmp(buf,beta_int.val,beta_int.N*sizeof(double))!=0)
+		LogError(ONE_POS,"File '%s' is for different values of beta",fname);
+	fread(buf,sizeof(double),gamma_int.N,chp_file);
+	if (memcmp(buf,gamma_int.val,gamma_int.N*sizeof(double))!=0)
+		LogError(ONE_POS,"File '%s' is for different values of gamma",fname);
+	Free_general(buf);
+	// read results
+	fread(&n,sizeof(size_t),1,chp_file);
+	for (k=0;k<n;k++) {
+		if (fread(&i,sizeof(size_t),1,chp_file)!=1 || i>=nPoints || fread(orCache+i*block,sizeof(double),block,
+			chp_file)!=block) LogError(ONE_POS,"Failed reading from file '%s'",fname);
+		orCached[i]=true;
+	}
+	// check if EOF reached and close file
+	if(fread(&ch,1,1,chp_file)!=0) LogError(ONE_POS,"File '%s' is too long",fname);
+	FCloseErr(chp_file,fname,ONE_POS);
+	PrintBoth(logfile,"Checkpoint (orientation averaging) loaded: %zu orientations are already computed\n",n);
+	Timing_FileIO+=GET_TIME()-tstart;
+}
+
+//======================================================================================================================
+
+static void CheckOrientChpoint(void)
+/* checks the time condition for checkpoint of orientation averaging (on the world root) and saves it, if necessary.
+ * Called after each new computed orientation (or batch of those).
+ */
+{
+	time_t wt;
+
+	if (chp_type==CHP_NONE || chp_time==UNDEF) return;
+	time(&wt);
+	if (chp_time<difftime(wt,last_chp_wt)) {
+		SaveOrientChpoint();
+		time(&last_chp_wt);
+		if (chp_type!=CHP_REGULAR) orChpExit=true;
+	}
+}
+
+//======================================================================================================================
+
+static void ComputeOrientBatch(void)
+/* computes the orientations of the current batch, assigned to this process group (in a round-robin fashion), and
+ * collects all results in orBuf at the world root
+ */
+{
+	int k;
+
+	for (k=group_id;k<orN;k+=orient_groups) {
+		bet_deg=beta_int.val[orBeta[k]];
+		gam_deg=gamma_int.val[orGamma[k]];
+		calculate_one_orientation(IFROOT ? orBuf+k*(block_theta+2) : NULL);
+	}
+	GatherOrientBatch(orBuf,block_theta+2,orN);
+}
+
+//======================================================================================================================
+
+static void orient_prefetch(const int n,const int * restrict beta_i,const int * restrict gamma_i)
+/* function that is called by Romberg integration (on the world root) with a list of orientations, which are required
+ * next. Those that are not yet computed are distributed among all process groups; the results are stored in orCache.
+ */
+{
+	int k;
+	size_t ind;
+
+	if (orChpExit) return;
+	orN=0;
+	for (k=0;k<n;k++) if (!orCached[beta_i[k]*gamma_int.N+gamma_i[k]]) {
+		orBeta[orN]=beta_i[k];
+		orGamma[orN]=gamma_i[k];
+		orN++;
+	}
+	if (orN==0) return;
+	BcastOrientBatch(&orN,orBeta,orGamma);
+	ComputeOrientBatch();
+	for (k=0;k<orN;k++) {
+		ind=orBeta[k]*gamma_int.N+orGamma[k];
+		memcpy(orCache+ind*(block_theta+2),orBuf+k*(block_theta+2),(block_theta+2)*sizeof(double));
+		orCached[ind]=true;
+	}
+	CheckOrientChpoint();
+}
+
+//======================================================================================================================
+
 static double orient_integrand(int beta_i,int gamma_i, double * restrict res)
 // function that provides interface with Romberg integration
 {
+	size_t ind;
+
+	/* on the world root the results are stored in orCache, if it is allocated. Then they may be already loaded from
+	 * checkpoint or computed by orient_prefetch
+	 */
+	if (orCache!=NULL) {
+		ind=beta_i*gamma_int.N+gamma_i;
+		if (!orCached[ind] && !orChpExit) {
+			if (orient_groups>1) orient_prefetch(1,&beta_i,&gamma_i);
+			else {
+				BcastOrient(&beta_i,&gamma_i,&finish_avg);
+				bet_deg=beta_int.val[beta_i];
+				gam_deg=gamma_int.val[gamma_i];
+				calculate_one_orientation(orCache+ind*(block_theta+2));
+				orCached[ind]=true;
+				CheckOrientChpoint();
+			}
+		}
+		if (orCached[ind]) memcpy(res,orCache+ind*(block_theta+2),(block_theta+2)*sizeof(double));
+		/* after the checkpoint exit the results are not saved, so zero values are used for the rest of orientations;
+		 * they lead to fast convergence of Romberg integration
+		 */
+		else {
+			memset(res,0,(block_theta+2)*sizeof(double));
+			orIncomplete=true;
+		}
+		return 0;
+	}
 	BcastOrient(&beta_i,&gamma_i,&finish_avg);
 	if (finish_avg) return 0;
 
@@ -359,12 +602,91 @@ static double orient_integrand(int beta_i,int gamma_i, double * restrict res)
 
 //======================================================================================================================
 
+static void SetSweepPoint(const int k)
+/* sets the parameters for sweep point k (k>0, the first point is set during initialization) and rebuilds everything
+ * which depends on them. Couple constants are recomputed anyway in calculate_one_orientation, while the interaction
+ * (including Dmatrix) is rebuilt only when wavelength changes, or refractive index changes and it enters the
+ * interaction term.
+ */
+{
+	TIME_TYPE tstart;
+	double mem;
+	bool newLambda,newInt;
+
+	newLambda=(sweep_lambda[k]!=sweep_lambda[k-1]);
+	newInt=newLambda || ((IntRelation==G_SO || IntRelation==G_IGT_SO)
+		&& memcmp(sweep_m[k],sweep_m[k-1],sizeof(*sweep_m))!=0);
+	memcpy(ref_index,sweep_m[k],sizeof(ref_index));
+	if (newLambda) { // the dipole size (gridspace) is kept fixed
+		ka_eq*=TWO_PI/(sweep_lambda[k]*WaveNum);
+		WaveNum=TWO_PI/sweep_lambda[k];
+		kd=WaveNum*gridspace;
+		if ((IntRelation==G_FCD || PolRelation==POL_FCD) && kd>=PI)
+			LogError(ONE_POS,"Too small dpl for FCD formulation at sweep point %d, should be at least 2",k+1);
+		InitBeam();
+	}
+	if (newInt) { // memory is the same as for the first point, so it is not counted again
+		mem=memory;
+		tstart=GET_TIME();
+		FreeInteraction();
+		InitInteraction();
+#ifdef SPARSE
+		FreeSparseTerms();
+		InitSparseTerms();
+#endif
+		Timing_Init_Int+=GET_TIME()-tstart;
+#ifndef SPARSE
+		D("InitDmatrix started");
+		Free_FFT_Dmat();
+		InitDmatrix();
+		D("InitDmatrix finished");
+#endif
+		memory=mem;
+	}
+}
+
+//======================================================================================================================
+
+static void RunSweep(void)
+/* performs calculation for all sweep points, results for each of them are saved in a separate subdirectory, while
+ * cross sections are also collected in a single table (in the main directory)
+ */
+{
+	int k,i;
+	char pdir[MAX_FNAME];
+	const char *mainDir=directory;
+
+	for (k=0;k<sweep_N;k++) {
+		if (k>0) {
+			SetSweepPoint(k);
+			ResetRecycling(); // the interaction matrix has changed
+		}
+		SnprintfErr(ALL_POS,pdir,MAX_FNAME,"%s/"F_SWEEP_DIR,mainDir,k+1);
+		if (IFROOT) {
+			MkDirErr(pdir,ONE_POS);
+			PrintBoth(logfile,"\nSWEEP POINT %d/%d: lambda="GFORM", dpl="GFORMDEF"\nrefractive index:",k+1,sweep_N,
+				sweep_lambda[k],TWO_PI/kd);
+			for (i=0;i<Nmat*Ncomp;i++) PrintBoth(logfile," "CFORM,REIM(ref_index[i]));
+			PrintBoth(logfile,"\n");
+		}
+		Synchronize(); // wait for the directory to be created
+		directory=pdir;
+		calculate_one_orientation(NULL);
+		directory=mainDir;
+		if (IFROOT) SaveSweepPoint(k);
+		sweepPrev=(sweepEY!=NULL);
+	}
+}
+
+//======================================================================================================================
+
 static void AllocateEverything(void)
 // allocates a lot of arrays and performs memory analysis
 {
 	double tmp;
 	size_t temp_int;
 	double memmax;
+	int nrhs; // number of parts in the vectors of the iterative solver
 
 	// redundant initialization to remove warnings
 	temp_int=0;
@@ -373,22 +695,17 @@ static void AllocateEverything(void)
 	 * surely stay NULL (independent of a particular compiler). But even without this forgetting to allocate a necessary
 	 * vector, will surely cause segmentation fault afterwards. So we do not implement these extra tests for now.
 	 */
-	// allocate all the memory
-	tmp=sizeof(doublecomplex)*(double)local_nRows;
+	// allocate all the memory; in lock-step mode vectors of the iterative solver hold two parts (for two polarizations)
+	nrhs=blockSolve ? 2 : 1;
+	tmp=sizeof(doublecomplex)*(double)local_nRows*nrhs;
 	if (!prognosis) { // main 5 vectors, some of them are used in the iterative solver
-		MALLOC_VECTOR(xvec,complex,local_nRows,ALL);
-		MALLOC_VECTOR(rvec,complex,local_nRows,ALL);
-		MALLOC_VECTOR(pvec,complex,local_nRows,ALL);
-		MALLOC_VECTOR(Einc,complex,local_nRows,ALL);
-		MALLOC_VECTOR(Avecbuffer,complex,local_nRows,ALL);
+		MALLOC_VECTOR(xvec,complex,nrhs*local_nRows,ALL);
+		MALLOC_VECTOR(rvec,complex,nrhs*local_nRows,ALL);
+		MALLOC_VECTOR(pvec,complex,nrhs*local_nRows,ALL);
+		MALLOC_VECTOR(Einc,complex,nrhs*local_nRows,ALL);
+		MALLOC_VECTOR(Avecbuffer,complex,nrhs*local_nRows,ALL);
 	}
 	memory+=5*tmp;
-#ifdef SPARSE
-	if (!prognosis) { // overflow of 3*nvoid_Ndip is tested in MakeParticle()
-		MALLOC_VECTOR(arg_full,complex,3*nvoid_Ndip,ALL);
-	}
-	memory+=3*nvoid_Ndip*sizeof(doublecomplex);
-#endif // !SPARSE
 	/* additional vectors for iterative methods. Potentially, this procedure can be fully automated for any new
 	 * iterative solver, based on the information contained in structure array 'params' in file iterative.c. However,
 	 * this requires different order of function calls to extract this information beforehand. So currently this part
@@ -410,9 +727,9 @@ static void AllocateEverything(void)
 		case IT_BICGSTAB:
 		case IT_QMR_CS:
 			if (!prognosis) {
-				MALLOC_VECTOR(vec1,complex,local_nRows,ALL);
-				MALLOC_VECTOR(vec2,complex,local_nRows,ALL);
-				MALLOC_VECTOR(vec3,complex,local_nRows,ALL);
+				MALLOC_VECTOR(vec1,complex,nrhs*local_nRows,ALL);
+				MALLOC_VECTOR(vec2,complex,nrhs*local_nRows,ALL);
+				MALLOC_VECTOR(vec3,complex,nrhs*local_nRows,ALL);
 			}
 			memory+=3*tmp;
 			break;
@@ -431,6 +748,22 @@ static void AllocateEverything(void)
 	 * iterative.c is non-zero, then allocate memory for these vectors here. Variable memory should be incremented to
 	 * reflect the total allocated memory.
 	 */
+	sweepPrev=false;
+	if (sweep_N>1 && InitField==IF_AUTO) { // fields of the previous sweep point, which are used as initial ones
+		if (!prognosis) {
+			MALLOC_VECTOR(sweepEY,complex,local_nRows,ALL);
+			MALLOC_VECTOR(sweepEX,complex,local_nRows,ALL);
+		}
+		memory+=2*tmp;
+	}
+	else sweepEY=sweepEX=NULL;
+	if (recycle_size>0) {
+		if (!prognosis) {
+			MALLOC_VECTOR(recycleU,complex,MultOverflow(recycle_size,local_nRows,ONE_POS_FUNC),ALL);
+			MALLOC_VECTOR(recycleC,complex,MultOverflow(recycle_size,local_nRows,ONE_POS_FUNC),ALL);
+		}
+		memory+=2*recycle_size*tmp;
+	}
 #ifndef SPARSE
 	MALLOC_VECTOR(expsX,complex,boxX,ALL);
 	MALLOC_VECTOR(expsY,complex,boxY,ALL);
@@ -520,6 +853,27 @@ static void AllocateEverything(void)
 			}
 			memory += (8*tmp*(1+1.0/alpha_int.N)+4)*sizeof(double);
 		}
+		// batch and cache may contain all grid points
+		temp_int=MultOverflow(beta_int.N,gamma_int.N,ONE_POS_FUNC);
+		tmp=(double)temp_int*(block_theta+2);
+		if (orient_groups>1) {
+			if (!prognosis) {
+				MALLOC_VECTOR(orBeta,int,temp_int,ALL);
+				MALLOC_VECTOR(orGamma,int,temp_int,ALL);
+			}
+			if (IFROOT) {
+				if (!prognosis) MALLOC_VECTOR(orBuf,double,MultOverflow(temp_int,block_theta+2,ONE_POS_FUNC),ONE);
+				memory += tmp*sizeof(double);
+			}
+		}
+		if (IFROOT && group_id==0 && (orient_groups>1 || chp_type!=CHP_NONE || load_chpoint)) {
+			if (!prognosis) {
+				MALLOC_VECTOR(orCache,double,MultOverflow(temp_int,block_theta+2,ONE_POS_FUNC),ONE);
+				MALLOC_VECTOR(orCached,bool,temp_int,ONE);
+				memset(orCached,0,temp_int*sizeof(bool));
+			}
+			memory += tmp*sizeof(double);
+		}
 	}
 	/* estimate of the memory (only the fastest scaling part):
 	 * MatVec - (288+384nprocs/boxX [+192/nprocs])*Ndip
@@ -567,7 +921,7 @@ void FreeEverything(void)
 	Free_general(position); // allocated in MakeParticle();
 #else	
 	Free_general(position_full); // allocated in MakeParticle();
-	Free_cVector(arg_full);
+	FreeSparseTerms();
 #endif // SPARSE
 #ifdef ACCIMEXP
 	Free_cVector(imexptable);
@@ -632,9 +986,22 @@ void FreeEverything(void)
 			Free_general(muel_phi_buf);
 		}
 	}
+	if (recycle_size>0) {
+		Free_cVector(recycleU);
+		Free_cVector(recycleC);
+	}
 	// these 2 were allocated in MakeParticle
 	Free_general(DipoleCoord);
 	Free_general(material);
+	if (sweep_N>0) {
+		if (sweepEY!=NULL) {
+			Free_cVector(sweepEY);
+			Free_cVector(sweepEX);
+		}
+		// these 2 were allocated in VariablesInterconnect
+		Free_general(sweep_lambda);
+		Free_general(sweep_m);
+	}
 
 	if (orient_avg) {
 		if (IFROOT) {
@@ -645,6 +1012,15 @@ void FreeEverything(void)
 			Free_general(muel_alpha-2);
 			Free_general(out);
 		}
+		if (orient_groups>1) {
+			Free_general(orBeta);
+			Free_general(orGamma);
+			if (IFROOT) Free_general(orBuf);
+		}
+		if (orCache!=NULL) {
+			Free_general(orCache);
+			Free_general(orCached);
+		}
 		Free_general(alpha_int.val);
 		Free_general(beta_int.val);
 		Free_general(gamma_int.val);
@@ -675,9 +1051,30 @@ void Calculator (void)
 	}
 	else dtheta_deg=dtheta_rad=block_theta=0;
 	finish_avg=false;
+	orChpExit=orIncomplete=false;
+	/* Lock-step solver for two polarizations requires the same interaction matrix (including the polarizability) for
+	 * both of them. It is not the case for LDR without averaging over incident polarization, unless the polarizability
+	 * is the same for both polarizations (e.g. for propagation along the z-axis).
+	 */
+	blockSolve=iter_block && !(symR && !scat_grid) && (PolRelation!=POL_LDR || avg_inc_pol
+		|| DotProdSquare(prop,incPolY)==DotProdSquare(prop,incPolX));
+	if (iter_block && !blockSolve) LogWarning(EC_INFO,ONE_POS,"'-iter_block' is ignored, since either only one "
+		"incident polarization is computed or the polarizability depends on the latter");
+	/* in lock-step mode the matrix-vector products for two polarizations are computed together, which requires buffers
+	 * for two vectors in MatVec. This is not implemented in OpenCL mode.
+	 */
+#ifdef OPENCL
+	mvBatch=1;
+#else
+	mvBatch=blockSolve ? 2 : 1;
+#endif
 	// Do preliminary setup for MatVec
 	TIME_TYPE startInitInt=GET_TIME();
 	InitInteraction();
+#ifdef SPARSE
+	// interaction terms are stored before the iterations (if requested)
+	InitSparseTerms();
+#endif
 	Timing_Init_Int=GET_TIME()-startInitInt;
 #ifndef SPARSE
 	// initialize D matrix (for matrix-vector multiplication)
@@ -694,20 +1091,38 @@ void Calculator (void)
 	if (prognosis) return;
 	// main calculation part
 	if (orient_avg) {
-		if (IFROOT) {
+		if (load_chpoint) {
+			if (IFROOT && group_id==0) LoadOrientChpoint();
+			// checkpoint contains only complete orientations, so the iterative solver always starts from scratch
+			load_chpoint=false;
+		}
+		if (IFROOT && group_id==0) {
 			SnprintfErr(ONE_POS,fname,MAX_FNAME,"%s/"F_LOG_ORAVG,directory);
 			D("Romberg2D started on root");
-			Romberg2D(parms,orient_integrand,block_theta+2,out,fname);
+			Romberg2D(parms,orient_integrand,orient_groups>1 ? orient_prefetch : NULL,block_theta+2,out,fname);
 			D("Romberg2D finished on root");
 			finish_avg=true;
-			/* first two are dummy variables; this call corresponds to one in orient_integrand by other processors;
-			 * TODO: replace by a call without unnecessary overhead
-			 */
-			BcastOrient(&finish_avg,&finish_avg,&finish_avg);
-			SaveMuellerAndCS(out);
+			if (orient_groups>1) { // negative batch size signals the end to all process groups
+				orN=-1;
+				BcastOrientBatch(&orN,orBeta,orGamma);
+			}
+			else {
+				/* first two are dummy variables; this call corresponds to one in orient_integrand by other processors;
+				 * TODO: replace by a call without unnecessary overhead
+				 */
+				BcastOrient(&finish_avg,&finish_avg,&finish_avg);
+			}
+			if (orIncomplete) PrintBoth(logfile,"Orientation averaging is interrupted by the checkpoint, the results "
+				"are not saved. Use '-chp_load' to continue it.\n");
+			else {
+				if (chp_type==CHP_ALWAYS) SaveOrientChpoint();
+				SaveMuellerAndCS(out);
+			}
 		}
+		else if (orient_groups>1) while (BcastOrientBatch(&orN,orBeta,orGamma)) ComputeOrientBatch();
 		else while (!finish_avg) orient_integrand(0,0,NULL);
 	}
+	else if (sweep_N>0) RunSweep();
 	else calculate_one_orientation(NULL);
 	// cleaning
 	FreeEverything();
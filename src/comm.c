@@ -31,13 +31,28 @@
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef OPENMP
+#	include <omp.h>
+#endif
 
 #ifdef ADDA_MPI
 MPI_Datatype mpi_dcomplex,mpi_int3,mpi_double3,mpi_dcomplex3; // combined datatypes
 int *recvcounts,*displs; // arrays of size ringid required for AllGather operations
 bool displs_init=false;  // whether arrays above are initialized
+int *redcounts=NULL;     // array of size nprocs for ReduceScatter (in units of MPI reduce type)
+MPI_Request ringReq[2];  // requests for non-blocking send and receive in RingShift
+/* communicator for all computations of a single particle; coincides with MPI_COMM_WORLD, unless processes are split
+ * into groups by InitGroups
+ */
+static MPI_Comm comm_group;
 #endif
 
+// SEMI-GLOBAL VARIABLES
+
+// defined and initialized in param.c
+extern char logfname[];
+extern const int orient_groups;
+
 /* whether a synchronize call should be performed before parallel timing. It makes communication timing more accurate,
  * but may deteriorate overall performance by introducing unnecessary delays (test showed only slight difference for
  * granule generator)
@@ -47,8 +62,6 @@ bool displs_init=false;  // whether arrays above are initialized
 #ifdef PARALLEL
 #ifndef SPARSE
 
-// SEMI-GLOBAL VARIABLES
-
 // defined and allocated in fft.c
 extern double * restrict BT_buffer, * restrict BT_rbuffer;
 // defined and initialized in timing.c
@@ -213,8 +226,8 @@ void InitDispls(void)
 		// !!! TODO: check for overflow of int
 		recvcounts[ringid]=local_nvoid_Ndip;
 		displs[ringid]=local_nvoid_d0;
-		MPI_Allgather(MPI_IN_PLACE,0,MPI_INT,recvcounts,1,MPI_INT,MPI_COMM_WORLD);
-		MPI_Allgather(MPI_IN_PLACE,0,MPI_INT,displs,1,MPI_INT,MPI_COMM_WORLD);
+		MPI_Allgather(MPI_IN_PLACE,0,MPI_INT,recvcounts,1,MPI_INT,comm_group);
+		MPI_Allgather(MPI_IN_PLACE,0,MPI_INT,displs,1,MPI_INT,comm_group);
 		displs_init=true;
 	}
 }
@@ -236,14 +249,139 @@ void AllGather(void * restrict x_from,void * restrict x_to,const var_type type,T
 	tstart=0;
 	if (timing!=NULL) {
 #ifdef SYNCHRONIZE_TIMING
-		MPI_Barrier(MPI_COMM_WORLD);  // synchronize to get correct timing
+		MPI_Barrier(comm_group);  // synchronize to get correct timing
 #endif
 		tstart=GET_TIME();
 	}
 	InitDispls(); // actually initialization is done only once
 	mes_type=MPIVarType(type,false,NULL);
-	if (x_from==NULL) MPI_Allgatherv(MPI_IN_PLACE,0,mes_type,x_to,recvcounts,displs,mes_type,MPI_COMM_WORLD);
-	else MPI_Allgatherv(x_from,local_nvoid_Ndip,mes_type,x_to,recvcounts,displs,mes_type,MPI_COMM_WORLD);
+	if (x_from==NULL) MPI_Allgatherv(MPI_IN_PLACE,0,mes_type,x_to,recvcounts,displs,mes_type,comm_group);
+	else MPI_Allgatherv(x_from,local_nvoid_Ndip,mes_type,x_to,recvcounts,displs,mes_type,comm_group);
+	if (timing!=NULL) (*timing)+=GET_TIME()-tstart;
+#endif
+}
+
+//======================================================================================================================
+
+void ReduceScatter(doublecomplex * restrict x_full,doublecomplex * restrict x_local,TIME_TYPE *timing)
+/* Sums vectors x_full (3 complex values for each of nvoid_Ndip dipoles) over all processors and scatters the result,
+ * so that each processor obtains its local part (the same distribution as for AllGather) in x_local; increments
+ * 'timing' (if not NULL) by the time used
+ */
+{
+#ifdef ADDA_MPI
+	MPI_Datatype mes_type;
+	int mult,i;
+	TIME_TYPE tstart;
+
+	// redundant initialization to remove warnings
+	tstart=0;
+	if (timing!=NULL) {
+#ifdef SYNCHRONIZE_TIMING
+		MPI_Barrier(comm_group);  // synchronize to get correct timing
+#endif
+		tstart=GET_TIME();
+	}
+	mes_type=MPIVarType(cmplx3_type,true,&mult);
+	if (redcounts==NULL) { // initialized only once
+		InitDispls();
+		if (nvoid_Ndip>(size_t)(INT_MAX/mult))
+			LogError(ONE_POS,"int overflow in MPI function for number of non-void dipoles (%zu)",nvoid_Ndip);
+		MALLOC_VECTOR(redcounts,int,nprocs,ALL);
+		for (i=0;i<nprocs;i++) redcounts[i]=mult*recvcounts[i];
+	}
+	MPI_Reduce_scatter(x_full,x_local,redcounts,mes_type,MPI_SUM,comm_group);
+	if (timing!=NULL) (*timing)+=GET_TIME()-tstart;
+#endif
+}
+
+//======================================================================================================================
+
+void *AllGatherVar(const void * restrict x_from,const size_t n,const var_type type,size_t * restrict ntot,
+	TIME_TYPE *timing)
+/* Gathers arrays x_from of n elements of given type (n may differ among processors) on all processors. Returns newly
+ * allocated array, containing all these arrays one after another (in order of ringid), its length is stored in ntot.
+ * Increments 'timing' (if not NULL) by the time used.
+ */
+{
+#ifdef ADDA_MPI
+	MPI_Datatype mes_type;
+	int *counts,*shifts,i,tsize;
+	size_t total;
+	void *x_to;
+	TIME_TYPE tstart=0; // redundant initialization to remove warnings
+
+	if (timing!=NULL) tstart=GET_TIME();
+	if (n>INT_MAX) LogError(ONE_POS,"int overflow in MPI function (%zu)",n);
+	mes_type=MPIVarType(type,false,NULL);
+	MPI_Type_size(mes_type,&tsize);
+	MALLOC_VECTOR(counts,int,nprocs,ALL);
+	MALLOC_VECTOR(shifts,int,nprocs,ALL);
+	counts[ringid]=n;
+	MPI_Allgather(MPI_IN_PLACE,0,MPI_INT,counts,1,MPI_INT,comm_group);
+	total=0;
+	for (i=0;i<nprocs;i++) {
+		shifts[i]=total;
+		total+=counts[i];
+		if (total>INT_MAX) LogError(ONE_POS,"int overflow in MPI function (%zu)",total);
+	}
+	x_to=voidVector(MultOverflow(MAX(total,1),tsize,ONE_POS_FUNC),ALL_POS,"gathered array");
+	MPI_Allgatherv(x_from,n,mes_type,x_to,counts,shifts,mes_type,comm_group);
+	Free_general(counts);
+	Free_general(shifts);
+	*ntot=total;
+	if (timing!=NULL) (*timing)+=GET_TIME()-tstart;
+	return x_to;
+#endif
+}
+
+//======================================================================================================================
+
+void RingChunk(const int proc,size_t *d0,size_t *n)
+/* Returns the starting (global) index d0 and number n of non-void dipoles, which are local to processor proc (the same
+ * distribution as for AllGather)
+ */
+{
+#ifdef ADDA_MPI
+	InitDispls(); // actually initialization is done only once
+	*d0=displs[proc];
+	*n=recvcounts[proc];
+#endif
+}
+
+//======================================================================================================================
+
+void RingShift(doublecomplex * restrict x_send,const size_t n_send,doublecomplex * restrict x_recv,
+	const size_t n_recv,TIME_TYPE *timing)
+/* Starts non-blocking send of n_send complex values in x_send to the previous processor in the ring (ringid-1) and
+ * receive of n_recv values from the next one (ringid+1) into x_recv. Thus, repeated shifts pass a buffer around the
+ * whole ring. The operation is completed by RingWait, and the buffers should not be used before that. Increments
+ * 'timing' (if not NULL) by the time used.
+ */
+{
+#ifdef ADDA_MPI
+	TIME_TYPE tstart=0; // redundant initialization to remove warnings
+
+	if (timing!=NULL) tstart=GET_TIME();
+	if (n_send>INT_MAX || n_recv>INT_MAX) LogError(ONE_POS,"int overflow in MPI function (%zu)",MAX(n_send,n_recv));
+	MPI_Irecv(x_recv,n_recv,mpi_dcomplex,(ringid+1)%nprocs,0,comm_group,ringReq);
+	MPI_Isend(x_send,n_send,mpi_dcomplex,(ringid+nprocs-1)%nprocs,0,comm_group,ringReq+1);
+	if (timing!=NULL) (*timing)+=GET_TIME()-tstart;
+#endif
+}
+
+//======================================================================================================================
+
+void RingWait(TIME_TYPE *timing)
+/* Waits for the completion of the operations started by RingShift. Increments 'timing' (if not NULL) by the time used,
+ * which is the part of communication, not overlapped with computation.
+ */
+{
+#ifdef ADDA_MPI
+	TIME_TYPE tstart=0; // redundant initialization to remove warnings
+
+	if (timing!=NULL) tstart=GET_TIME();
+	MPI_Waitall(2,ringReq,MPI_STATUSES_IGNORE);
 	if (timing!=NULL) (*timing)+=GET_TIME()-tstart;
 #endif
 }
@@ -257,6 +395,9 @@ void InitComm(int *argc_p UOIP,char ***argv_p UOIP)
 {
 #ifdef ADDA_MPI
 	int ver,subver;
+#	ifdef OPENMP
+	int thr_level;
+#	endif
 
 	/* MPI_Init may alter argc and argv and interfere with normal parsing of command line parameters. The way of
 	 * altering is implementation depending. MPI searches for MPI parameters in the command line and removes them (we
@@ -265,12 +406,25 @@ void InitComm(int *argc_p UOIP,char ***argv_p UOIP)
 	 * MPICH 1.2.5, for example, just replaces corresponding parameters by NULLs. To incorporate it we introduce special
 	 * function to restore the command line
 	 */
+#	ifdef OPENMP
+	/* In hybrid mode all MPI calls are issued by the master thread outside of parallel regions, so 'funneled' level is
+	 * sufficient. It is checked below, when ringid is already known.
+	 */
+	MPI_Init_thread(argc_p,argv_p,MPI_THREAD_FUNNELED,&thr_level);
+#	else
 	MPI_Init(argc_p,argv_p);
+#	endif
 	tstart_main = GET_TIME(); // initialize program time
 	RecoverCommandLine(argc_p,argv_p);
-	// initialize ringid and nprocs
-	MPI_Comm_rank(MPI_COMM_WORLD,&ringid);
-	MPI_Comm_size(MPI_COMM_WORLD,&nprocs);
+	// initialize ringid and nprocs; they are changed by InitGroups, if required
+	comm_group=MPI_COMM_WORLD;
+	MPI_Comm_rank(comm_group,&ringid);
+	MPI_Comm_size(comm_group,&nprocs);
+#	ifdef OPENMP
+	if (thr_level<MPI_THREAD_FUNNELED) LogWarning(EC_WARN,ONE_POS,"MPI library provides only level %d of thread "
+		"support, while %d (MPI_THREAD_FUNNELED) is required for hybrid MPI+OpenMP mode. Proceeding anyway, but "
+		"consider setting OMP_NUM_THREADS=1",thr_level,MPI_THREAD_FUNNELED);
+#	endif
 #ifndef SPARSE
 	// initialize Ntrans
 	if (IS_EVEN(nprocs)) Ntrans=nprocs-1;
@@ -311,6 +465,13 @@ void InitComm(int *argc_p UOIP,char ***argv_p UOIP)
 	nprocs=1;
 	ringid=ADDA_ROOT;
 #endif
+	group_id=0;
+	// number of threads is determined by the OpenMP runtime (e.g., by environmental variable OMP_NUM_THREADS)
+#ifdef OPENMP
+	nthreads=omp_get_max_threads();
+#else
+	nthreads=1;
+#endif
 
 #ifndef SPARSE // CheckNprocs does not exist in sparse mode
 	// check if weird number of processors is specified; called even in sequential mode to initialize weird_nprocs
@@ -342,9 +503,11 @@ void Stop(const int code)
 			Free_general(recvcounts);
 			Free_general(displs);
 		}
-		// wait for all processors
+		if (redcounts!=NULL) Free_general(redcounts);
+		// wait for all processors (in all groups)
 		fflush(stdout);
-		Synchronize();
+		MPI_Barrier(MPI_COMM_WORLD);
+		if (comm_group!=MPI_COMM_WORLD) MPI_Comm_free(&comm_group);
 		// finalize MPI communications
 		MPI_Finalize();
 	}
@@ -358,7 +521,7 @@ void Synchronize(void)
 // synchronizes all processes
 {
 #ifdef ADDA_MPI
-	MPI_Barrier(MPI_COMM_WORLD);
+	MPI_Barrier(comm_group);
 #endif
 }
 
@@ -375,11 +538,11 @@ void MyBcast(void * restrict data UOIP,const var_type type UOIP,const size_t n_e
 	if (n_elem>INT_MAX) LogError(ONE_POS,"int overflow in MPI function (%zu)",n_elem);
 	if (timing!=NULL) {
 #ifdef SYNCHRONIZE_TIMING
-		MPI_Barrier(MPI_COMM_WORLD); // synchronize to get correct timing
+		MPI_Barrier(comm_group); // synchronize to get correct timing
 #endif
 		tstart=GET_TIME();
 	}
-	MPI_Bcast(data,n_elem,MPIVarType(type,false,NULL),ADDA_ROOT,MPI_COMM_WORLD);
+	MPI_Bcast(data,n_elem,MPIVarType(type,false,NULL),ADDA_ROOT,comm_group);
 	if (timing!=NULL) (*timing)+=GET_TIME()-tstart;
 #endif
 }
@@ -399,7 +562,7 @@ void BcastOrient(int *i UOIP, int *j UOIP, int *k UOIP)
 		buf[1]=*j;
 		buf[2]=*k;
 	}
-	MPI_Bcast(buf,3,MPI_INT,ADDA_ROOT,MPI_COMM_WORLD);
+	MPI_Bcast(buf,3,MPI_INT,ADDA_ROOT,comm_group);
 	if (!IFROOT) {
 		*i=buf[0];
 		*j=buf[1];
@@ -410,14 +573,75 @@ void BcastOrient(int *i UOIP, int *j UOIP, int *k UOIP)
 
 //======================================================================================================================
 
+bool BcastOrientBatch(int * restrict n UOIP,int * restrict beta_i UOIP,int * restrict gamma_i UOIP)
+/* cast a batch of n orientations (given by indices of beta and gamma) from the world root to all processes in all
+ * groups. Negative n signifies the end of orientation averaging, then false is returned.
+ */
+{
+#ifdef ADDA_MPI
+	MPI_Bcast(n,1,MPI_INT,ADDA_ROOT,MPI_COMM_WORLD);
+	if (*n<0) return false;
+	MPI_Bcast(beta_i,*n,MPI_INT,ADDA_ROOT,MPI_COMM_WORLD);
+	MPI_Bcast(gamma_i,*n,MPI_INT,ADDA_ROOT,MPI_COMM_WORLD);
+	return true;
+#else
+	return false;
+#endif
+}
+
+//======================================================================================================================
+
+void GatherOrientBatch(double * restrict res UOIP,const int block UOIP,const int n UOIP)
+/* collects results for a batch of n orientations at the world root. Results for the k-th orientation (of size 'block')
+ * are stored in res+k*block on the root of group k%orient_groups, which computed them.
+ */
+{
+#ifdef ADDA_MPI
+	int g,cnt;
+	MPI_Datatype vec_type;
+	MPI_Status status;
+
+	if (!IFROOT) return;
+	for (g=1;g<orient_groups && g<n;g++) if (group_id==0 || group_id==g) {
+		// results of one group are regularly strided in res
+		cnt=(n-g+orient_groups-1)/orient_groups;
+		MPI_Type_vector(cnt,block,orient_groups*block,MPI_DOUBLE,&vec_type);
+		MPI_Type_commit(&vec_type);
+		// ringid of the group root in MPI_COMM_WORLD is g*nprocs
+		if (group_id==0) MPI_Recv(res+g*block,1,vec_type,g*nprocs,0,MPI_COMM_WORLD,&status);
+		else MPI_Send(res+g*block,1,vec_type,ADDA_ROOT,0,MPI_COMM_WORLD);
+		MPI_Type_free(&vec_type);
+	}
+#endif
+}
+
+//======================================================================================================================
+
+void AccumulateGroups(size_t *data UOIP)
+/* sums data (e.g. some counter) over all process groups; the result is stored at the world root. Only roots of groups
+ * contribute, while the data on other processes is reset to zero (it is not used afterwards anyway).
+ */
+{
+#ifdef ADDA_MPI
+	if (orient_groups<=1) return;
+	if (IFROOT && group_id==0) MPI_Reduce(MPI_IN_PLACE,data,1,MPI_SIZE_T,MPI_SUM,ADDA_ROOT,MPI_COMM_WORLD);
+	else {
+		if (!IFROOT) *data=0;
+		MPI_Reduce(data,NULL,1,MPI_SIZE_T,MPI_SUM,ADDA_ROOT,MPI_COMM_WORLD);
+	}
+#endif
+}
+
+//======================================================================================================================
+
 double AccumulateMax(double data UOIP,double *max UOIP)
 // given a single double on each processor, accumulates their sum (returns) and maximum on root processor
 {
 #ifdef ADDA_MPI
 	double buf;
 	// potentially can be optimized by combining into one operation
-	MPI_Reduce(&data,&buf,1,MPI_DOUBLE,MPI_SUM,ADDA_ROOT,MPI_COMM_WORLD);
-	MPI_Reduce(&data,max,1,MPI_DOUBLE,MPI_MAX,ADDA_ROOT,MPI_COMM_WORLD);
+	MPI_Reduce(&data,&buf,1,MPI_DOUBLE,MPI_SUM,ADDA_ROOT,comm_group);
+	MPI_Reduce(&data,max,1,MPI_DOUBLE,MPI_MAX,ADDA_ROOT,comm_group);
 	return buf;
 #else
 	return data;
@@ -437,14 +661,14 @@ void Accumulate(void * restrict data UOIP,const var_type type UOIP,size_t n UOIP
 
 	if (n>INT_MAX) LogError(ONE_POS,"int overflow in MPI function (%zu)",n);
 #ifdef SYNCHRONIZE_TIMING
-	MPI_Barrier(MPI_COMM_WORLD); // synchronize to get correct timing
+	MPI_Barrier(comm_group); // synchronize to get correct timing
 #endif
 	tstart=GET_TIME();
 	mes_type=MPIVarType(type,true,&mult);
 	n*=mult;
 	// Strange, but MPI 2.2 doesn't seem to support calling the following the same way on all processes
-	if (IFROOT) MPI_Reduce(MPI_IN_PLACE,data,n,mes_type,MPI_SUM,ADDA_ROOT,MPI_COMM_WORLD);
-	else MPI_Reduce(data,NULL,n,mes_type,MPI_SUM,ADDA_ROOT,MPI_COMM_WORLD);
+	if (IFROOT) MPI_Reduce(MPI_IN_PLACE,data,n,mes_type,MPI_SUM,ADDA_ROOT,comm_group);
+	else MPI_Reduce(data,NULL,n,mes_type,MPI_SUM,ADDA_ROOT,comm_group);
 	(*timing)=GET_TIME()-tstart;
 #endif
 }
@@ -465,19 +689,59 @@ void MyInnerProduct(void * restrict data UOIP,const var_type type UOIP,size_t n
 	if (n>INT_MAX) LogError(ONE_POS,"int overflow in MPI function (%zu)",n);
 	if (timing!=NULL) {
 #ifdef SYNCHRONIZE_TIMING
-		MPI_Barrier(MPI_COMM_WORLD); // synchronize to get correct timing
+		MPI_Barrier(comm_group); // synchronize to get correct timing
 #endif
 		tstart=GET_TIME();
 	}
 	mes_type=MPIVarType(type,true,&mult);
 	n*=mult;
-	MPI_Allreduce(MPI_IN_PLACE,data,n,mes_type,MPI_SUM,MPI_COMM_WORLD);
+	MPI_Allreduce(MPI_IN_PLACE,data,n,mes_type,MPI_SUM,comm_group);
 	if (timing!=NULL) (*timing)+=GET_TIME()-tstart;
 #endif
 }
 
 //======================================================================================================================
 
+void InitGroups(void)
+/* splits processes into orient_groups groups of equal size (consecutive ringids), each of which computes its own subset
+ * of orientations during orientation averaging. Afterwards ringid and nprocs refer to the group, and all computations
+ * for a single particle use the group communicator. The world root (the one performing the integration) stays the root
+ * of group 0. Roots of other groups start their own logfiles and redirect stdout to a file. Should be called after
+ * DirectoryLog (which creates the output directory) but before ParSetup.
+ */
+{
+#ifdef ADDA_MPI
+	char fname[MAX_FNAME];
+	int size;
+
+	if (orient_groups<=1) return;
+	size=nprocs/orient_groups; // divisibility is tested in VariablesInterconnect
+	if (IFROOT) fprintf(logfile,"Orientations are computed concurrently by %d process groups of %d processes each "
+		"(logs of other groups are in '"F_LOG_GROUP"', etc.)\n",orient_groups,size,1);
+	group_id=ringid/size;
+	MPI_Comm_split(MPI_COMM_WORLD,group_id,ringid,&comm_group);
+	MPI_Comm_rank(comm_group,&ringid);
+	MPI_Comm_size(comm_group,&nprocs);
+#	ifndef SPARSE
+	if (IS_EVEN(nprocs)) Ntrans=nprocs-1;
+	else Ntrans=nprocs;
+	CheckNprocs();
+#	endif
+	if (IFROOT && group_id!=0) {
+		SnprintfErr(ALL_POS,logfname,MAX_FNAME,"%s/"F_LOG_GROUP,directory,group_id);
+		logfile=FOpenErr(logfname,"w",ALL_POS);
+		fprintf(logfile,"Generated by ADDA v."ADDA_VERSION"\n"
+			"Process group %d of %d (%d processors), computing a part of orientations. Complete information on the "
+			"simulation is in the main logfile.\n",group_id,orient_groups,nprocs);
+		SnprintfErr(ALL_POS,fname,MAX_FNAME,"%s/"F_STDOUT_GROUP,directory,group_id);
+		if (freopen(fname,"w",stdout)==NULL) LogError(ALL_POS,"Failed to redirect stdout to file '%s'",fname);
+	}
+	D("Process group %d initialized",group_id);
+#endif
+}
+
+//======================================================================================================================
+
 void ParSetup(void)
 // initialize common parameters; need to do in the beginning to enable call to MakeParticle
 {
@@ -489,6 +753,7 @@ void ParSetup(void)
 	gridX=fftFit(2*boxX,nprocs);
 	gridY=fftFit(2*boxY,1);
 	gridZ=fftFit(2*boxZ,2*nprocs);
+	TuneFFTGrid(); // may increase the above values; does nothing unless '-fft_tune' is used
 	// initialize some variables
 	smallY=gridY/2;
 	smallZ=gridZ/2;
@@ -549,7 +814,7 @@ void SetupLocalD(void)
 	/* use of exclusive scan (MPI_Exscan) is logically more suitable, but it has special behavior for the ringid=0. The
 	 * latter would require special additional arrangements.
 	 */
-	MPI_Scan(&local_nvoid_Ndip,&local_nvoid_d1,1,MPI_SIZE_T,MPI_SUM,MPI_COMM_WORLD);
+	MPI_Scan(&local_nvoid_Ndip,&local_nvoid_d1,1,MPI_SIZE_T,MPI_SUM,comm_group);
 	local_nvoid_d0=local_nvoid_d1-local_nvoid_Ndip;
 #else
 	local_nvoid_d0=0;
@@ -579,7 +844,7 @@ void ReadField(const char * restrict fname,doublecomplex *restrict field)
 	double buf[6];
 
 #if defined(ADDA_MPI) && defined(SYNCHRONIZE_TIMING)
-	MPI_Barrier(MPI_COMM_WORLD);  // synchronize to get correct timing
+	MPI_Barrier(comm_group);  // synchronize to get correct timing
 #endif
 	// skips first line with headers and any comments, if present
 	size_t line=SkipNLines(file,1);
@@ -620,7 +885,7 @@ void ReadField(const char * restrict fname,doublecomplex *restrict field)
 		}
 	}
 #if defined(ADDA_MPI) && defined(SYNCHRONIZE_TIMING)
-	MPI_Barrier(MPI_COMM_WORLD);  // synchronize to get correct timing
+	MPI_Barrier(comm_group);  // synchronize to get correct timing
 #endif
 	Timing_FileIO+=GET_TIME()-tstart;
 }
@@ -629,9 +894,9 @@ void ReadField(const char * restrict fname,doublecomplex *restrict field)
 
 #ifndef SPARSE
 
-void BlockTranspose(doublecomplex * restrict X UOIP,TIME_TYPE *timing UOIP)
-/* do the data-transposition, i.e. exchange, between fftX and fftY&fftZ; specializes at Xmatrix; do 3 components in one
- * message; increments 'timing' (if not NULL) by the time used
+void BlockTranspose(doublecomplex * restrict X UOIP,const int nv UOIP,TIME_TYPE *timing UOIP)
+/* do the data-transposition, i.e. exchange, between fftX and fftY&fftZ; specializes at Xmatrix; do all 3*nv components
+ * (of nv vectors) in one message; increments 'timing' (if not NULL) by the time used
  *
  *  !!! TODO: Although size_t is used for bufsize,etc., MPI functions take int as arguments. This limits the largest
  *  possible size to some extent. Moreover, the size of int is not really well predicted. The exact implications of this
@@ -640,7 +905,7 @@ void BlockTranspose(doublecomplex * restrict X UOIP,TIME_TYPE *timing UOIP)
 {
 #ifdef ADDA_MPI
 	TIME_TYPE tstart;
-	size_t bufsize,msize,posit,step,y,z;
+	size_t bufsize,msize,posit,step,y,z,zc;
 	int transmission,part,Xpos,Xcomp;
 	MPI_Status status;
 
@@ -649,35 +914,48 @@ void BlockTranspose(doublecomplex * restrict X UOIP,TIME_TYPE *timing UOIP)
 
 	if (timing!=NULL) {
 #ifdef SYNCHRONIZE_TIMING
-		MPI_Barrier(MPI_COMM_WORLD);  // synchronize to get correct timing
+		MPI_Barrier(comm_group);  // synchronize to get correct timing
 #endif
 		tstart=GET_TIME();
 	}
 	step=2*local_Nx;
 	msize=local_Nx*sizeof(doublecomplex);
-	bufsize=6*local_Nz*smallY*local_Nx;
+	bufsize=6*(size_t)nv*local_Nz*smallY*local_Nx;
 	if (bufsize>INT_MAX)
 		LogError(ALL_POS,"int overflow in MPI function for BT buffer (%zu)",bufsize);
 
 	for(transmission=1;transmission<=Ntrans;transmission++) {
 		// if part==nprocs then skip this transmission
 		if ((part=CalcPartner(transmission))!=nprocs) {
-			posit=0;
 			Xpos=local_Nx*part;
-			for(Xcomp=0;Xcomp<3;Xcomp++) for(z=0;z<local_Nz;z++) for(y=0;y<smallY;y++) {
-				memcpy(BT_buffer+posit,X+Xcomp*local_Nsmall+IndexBlock(Xpos,y,z,smallY),msize);
-				posit+=step;
+			/* combined loop over Xcomp and z, each iteration covers a contiguous part of the buffer; thus it can be
+			 * shared among threads (if any)
+			 */
+#pragma omp parallel for private(Xcomp,z,y,posit)
+			for(zc=0;zc<3*nv*local_Nz;zc++) {
+				Xcomp=(int)(zc/local_Nz);
+				z=zc%local_Nz;
+				posit=zc*smallY*step;
+				for(y=0;y<smallY;y++) {
+					memcpy(BT_buffer+posit,X+Xcomp*local_Nsmall+IndexBlock(Xpos,y,z,smallY),msize);
+					posit+=step;
+				}
 			}
 
 			MPI_Sendrecv(BT_buffer, bufsize, MPI_DOUBLE, part, 0,
 				BT_rbuffer, bufsize, MPI_DOUBLE, part, 0,
-				MPI_COMM_WORLD,&status);
+				comm_group,&status);
 
-			posit=0;
 			Xpos=local_Nx*part;
-			for(Xcomp=0;Xcomp<3;Xcomp++) for(z=0;z<local_Nz;z++) for(y=0;y<smallY;y++) {
-				memcpy(X+Xcomp*local_Nsmall+IndexBlock(Xpos,y,z,smallY),BT_rbuffer+posit,msize);
-				posit+=step;
+#pragma omp parallel for private(Xcomp,z,y,posit)
+			for(zc=0;zc<3*nv*local_Nz;zc++) {
+				Xcomp=(int)(zc/local_Nz);
+				z=zc%local_Nz;
+				posit=zc*smallY*step;
+				for(y=0;y<smallY;y++) {
+					memcpy(X+Xcomp*local_Nsmall+IndexBlock(Xpos,y,z,smallY),BT_rbuffer+posit,msize);
+					posit+=step;
+				}
 			}
 		}
 	}
@@ -700,7 +978,7 @@ void BlockTranspose_DRm(doublecomplex * restrict X UOIP,const size_t lengthY UOI
 	MPI_Status status;
 
 #ifdef SYNCHRONIZE_TIMING
-	MPI_Barrier(MPI_COMM_WORLD); // synchronize to get correct timing
+	MPI_Barrier(comm_group); // synchronize to get correct timing
 #endif
 	tstart=GET_TIME();
 	step=2*local_Nx;
@@ -711,22 +989,28 @@ void BlockTranspose_DRm(doublecomplex * restrict X UOIP,const size_t lengthY UOI
 
 	for(transmission=1;transmission<=Ntrans;transmission++) {
 		if ((part=CalcPartner(transmission))!=nprocs) {
-			posit=0;
 			Xpos=local_Nx*part;
-			for(z=0;z<lengthZ;z++) for(y=0;y<lengthY;y++) {
-				memcpy(BT_buffer+posit,X+IndexBlock(Xpos,y,z,lengthY),msize);
-				posit+=step;
+#pragma omp parallel for private(y,posit)
+			for(z=0;z<lengthZ;z++) {
+				posit=z*lengthY*step;
+				for(y=0;y<lengthY;y++) {
+					memcpy(BT_buffer+posit,X+IndexBlock(Xpos,y,z,lengthY),msize);
+					posit+=step;
+				}
 			}
 
 			MPI_Sendrecv(BT_buffer,bufsize,MPI_DOUBLE,part,0,
 				BT_rbuffer,bufsize,MPI_DOUBLE,part,0,
-				MPI_COMM_WORLD,&status);
+				comm_group,&status);
 
-			posit=0;
 			Xpos=local_Nx*part;
-			for(z=0;z<lengthZ;z++) for(y=0;y<lengthY;y++) {
-				memcpy(X+IndexBlock(Xpos,y,z,lengthY),BT_rbuffer+posit,msize);
-				posit+=step;
+#pragma omp parallel for private(y,posit)
+			for(z=0;z<lengthZ;z++) {
+				posit=z*lengthY*step;
+				for(y=0;y<lengthY;y++) {
+					memcpy(X+IndexBlock(Xpos,y,z,lengthY),BT_rbuffer+posit,msize);
+					posit+=step;
+				}
 			}
 		}
 	}
@@ -810,7 +1094,7 @@ void CollectDomainGranul(unsigned char * restrict dom UOIP,const size_t gXY UOIP
 	TIME_TYPE tstart;
 
 #ifdef SYNCHRONIZE_TIMING
-	MPI_Barrier(MPI_COMM_WORLD); // synchronize to get correct timing
+	MPI_Barrier(comm_group); // synchronize to get correct timing
 #endif
 	tstart=GET_TIME();
 	unit=gXY*sizeof(char);
@@ -822,7 +1106,7 @@ void CollectDomainGranul(unsigned char * restrict dom UOIP,const size_t gXY UOIP
 					index-=gXY;
 					memcpy(gr_comm_ob,dom+index,unit);
 				}
-				MPI_Recv(dom+index,unit*gr_comm_size[i],MPI_UNSIGNED_CHAR,i,0,MPI_COMM_WORLD,&status);
+				MPI_Recv(dom+index,unit*gr_comm_size[i],MPI_UNSIGNED_CHAR,i,0,comm_group,&status);
 				if (gr_comm_overl[i-1]) for (j=0;j<gXY;j++) dom[index+j]|=gr_comm_ob[j];
 				index+=gXY*gr_comm_size[i];
 			}
@@ -835,7 +1119,7 @@ void CollectDomainGranul(unsigned char * restrict dom UOIP,const size_t gXY UOIP
 					memcpy(gr_comm_ob,dom+index,unit);
 					index+=gXY;
 				}
-				MPI_Recv(dom+index-gXY*gr_comm_size[i],unit*gr_comm_size[i],MPI_UNSIGNED_CHAR,i,0,MPI_COMM_WORLD,
+				MPI_Recv(dom+index-gXY*gr_comm_size[i],unit*gr_comm_size[i],MPI_UNSIGNED_CHAR,i,0,comm_group,
 					&status);
 				if (gr_comm_overl[i]) for (j=0;j<gXY;j++) dom[index-gXY+j]|=gr_comm_ob[j];
 				index-=gXY*gr_comm_size[i];
@@ -846,7 +1130,7 @@ void CollectDomainGranul(unsigned char * restrict dom UOIP,const size_t gXY UOIP
 		// the test here implies the test for above MPI_Recv as well
 		size_t size=(size_t)unit*(size_t)locgZ;
 		if (size>INT_MAX) LogError(ALL_POS,"int overflow in MPI function (%zu)",size);
-		MPI_Send(dom,size,MPI_UNSIGNED_CHAR,ADDA_ROOT,0,MPI_COMM_WORLD);
+		MPI_Send(dom,size,MPI_UNSIGNED_CHAR,ADDA_ROOT,0,comm_group);
 	}
 	(*timing)+=GET_TIME()-tstart;
 #endif
@@ -879,10 +1163,10 @@ void ExchangeFits(bool * restrict data UOIP,const size_t n UOIP,TIME_TYPE *timin
 
 	if (n>INT_MAX) LogError(ONE_POS,"int overflow in MPI function (%zu)",n);
 #ifdef SYNCHRONIZE_TIMING
-	MPI_Barrier(MPI_COMM_WORLD); // synchronize to get correct timing
+	MPI_Barrier(comm_group); // synchronize to get correct timing
 #endif
 	tstart=GET_TIME();
-	MPI_Allreduce(data,gr_comm_buf,n,mpi_bool,MPI_LAND,MPI_COMM_WORLD);
+	MPI_Allreduce(data,gr_comm_buf,n,mpi_bool,MPI_LAND,comm_group);
 	memcpy(data,gr_comm_buf,n*sizeof(bool));
 	(*timing)+=GET_TIME()-tstart;
 #endif
@@ -906,18 +1190,18 @@ bool ExchangePhaseShifts(doublecomplex * restrict bottom, doublecomplex * restri
 
 	if (2*boxXY>INT_MAX) LogError(ONE_POS,"int overflow in MPI function (%zu)",2*boxXY);
 #ifdef SYNCHRONIZE_TIMING
-	MPI_Barrier(MPI_COMM_WORLD); // synchronize to get correct timing
+	MPI_Barrier(comm_group); // synchronize to get correct timing
 #endif
 	tstart=GET_TIME();
 	// receive slice from previous processor and increment own slice by these values
 	if (ringid>0) { // It is important to use 0 instead of ROOT
-		MPI_Recv(bottom,2*boxXY,MPI_DOUBLE,ringid-1,0,MPI_COMM_WORLD,&status);
+		MPI_Recv(bottom,2*boxXY,MPI_DOUBLE,ringid-1,0,comm_group,&status);
 		for (i=0;i<boxXY;i++) top[i]+=bottom[i];
 	}
 	// send updated slice to previous processor
-	if (ringid<(nprocs-1)) MPI_Send(top,2*boxXY,MPI_DOUBLE,ringid+1,0,MPI_COMM_WORLD);
+	if (ringid<(nprocs-1)) MPI_Send(top,2*boxXY,MPI_DOUBLE,ringid+1,0,comm_group);
 #ifdef SYNCHRONIZE_TIMING
-	MPI_Barrier(MPI_COMM_WORLD); // synchronize to get correct timing
+	MPI_Barrier(comm_group); // synchronize to get correct timing
 #endif
 	(*timing)+=GET_TIME()-tstart;
 	return (ringid!=0);
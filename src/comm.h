@@ -37,14 +37,18 @@ double AccumulateMax(double data,double *max);
 void Accumulate(void * restrict data UOIP,const var_type type UOIP,size_t n UOIP,TIME_TYPE *timing UOIP);
 void MyInnerProduct(void * restrict data,const var_type type,size_t n,TIME_TYPE *timing);
 void InitComm(int *argc_p,char ***argv_p);
+void InitGroups(void);
 void ParSetup(void);
 void SetupLocalD(void);
 void MyBcast(void * restrict data,const var_type type,const size_t n_elem,TIME_TYPE *timing);
 void BcastOrient(int *i,int *j,int *k);
+bool BcastOrientBatch(int * restrict n,int * restrict beta_i,int * restrict gamma_i);
+void GatherOrientBatch(double * restrict res,int block,int n);
+void AccumulateGroups(size_t *data);
 void ReadField(const char * restrict fname,doublecomplex *restrict field);
 
 #ifndef SPARSE
-void BlockTranspose(doublecomplex * restrict X,TIME_TYPE *timing);
+void BlockTranspose(doublecomplex * restrict X,int nv,TIME_TYPE *timing);
 void BlockTranspose_DRm(doublecomplex * restrict X,size_t lengthY,size_t lengthZ);
 // used by granule generator
 void SetGranulComm(double z0,double z1,double gdZ,int gZ,size_t gXY,size_t buf_size,int *lz0,int *lz1,int sm_gr);
@@ -58,6 +62,12 @@ void ExchangeFits(bool * restrict data,const size_t n,TIME_TYPE *timing);
 void CatNFiles(const char * restrict dir,const char * restrict tmpl,const char * restrict dest);
 bool ExchangePhaseShifts(doublecomplex * restrict bottom, doublecomplex * restrict top,TIME_TYPE *timing);
 void AllGather(void * restrict x_from,void * restrict x_to,var_type type,TIME_TYPE *timing);
+void ReduceScatter(doublecomplex * restrict x_full,doublecomplex * restrict x_local,TIME_TYPE *timing);
+void *AllGatherVar(const void * restrict x_from,size_t n,var_type type,size_t * restrict ntot,TIME_TYPE *timing);
+void RingChunk(int proc,size_t *d0,size_t *n);
+void RingShift(doublecomplex * restrict x_send,size_t n_send,doublecomplex * restrict x_recv,size_t n_recv,
+	TIME_TYPE *timing);
+void RingWait(TIME_TYPE *timing);
 
 /* The advantage of using this define is that compiler may remove an unnecessary test in sequential mode. The define do
  * not include common 'if', etc. to make the structure of the code (in the main text) immediately visible.
@@ -42,6 +42,8 @@
 #if defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 199901L)
 #	define __USE_MINGW_ANSI_STDIO 1
 #endif
+// the same applies to 64-bit file offsets on 32-bit POSIX systems, since cache files may exceed 2 GB
+#define _FILE_OFFSET_BITS 64
 
 // basic constants
 #define UNDEF -1 // should be used only for variables, which are naturally non-negative
@@ -106,6 +108,9 @@
 #define MAX_NMAT         15   // maximum number of different refractive indices (<256)
 #define MAX_N_SH_PARMS   25   // maximum number of shape parameters
 #define MAX_N_BEAM_PARMS 10   // maximum number of beam parameters
+#define MAX_RECYCLE      20   // maximum number of recycled solutions of the iterative solver
+#define SS_AUTO_RATIO    16   // maximum size of displacement table (per dipole) for automatic choice in sparse mode
+#define AIM_MAX_ORDER    7    // maximum order of interpolation onto the auxiliary grid of AIM (in sparse mode)
 
 // sizes of filenames and other strings
 /* There is MAX_PATH constant that equals 260 on Windows. However, even this OS allows ways to override this limit. On
@@ -143,6 +148,7 @@
 #define GFORM "%.10g"        // variable width (showing significant digits)
 #define GFORMDEF "%g"        // default output for non-precise values
 #define GFORM_DEBUG "%.2g"   // for debug and error output
+#define GFORM_EXACT "%.17g" // to represent doubles exactly (e.g. in keys of cache files)
 #define CFORM "%.10g%+.10gi" // for complex numbers; may be defined in terms of GFORM
 	// derived formats; starting "" is to avoid redundant syntax errors in Eclipse
 #define GFORM3V "("GFORM","GFORM","GFORM")"
@@ -326,6 +332,21 @@ enum init_field { // how to calculate initial field to be used in the iterative
 	IF_WKB   // from WKB approximation (incident field corrected for phase shift in the particle)
 };
 
+enum sparse_store { // which interaction terms are stored before the iterations (only in sparse mode)
+	SS_AUTO, // choose between SS_DISP and SS_NONE based on the size of the table
+	SS_NONE, // compute all terms on the fly in each MatVec
+	SS_DISP, // table over all possible displacements between dipoles
+	SS_FULL, // all (local) blocks of the interaction matrix
+	SS_ACA,  // hierarchical matrix with low-rank blocks, obtained by adaptive cross approximation (see hmatrix.c)
+	SS_AIM   // far field through FFT on a coarse auxiliary grid, corrected for near pairs (see aim.c)
+};
+
+enum fftback { // FFT routines (backends) used for the main FFT-based operations (not in sparse mode)
+	FFTB_FFTW,      // FFTW3 library
+	FFTB_TEMPERTON, // Fortran routines by C. Temperton
+	FFTB_BUILTIN    // built-in mixed-radix routines (see fftmr.c)
+};
+
 // return values for functions
 #define CHP_EXIT -2 // exit after saving checkpoint
 
@@ -346,12 +367,16 @@ enum init_field { // how to calculate initial field to be used in the iterative
 #define F_DIPPOL        "DipPol"
 #define F_BEAM          "IncBeam"
 #define F_GRANS         "granules"
+#define F_SWEEP         "CrossSec-sweep" // table of cross sections for all sweep points
+#define F_SWEEP_DIR     "sweep%03d"      // subdirectory for each sweep point; point number as argument
 	// suffixes
 #define F_XSUF          "-X"
 #define F_YSUF          "-Y"
 	// logs
 #define F_LOG           "log"
 #define F_LOG_ERR       "logerr.%d"    // ringid as argument
+#define F_LOG_GROUP     "log_group%d"  // group_id as argument
+#define F_STDOUT_GROUP  "stdout_group%d" // group_id as argument
 #define F_LOG_ORAVG     "log_orient_avg"
 #define F_LOG_INT_CSCA  "log_int_Csca"
 #define F_LOG_INT_ASYM  "log_int_asym"
@@ -379,6 +404,19 @@ enum init_field { // how to calculate initial field to be used in the iterative
 	// checkpoint files
 #define F_CHP_LOG       "chp.log"
 #define F_CHP           "chp.%d"   // ringid as argument
+#define F_CHP_ORIENT    "chp_orient"
+#define F_CHP_ORIENT_TMP F_CHP_ORIENT ".tmp"
+	// FFTW wisdom cache; grid dimensions, number of processors, and FFTW version as arguments
+#define F_WISDOM        "wisdom_%zux%zux%zu_np%d_%s"
+#define F_WISDOM_TMP    ".tmp" // suffix added to F_WISDOM for temporary file
+	// Dmatrix cache; two halves of 64-bit hash as arguments
+#define F_DMCACHE       "dm_%08lx%08lx"
+#define F_DMCACHE_TMP   ".tmp" // suffix added to the name of cache file for temporary file
+	// cache of Sommerfeld integrals; two halves of 64-bit hash as arguments (F_DMCACHE_TMP is used as well)
+#define F_SOMCACHE      "som_%08lx%08lx"
+	// cache of tuned FFT grid; particle box, number of processors, FFT routines, and surface suffix as arguments
+#define F_FFTTUNE       "ffttune_%dx%dx%d_np%d_%s%s"
+#define F_FFTTUNE_TMP   ".tmp" // suffix added to F_FFTTUNE for temporary file
 
 // default file and directory names; can be changed by command line options
 #define FD_ALLDIR_PARMS "alldir_params.dat"
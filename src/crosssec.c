@@ -1122,7 +1122,7 @@ double ScaCross(const char *f_suf)
 	SnprintfErr(ONE_POS,fname,MAX_FNAME,"%s/"F_LOG_INT_CSCA "%s",directory,f_suf);
 
 	tstart = GET_TIME();
-	Romberg2D(parms,CscaIntegrand,1,&res,fname);
+	Romberg2D(parms,CscaIntegrand,NULL,1,&res,fname);
 	res*=FOUR_PI/(WaveNum*WaveNum);
 	if (surface) res*=inc_scale;
 	Timing_Integration += GET_TIME() - tstart;
@@ -1162,7 +1162,7 @@ static void AsymParm(double *vec,const char *f_suf)
 	SnprintfErr(ONE_POS,log_int,MAX_FNAME,"%s/"F_LOG_INT_ASYM "%s",directory,f_suf);
 
 	tstart = GET_TIME();
-	Romberg2D(parms,gIntegrand,3,vec,log_int);
+	Romberg2D(parms,gIntegrand,NULL,3,vec,log_int);
 	vMultScal(FOUR_PI/(WaveNum*WaveNum),vec,vec);
 	if (surface) vMultScal(inc_scale,vec,vec);
 	Timing_Integration += GET_TIME() - tstart;
@@ -1194,7 +1194,7 @@ void AsymParm_x(double *vec,const char *f_suf)
 	SnprintfErr(ONE_POS,log_int,MAX_FNAME,"%s/"F_LOG_INT_ASYM F_LOG_X"%s",directory,f_suf);
 
 	tstart = GET_TIME();
-	Romberg2D(parms,gxIntegrand,1,vec,log_int);
+	Romberg2D(parms,gxIntegrand,NULL,1,vec,log_int);
 	vec[0] *= FOUR_PI/(WaveNum*WaveNum);
 	if (surface) vec[0]*=inc_scale;
 	Timing_Integration += GET_TIME() - tstart;
@@ -1226,7 +1226,7 @@ void AsymParm_y(double *vec,const char *f_suf)
 	SnprintfErr(ONE_POS,log_int,MAX_FNAME,"%s/"F_LOG_INT_ASYM F_LOG_Y"%s",directory,f_suf);
 
 	tstart = GET_TIME();
-	Romberg2D(parms,gyIntegrand,1,vec,log_int);
+	Romberg2D(parms,gyIntegrand,NULL,1,vec,log_int);
 	vec[0] *= FOUR_PI/(WaveNum*WaveNum);
 	if (surface) vec[0]*=inc_scale;
 	Timing_Integration += GET_TIME() - tstart;
@@ -1254,7 +1254,7 @@ void AsymParm_z(double *vec,const char *f_suf)
 	SnprintfErr(ONE_POS,log_int,MAX_FNAME,"%s/"F_LOG_INT_ASYM F_LOG_Z"%s",directory,f_suf);
 
 	tstart = GET_TIME();
-	Romberg2D(parms,gzIntegrand,1,vec,log_int);
+	Romberg2D(parms,gzIntegrand,NULL,1,vec,log_int);
 	vec[0] *= FOUR_PI/(WaveNum*WaveNum);
 	if (surface) vec[0]*=inc_scale;
 	Timing_Integration += GET_TIME() - tstart;
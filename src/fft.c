@@ -29,9 +29,23 @@
 #include "prec_time.h"
 #include "vars.h"
 // system headers
+#include <ctype.h>
 #include <math.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef __AVX__
+#	include <immintrin.h> // used in TransposeLeaf, when enabled by the compiler (e.g. -mavx or -march=native)
+#endif
+/* Dmatrix cache is memory-mapped, when possible. In OpenCL mode host copies of the matrices are freed after copying to
+ * the device, so they are simply read into allocated memory.
+ */
+#if defined(POSIX) && !defined(OPENCL)
+#	define DM_CACHE_MMAP
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <unistd.h>
+#endif
 
 #ifdef CLFFT_AMD
 	IGNORE_WARNING(-Wstrict-prototypes) // no way to change the library header
@@ -45,33 +59,66 @@
 #		error "Apple clFFT relies on C++ sources, hence is incompatible with NO_CPP option"
 #	endif
 #endif
-/* standard FFT routines (FFTW3 of FFT_TEMPERTON) are required even when OpenCL is used, since they are used for Fourier
- * transform of the D-matrix
+/* standard FFT routines (FFTW3, FFT_TEMPERTON, or built-in) are required even when OpenCL is used, since they are used
+ * for Fourier transform of the D-matrix
  */
 #ifdef FFTW3
 #	include <fftw3.h> // types.h or cmplx.h should be defined before (to match C99 complex type)
 /* define level of planning for usual and Dmatrix (DM) FFT: FFTW_ESTIMATE (heuristics), FFTW_MEASURE (default),
- * FTW_PATIENT, or FFTW_EXHAUSTIVE
+ * FTW_PATIENT, or FFTW_EXHAUSTIVE. These are defaults, which are changed when wisdom cache is used (see WisdomImport)
  */
 #	define PLAN_FFTW FFTW_MEASURE
 #	define PLAN_FFTW_DM FFTW_ESTIMATE
 #	define ONLY_FOR_FFTW3 // this is used in function argument declarations
+	// beginning of the first line of wisdom file, followed by planning time
+#	define WISDOM_HEADER "ADDA FFTW wisdom; planning time (s): "
+#	define PLAN_FFTW_TUNE FFTW_ESTIMATE // used only for benchmarking in TuneFFTGrid
 #else
 #	define ONLY_FOR_FFTW3 ATT_UNUSED
 #endif
 
+// maximum size of the block (along both dimensions), which is transposed directly by TransposeLeaf()
+#define TR_LEAF 16
+
 #ifdef FFT_TEMPERTON
 #	define ONLY_FOR_TEMPERTON // this is used in function argument declarations
 #else
 #	define ONLY_FOR_TEMPERTON ATT_UNUSED
 #endif
+#ifdef OPENCL
+#	define ONLY_FOR_HOST ATT_UNUSED
+#else
+#	define ONLY_FOR_HOST // this is used in function argument declarations
+#endif
 
 // SEMI-GLOBAL VARIABLES
 
+// defined and initialized in calculator.c
+extern const int mvBatch;
 // defined and initialized in interaction.c
 extern const int local_Nz_Rm;
+// defined and initialized in make_particle.c
+extern const double ZsumShift;
+// defined and initialized in param.c
+extern const double igt_lim,igt_eps,nloc_Rp;
+extern const char *dm_cache;
+extern const bool dm_cache_dir;
+extern const enum fftback fftBackend;
+extern const bool fft_tune;
+extern const char *fft_tune_dir;
+extern const bool yz_transpose;
+#ifdef FFTW3
+extern const char *wisdom_dir;
+extern const bool wisdom_patient;
+#endif
 // defined and initialized in timing.c
-extern TIME_TYPE Timing_FFT_Init,Timing_Dm_Init;
+extern TIME_TYPE Timing_FFT_Init,Timing_Dm_Init,Timing_DmGcalc,Timing_DmFFT,Timing_DmTransp;
+#ifdef FFTW3
+extern double Timing_FFTWPlan,Timing_FFTWSaved;
+#endif
+#if defined(OPENMP) && !defined(OPENCL)
+extern double * restrict Timing_MVThread;
+#endif
 
 // used in comm.c
 double * restrict BT_buffer, * restrict BT_rbuffer; // buffers for BlockTranspose
@@ -79,10 +126,15 @@ double * restrict BT_buffer, * restrict BT_rbuffer; // buffers for BlockTranspos
 doublecomplex * restrict Dmatrix; // holds FFT of the interaction matrix
 doublecomplex * restrict Rmatrix; // holds FFT of the reflection matrix
 #ifndef OPENCL
-	// holds input vector (on expanded grid) to matvec, also used as storage space in iterative.c
+	/* holds input vectors (on expanded grid) to matvec - 3*mvBatch components, i.e. 3 components for each of mvBatch
+	 * vectors; also used as storage space in iterative.c
+	 */
 doublecomplex * restrict Xmatrix;
-doublecomplex * restrict slices; // used in inner cycle of matvec - holds 3 components (for fixed x)
-doublecomplex * restrict slices_tr; // additional storage space for slices to accelerate transpose
+/* the following slices are allocated separately for each thread (nthreads parts of size 3*mvBatch*gridYZ); hence, e.g.,
+ * slices of the thread with THREAD_ID=t start from slices+3*mvBatch*t*gridYZ
+ */
+doublecomplex * restrict slices; // used in inner cycle of matvec - holds 3*mvBatch components (for fixed x)
+doublecomplex * restrict slices_tr; // additional storage space for slices to accelerate transpose (NULL if not used)
 doublecomplex * restrict slicesR,* restrict slicesR_tr; // same as above, but for reflected interaction
 #endif
 size_t DsizeY,DsizeZ,DsizeYZ; // size of the 'matrix' D
@@ -97,18 +149,33 @@ size_t local_gridX; // 'thickness' in x direction of a slice*
 size_t slicesize; // total number of doublecomplex values per slice
 #endif
 
+// parameters of on-disk cache of Dmatrix and Rmatrix
+#define DM_CACHE_HEADER 1024 // size of the header (in bytes), the data starts right after it
+#define DM_CACHE_MAGIC "ADDA Dmatrix cache, version 1" // first line of the header
+
 // LOCAL VARIABLES
 
-// D2 matrix and its two slices; used only temporary for InitDmatrix
+/* D2 matrix and its two slices; used only temporary for InitDmatrix. Slices are allocated separately for each thread
+ * (nthreads parts of size gridYZ)
+ */
 static doublecomplex * restrict slice,* restrict slice_tr,* restrict D2matrix;
 static doublecomplex * restrict R2matrix; // same for surface (slice and slice_tr are reused from Dmatrix)
 static size_t D2sizeY; // size of the 'matrix' D2 (x-size is gridX), Z size is not used
 static size_t R2sizeY; // size of the 'matrix' R2 (x- and z-sizes are corresponding grids)
 static size_t lz_Dm,lz_Rm; // local sizes along z for D(2) and R(2) matrices
+static bool thrSafe; // whether interaction terms can be computed by several OpenMP threads simultaneously
 // the following two lines are defined in InitDmatrix but used in InitRmatrix, they are analogous to Dm values
 static size_t Rsize,R2sizeTot; // sizes of R and R2 matrices
 static int jstartR;            // starting index for y
 static bool weird_nprocs;      // whether weird number of processors is used
+// on-disk cache of Dmatrix and Rmatrix
+static char dmCacheKey[DM_CACHE_HEADER]; // description of all parameters, on which the matrices depend
+static char dmCacheFname[MAX_FNAME];     // name of the cache file
+static bool dmLoaded;                    // whether the matrices were loaded from cache (then they are not computed)
+#ifdef DM_CACHE_MMAP
+static void *dmCacheMap;                 // memory-mapped cache file (NULL if memory mapping is not used)
+static size_t dmCacheMapSize;            // size of the memory-mapped file
+#endif
 
 #ifdef OPENCL
 // clFFT plans
@@ -122,22 +189,46 @@ static clFFT_Plan clplanX,clplanY,clplanZ;
 #ifdef FFTW3
 // FFTW3 plans: f - FFT_FORWARD; b - FFT_BACKWARD
 static fftw_plan planXf_Dm,planYf_slice,planZf_slice,planXf_Rm;
+static unsigned planFlag,planFlagDm; // actual planner flags for usual and Dmatrix FFT
+static char wisdomFname[MAX_FNAME];  // name of the file with FFTW wisdom
+static char *wisdomImported;         // wisdom imported from file (to test for changes); NULL if nothing was imported
+static double wisdomTime;            // planning time stored in the wisdom file (in s)
 #	ifndef OPENCL // these plans are used only if OpenCL is not used
-static fftw_plan planXf,planXb,planYf,planYb,planZf,planZb,planYRf,planZRf; // last two for reflected interaction
+/* arrays of plans (of size nPlans): Y and Z plans are separate for each thread, since they are bound to its slices;
+ * X plans are separate for each chunk of Xmatrix (ChunkStart), all chunks are transformed in parallel. The last two are
+ * for reflected interaction. The first nthreads plans transform a single vector, the rest (if mvBatch>1) - mvBatch
+ * vectors at once (see PlanIndex).
+ */
+static fftw_plan *planXf,*planXb,*planYf,*planYb,*planZf,*planZb,*planYRf,*planZRf;
+static int nPlans; // size of the above arrays
 #	endif
-#elif defined(FFT_TEMPERTON)
+#endif
+#ifdef FFT_TEMPERTON
 #	ifdef NO_FORTRAN
 #		error "Tempertron FFT is implemented in Fortran, hence incompatible with NO_FORTRAN option"
 #	endif
-#	define IFAX_SIZE 20
-// arrays for Temperton FFT
-static double * restrict trigsX,* restrict trigsY,* restrict trigsZ,* restrict work;
-static int ifaxX[IFAX_SIZE],ifaxY[IFAX_SIZE],ifaxZ[IFAX_SIZE];
 // Fortran routines from cfft99D.f
 void cftfax_(const int *nn,int * restrict ifax,double * restrict trigs);
 void cfft99_(double * restrict data,double * restrict _work,const double * restrict trigs,const int * restrict ifax,
 	const int *inc,const int *jump,const int *nn,const int *lot,const int *isign);
 #endif
+// fftmr.c
+void fftmrInit(int n,int * restrict ifax,double * restrict trigs);
+size_t fftmrWorkSize(int n);
+void fftmr(doublecomplex * restrict data,double * restrict work,const double * restrict trigs,const int * restrict ifax,
+	int inc,int jump,int n,int lot,int isign);
+
+#define IFAX_SIZE 20
+// parameters of TuneFFTGrid
+#define TUNE_RANGE 1.25    // maximum ratio of candidate grid size to the minimal one
+#define TUNE_MAX_CAND 32   // maximum number of candidates along each axis
+#define TUNE_MIN_TIME 0.02 // minimum duration (in s) of each benchmark
+/* arrays for line-based FFT routines (Temperton or built-in); work is separate for each thread (nthreads parts of size
+ * workSize)
+ */
+static double * restrict trigsX,* restrict trigsY,* restrict trigsZ,* restrict work;
+static size_t workSize;
+static int ifaxX[IFAX_SIZE],ifaxY[IFAX_SIZE],ifaxZ[IFAX_SIZE];
 
 //======================================================================================================================
 
@@ -224,56 +315,114 @@ static inline size_t IndexSliceR2matrix(int y,const int z)
 
 //======================================================================================================================
 
-static void transpose(const doublecomplex * restrict data,doublecomplex * restrict trans,const size_t Y,const size_t Z)
-// optimized routine to transpose complex matrix with dimensions YxZ: data -> trans
+static inline size_t ChunkStart(const size_t n,const int t)
+// starting index of chunk t, when the range [0,n) is divided into nthreads (almost) equal chunks; t=nthreads gives n
 {
-	size_t y,z,y1,y2,z1,z2,i,j,y0,z0;
-	doublecomplex *t1,*t2,*t3,*t4;
-	const doublecomplex *w1,*w2,*w3;
-	const size_t blockTr=64; // block size
-	/* Intel compiler 11.1 seems to produce broken code for this function whenever blockTr>1, at least when the function
-	 * is called in row of three from TransposeYZ(). So maybe the bug is due to incorrect inlining. This bug appears
-	 * only for -O3 compilation, but not for -O2. Moreover, the bug is not present for icc 13.0.
-	 * We have no idea what can be done on our side.
-	 */
+	return (n*t)/nthreads;
+}
 
-	y1=Y/blockTr;
-	y2=Y%blockTr;
-	z1=Z/blockTr;
-	z2=Z%blockTr;
-
-	w1=data;
-	t1=trans-Y;
-
-	for(i=0;i<=y1;i++) {
-		if (i==y1) y0=y2;
-		else y0=blockTr;
-		w2=w1;
-		t2=t1;
-		for(j=0;j<=z1;j++) {
-			if (j==z1) z0=z2;
-			else z0=blockTr;
-			w3=w2;
-			t3=t2;
-			for (y=0;y<y0;y++) {
-				t4=t3+y;
-				for (z=0;z<z0;z++) *(t4+=Y)=w3[z];
-				w3+=Z;
-			}
-			w2+=blockTr;
-			t2+=blockTr*Y;
+//======================================================================================================================
+
+#if defined(FFTW3) && !defined(OPENCL)
+static inline int PlanIndex(const int nv,const int t)
+// index of FFTW plan for thread (or chunk) t, transforming nv vectors; only nv=1 and nv=mvBatch are planned
+{
+	return (nv==1) ? t : nthreads+t;
+}
+
+//======================================================================================================================
+
+static inline int PlanNv(const int ind)
+// number of vectors, transformed by FFTW plan with index 'ind'; inverse of PlanIndex
+{
+	return (ind<nthreads) ? 1 : mvBatch;
+}
+
+//======================================================================================================================
+#endif
+
+static inline void TransposeLeaf(const doublecomplex * restrict data,doublecomplex * restrict trans,const size_t Y,
+	const size_t Z,const size_t ldD,const size_t ldT)
+/* transposes a small block (Y,Z<=TR_LEAF), which fits into L1 cache together with its image; arguments are the same as
+ * for transpose(). The block is processed by 2x2 tiles, which are transposed in registers when AVX is available (a
+ * 256-bit register holds two complex numbers, i.e. half of a tile).
+ */
+{
+	size_t y,z;
+#ifdef __AVX__
+	__m256d r0,r1;
+#endif
+
+	for (y=0;y+2<=Y;y+=2) {
+		for (z=0;z+2<=Z;z+=2) {
+#ifdef __AVX__
+			r0=_mm256_loadu_pd((const double *)(data+y*ldD+z));
+			r1=_mm256_loadu_pd((const double *)(data+(y+1)*ldD+z));
+			_mm256_storeu_pd((double *)(trans+z*ldT+y),_mm256_permute2f128_pd(r0,r1,0x20));
+			_mm256_storeu_pd((double *)(trans+(z+1)*ldT+y),_mm256_permute2f128_pd(r0,r1,0x31));
+#else
+			trans[z*ldT+y]=data[y*ldD+z];
+			trans[z*ldT+y+1]=data[(y+1)*ldD+z];
+			trans[(z+1)*ldT+y]=data[y*ldD+z+1];
+			trans[(z+1)*ldT+y+1]=data[(y+1)*ldD+z+1];
+#endif
 		}
-		w1+=blockTr*Z;
-		t1+=blockTr;
+		if (z<Z) {
+			trans[z*ldT+y]=data[y*ldD+z];
+			trans[z*ldT+y+1]=data[(y+1)*ldD+z];
+		}
+	}
+	if (y<Y) for (z=0;z<Z;z++) trans[z*ldT+y]=data[y*ldD+z];
+}
+
+//======================================================================================================================
+
+static void transpose(const doublecomplex * restrict data,doublecomplex * restrict trans,const size_t Y,const size_t Z,
+	const size_t ldD,const size_t ldT)
+/* optimized routine to transpose complex matrix with dimensions YxZ: data -> trans; ldD and ldT are the leading
+ * dimensions (distance between rows) of data and trans respectively (ldD>=Z, ldT>=Y). Other elements of trans are not
+ * changed, which allows one to transpose only a part of a matrix.
+ *
+ * Cache-oblivious algorithm: the larger dimension is recursively halved until the block fits into L1 cache. Contrary to
+ * blocking with fixed size, it also avoids cache-associativity conflicts for power-of-two leading dimensions (typical
+ * for FFT grids), since the blocks are small and are read and written in both directions by short contiguous pieces.
+ * Splitting is done at even indices to keep the 2x2 tiles of TransposeLeaf() aligned.
+ */
+{
+	size_t h;
+
+	if (Y<=TR_LEAF && Z<=TR_LEAF) TransposeLeaf(data,trans,Y,Z,ldD,ldT);
+	else if (Y>=Z) {
+		h=(Y/2+1)&~(size_t)1;
+		transpose(data,trans,h,Z,ldD,ldT);
+		transpose(data+h*ldD,trans+h,Y-h,Z,ldD,ldT);
+	}
+	else {
+		h=(Z/2+1)&~(size_t)1;
+		transpose(data,trans,Y,h,ldD,ldT);
+		transpose(data+h,trans+h*ldT,Y,Z-h,ldD,ldT);
 	}
 }
 
 //======================================================================================================================
 
-void TransposeYZ(const int direction)
+#ifndef OPENCL
+static inline void ZeroPadding(doublecomplex * restrict sl_tr)
+// zeroes elements of a single (transposed) slice with y>=boxY
+{
+	size_t z,y;
+
+	for (z=0;z<gridZ;z++) for (y=boxY;y<gridY;y++) sl_tr[z*gridY+y]=0;
+}
+
+//======================================================================================================================
+#endif
+
+void TransposeYZ(const int direction,const int nv ONLY_FOR_HOST)
 /* optimized routine to transpose y and z; forward: slices->slices_tr; backward: slices_tr->slices; direction can be
  * made boolean but this contradicts with existing definitions of FFT_FORWARD and FFT_BACKWARD, which themselves are
- * determined by FFT routines invocation format
+ * determined by FFT routines invocation format. nv is the number of vectors in slices (ignored in OpenCL mode). With
+ * '-no_yz_transpose' it only prepares zero padding for the strided fftY (and does nothing for backward direction).
  */
 {
 #ifdef OPENCL
@@ -298,23 +447,78 @@ void TransposeYZ(const int direction)
 	else CL_CH_ERR(clEnqueueNDRangeKernel(command_queue,cltransposeob,3,NULL,enqtglobalyz,tblock,0,NULL,NULL));
 #else
 	size_t Xcomp,ind;
+	const size_t sh=3*mvBatch*THREAD_ID*gridYZ; // shift of slices of the current thread
+	const size_t nc=3*nv; // number of components
 
-	if (direction==FFT_FORWARD) for (Xcomp=0;Xcomp<3;Xcomp++) {
-		ind=Xcomp*gridYZ;
-		transpose(slices+ind,slices_tr+ind,gridY,gridZ);
-		if (surface) transpose(slicesR+ind,slicesR_tr+ind,gridY,gridZ);
+	/* Only the first boxY rows of slices (y<boxY) are non-zero before and required after the FFTs (the rest correspond
+	 * to zero padding). So forward transpose reads only them, explicitly zeroing the rest of slices_tr, while backward
+	 * transpose writes only them. Values in other rows of slices are not defined, and are never used (see MatVec).
+	 * When the transpose is skipped ('-no_yz_transpose'), fftY transforms slices directly, so only the rest is zeroed.
+	 */
+	if (!yz_transpose) {
+		if (direction==FFT_FORWARD) for (Xcomp=0;Xcomp<nc;Xcomp++) {
+			ind=sh+Xcomp*gridYZ+boxY*gridZ;
+			memset(slices+ind,0,(gridY-boxY)*gridZ*sizeof(doublecomplex));
+			if (surface) memset(slicesR+ind,0,(gridY-boxY)*gridZ*sizeof(doublecomplex));
+		}
+		return;
+	}
+	if (direction==FFT_FORWARD) for (Xcomp=0;Xcomp<nc;Xcomp++) {
+		ind=sh+Xcomp*gridYZ;
+		transpose(slices+ind,slices_tr+ind,boxY,gridZ,gridZ,gridY);
+		ZeroPadding(slices_tr+ind);
+		if (surface) {
+			transpose(slicesR+ind,slicesR_tr+ind,boxY,gridZ,gridZ,gridY);
+			ZeroPadding(slicesR_tr+ind);
+		}
 	}
-	else for (Xcomp=0;Xcomp<3;Xcomp++) { // direction==FFT_BACKWARD
-		ind=Xcomp*gridYZ;
-		transpose(slices_tr+ind,slices+ind,gridZ,gridY);
+	else for (Xcomp=0;Xcomp<nc;Xcomp++) { // direction==FFT_BACKWARD
+		ind=sh+Xcomp*gridYZ;
+		transpose(slices_tr+ind,slices+ind,gridZ,boxY,gridY,gridZ);
 	}
 #endif
 }
 
 //======================================================================================================================
 
-void fftX(const int isign)
-// FFT three components of (buf)Xmatrix(x) for all y,z; called from matvec
+static inline void LineFFTInit(const int n,int * restrict ifax,double * restrict trigs)
+// initializes factors and twiddle factors for line-based FFT of size n, using Temperton or built-in routines
+{
+#ifdef FFT_TEMPERTON
+	if (fftBackend==FFTB_TEMPERTON) {
+		cftfax_(&n,ifax,trigs);
+		return;
+	}
+#endif
+	fftmrInit(n,ifax,trigs);
+}
+
+//======================================================================================================================
+
+static inline void LineFFT(doublecomplex * restrict data,double * restrict tw,const double * restrict trigs,
+	const int * restrict ifax,int inc,int jump,int n,int lot,int isign)
+/* performs lot FFTs of size n (line-based) using Temperton or built-in routines; tw is the work array of the current
+ * thread. Arguments are passed by value, so they can be given as pointers to the Fortran routine.
+ */
+{
+#ifdef FFT_TEMPERTON
+	if (fftBackend==FFTB_TEMPERTON) {
+		/* Calls to Temperton FFT cause warnings for translation from doublecomplex to double pointers. However, such a
+		 * cast is perfectly valid in C99. So we set pragmas to remove these warnings.
+		 */
+		IGNORE_WARNING(-Wstrict-aliasing);
+		cfft99_((double *)data,tw,trigs,ifax,&inc,&jump,&n,&lot,&isign);
+		STOP_IGNORE;
+		return;
+	}
+#endif
+	fftmr(data,tw,trigs,ifax,inc,jump,n,lot,isign);
+}
+
+//======================================================================================================================
+
+void fftX(const int isign,const int nv ONLY_FOR_HOST)
+// FFT three components of nv vectors in (buf)Xmatrix(x) for all y,z; called from matvec
 {
 #ifdef OPENCL
 #	ifdef CLFFT_AMD
@@ -324,28 +528,33 @@ void fftX(const int isign)
 	CL_CH_ERR(clFFT_ExecuteInterleaved(command_queue,clplanX,(int)3*local_Nz*smallY,(clFFT_Direction)isign,bufXmatrix,
 		bufXmatrix,0,NULL,NULL));
 #	endif
-#elif defined(FFTW3)
-	if (isign==FFT_FORWARD) fftw_execute(planXf);
-	else fftw_execute(planXb);
-#elif defined(FFT_TEMPERTON)
-	int nn=gridX,inc=1,jump=nn,lot=boxY;
+#else
 	size_t z;
-	/* Calls to Temperton FFT cause warnings for translation from doublecomplex to double pointers. However, such a cast
-	 * is perfectly valid in C99. So we set pragmas to remove these warnings.
-	 *
-	 * !!! TODO: Another (ultimate) solution is to remove this routine altogether, since FFTW is perfect in all
-	 * respects. This is also reasonable considering future switch to tgmath.h
-	 */
-	IGNORE_WARNING(-Wstrict-aliasing);
-	for (z=0;z<3*local_Nz;z++) cfft99_((double *)(Xmatrix+z*gridX*smallY),work,trigsX,ifaxX,&inc,&jump,&nn,&lot,&isign);
-	STOP_IGNORE;
+#	ifdef FFTW3
+	int t,p;
+
+	if (fftBackend==FFTB_FFTW) {
+		// each chunk of Xmatrix has its own plan; empty chunks (if any) have NULL plans
+#		pragma omp parallel for private(p)
+		for (t=0;t<nthreads;t++) if (planXf[p=PlanIndex(nv,t)]!=NULL) {
+			if (isign==FFT_FORWARD) fftw_execute(planXf[p]);
+			else fftw_execute(planXb[p]);
+		}
+		return;
+	}
+#	endif
+#	pragma omp parallel for
+	for (z=0;z<3*nv*local_Nz;z++)
+		LineFFT(Xmatrix+z*gridX*smallY,work+THREAD_ID*workSize,trigsX,ifaxX,1,gridX,gridX,boxY,isign);
 #endif
 }
 
 //======================================================================================================================
 
-void fftY(const int isign)
-// FFT three components of slices_tr(y) for all z; called from matvec
+void fftY(const int isign,const int nv ONLY_FOR_HOST)
+/* FFT three components of nv vectors in slices_tr(y) for all z; called from matvec. With '-no_yz_transpose' slices(y)
+ * are transformed instead, i.e. FFTs have stride gridZ, while neighboring (in z) lines are contiguous in memory.
+ */
 {
 #ifdef OPENCL
 #	ifdef CLFFT_AMD
@@ -361,27 +570,39 @@ void fftY(const int isign)
 		CL_CH_ERR(clFFT_ExecuteInterleaved(command_queue,clplanY,(int)3*gridZ*local_gridX,(clFFT_Direction)isign,
 			bufslicesR_tr,bufslicesR_tr,0,NULL,NULL));
 #	endif
-#elif defined(FFTW3)
-	if (isign==FFT_FORWARD) {
-		fftw_execute(planYf);
-		if (surface) fftw_execute(planYRf);
-	}
-	else fftw_execute(planYb);
-#elif defined(FFT_TEMPERTON)
-	int nn=gridY,inc=1,jump=nn,lot=3*gridZ;
+#else
+	int Xcomp;
+	const int t=THREAD_ID;
+	const size_t sh=3*mvBatch*t*gridYZ; // shift of slices of the current thread
+	double * restrict tw=work+t*workSize; // work of the current thread
+#	ifdef FFTW3
+	const int p=PlanIndex(nv,t);
 
-	IGNORE_WARNING(-Wstrict-aliasing);
-	cfft99_((double *)(slices_tr),work,trigsY,ifaxY,&inc,&jump,&nn,&lot,&isign);
+	if (fftBackend==FFTB_FFTW) {
+		if (isign==FFT_FORWARD) {
+			fftw_execute(planYf[p]);
+			if (surface) fftw_execute(planYRf[p]);
+		}
+		else fftw_execute(planYb[p]);
+		return;
+	}
+#	endif
+	if (!yz_transpose) {
+		for (Xcomp=0;Xcomp<3*nv;Xcomp++) LineFFT(slices+sh+gridYZ*Xcomp,tw,trigsY,ifaxY,gridZ,1,gridY,gridZ,isign);
+		if (surface && isign==FFT_FORWARD) for (Xcomp=0;Xcomp<3*nv;Xcomp++)
+			LineFFT(slicesR+sh+gridYZ*Xcomp,tw,trigsY,ifaxY,gridZ,1,gridY,gridZ,isign);
+		return;
+	}
+	LineFFT(slices_tr+sh,tw,trigsY,ifaxY,1,gridY,gridY,3*nv*gridZ,isign);
 	// the same operation is applied to sliceR_tr, when required
-	if (surface && isign==FFT_FORWARD) cfft99_((double *)(slicesR_tr),work,trigsY,ifaxY,&inc,&jump,&nn,&lot,&isign);
-	STOP_IGNORE;
+	if (surface && isign==FFT_FORWARD) LineFFT(slicesR_tr+sh,tw,trigsY,ifaxY,1,gridY,gridY,3*nv*gridZ,isign);
 #endif
 }
 
 //======================================================================================================================
 
-void fftZ(const int isign)
-// FFT three components of slices(z) for all y; called from matvec
+void fftZ(const int isign,const int nv ONLY_FOR_HOST)
+// FFT three components of nv vectors in slices(z) for all y; called from matvec
 {
 #ifdef OPENCL
 #	ifdef CLFFT_AMD
@@ -397,91 +618,101 @@ void fftZ(const int isign)
 		CL_CH_ERR(clFFT_ExecuteInterleaved(command_queue,clplanZ,(int)3*gridY*local_gridX,(clFFT_Direction)FFT_BACKWARD,
 			bufslicesR,bufslicesR,0,NULL,NULL));
 #	endif
-#elif defined(FFTW3)
-	if (isign==FFT_FORWARD) {
-		fftw_execute(planZf);
-		if (surface) fftw_execute(planZRf);
-	}
-	else fftw_execute(planZb);
-#elif defined(FFT_TEMPERTON)
-	int nn=gridZ,inc=1,jump=nn,lot=boxY,Xcomp;
+#else
+	int Xcomp;
+	const int t=THREAD_ID;
+	const size_t sh=3*mvBatch*t*gridYZ; // shift of slices of the current thread
+	double * restrict tw=work+t*workSize; // work of the current thread
+#	ifdef FFTW3
+	const int p=PlanIndex(nv,t);
 
-	IGNORE_WARNING(-Wstrict-aliasing);
-	for (Xcomp=0;Xcomp<3;Xcomp++) cfft99_((double *)(slices+gridYZ*Xcomp),work,trigsZ,ifaxZ,&inc,&jump,&nn,&lot,&isign);
-	if (surface && isign==FFT_FORWARD) { // the same operation is applied to slicesR, but with inverse transform
-		const int invSign=FFT_BACKWARD;
-		for (Xcomp=0;Xcomp<3;Xcomp++)
-			cfft99_((double *)(slicesR+gridYZ*Xcomp),work,trigsZ,ifaxZ,&inc,&jump,&nn,&lot,&invSign);
+	if (fftBackend==FFTB_FFTW) {
+		if (isign==FFT_FORWARD) {
+			fftw_execute(planZf[p]);
+			if (surface) fftw_execute(planZRf[p]);
+		}
+		else fftw_execute(planZb[p]);
+		return;
 	}
-	STOP_IGNORE;
+#	endif
+	for (Xcomp=0;Xcomp<3*nv;Xcomp++) LineFFT(slices+sh+gridYZ*Xcomp,tw,trigsZ,ifaxZ,1,gridZ,gridZ,boxY,isign);
+	if (surface && isign==FFT_FORWARD) // the same operation is applied to slicesR, but with inverse transform
+		for (Xcomp=0;Xcomp<3*nv;Xcomp++)
+			LineFFT(slicesR+sh+gridYZ*Xcomp,tw,trigsZ,ifaxZ,1,gridZ,gridZ,boxY,FFT_BACKWARD);
 #endif
 }
 
 //======================================================================================================================
 
 static void fftX_Dm(void)
-// FFT(forward) D2matrix(x) for all y,z; used for Dmatrix calculation
+/* FFT(forward) D2matrix(x) for all y,z; used for Dmatrix calculation. Layers with different z are shared among OpenMP
+ * threads. For FFTW the plan transforms a single layer and is executed on others by the new-array execute function,
+ * which is thread-safe. The shift between layers is a multiple of 32 bytes (since gridX is even), so their alignment
+ * is the same as that of the first one.
+ */
 {
-#ifdef FFTW3
-	fftw_execute(planXf_Dm);
-#elif defined(FFT_TEMPERTON)
-	int nn=gridX,inc=1,jump=nn,lot=D2sizeY,isign=FFT_FORWARD;
 	size_t z;
 
-	IGNORE_WARNING(-Wstrict-aliasing);
-	for (z=0;z<lz_Dm;z++) cfft99_((double *)(D2matrix+z*gridX*D2sizeY),work,trigsX,ifaxX,&inc,&jump,&nn,&lot,&isign);
-	STOP_IGNORE;
+#ifdef FFTW3
+	if (fftBackend==FFTB_FFTW) {
+#		pragma omp parallel for
+		for (z=0;z<lz_Dm;z++) fftw_execute_dft(planXf_Dm,D2matrix+z*gridX*D2sizeY,D2matrix+z*gridX*D2sizeY);
+		return;
+	}
 #endif
+#pragma omp parallel for
+	for (z=0;z<lz_Dm;z++)
+		LineFFT(D2matrix+z*gridX*D2sizeY,work+THREAD_ID*workSize,trigsX,ifaxX,1,gridX,gridX,D2sizeY,FFT_FORWARD);
 }
 
 //======================================================================================================================
 
 static void fftX_Rm(void)
-// FFT(forward) D2matrix(x) for all y,z; used for Rmatrix calculation
+// FFT(forward) R2matrix(x) for all y,z; used for Rmatrix calculation; the same as fftX_Dm
 {
-#ifdef FFTW3
-	fftw_execute(planXf_Rm);
-#elif defined(FFT_TEMPERTON)
-	int nn=gridX,inc=1,jump=nn,lot=R2sizeY,isign=FFT_FORWARD;
 	size_t z;
 	const size_t zlim=local_Nz_Rm; // can be smaller by 1 than lz_Rm
 
-	IGNORE_WARNING(-Wstrict-aliasing);
-	for (z=0;z<zlim;z++) cfft99_((double *)(R2matrix+z*gridX*R2sizeY),work,trigsX,ifaxX,&inc,&jump,&nn,&lot,&isign);
-	STOP_IGNORE;
+#ifdef FFTW3
+	if (fftBackend==FFTB_FFTW) {
+#		pragma omp parallel for
+		for (z=0;z<zlim;z++) fftw_execute_dft(planXf_Rm,R2matrix+z*gridX*R2sizeY,R2matrix+z*gridX*R2sizeY);
+		return;
+	}
 #endif
+#pragma omp parallel for
+	for (z=0;z<zlim;z++)
+		LineFFT(R2matrix+z*gridX*R2sizeY,work+THREAD_ID*workSize,trigsX,ifaxX,1,gridX,gridX,R2sizeY,FFT_FORWARD);
 }
 
 //======================================================================================================================
 
-static void fftY_slice(void)
-// FFT(forward) slice_tr(y) for all z; used for Dmatrix and Rmatrix calculation
+static void fftY_slice(doublecomplex * restrict sl_tr)
+/* FFT(forward) sl_tr(y) for all z; used for Dmatrix and Rmatrix calculation. sl_tr is a part of slice_tr of the
+ * current thread; for FFTW the plan (created for the first part) is executed by the thread-safe new-array function.
+ */
 {
 #ifdef FFTW3
-	fftw_execute(planYf_slice);
-#elif defined(FFT_TEMPERTON)
-	int nn=gridY,inc=1,jump=nn,lot=gridZ,isign=FFT_FORWARD;
-
-	IGNORE_WARNING(-Wstrict-aliasing);
-	cfft99_((double *)slice_tr,work,trigsY,ifaxY,&inc,&jump,&nn,&lot,&isign);
-	STOP_IGNORE;
+	if (fftBackend==FFTB_FFTW) {
+		fftw_execute_dft(planYf_slice,sl_tr,sl_tr);
+		return;
+	}
 #endif
+	LineFFT(sl_tr,work+THREAD_ID*workSize,trigsY,ifaxY,1,gridY,gridY,gridZ,FFT_FORWARD);
 }
 
 //======================================================================================================================
 
-static void fftZ_slice(void)
-// FFT(forward) slice(z) for all y; used for Dmatrix and Rmatrix calculation
+static void fftZ_slice(doublecomplex * restrict sl)
+// FFT(forward) sl(z) for all y; used for Dmatrix and Rmatrix calculation; the same as fftY_slice
 {
 #ifdef FFTW3
-	fftw_execute(planZf_slice);
-#elif defined(FFT_TEMPERTON)
-	int nn=gridZ,inc=1,jump=nn,lot=gridY,isign=FFT_FORWARD;
-
-	IGNORE_WARNING(-Wstrict-aliasing);
-	cfft99_((double *)slice,work,trigsZ,ifaxZ,&inc,&jump,&nn,&lot,&isign);
-	STOP_IGNORE;
+	if (fftBackend==FFTB_FFTW) {
+		fftw_execute_dft(planZf_slice,sl,sl);
+		return;
+	}
 #endif
+	LineFFT(sl,work+THREAD_ID*workSize,trigsZ,ifaxZ,1,gridZ,gridZ,gridY,FFT_FORWARD);
 }
 
 //======================================================================================================================
@@ -527,8 +758,8 @@ void CheckNprocs(void)
 
 int fftFit(int x,int divis)
 /* find the first number >=x divisible by 2 only (Apple clFFT) or 2,3,5 only (Temperton FFT or clAMDFFT) or also
- * allowing 7 and one of 11 or 13 (FFTW3), and also divisible by 2 and divis. If weird_nprocs is used, only the latter
- * condition is required.
+ * allowing 7 (built-in FFT) and one of 11 or 13 (FFTW3), and also divisible by 2 and divis. If weird_nprocs is used,
+ * only the latter condition is required.
  */
 {
 	int y;
@@ -548,12 +779,14 @@ int fftFit(int x,int divis)
 #ifndef OPENCL
 			while (y%3==0) y/=3;
 			while (y%5==0) y/=5; // here Temperton FFT ends
-#	ifdef FFTW3
-			while (y%7==0) y/=7;
-			// one multiplier of either 11 or 13 is allowed
-			if (y%11==0) y/=11;
-			else if (y%13==0) y/=13;
-#	endif
+			if (fftBackend!=FFTB_TEMPERTON) {
+				while (y%7==0) y/=7; // here built-in FFT ends
+				// one multiplier of either 11 or 13 is allowed
+				if (fftBackend==FFTB_FFTW) {
+					if (y%11==0) y/=11;
+					else if (y%13==0) y/=13;
+				}
+			}
 #endif
 			if (y==1) return(x);
 		}
@@ -563,41 +796,341 @@ int fftFit(int x,int divis)
 
 //======================================================================================================================
 
+static double LineFFTTime(const int n,const int lot)
+/* measures the wall time (in s) per single forward FFT of size n, when lot contiguous vectors are transformed at once
+ * by the current FFT routines (as in fftX, fftY, and fftZ). The transforms are repeated until TUNE_MIN_TIME is
+ * reached. Data is zero, so it stays bounded and has no denormals.
+ */
+{
+	const size_t size=n*(size_t)lot;
+	doublecomplex *buf;
+	double *tr,*wk,t;
+	int ifax[IFAX_SIZE],rep,nrep;
+	size_t i;
+	SYSTEM_TIME tvp[2];
+#ifdef FFTW3
+	fftw_plan plan=NULL;
+	int nint=n; // this is needed to provide 'int *' to n
+#endif
+
+	MALLOC_VECTOR(buf,complex,size,ONE);
+	tr=wk=NULL;
+#ifdef FFTW3
+	if (fftBackend==FFTB_FFTW)
+		plan=fftw_plan_many_dft(1,&nint,lot,buf,NULL,1,n,buf,NULL,1,n,FFT_FORWARD,PLAN_FFTW_TUNE);
+	else
+#endif
+	{
+		MALLOC_VECTOR(tr,double,2*n,ONE);
+		MALLOC_VECTOR(wk,double,(fftBackend==FFTB_BUILTIN) ? fftmrWorkSize(n) : 2*size,ONE);
+		LineFFTInit(n,ifax,tr);
+	}
+	for (i=0;i<size;i++) buf[i]=0;
+	nrep=1;
+	while (true) {
+		GET_SYSTEM_TIME(tvp);
+		for (rep=0;rep<nrep;rep++) {
+#ifdef FFTW3
+			if (plan!=NULL) {
+				fftw_execute(plan);
+				continue;
+			}
+#endif
+			LineFFT(buf,wk,tr,ifax,1,n,n,lot,FFT_FORWARD);
+		}
+		GET_SYSTEM_TIME(tvp+1);
+		if ((t=DiffSystemTime(tvp,tvp+1))>=TUNE_MIN_TIME) break;
+		nrep*=2;
+	}
+#ifdef FFTW3
+	if (plan!=NULL) fftw_destroy_plan(plan);
+#endif
+	Free_cVector(buf);
+	Free_general(tr);
+	Free_general(wk);
+	return t/(nrep*(double)lot);
+}
+
+//======================================================================================================================
+
+static double TransposeTime(const size_t Y,const size_t Z)
+/* measures the wall time (in s) per element of transpose of YxZ complex matrix; it is used as an estimate for all
+ * element-wise operations in MatVec
+ */
+{
+	doublecomplex *buf;
+	double t;
+	int rep,nrep;
+	size_t i;
+	SYSTEM_TIME tvp[2];
+
+	MALLOC_VECTOR(buf,complex,2*Y*Z,ONE);
+	for (i=0;i<2*Y*Z;i++) buf[i]=0;
+	nrep=1;
+	while (true) {
+		GET_SYSTEM_TIME(tvp);
+		for (rep=0;rep<nrep;rep++) transpose(buf,buf+Y*Z,Y,Z,Z,Y);
+		GET_SYSTEM_TIME(tvp+1);
+		if ((t=DiffSystemTime(tvp,tvp+1))>=TUNE_MIN_TIME) break;
+		nrep*=2;
+	}
+	Free_cVector(buf);
+	return t/(nrep*(double)(Y*Z));
+}
+
+//======================================================================================================================
+
+static double PredictMatVec(const size_t gX,const size_t gY,const size_t gZ,const double tX,const double tY,
+	const double tZ,const double tE)
+/* predicted time of MatVec (for a single vector) for grid gXxgYxgZ, given the times of 1D FFTs along each axis and the
+ * time per element of element-wise operations. It counts the number of 1D FFTs (forward and backward) in fftX, fftY,
+ * and fftZ (including those for slicesR in surface mode), and the number of elements processed by TransposeYZ and
+ * multiplication by Dmatrix (and Rmatrix).
+ */
+{
+	const double sf=surface ? 1.5 : 1; // factor for additional FFTs of slicesR
+	const double nX=3.0*gZ*boxY,nY=sf*3.0*gX*gZ,nZ=sf*3.0*gX*boxY;
+	const double nE=1.5*gX*((surface ? 3 : 2)*(double)boxY*gZ+(surface ? 2 : 1)*(double)gY*gZ);
+
+	return nX*tX+nY*tY+nZ*tZ+nE*tE;
+}
+
+//======================================================================================================================
+
+static const char *FFTBackendName(void)
+// short name of the current FFT routines (as in the command line)
+{
+	switch (fftBackend) {
+		case FFTB_FFTW: return "fftw";
+		case FFTB_TEMPERTON: return "temperton";
+		case FFTB_BUILTIN: return "builtin";
+	}
+	LogError(ONE_POS,"Unknown FFT routines (%d)",(int)fftBackend);
+	return NULL; // never reached
+}
+
+//======================================================================================================================
+
+void TuneFFTGrid(void)
+/* If '-fft_tune' is used, chooses gridX, gridY, and gridZ (initially set to the minimal admissible values by fftFit)
+ * among admissible values up to TUNE_RANGE times larger, which minimize the predicted time of MatVec (PredictMatVec).
+ * For that the time of 1D FFT is measured for each candidate size with the same layout (number of simultaneously
+ * transformed vectors) as in fftX, fftY, and fftZ. Only the root processor performs the benchmark (or reads the choice
+ * from the cache file), then the result is broadcasted to all processors.
+ */
+{
+	const int div[3]={nprocs,1,2*nprocs}; // the same as in ParSetup
+	int lot[3],d,i,j,k,nc[3];
+	size_t grid[3],cand[3][TUNE_MAX_CAND],n;
+	double tLine[3][TUNE_MAX_CAND],tE,t,tBest,tMin;
+	char fname[MAX_FNAME],tmpFname[MAX_FNAME],line[MAX_LINE];
+	bool loaded;
+	FILE * restrict file;
+	SYSTEM_TIME tvp[2];
+
+	if (!fft_tune) return;
+	grid[0]=gridX;
+	grid[1]=gridY;
+	grid[2]=gridZ;
+	if (IFROOT) {
+		GET_SYSTEM_TIME(tvp);
+		// try to read the choice from cache; it is verified to be admissible for the current problem
+		loaded=false;
+		if (fft_tune_dir!=NULL) {
+			SnprintfErr(ONE_POS,fname,MAX_FNAME,"%s/"F_FFTTUNE,fft_tune_dir,boxX,boxY,boxZ,nprocs,FFTBackendName(),
+				surface ? "_surf" : "");
+			if ((file=fopen(fname,"r"))!=NULL) {
+				if (fgets(line,MAX_LINE,file)!=NULL
+					&& sscanf(line,"%zu %zu %zu %lf %lf",cand[0],cand[1],cand[2],&tBest,&tMin)==5) {
+					loaded=true;
+					for (d=0;d<3;d++) if (cand[d][0]<grid[d] || fftFit(cand[d][0],div[d])!=(int)cand[d][0])
+						loaded=false;
+				}
+				FCloseErr(file,fname,ONE_POS);
+				if (loaded) for (d=0;d<3;d++) grid[d]=cand[d][0];
+				else LogWarning(EC_WARN,ONE_POS,"Failed to read tuned FFT grid from file '%s'. It will be "
+					"overwritten",fname);
+			}
+		}
+		if (!loaded) {
+			// candidate sizes and times of 1D FFTs for them
+			lot[0]=lot[2]=boxY;
+			lot[1]=3*gridZ;
+			for (d=0;d<3;d++) {
+				nc[d]=0;
+				for (n=grid[d];n<=TUNE_RANGE*grid[d] && nc[d]<TUNE_MAX_CAND;n=fftFit(n+1,div[d])) {
+					cand[d][nc[d]]=n;
+					tLine[d][nc[d]]=LineFFTTime(n,lot[d]);
+					nc[d]++;
+				}
+			}
+			tE=TransposeTime(gridY,gridZ);
+			// exhaustive search over all combinations; the first candidates are the minimal ones
+			tMin=tBest=PredictMatVec(cand[0][0],cand[1][0],cand[2][0],tLine[0][0],tLine[1][0],tLine[2][0],tE);
+			for (i=0;i<nc[0];i++) for (j=0;j<nc[1];j++) for (k=0;k<nc[2];k++) {
+				t=PredictMatVec(cand[0][i],cand[1][j],cand[2][k],tLine[0][i],tLine[1][j],tLine[2][k],tE);
+				if (t<tBest) {
+					tBest=t;
+					grid[0]=cand[0][i];
+					grid[1]=cand[1][j];
+					grid[2]=cand[2][k];
+				}
+			}
+			// the file is first written under temporary name and then renamed (see also WisdomExport)
+			if (fft_tune_dir!=NULL) {
+				SnprintfErr(ONE_POS,tmpFname,MAX_FNAME,"%s"F_FFTTUNE_TMP,fname);
+				if ((file=fopen(tmpFname,"w"))==NULL) {
+					MkDirErr(fft_tune_dir,ONE_POS);
+					file=FOpenErr(tmpFname,"w",ONE_POS);
+				}
+				fprintf(file,"%zu %zu %zu %g %g\n",grid[0],grid[1],grid[2],tBest,tMin);
+				FCloseErr(file,tmpFname,ONE_POS);
+				if (rename(tmpFname,fname)!=0)
+					LogWarning(EC_WARN,ONE_POS,"Failed to rename file '%s' into '%s'",tmpFname,fname);
+			}
+		}
+		GET_SYSTEM_TIME(tvp+1);
+		fprintf(logfile,"FFT grid tuned%s: %zux%zux%zu, predicted MatVec time is "GFORMDEF" s ("GFORMDEF" s for "
+			"minimal grid %zux%zux%zu); tuning time %.2f s\n",loaded ? " (read from cache)" : "",grid[0],grid[1],
+			grid[2],tBest,tMin,gridX,gridY,gridZ,DiffSystemTime(tvp,tvp+1));
+	}
+	MyBcast(grid,sizet_type,3,NULL);
+	gridX=grid[0];
+	gridY=grid[1];
+	gridZ=grid[2];
+}
+
+//======================================================================================================================
+
+#ifdef FFTW3
+
+static void WisdomImport(void)
+/* sets planner flags and, if wisdom cache is used, imports FFTW wisdom from the file. Its name contains grid
+ * dimensions, number of processors, and version of FFTW library, since wisdom is specific to all of them (in
+ * particular, it is not portable between different builds of FFTW). All processors import wisdom, but only the root
+ * remembers it to test for changes in WisdomExport.
+ */
+{
+	FILE * restrict file;
+	char ver[MAX_LINE],line[MAX_LINE];
+	size_t i;
+
+	planFlag=PLAN_FFTW;
+	planFlagDm=PLAN_FFTW_DM;
+	wisdomImported=NULL;
+	wisdomTime=0;
+	if (wisdom_dir==NULL) return;
+	// measuring is affordable for Dmatrix plans, since it is done only once and then reused
+	if (wisdom_patient) planFlag=FFTW_PATIENT;
+	planFlagDm=planFlag;
+	// replace all symbols of version string, which may cause problems in file name
+	strncpy(ver,fftw_version,MAX_LINE-1);
+	ver[MAX_LINE-1]='\0';
+	for (i=0;ver[i]!='\0';i++) if (!isalnum((unsigned char)ver[i]) && ver[i]!='.' && ver[i]!='-') ver[i]='_';
+	SnprintfErr(ALL_POS,wisdomFname,MAX_FNAME,"%s/"F_WISDOM,wisdom_dir,gridX,gridY,gridZ,nprocs,ver);
+	if ((file=fopen(wisdomFname,"r"))==NULL) {
+		if (IFROOT) fprintf(logfile,"FFTW wisdom file '%s' not found, it will be created\n",wisdomFname);
+		return;
+	}
+	// the first line contains the planning time, then the wisdom itself follows (in FFTW format)
+	if (fgets(line,MAX_LINE,file)==NULL || sscanf(line,WISDOM_HEADER"%lf",&wisdomTime)!=1
+		|| !fftw_import_wisdom_from_file(file)) {
+		LogWarning(EC_WARN,ONE_POS,"Failed to import FFTW wisdom from file '%s'. It will be overwritten",wisdomFname);
+		fftw_forget_wisdom();
+		wisdomTime=0;
+	}
+	else if (IFROOT) {
+		wisdomImported=fftw_export_wisdom_to_string();
+		fprintf(logfile,"FFTW wisdom imported from file '%s'\n",wisdomFname);
+	}
+	FCloseErr(file,wisdomFname,ALL_POS);
+}
+
+//======================================================================================================================
+
+static void WisdomExport(void)
+/* if wisdom cache is used, estimates the planning time saved by imported wisdom and exports wisdom to the file, if it
+ * was changed during planning. Only the root processor (of the first process group) does it, since all processors plan
+ * the same transforms.
+ */
+{
+	FILE * restrict file;
+	char *wisdom;
+	char tmpFname[MAX_FNAME];
+
+	if (wisdom_dir==NULL || !IFROOT || group_id!=0) return;
+	if (wisdomImported!=NULL) Timing_FFTWSaved=MAX(wisdomTime-Timing_FFTWPlan,0);
+	wisdom=fftw_export_wisdom_to_string();
+	if (wisdomImported==NULL || strcmp(wisdom,wisdomImported)!=0) {
+		// stored time corresponds to planning from scratch, i.e. it accumulates the time of all partial planning
+		wisdomTime+=Timing_FFTWPlan;
+		/* the file is first written under temporary name and then renamed, so that other ADDA instances (running
+		 * simultaneously) never encounter partially-written file
+		 */
+		SnprintfErr(ONE_POS,tmpFname,MAX_FNAME,"%s"F_WISDOM_TMP,wisdomFname);
+		if ((file=fopen(tmpFname,"w"))==NULL) {
+			MkDirErr(wisdom_dir,ONE_POS);
+			file=FOpenErr(tmpFname,"w",ONE_POS);
+		}
+		fprintf(file,WISDOM_HEADER"%.4f\n",wisdomTime);
+		fftw_export_wisdom_to_file(file);
+		FCloseErr(file,tmpFname,ONE_POS);
+		if (rename(tmpFname,wisdomFname)!=0)
+			LogWarning(EC_WARN,ONE_POS,"Failed to rename file '%s' into '%s'",tmpFname,wisdomFname);
+		else fprintf(logfile,"FFTW wisdom exported to file '%s'\n",wisdomFname);
+	}
+	fftw_free(wisdom);
+	if (wisdomImported!=NULL) fftw_free(wisdomImported);
+}
+
+#endif // FFTW3
+
+//======================================================================================================================
+
 static void fftInitBeforeD(void)
 // initialize fft before initialization of Dmatrix
 {
+	size_t size;
 #ifdef FFTW3
 	int grXint=gridX,grYint=gridY,grZint=gridZ; // this is needed to provide 'int *' to grids
-
-	D("FFTW library version: %s\n     compiler: %s\n     codelet optimizations: %s",fftw_version,fftw_cc,
-		fftw_codelet_optim);
-	planYf_slice=fftw_plan_many_dft(1,&grYint,gridZ,slice_tr,NULL,1,gridY,slice_tr,NULL,1,gridY,FFT_FORWARD,
-		PLAN_FFTW_DM);
-	planZf_slice=fftw_plan_many_dft(1,&grZint,gridY,slice,NULL,1,gridZ,slice,NULL,1,gridZ,FFT_FORWARD,PLAN_FFTW_DM);
-	planXf_Dm=fftw_plan_many_dft(1,&grXint,lz_Dm*D2sizeY,D2matrix,NULL,1,gridX,D2matrix,NULL,1,gridX,FFT_FORWARD,
-		PLAN_FFTW_DM);
-	// very similar to Dm, but local_Nz_Rm can be smaller by 1 than lz_Rm
-	if (surface) planXf_Rm=fftw_plan_many_dft(1,&grXint,local_Nz_Rm*R2sizeY,R2matrix,NULL,1,gridX,R2matrix,NULL,1,gridX,
-		FFT_FORWARD,PLAN_FFTW_DM);
-#elif defined(FFT_TEMPERTON)
-	int nn;
-	size_t size;
-
-	// allocate memory
+	SYSTEM_TIME tvp[2];
+
+	if (fftBackend==FFTB_FFTW) {
+		D("FFTW library version: %s\n     compiler: %s\n     codelet optimizations: %s",fftw_version,fftw_cc,
+			fftw_codelet_optim);
+		WisdomImport();
+		if (dmLoaded) return; // plans for Dmatrix are not needed
+		GET_SYSTEM_TIME(tvp);
+		planYf_slice=fftw_plan_many_dft(1,&grYint,gridZ,slice_tr,NULL,1,gridY,slice_tr,NULL,1,gridY,FFT_FORWARD,
+			planFlagDm);
+		planZf_slice=fftw_plan_many_dft(1,&grZint,gridY,slice,NULL,1,gridZ,slice,NULL,1,gridZ,FFT_FORWARD,
+			planFlagDm);
+		// X plans transform a single z-layer, see fftX_Dm
+		planXf_Dm=fftw_plan_many_dft(1,&grXint,D2sizeY,D2matrix,NULL,1,gridX,D2matrix,NULL,1,gridX,FFT_FORWARD,
+			planFlagDm);
+		if (surface) planXf_Rm=fftw_plan_many_dft(1,&grXint,R2sizeY,R2matrix,NULL,1,gridX,R2matrix,NULL,1,gridX,
+			FFT_FORWARD,planFlagDm);
+		GET_SYSTEM_TIME(tvp+1);
+		Timing_FFTWPlan=DiffSystemTime(tvp,tvp+1);
+		return;
+	}
+#endif
+	// line-based routines (Temperton or built-in); allocate memory
 	MALLOC_VECTOR(trigsX,double,2*gridX,ALL);
 	MALLOC_VECTOR(trigsY,double,2*gridY,ALL);
 	MALLOC_VECTOR(trigsZ,double,2*gridZ,ALL);
-	size=MAX(gridX*D2sizeY,3*gridYZ);
-	if (surface) size=MAX(size,gridX*R2sizeY);
-	MALLOC_VECTOR(work,double,2*size,ALL);
+	// built-in FFT processes a few lines at a time, so its work array is much smaller
+	if (fftBackend==FFTB_BUILTIN) workSize=fftmrWorkSize(MAX(gridX,MAX(gridY,gridZ)));
+	else {
+		size=MAX(gridX*D2sizeY,3*mvBatch*gridYZ);
+		if (surface) size=MAX(size,gridX*R2sizeY);
+		workSize=2*size;
+	}
+	MALLOC_VECTOR(work,double,nthreads*workSize,ALL);
 	// initialize ifax and trigs
-	nn=gridX;
-	cftfax_(&nn,ifaxX,trigsX);
-	nn=gridY;
-	cftfax_(&nn,ifaxY,trigsY);
-	nn=gridZ;
-	cftfax_(&nn,ifaxZ,trigsZ);
-#endif
+	LineFFTInit(gridX,ifaxX,trigsX);
+	LineFFTInit(gridY,ifaxY,trigsY);
+	LineFFTInit(gridZ,ifaxZ,trigsZ);
 }
 
 //======================================================================================================================
@@ -737,56 +1270,134 @@ static void fftInitAfterD(void)
 		DiffSystemTime(tvp,tvp+1),DiffSystemTime(tvp,tvp+3),DiffSystemTime(tvp+1,tvp+2),DiffSystemTime(tvp+2,tvp+3));
 #	endif
 #elif defined(FFTW3) // this is not needed when OpenCL is used
-	int lot;
+	int lot,t,p,nc;
+	size_t sh,z0,z1;
 	fftw_iodim dims,howmany_dims[2];
 	int grYint=gridY; // this is needed to provide 'int *' to gridY
-#	ifdef PRECISE_TIMING
+	size_t planSize;
 	SYSTEM_TIME tvp[7];
-#	endif
+
+	if (fftBackend!=FFTB_FFTW) return; // line-based routines need no further initialization
 	if (IFROOT) printf("Initializing FFTW3\n");
-#	ifdef PRECISE_TIMING
+	/* allocate arrays of plans, one per thread (or per chunk for X plans); the second set of plans is for transforming
+	 * mvBatch vectors at once (in MatVecBatch)
+	 */
+	nPlans=(mvBatch>1) ? 2*nthreads : nthreads;
+	planSize=nPlans*sizeof(fftw_plan);
+	planXf=(fftw_plan *)voidVector(planSize,ALL_POS,"planXf");
+	planXb=(fftw_plan *)voidVector(planSize,ALL_POS,"planXb");
+	planYf=(fftw_plan *)voidVector(planSize,ALL_POS,"planYf");
+	planYb=(fftw_plan *)voidVector(planSize,ALL_POS,"planYb");
+	planZf=(fftw_plan *)voidVector(planSize,ALL_POS,"planZf");
+	planZb=(fftw_plan *)voidVector(planSize,ALL_POS,"planZb");
+	if (surface) {
+		planYRf=(fftw_plan *)voidVector(planSize,ALL_POS,"planYRf");
+		planZRf=(fftw_plan *)voidVector(planSize,ALL_POS,"planZRf");
+	}
+	/* Planning is not thread-safe in FFTW3, so all plans are created here serially. Plans for threads other than the
+	 * first one are for the same problems, hence they are created very fast (using wisdom accumulated by FFTW). Several
+	 * vectors are transformed by a single plan simply by considering all their components together (3*nv in total).
+	 */
 	GET_SYSTEM_TIME(tvp);
-#	endif
-	lot=3*gridZ;
-	planYf=fftw_plan_many_dft(1,&grYint,lot,slices_tr,NULL,1,gridY,slices_tr,NULL,1,gridY,FFT_FORWARD,PLAN_FFTW);
-	if (surface) // same operation, but applied to slicesR_tr
-		planYRf=fftw_plan_many_dft(1,&grYint,lot,slicesR_tr,NULL,1,gridY,slicesR_tr,NULL,1,gridY,FFT_FORWARD,PLAN_FFTW);
+	/* With '-no_yz_transpose' Y plans are applied directly to slices (and slicesR) with stride gridZ, looping over z
+	 * (with unit stride) and over components. Other plans do not depend on this option.
+	 */
+	if (!yz_transpose) {
+		dims.n=gridY;
+		dims.is=dims.os=gridZ;
+		howmany_dims[0].is=howmany_dims[0].os=gridYZ;
+		howmany_dims[1].n=gridZ;
+		howmany_dims[1].is=howmany_dims[1].os=1;
+	}
+	for (p=0;p<nPlans;p++) {
+		t=p%nthreads;
+		lot=3*PlanNv(p)*gridZ;
+		sh=3*mvBatch*t*gridYZ;
+		if (!yz_transpose) {
+			howmany_dims[0].n=3*PlanNv(p);
+			planYf[p]=fftw_plan_guru_dft(1,&dims,2,howmany_dims,slices+sh,slices+sh,FFT_FORWARD,planFlag);
+			planYb[p]=fftw_plan_guru_dft(1,&dims,2,howmany_dims,slices+sh,slices+sh,FFT_BACKWARD,planFlag);
+			if (surface)
+				planYRf[p]=fftw_plan_guru_dft(1,&dims,2,howmany_dims,slicesR+sh,slicesR+sh,FFT_FORWARD,planFlag);
+			continue;
+		}
+		planYf[p]=fftw_plan_many_dft(1,&grYint,lot,slices_tr+sh,NULL,1,gridY,slices_tr+sh,NULL,1,gridY,FFT_FORWARD,
+			planFlag);
+		if (surface) // same operation, but applied to slicesR_tr
+			planYRf[p]=fftw_plan_many_dft(1,&grYint,lot,slicesR_tr+sh,NULL,1,gridY,slicesR_tr+sh,NULL,1,gridY,
+				FFT_FORWARD,planFlag);
+	}
 #	ifdef PRECISE_TIMING
 	GET_SYSTEM_TIME(tvp+1);
 #	endif
-	planYb=fftw_plan_many_dft(1,&grYint,lot,slices_tr,NULL,1,gridY,slices_tr,NULL,1,gridY,FFT_BACKWARD,PLAN_FFTW);
+	if (yz_transpose) for (p=0;p<nPlans;p++) { // planYb is created above otherwise
+		t=p%nthreads;
+		lot=3*PlanNv(p)*gridZ;
+		sh=3*mvBatch*t*gridYZ;
+		planYb[p]=fftw_plan_many_dft(1,&grYint,lot,slices_tr+sh,NULL,1,gridY,slices_tr+sh,NULL,1,gridY,FFT_BACKWARD,
+			planFlag);
+	}
 #	ifdef PRECISE_TIMING
 	GET_SYSTEM_TIME(tvp+2);
 #	endif
 	dims.n=gridZ;
 	dims.is=dims.os=1;
-	howmany_dims[0].n=3;
 	howmany_dims[0].is=howmany_dims[0].os=gridZ*gridY;
 	howmany_dims[1].n=boxY;
 	howmany_dims[1].is=howmany_dims[1].os=gridZ;
-	planZf=fftw_plan_guru_dft(1,&dims,2,howmany_dims,slices,slices,FFT_FORWARD,PLAN_FFTW);
-	// same operation but for slicesR and inverse transform (since correlation is computed instead of convolution)
-	if (surface) planZRf=fftw_plan_guru_dft(1,&dims,2,howmany_dims,slicesR,slicesR,FFT_BACKWARD,PLAN_FFTW);
+	for (p=0;p<nPlans;p++) {
+		t=p%nthreads;
+		howmany_dims[0].n=3*PlanNv(p);
+		sh=3*mvBatch*t*gridYZ;
+		planZf[p]=fftw_plan_guru_dft(1,&dims,2,howmany_dims,slices+sh,slices+sh,FFT_FORWARD,planFlag);
+		// same operation but for slicesR and inverse transform (since correlation is computed instead of convolution)
+		if (surface)
+			planZRf[p]=fftw_plan_guru_dft(1,&dims,2,howmany_dims,slicesR+sh,slicesR+sh,FFT_BACKWARD,planFlag);
+	}
 #	ifdef PRECISE_TIMING
 	GET_SYSTEM_TIME(tvp+3);
 #	endif
-	planZb=fftw_plan_guru_dft(1,&dims,2,howmany_dims,slices,slices,FFT_BACKWARD,PLAN_FFTW);
+	for (p=0;p<nPlans;p++) {
+		t=p%nthreads;
+		howmany_dims[0].n=3*PlanNv(p);
+		sh=3*mvBatch*t*gridYZ;
+		planZb[p]=fftw_plan_guru_dft(1,&dims,2,howmany_dims,slices+sh,slices+sh,FFT_BACKWARD,planFlag);
+	}
 #	ifdef PRECISE_TIMING
 	GET_SYSTEM_TIME(tvp+4);
 #	endif
+	// X plans are divided into chunks along the combined index of component and z (total 3*nv*local_Nz)
 	dims.n=gridX;
 	dims.is=dims.os=1;
-	howmany_dims[0].n=3*local_Nz;
 	howmany_dims[0].is=howmany_dims[0].os=smallY*gridX;
 	howmany_dims[1].n=boxY;
 	howmany_dims[1].is=howmany_dims[1].os=gridX;
-	planXf=fftw_plan_guru_dft(1,&dims,2,howmany_dims,Xmatrix,Xmatrix,FFT_FORWARD,PLAN_FFTW);
+	for (p=0;p<nPlans;p++) {
+		t=p%nthreads;
+		nc=3*PlanNv(p);
+		z0=ChunkStart(nc*local_Nz,t);
+		z1=ChunkStart(nc*local_Nz,t+1);
+		howmany_dims[0].n=z1-z0;
+		sh=z0*smallY*gridX;
+		if (z1>z0) planXf[p]=fftw_plan_guru_dft(1,&dims,2,howmany_dims,Xmatrix+sh,Xmatrix+sh,FFT_FORWARD,planFlag);
+		else planXf[p]=NULL;
+	}
 #	ifdef PRECISE_TIMING
 	GET_SYSTEM_TIME(tvp+5);
 #	endif
-	planXb=fftw_plan_guru_dft(1,&dims,2,howmany_dims,Xmatrix,Xmatrix,FFT_BACKWARD,PLAN_FFTW);
-#	ifdef PRECISE_TIMING
+	for (p=0;p<nPlans;p++) {
+		t=p%nthreads;
+		nc=3*PlanNv(p);
+		z0=ChunkStart(nc*local_Nz,t);
+		z1=ChunkStart(nc*local_Nz,t+1);
+		howmany_dims[0].n=z1-z0;
+		sh=z0*smallY*gridX;
+		if (z1>z0) planXb[p]=fftw_plan_guru_dft(1,&dims,2,howmany_dims,Xmatrix+sh,Xmatrix+sh,FFT_BACKWARD,planFlag);
+		else planXb[p]=NULL;
+	}
 	GET_SYSTEM_TIME(tvp+6);
+	Timing_FFTWPlan+=DiffSystemTime(tvp,tvp+6);
+#	ifdef PRECISE_TIMING
 	// print precise timing of FFT planning
 	if (IFROOT) PrintBoth(logfile,
 		"~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\n"
@@ -803,19 +1414,199 @@ static void fftInitAfterD(void)
 #	endif
 #endif
 #ifdef FFTW3
-	// destroy old (D,R-matrix) plans; also in OpenCL mode
-	fftw_destroy_plan(planXf_Dm);
-	fftw_destroy_plan(planYf_slice);
-	fftw_destroy_plan(planZf_slice);
-	if (surface) fftw_destroy_plan(planXf_Rm);
+	if (fftBackend==FFTB_FFTW) {
+		WisdomExport();
+		// destroy old (D,R-matrix) plans; also in OpenCL mode
+		if (!dmLoaded) {
+			fftw_destroy_plan(planXf_Dm);
+			fftw_destroy_plan(planYf_slice);
+			fftw_destroy_plan(planZf_slice);
+			if (surface) fftw_destroy_plan(planXf_Rm);
+		}
 #	ifdef OPENCL // in this case, FFTW ends here
-	fftw_cleanup();
+		fftw_cleanup();
 #	endif
+	}
 #endif
 }
 
 //======================================================================================================================
 
+static void DmCacheInit(const size_t Dsize)
+/* builds the description of all parameters, on which Dmatrix and Rmatrix depend, and the name of the cache file. In
+ * particular, the refractive index is included only for interaction formulations, which depend on it. This description
+ * is stored in the header of the file and compared upon loading. If the name is not given explicitly, it is determined
+ * by (64-bit FNV-1a) hash of the description. In parallel mode each processor uses its own file.
+ */
+{
+	size_t shift,i;
+	uint64_t hash;
+
+	shift=SnprintfErr(ALL_POS,dmCacheKey,DM_CACHE_HEADER,DM_CACHE_MAGIC"\n"
+		"grid=%zux%zux%zu box=%dx%dx%d nprocs=%d reduced_FFT=%d doublecomplex=%zu Dsize=%zu\n"
+		"WaveNum="GFORM_EXACT" gridspace="GFORM_EXACT" int=%d igt=("GFORM_EXACT","GFORM_EXACT")\n"
+		"nloc_Rp="GFORM_EXACT"\n",
+		gridX,gridY,gridZ,boxX,boxY,boxZ,nprocs,(int)reduced_FFT,sizeof(doublecomplex),Dsize,
+		WaveNum,gridspace,(int)IntRelation,igt_lim,igt_eps,nloc_Rp);
+	if (IntRelation==G_SO || IntRelation==G_IGT_SO) shift=SnprintfShiftErr(ALL_POS,shift,dmCacheKey,DM_CACHE_HEADER,
+		"m=("GFORM_EXACT","GFORM_EXACT")\n",REIM(ref_index[0]));
+	if (surface) SnprintfShiftErr(ALL_POS,shift,dmCacheKey,DM_CACHE_HEADER,
+		"surf=%d hsub="GFORM_EXACT" msub=("GFORM_EXACT","GFORM_EXACT") ZsumShift="GFORM_EXACT" Rsize=%zu\n",
+		(int)ReflRelation,hsub,msubInf ? INFINITY : creal(msub),msubInf ? 0 : cimag(msub),ZsumShift,Rsize);
+	if (dm_cache_dir) {
+		hash=UINT64_C(14695981039346656037);
+		for (i=0;dmCacheKey[i]!='\0';i++) {
+			hash^=(unsigned char)dmCacheKey[i];
+			hash*=UINT64_C(1099511628211);
+		}
+		shift=SnprintfErr(ALL_POS,dmCacheFname,MAX_FNAME,"%s/"F_DMCACHE,dm_cache,(unsigned long)(hash>>32),
+			(unsigned long)(hash&UINT32_MAX));
+	}
+	else shift=SnprintfErr(ALL_POS,dmCacheFname,MAX_FNAME,"%s",dm_cache);
+#ifdef PARALLEL
+	SnprintfShiftErr(ALL_POS,shift,dmCacheFname,MAX_FNAME,".%d",ringid);
+#endif
+}
+
+//======================================================================================================================
+
+static bool DmCacheLoad(const size_t Dsize)
+/* tries to load Dmatrix and Rmatrix from cache file, returns true if successful on all processors. The file is either
+ * memory-mapped or read into allocated memory (see DM_CACHE_MMAP).
+ */
+{
+	FILE * restrict file;
+	char header[DM_CACHE_HEADER];
+	size_t Rsize_loc,fsize;
+	int nloaded;
+	bool ok;
+
+	Rsize_loc = surface ? Rsize : 0;
+	fsize=DM_CACHE_HEADER+(Dsize+Rsize_loc)*sizeof(doublecomplex);
+	ok=false;
+	// header is read by standard functions, and compared with the expected one
+	if ((file=fopen(dmCacheFname,"rb"))!=NULL) {
+		if (fread(header,1,DM_CACHE_HEADER,file)==DM_CACHE_HEADER && strncmp(header,dmCacheKey,DM_CACHE_HEADER)==0
+			&& TestFileSize(dmCacheFname,fsize)) ok=true;
+		else LogWarning(EC_WARN,ALL_POS,"Cache file '%s' does not match current parameters (or is corrupted). It will "
+			"be overwritten",dmCacheFname);
+#ifndef DM_CACHE_MMAP
+		if (ok) {
+			MALLOC_VECTOR(Dmatrix,complex,Dsize,ALL);
+			if (surface) MALLOC_VECTOR(Rmatrix,complex,Rsize,ALL);
+			fseek(file,DM_CACHE_HEADER,SEEK_SET);
+			if (fread(Dmatrix,sizeof(doublecomplex),Dsize,file)!=Dsize
+				|| (surface && fread(Rmatrix,sizeof(doublecomplex),Rsize,file)!=Rsize))
+				LogError(ALL_POS,"Failed to read cache file '%s'",dmCacheFname);
+		}
+#endif
+		FCloseErr(file,dmCacheFname,ALL_POS);
+	}
+#ifdef DM_CACHE_MMAP
+	if (ok) {
+		int fd;
+		// read-only private mapping is sufficient, since the matrices are not changed afterwards
+		if ((fd=open(dmCacheFname,O_RDONLY))==-1 ||
+			(dmCacheMap=mmap(NULL,fsize,PROT_READ,MAP_PRIVATE,fd,0))==MAP_FAILED) {
+			LogWarning(EC_WARN,ALL_POS,"Failed to map cache file '%s' into memory",dmCacheFname);
+			dmCacheMap=NULL;
+			ok=false;
+		}
+		else {
+			dmCacheMapSize=fsize;
+			Dmatrix=(doublecomplex *)((char *)dmCacheMap+DM_CACHE_HEADER);
+			if (surface) Rmatrix=Dmatrix+Dsize;
+		}
+		if (fd!=-1) close(fd);
+	}
+#endif
+	// all processors should agree, since the computation of the matrices is collective
+	nloaded = ok ? 1 : 0;
+	MyInnerProduct(&nloaded,int_type,1,NULL);
+	if (nloaded==nprocs) {
+		if (IFROOT) PrintBoth(logfile,"Dmatrix%s loaded from cache file '%s'\n",surface ? " and Rmatrix" : "",
+			dmCacheFname);
+		return true;
+	}
+	// otherwise release whatever was loaded
+	if (ok) {
+#ifdef DM_CACHE_MMAP
+		munmap(dmCacheMap,dmCacheMapSize);
+		dmCacheMap=NULL;
+#else
+		Free_cVector(Dmatrix);
+		if (surface) Free_cVector(Rmatrix);
+#endif
+	}
+	return false;
+}
+
+//======================================================================================================================
+
+static void DmCacheWrite(const doublecomplex * restrict data,const size_t size,const bool first,const bool last)
+/* writes matrix 'data' to the cache file, either creating it (if 'first') or appending. The file is written under
+ * temporary name, which is renamed in the end (if 'last'), so that it is never left partially written.
+ */
+{
+	FILE * restrict file;
+	char tmpFname[MAX_FNAME];
+
+	SnprintfErr(ALL_POS,tmpFname,MAX_FNAME,"%s"F_DMCACHE_TMP,dmCacheFname);
+	if (first) {
+		/* directory (if its name is known) is created by root only if needed, but before any other processor opens its
+		 * file. Synchronization is performed on all processors, since the failure of fopen may differ among them.
+		 */
+		file=NULL;
+		if (dm_cache_dir) {
+			if (IFROOT && (file=fopen(tmpFname,"wb"))==NULL) MkDirErr(dm_cache,ONE_POS);
+			Synchronize();
+		}
+		if (file==NULL) file=FOpenErr(tmpFname,"wb",ALL_POS);
+		if (fwrite(dmCacheKey,1,DM_CACHE_HEADER,file)!=DM_CACHE_HEADER)
+			LogError(ALL_POS,"Failed writing to file '%s'",tmpFname);
+	}
+	else file=FOpenErr(tmpFname,"ab",ALL_POS);
+	if (fwrite(data,sizeof(doublecomplex),size,file)!=size) LogError(ALL_POS,"Failed writing to file '%s'",tmpFname);
+	FCloseErr(file,tmpFname,ALL_POS);
+	if (last) {
+		if (rename(tmpFname,dmCacheFname)!=0)
+			LogWarning(EC_WARN,ALL_POS,"Failed to rename file '%s' into '%s'",tmpFname,dmCacheFname);
+		else if (IFROOT) fprintf(logfile,"Dmatrix%s saved to cache file '%s'\n",surface ? " and Rmatrix" : "",
+			dmCacheFname);
+	}
+}
+
+//======================================================================================================================
+
+#ifdef OPENCL
+static void RmatrixToOCL(void)
+// sets surface-related kernel arguments and copies Rmatrix to OpenCL buffer (freeing host copy)
+{
+	// Setting kernel arguments which are always the same
+	// for arith3_surface
+	CL_CH_ERR(clSetKernelArg(clarith3_surface,0,sizeof(cl_mem),&bufslices_tr));
+	CL_CH_ERR(clSetKernelArg(clarith3_surface,1,sizeof(cl_mem),&bufDmatrix));
+	CL_CH_ERR(clSetKernelArg(clarith3_surface,2,sizeof(size_t),&smallY));
+	CL_CH_ERR(clSetKernelArg(clarith3_surface,3,sizeof(size_t),&smallZ));
+	CL_CH_ERR(clSetKernelArg(clarith3_surface,4,sizeof(size_t),&gridX));
+	CL_CH_ERR(clSetKernelArg(clarith3_surface,5,sizeof(size_t),&DsizeY));
+	CL_CH_ERR(clSetKernelArg(clarith3_surface,6,sizeof(size_t),&DsizeZ));
+	CL_CH_ERR(clSetKernelArg(clarith3_surface,11,sizeof(cl_mem),&bufslicesR_tr));
+	CL_CH_ERR(clSetKernelArg(clarith3_surface,12,sizeof(cl_mem),&bufRmatrix));
+	// for transpose forward (backward are not needed for surface)
+	CL_CH_ERR(clSetKernelArg(cltransposeofR,0,sizeof(cl_mem),&bufslicesR));
+	CL_CH_ERR(clSetKernelArg(cltransposeofR,1,sizeof(cl_mem),&bufslicesR_tr));
+	CL_CH_ERR(clSetKernelArg(cltransposeofR,2,sizeof(size_t),&gridZ));
+	CL_CH_ERR(clSetKernelArg(cltransposeofR,3,sizeof(size_t),&gridY));
+	CL_CH_ERR(clSetKernelArg(cltransposeofR,4,17*16*sizeof(doublecomplex),NULL));
+	// copy Rmatrix to OpenCL buffer, blocking to ensure completion before function end
+	CL_CH_ERR(clEnqueueWriteBuffer(command_queue,bufRmatrix,CL_TRUE,0,Rsize*sizeof(*Rmatrix),Rmatrix,0,NULL,NULL));
+	Free_cVector(Rmatrix);
+}
+#endif
+
+//======================================================================================================================
+
 static void InitRmatrix(const double invNgrid)
 /* Initializes the matrix R. R[i][j][k]=GR[i1-i2][j1-j2][k1+k2]. Actually R=-FFT(GR)/Ngrid. Then -GR.x=invFFT(R*FFT(x))
  * for practical implementation of FFT such that invFFT(FFT(x))=Ngrid*x. GR is exactly reflected Green's tensor. The
@@ -825,6 +1616,7 @@ static void InitRmatrix(const double invNgrid)
 {
 	int i,j,k,Rcomp;
 	size_t x,y,z,indexfrom,indexto,ind,index;
+	TIME_TYPE tstart,tFFT,tTr;
 
 	// allocate memory for Rmatrix (R2matrix is allocated earlier in InitDmatrix)
 	MALLOC_VECTOR(Rmatrix,complex,Rsize,ALL);
@@ -843,23 +1635,38 @@ static void InitRmatrix(const double invNgrid)
 	 * faster than using a lot of conditionals
 	 */
 	for (ind=0;ind<Rsize;ind++) Rmatrix[ind]=0;
-	// fill Rmatrix with values of reflected Green's tensor
+	// fill Rmatrix with values of reflected Green's tensor; thrSafe is set in InitDmatrix
+	tstart=GET_TIME();
+#pragma omp parallel for schedule(dynamic) if(thrSafe) private(i,j,index)
 	for(k=0;k<local_Nz_Rm;k++) for (j=jstartR;j<boxY;j++) for (i=1-boxX;i<boxX;i++) {
 			index=NDCOMP*Index2matrix(i,j,k,R2sizeY);
 			(*ReflTerm_int)(i,j,k,Rmatrix+index);
 	} // end of i,j,k loop
+	Timing_DmGcalc+=GET_TIME()-tstart;
 	if (IFROOT) printf("Fourier transform of Rmatrix");
 	for(Rcomp=0;Rcomp<NDCOMP;Rcomp++) { // main cycle over components of Rmatrix
 		// fill R2matrix with precomputed values from Rmatrix
 		for (ind=0;ind<R2sizeTot;ind++) R2matrix[ind]=Rmatrix[NDCOMP*ind+Rcomp];
+		tstart=GET_TIME();
 		fftX_Rm(); // fftX R2matrix
+		Timing_DmFFT+=GET_TIME()-tstart;
+		tstart=GET_TIME();
 		BlockTranspose_DRm(R2matrix,R2sizeY,lz_Rm);
+		Timing_DmTransp+=GET_TIME()-tstart;
+		// the same parallelization, as in InitDmatrix
+		tFFT=tTr=0;
+#pragma omp parallel private(j,k,y,z,ind,indexfrom,indexto) reduction(+:tFFT,tTr)
+		{
+		doublecomplex * restrict sl=slice+THREAD_ID*gridYZ;
+		doublecomplex * restrict sl_tr=slice_tr+THREAD_ID*gridYZ;
+		TIME_TYPE tstart_thr;
+#pragma omp for schedule(static)
 		for(x=local_x0;x<local_x1;x++) {
-			for (ind=0;ind<gridYZ;ind++) slice[ind]=0.0; // fill slice with 0.0
+			for (ind=0;ind<gridYZ;ind++) sl[ind]=0.0; // fill slice with 0.0
 			for(j=jstartR;j<boxY;j++) for(k=0;k<2*boxZ-1;k++) {
 				indexfrom=IndexGarbledR(x,j,k);
 				indexto=IndexSliceR2matrix(j,k);
-				slice[indexto]=R2matrix[indexfrom];
+				sl[indexto]=R2matrix[indexfrom];
 			}
 			/* here a specific symmetry is used, that elements of R depend on direction y/|rho| either as even order
 			 * (0 or 2) or as odd (1) - the latter are elements 1 and 4 (see GetSomIntegral in interaction.c)
@@ -868,18 +1675,27 @@ static void InitRmatrix(const double invNgrid)
 				// mirror along y
 				indexfrom=IndexSliceR2matrix(j,k);
 				indexto=IndexSliceR2matrix(-j,k);
-				if (Rcomp==1 || Rcomp==4) slice[indexto]=-slice[indexfrom];
-				else slice[indexto]=slice[indexfrom];
+				if (Rcomp==1 || Rcomp==4) sl[indexto]=-sl[indexfrom];
+				else sl[indexto]=sl[indexfrom];
 			}
-			fftZ_slice(); // fftZ slice
-			transpose(slice,slice_tr,gridY,gridZ);
-			fftY_slice(); // fftY slice_tr
+			tstart_thr=GET_TIME();
+			fftZ_slice(sl); // fftZ slice
+			tFFT+=GET_TIME()-tstart_thr;
+			tstart_thr=GET_TIME();
+			transpose(sl,sl_tr,gridY,gridZ,gridZ,gridY);
+			tTr+=GET_TIME()-tstart_thr;
+			tstart_thr=GET_TIME();
+			fftY_slice(sl_tr); // fftY slice_tr
+			tFFT+=GET_TIME()-tstart_thr;
 			for(z=0;z<gridZ;z++) for(y=0;y<RsizeY;y++) {
 				indexto=IndexRmatrix(x-local_x0,y,z)+Rcomp;
 				indexfrom=IndexSlice_zy(y,z);
-				Rmatrix[indexto]=-invNgrid*slice_tr[indexfrom];
+				Rmatrix[indexto]=-invNgrid*sl_tr[indexfrom];
 			}
 		} // end slice X
+		} // end of parallel region
+		Timing_DmFFT+=tFFT/nthreads;
+		Timing_DmTransp+=tTr/nthreads;
 		if (IFROOT) printf(".");
 	} // end of Rcomp
 	if (IFROOT) printf("\n");
@@ -888,31 +1704,89 @@ static void InitRmatrix(const double invNgrid)
 	Free_general(BT_buffer);
 	Free_general(BT_rbuffer);
 #endif
+	if (dm_cache!=NULL && group_id==0) DmCacheWrite(Rmatrix,Rsize,false,true);
 #ifdef OPENCL
-	// Setting kernel arguments which are always the same
-	// for arith3_surface
-	CL_CH_ERR(clSetKernelArg(clarith3_surface,0,sizeof(cl_mem),&bufslices_tr));
-	CL_CH_ERR(clSetKernelArg(clarith3_surface,1,sizeof(cl_mem),&bufDmatrix));
-	CL_CH_ERR(clSetKernelArg(clarith3_surface,2,sizeof(size_t),&smallY));
-	CL_CH_ERR(clSetKernelArg(clarith3_surface,3,sizeof(size_t),&smallZ));
-	CL_CH_ERR(clSetKernelArg(clarith3_surface,4,sizeof(size_t),&gridX));
-	CL_CH_ERR(clSetKernelArg(clarith3_surface,5,sizeof(size_t),&DsizeY));
-	CL_CH_ERR(clSetKernelArg(clarith3_surface,6,sizeof(size_t),&DsizeZ));
-	CL_CH_ERR(clSetKernelArg(clarith3_surface,11,sizeof(cl_mem),&bufslicesR_tr));
-	CL_CH_ERR(clSetKernelArg(clarith3_surface,12,sizeof(cl_mem),&bufRmatrix));
-	// for transpose forward (backward are not needed for surface)
-	CL_CH_ERR(clSetKernelArg(cltransposeofR,0,sizeof(cl_mem),&bufslicesR));
-	CL_CH_ERR(clSetKernelArg(cltransposeofR,1,sizeof(cl_mem),&bufslicesR_tr));
-	CL_CH_ERR(clSetKernelArg(cltransposeofR,2,sizeof(size_t),&gridZ));
-	CL_CH_ERR(clSetKernelArg(cltransposeofR,3,sizeof(size_t),&gridY));
-	CL_CH_ERR(clSetKernelArg(cltransposeofR,4,17*16*sizeof(doublecomplex),NULL));
-	// copy Rmatrix to OpenCL buffer, blocking to ensure completion before function end
-	CL_CH_ERR(clEnqueueWriteBuffer(command_queue,bufRmatrix,CL_TRUE,0,Rsize*sizeof(*Rmatrix),Rmatrix,0,NULL,NULL));
-	Free_cVector(Rmatrix);
+	RmatrixToOCL();
 #endif
 }
 
 
+//======================================================================================================================
+
+static void CalcGreenSym(const int nnn,const int jstart)
+/* Fills Dmatrix with values of Green's tensor (with indexing corresponding to D2matrix), using the symmetry of the
+ * cubic lattice. For all interaction formulations, except 'so', the interaction tensor is invariant to reflections and
+ * permutations of the coordinate axes (accompanied by the corresponding transformation of the tensor components). So
+ * it is evaluated only once for each canonical displacement 0<=c0<=c1<=c2, and then scattered to all (up to 48)
+ * equivalent positions in the local part of the matrix. The set of filled positions is exactly the same as in the
+ * direct loop in InitDmatrix. This is especially important for expensive formulations, like 'igt'.
+ *
+ * Different canonical displacements are scattered to disjoint sets of positions, so the outer loop is shared among
+ * OpenMP threads (if thrSafe). Dynamic scheduling is used, since both the number of displacements and the cost of
+ * each of them (e.g., for 'igt') vary with c2.
+ */
+{
+	// all permutations of three axes
+	static const int perm[6][3]={{0,1,2},{0,2,1},{1,0,2},{1,2,0},{2,0,1},{2,1,0}};
+	static const int comp[3][3]={{0,1,2},{1,3,4},{2,4,5}}; // index of component (m,n) of symmetric tensor
+	const int kmin=nnn*local_z0,kmax=nnn*local_z1;
+	int bnd[3],lim[3],c2,a,b,kz,tmp;
+	size_t neval,nfill;
+
+	// bounds for absolute values of displacements along x, y, and z (the latter includes padding, as in InitDmatrix)
+	bnd[0]=boxX;
+	bnd[1]=boxY;
+	bnd[2]=1;
+	for (kz=kmin;kz<kmax;kz++) bnd[2]=MAX(bnd[2],abs((kz>(int)smallZ) ? kz-(int)gridZ : kz)+1);
+	// sorted bounds limit the canonical displacements
+	memcpy(lim,bnd,sizeof(bnd));
+	for (a=0;a<2;a++) for (b=0;b<2-a;b++) if (lim[b]>lim[b+1]) {
+		tmp=lim[b];
+		lim[b]=lim[b+1];
+		lim[b+1]=tmp;
+	}
+	neval=0;
+	nfill=(size_t)(kmax-kmin)*(boxY-jstart)*(2*boxX-1); // number of positions in the direct loop
+	// zero displacement (c2=0) is left zero
+#pragma omp parallel for schedule(dynamic) if(thrSafe) reduction(+:neval)
+	for (c2=1;c2<lim[2];c2++) {
+		int c[3],v[3],s[3],p,m,n,i,j,k,kc;
+		doublecomplex g[NDCOMP],*dest;
+		bool computed;
+
+		c[2]=c2;
+		for (c[1]=0;c[1]<=MIN(c[2],lim[1]-1);c[1]++) for (c[0]=0;c[0]<=MIN(c[1],lim[0]-1);c[0]++) {
+			computed=false;
+			for (p=0;p<6;p++) {
+				for (m=0;m<3;m++) v[m]=c[perm[p][m]];
+				if (v[0]>=bnd[0] || v[1]>=bnd[1] || v[2]>=bnd[2]) continue;
+				// zero coordinates are not reflected; also j>=jstart is required
+				for (s[0]=1;s[0]>=(v[0]==0 ? 1 : -1);s[0]-=2)
+					for (s[1]=1;s[1]>=(v[1]==0 || jstart==0 ? 1 : -1);s[1]-=2)
+					for (s[2]=1;s[2]>=(v[2]==0 ? 1 : -1);s[2]-=2) {
+					i=s[0]*v[0];
+					j=s[1]*v[1];
+					kc=s[2]*v[2];
+					// inverse of the correction of k in InitDmatrix
+					k = (kc>=0) ? kc : kc+(int)gridZ;
+					if (k<kmin || k>=kmax || ((k>(int)smallZ) ? k-(int)gridZ : k)!=kc) continue;
+					if (!computed) {
+						(*InterTerm_int)(c[0],c[1],c[2],g);
+						computed=true;
+						neval++;
+					}
+					dest=Dmatrix+NDCOMP*Index2matrix(i,j,k-kmin,D2sizeY);
+					for (m=0;m<3;m++) for (n=m;n<3;n++) dest[comp[m][n]]=s[m]*s[n]*g[comp[perm[p][m]][perm[p][n]]];
+				}
+			}
+		}
+	}
+	MyInnerProduct(&neval,sizet_type,1,NULL);
+	MyInnerProduct(&nfill,sizet_type,1,NULL);
+	if (IFROOT) fprintf(logfile,"Green's tensor is computed for %zu distinct (by symmetry) displacements instead of "
+		"%zu\n",neval,nfill);
+}
+
 //======================================================================================================================
 
 void InitDmatrix(void)
@@ -926,7 +1800,7 @@ void InitDmatrix(void)
 	double invNgrid;
 	int nnn; // multiplier used for reduced_FFT or not reduced; 1 or 2
 	int jstart,kstart;
-	TIME_TYPE start,time1;
+	TIME_TYPE start,time1,tstart,tFFT,tTr;
 #ifdef PRECISE_TIMING
 	// precise timing of the Dmatrix computation
 	SYSTEM_TIME tvp[15];
@@ -1163,19 +2037,24 @@ void InitDmatrix(void)
 #endif
 	// memory estimation and exit for prognosis
 	MAXIMIZE(memPeak,memory);
-	/* objects which are always allocated (at least temporarily): Dmatrix,D2matrix,slice,slice_tr
-	 * for surface, the peak is either by D2matrix & R2matrix, or by R2matrix & Rmatrix (the latter is mostly probable)
+	/* objects which are always allocated (at least temporarily): Dmatrix,D2matrix,slice,slice_tr (the latter two for
+	 * each thread); for surface, the peak is either by D2matrix & R2matrix, or by R2matrix & Rmatrix (the latter is
+	 * mostly probable)
 	 */
-	memPeak+=sizeof(doublecomplex)*((double)Dsize+2*gridYZ+(surface ? (MAX(Rsize,D2sizeTot)+R2sizeTot) : D2sizeTot));
+	memPeak+=sizeof(doublecomplex)*((double)Dsize+2*nthreads*(double)gridYZ
+		+(surface ? (MAX(Rsize,D2sizeTot)+R2sizeTot) : D2sizeTot));
 #ifndef OPENCL
 	/* allocated memory that is used further on (Dmatrix,Xmatrix,slices,slices_tr), not relevant for OpenCL version;
 	 * we assume that it is always larger than memPeak above (so memPeak doesn't have to be adjusted). In particular,
-	 * we ignore the memory, which is temporarily allocated for BlockTranspose buffers of Dm and Rm.
+	 * we ignore the memory, which is temporarily allocated for BlockTranspose buffers of Dm and Rm. All buffers, except
+	 * Dmatrix and Rmatrix, hold mvBatch vectors.
 	 */
-	double mem=sizeof(doublecomplex)*((double)Dsize+3*local_Nsmall+6*gridYZ);
-	if (surface) mem+=sizeof(doublecomplex)*((double)Rsize+6*gridYZ); // for Rmatrix, slicesR, and slicesR_tr
+	const int nsl=yz_transpose ? 2 : 1; // number of slices arrays (slices and slices_tr or only the former)
+	double mem=sizeof(doublecomplex)*((double)Dsize+mvBatch*(3*(double)local_Nsmall+3*nsl*nthreads*(double)gridYZ));
+	// for Rmatrix, slicesR, and slicesR_tr
+	if (surface) mem+=sizeof(doublecomplex)*((double)Rsize+3*nsl*mvBatch*nthreads*(double)gridYZ);
 #ifdef PARALLEL
-	const size_t BTsize = 6*smallY*local_Nz*local_Nx; // in doubles
+	const size_t BTsize = 6*mvBatch*smallY*local_Nz*local_Nx; // in doubles
 	mem+=2*BTsize*sizeof(double);
 #endif
 	// printout some information
@@ -1189,150 +2068,199 @@ void InitDmatrix(void)
 	memory+=mem;
 #endif
 	if (prognosis) return;
-	// allocate memory for Dmatrix
-	MALLOC_VECTOR(Dmatrix,complex,Dsize,ALL);
-	// allocate memory for D2matrix components
-	MALLOC_VECTOR(D2matrix,complex,D2sizeTot,ALL);
-	MALLOC_VECTOR(slice,complex,gridYZ,ALL);
-	MALLOC_VECTOR(slice_tr,complex,gridYZ,ALL);
-	/* allocate memory for R2matrix components. In principle, this can be done after D2 matrix is freed. However, this
-	 * way allows us to init all FFT routines (in particular, build FFTW plans) in one go. Moreover, this should not
-	 * increase the peak memory, since Rmatrix is allocated further on (see above).
-	 */
-	if (surface) MALLOC_VECTOR(R2matrix,complex,R2sizeTot,ALL);
-	// actually allocation of Xmatrix, slices, slices_tr is below after freeing of Dmatrix and its slice
+	dmLoaded=false;
+	if (dm_cache!=NULL) {
+		DmCacheInit(Dsize);
+		dmLoaded=DmCacheLoad(Dsize);
+	}
+	if (!dmLoaded) {
+		// allocate memory for Dmatrix
+		MALLOC_VECTOR(Dmatrix,complex,Dsize,ALL);
+		// allocate memory for D2matrix components
+		MALLOC_VECTOR(D2matrix,complex,D2sizeTot,ALL);
+		MALLOC_VECTOR(slice,complex,nthreads*gridYZ,ALL);
+		MALLOC_VECTOR(slice_tr,complex,nthreads*gridYZ,ALL);
+		/* allocate memory for R2matrix components. In principle, this can be done after D2 matrix is freed. However,
+		 * this way allows us to init all FFT routines (in particular, build FFTW plans) in one go. Moreover, this
+		 * should not increase the peak memory, since Rmatrix is allocated further on (see above).
+		 */
+		if (surface) MALLOC_VECTOR(R2matrix,complex,R2sizeTot,ALL);
+		// actually allocation of Xmatrix, slices, slices_tr is below after freeing of Dmatrix and its slice
 #ifdef PARALLEL
-	// allocate buffer for BlockTranspose_Dm
-	size_t bufsize = 2*lz_Dm*D2sizeY*local_Nx;
-	MALLOC_VECTOR(BT_buffer,double,bufsize,ALL);
-	MALLOC_VECTOR(BT_rbuffer,double,bufsize,ALL);
+		// allocate buffer for BlockTranspose_Dm
+		size_t bufsize = 2*lz_Dm*D2sizeY*local_Nx;
+		MALLOC_VECTOR(BT_buffer,double,bufsize,ALL);
+		MALLOC_VECTOR(BT_rbuffer,double,bufsize,ALL);
 #endif
+	}
 	D("Initialize FFT (1st part)");
 	fftInitBeforeD();
 #ifdef PRECISE_TIMING
 	GET_SYSTEM_TIME(tvp+1);
 	Elapsed(tvp,tvp+1,&Timing_beg); // it includes a lot of OpenCL stuff
 #endif
-	if (IFROOT) printf("Calculating Green's function (Dmatrix)\n");
-	/* Interaction matrix values are calculated all at once for performance reasons. They are stored in Dmatrix with
-	 * indexing corresponding to D2matrix (to facilitate copying) but NDCOMP elements instead of one. Afterwards they
-	 * are replaced by Fourier transforms (with different indexing) component-wise (in cycle over NDCOMP)
-	 */
-	/* fill Dmatrix with 0, this if to fill the possible gap between e.g. boxY and gridY/2; (and for R=0) probably
-	 * faster than using a lot of conditionals
-	 */
-	for (ind=0;ind<Dsize;ind++) Dmatrix[ind]=0;
-	// fill Dmatrix with values of Green's tensor
-	for(k=nnn*local_z0;k<nnn*local_z1;k++) {
-		// correction of k is relevant only if reduced_FFT is not used
-		if (k>(int)smallZ) kcor=k-gridZ;
-		else kcor=k;
-		for (j=jstart;j<boxY;j++) for (i=1-boxX;i<boxX;i++) {
-			index=NDCOMP*Index2matrix(i,j,k-nnn*local_z0,D2sizeY);
-			/* The test for zero distance is somewhat non-optimal. However, other alternatives are not perfect either:
-			 * 1) complicate the loops to remove the zero element in the beginning (move tests to the upper level)
-			 * 2) call the function with zero - it will produce NaN. Then set this element to zero after the loop.
-			 */
-			if (i!=0 || j!=0 || kcor!=0) (*InterTerm_int)(i,j,kcor,Dmatrix+index);
+	if (!dmLoaded) {
+		if (IFROOT) printf("Calculating Green's function (Dmatrix)\n");
+		/* Interaction matrix values are calculated all at once for performance reasons. They are stored in Dmatrix
+		 * with indexing corresponding to D2matrix (to facilitate copying) but NDCOMP elements instead of one.
+		 * Afterwards they are replaced by Fourier transforms (with different indexing) component-wise (in cycle over
+		 * NDCOMP)
+		 */
+		/* fill Dmatrix with 0, this if to fill the possible gap between e.g. boxY and gridY/2; (and for R=0) probably
+		 * faster than using a lot of conditionals
+		 */
+		for (ind=0;ind<Dsize;ind++) Dmatrix[ind]=0;
+		// IGT relies on Fortran routines with static variables, which can't be called from several threads
+		thrSafe=true;
+#ifndef NO_FORTRAN
+		if (IntRelation==G_IGT) thrSafe=false;
+#endif
+		tstart=GET_TIME();
+		// fill Dmatrix with values of Green's tensor; symmetry is not applicable to 'so', since it depends on prop
+		if (IntRelation!=G_SO) CalcGreenSym(nnn,jstart);
+		else {
+#pragma omp parallel for schedule(dynamic) if(thrSafe) private(i,j,kcor,index)
+			for(k=nnn*local_z0;k<nnn*local_z1;k++) {
+				// correction of k is relevant only if reduced_FFT is not used
+				if (k>(int)smallZ) kcor=k-gridZ;
+				else kcor=k;
+				for (j=jstart;j<boxY;j++) for (i=1-boxX;i<boxX;i++) {
+					index=NDCOMP*Index2matrix(i,j,k-nnn*local_z0,D2sizeY);
+					/* The test for zero distance is somewhat non-optimal. However, other alternatives are not perfect
+					 * either:
+					 * 1) complicate the loops to remove the zero element in the beginning (move tests to the upper
+					 *    level)
+					 * 2) call the function with zero - it will produce NaN. Then set this element to zero after the
+					 *    loop.
+					 */
+					if (i!=0 || j!=0 || kcor!=0) (*InterTerm_int)(i,j,kcor,Dmatrix+index);
+				}
+			} // end of i,j,k loop
 		}
-	} // end of i,j,k loop
-	if (IFROOT) printf("Fourier transform of Dmatrix");
+		Timing_DmGcalc+=GET_TIME()-tstart;
+		if (IFROOT) printf("Fourier transform of Dmatrix");
 #ifdef PRECISE_TIMING
-	GET_SYSTEM_TIME(tvp+11); // same as the last time-stamp in the following loop
-	Elapsed(tvp+1,tvp+11,&Timing_Gcalc);
+		GET_SYSTEM_TIME(tvp+11); // same as the last time-stamp in the following loop
+		Elapsed(tvp+1,tvp+11,&Timing_Gcalc);
 #endif
-	for(Dcomp=0;Dcomp<NDCOMP;Dcomp++) { // main cycle over components of Dmatrix
+		for(Dcomp=0;Dcomp<NDCOMP;Dcomp++) { // main cycle over components of Dmatrix
 #ifdef PRECISE_TIMING
-		GET_SYSTEM_TIME(tvp+2);
-		ElapsedInc(tvp+11,tvp+2,&Timing_InitMV);
+			GET_SYSTEM_TIME(tvp+2);
+			ElapsedInc(tvp+11,tvp+2,&Timing_InitMV);
 #endif
-		// fill D2matrix with precomputed values from Dmatrix
-		for (ind=0;ind<D2sizeTot;ind++) D2matrix[ind]=Dmatrix[NDCOMP*ind+Dcomp];
+			// fill D2matrix with precomputed values from Dmatrix
+			for (ind=0;ind<D2sizeTot;ind++) D2matrix[ind]=Dmatrix[NDCOMP*ind+Dcomp];
 #ifdef PRECISE_TIMING
-		GET_SYSTEM_TIME(tvp+3);
-		ElapsedInc(tvp+2,tvp+3,&Timing_ar1);
+			GET_SYSTEM_TIME(tvp+3);
+			ElapsedInc(tvp+2,tvp+3,&Timing_ar1);
 #endif
-		fftX_Dm(); // fftX D2matrix
+			tstart=GET_TIME();
+			fftX_Dm(); // fftX D2matrix
+			Timing_DmFFT+=GET_TIME()-tstart;
 #ifdef PRECISE_TIMING
-		GET_SYSTEM_TIME(tvp+4);
-		ElapsedInc(tvp+3,tvp+4,&Timing_fftX);
+			GET_SYSTEM_TIME(tvp+4);
+			ElapsedInc(tvp+3,tvp+4,&Timing_fftX);
 #endif
-		BlockTranspose_DRm(D2matrix,D2sizeY,lz_Dm);
+			tstart=GET_TIME();
+			BlockTranspose_DRm(D2matrix,D2sizeY,lz_Dm);
+			Timing_DmTransp+=GET_TIME()-tstart;
 #ifdef PRECISE_TIMING
-		GET_SYSTEM_TIME(tvp+5);
-		ElapsedInc(tvp+4,tvp+5,&Timing_BT);
+			GET_SYSTEM_TIME(tvp+5);
+			ElapsedInc(tvp+4,tvp+5,&Timing_BT);
 #endif
-		for(x=local_x0;x<local_x1;x++) {
+			/* slices with different x are processed by OpenMP threads independently, each using its own part of slice
+			 * and slice_tr; the time of FFTs and transposes is averaged over threads
+			 */
+			tFFT=tTr=0;
+#pragma omp parallel private(j,k,y,z,ind,indexfrom,indexto) reduction(+:tFFT,tTr)
+			{
+			doublecomplex * restrict sl=slice+THREAD_ID*gridYZ;
+			doublecomplex * restrict sl_tr=slice_tr+THREAD_ID*gridYZ;
+			TIME_TYPE tstart_thr;
+#pragma omp for schedule(static)
+			for(x=local_x0;x<local_x1;x++) {
 #ifdef PRECISE_TIMING
-			GET_SYSTEM_TIME(tvp+6);
+				GET_SYSTEM_TIME(tvp+6);
 #endif
-			for (ind=0;ind<gridYZ;ind++) slice[ind]=0.0; // fill slice with 0.0
-			for(j=jstart;j<boxY;j++) for(k=kstart;k<boxZ;k++) {
-				indexfrom=IndexGarbledD(x,j,k);
-				indexto=IndexSliceD2matrix(j,k);
-				slice[indexto]=D2matrix[indexfrom];
-			}
-			if (reduced_FFT) { // here a specific symmetry is used, that G is a combination of tensors I and RR/|R|^2
-				for(j=1;j<boxY;j++) for(k=0;k<boxZ;k++) {
-					// mirror along y
-					indexfrom=IndexSliceD2matrix(j,k);
-					indexto=IndexSliceD2matrix(-j,k);
-					if (Dcomp==1 || Dcomp==4) slice[indexto]=-slice[indexfrom];
-					else slice[indexto]=slice[indexfrom];
+				for (ind=0;ind<gridYZ;ind++) sl[ind]=0.0; // fill slice with 0.0
+				for(j=jstart;j<boxY;j++) for(k=kstart;k<boxZ;k++) {
+					indexfrom=IndexGarbledD(x,j,k);
+					indexto=IndexSliceD2matrix(j,k);
+					sl[indexto]=D2matrix[indexfrom];
 				}
-				for(j=1-boxY;j<boxY;j++) for(k=1;k<boxZ;k++) {
-					// mirror along z
-					indexfrom=IndexSliceD2matrix(j,k);
-					indexto=IndexSliceD2matrix(j,-k);
-					if (Dcomp==2 || Dcomp==4) slice[indexto]=-slice[indexfrom];
-					else slice[indexto]=slice[indexfrom];
+				// here a specific symmetry is used, that G is a combination of tensors I and RR/|R|^2
+				if (reduced_FFT) {
+					for(j=1;j<boxY;j++) for(k=0;k<boxZ;k++) {
+						// mirror along y
+						indexfrom=IndexSliceD2matrix(j,k);
+						indexto=IndexSliceD2matrix(-j,k);
+						if (Dcomp==1 || Dcomp==4) sl[indexto]=-sl[indexfrom];
+						else sl[indexto]=sl[indexfrom];
+					}
+					for(j=1-boxY;j<boxY;j++) for(k=1;k<boxZ;k++) {
+						// mirror along z
+						indexfrom=IndexSliceD2matrix(j,k);
+						indexto=IndexSliceD2matrix(j,-k);
+						if (Dcomp==2 || Dcomp==4) sl[indexto]=-sl[indexfrom];
+						else sl[indexto]=sl[indexfrom];
+					}
 				}
-			}
 #ifdef PRECISE_TIMING
-			GET_SYSTEM_TIME(tvp+7);
-			ElapsedInc(tvp+6,tvp+7,&Timing_ar2);
+				GET_SYSTEM_TIME(tvp+7);
+				ElapsedInc(tvp+6,tvp+7,&Timing_ar2);
 #endif
-			fftZ_slice(); // fftZ slice
+				tstart_thr=GET_TIME();
+				fftZ_slice(sl); // fftZ slice
+				tFFT+=GET_TIME()-tstart_thr;
 #ifdef PRECISE_TIMING
-			GET_SYSTEM_TIME(tvp+8);
-			ElapsedInc(tvp+7,tvp+8,&Timing_fftZ);
+				GET_SYSTEM_TIME(tvp+8);
+				ElapsedInc(tvp+7,tvp+8,&Timing_fftZ);
 #endif
-			transpose(slice,slice_tr,gridY,gridZ);
+				tstart_thr=GET_TIME();
+				transpose(sl,sl_tr,gridY,gridZ,gridZ,gridY);
+				tTr+=GET_TIME()-tstart_thr;
 #ifdef PRECISE_TIMING
-			GET_SYSTEM_TIME(tvp+9);
-			ElapsedInc(tvp+8,tvp+9,&Timing_TYZ);
+				GET_SYSTEM_TIME(tvp+9);
+				ElapsedInc(tvp+8,tvp+9,&Timing_TYZ);
 #endif
-			fftY_slice(); // fftY slice_tr
+				tstart_thr=GET_TIME();
+				fftY_slice(sl_tr); // fftY slice_tr
+				tFFT+=GET_TIME()-tstart_thr;
 #ifdef PRECISE_TIMING
-			GET_SYSTEM_TIME(tvp+10);
-			ElapsedInc(tvp+9,tvp+10,&Timing_fftY);
+				GET_SYSTEM_TIME(tvp+10);
+				ElapsedInc(tvp+9,tvp+10,&Timing_fftY);
 #endif
-			for(z=0;z<DsizeZ;z++) for(y=0;y<DsizeY;y++) {
-				indexto=IndexDmatrix(x-local_x0,y,z)+Dcomp;
-				indexfrom=IndexSlice_zy(y,z);
-				Dmatrix[indexto]=-invNgrid*slice_tr[indexfrom];
-			}
+				for(z=0;z<DsizeZ;z++) for(y=0;y<DsizeY;y++) {
+					indexto=IndexDmatrix(x-local_x0,y,z)+Dcomp;
+					indexfrom=IndexSlice_zy(y,z);
+					Dmatrix[indexto]=-invNgrid*sl_tr[indexfrom];
+				}
 #ifdef PRECISE_TIMING
-			GET_SYSTEM_TIME(tvp+11);
-			ElapsedInc(tvp+10,tvp+11,&Timing_ar3);
+				GET_SYSTEM_TIME(tvp+11);
+				ElapsedInc(tvp+10,tvp+11,&Timing_ar3);
 #endif
-		} // end slice X
-		if (IFROOT) printf(".");
-	} // end of Dcomp
-	if (IFROOT) printf("\n");
-	// free vectors used for computation of Dmatrix; slice and slice_tr are freed after InitRmatrix
-	Free_cVector(D2matrix);
+			} // end slice X
+			} // end of parallel region
+			Timing_DmFFT+=tFFT/nthreads;
+			Timing_DmTransp+=tTr/nthreads;
+			if (IFROOT) printf(".");
+		} // end of Dcomp
+		if (IFROOT) printf("\n");
+		// free vectors used for computation of Dmatrix; slice and slice_tr are freed after InitRmatrix
+		Free_cVector(D2matrix);
 #ifdef PARALLEL
-	// deallocate buffers for BlockTranspose_DRm
-	Free_general(BT_buffer);
-	Free_general(BT_rbuffer);
+		// deallocate buffers for BlockTranspose_DRm
+		Free_general(BT_buffer);
+		Free_general(BT_rbuffer);
 #endif
+		// other process groups compute the same matrix, so only the first one writes it
+		if (dm_cache!=NULL && group_id==0) DmCacheWrite(Dmatrix,Dsize,true,!surface);
 #ifdef OPENCL
-	// copy Dmatrix to OpenCL buffer, blocking to ensure completion before function end
-	CL_CH_ERR(clEnqueueWriteBuffer(command_queue,bufDmatrix,CL_TRUE,0,Dsize*sizeof(*Dmatrix),Dmatrix,0,NULL,NULL));
-	Free_cVector(Dmatrix);
+		// copy Dmatrix to OpenCL buffer, blocking to ensure completion before function end
+		CL_CH_ERR(clEnqueueWriteBuffer(command_queue,bufDmatrix,CL_TRUE,0,Dsize*sizeof(*Dmatrix),Dmatrix,0,NULL,NULL));
+		Free_cVector(Dmatrix);
 #endif
-	if (surface) { // only the total execution time of InitRmatrix is timed
+		if (surface) { // only the total execution time of InitRmatrix is timed
 #ifdef PRECISE_TIMING
 			GET_SYSTEM_TIME(tvp+12);
 #endif
@@ -1342,26 +2270,43 @@ void InitDmatrix(void)
 			GET_SYSTEM_TIME(tvp+13);
 			t_Rm=DiffSystemTime(tvp+12,tvp+13);
 #endif
+		}
+		Free_cVector(slice);
+		Free_cVector(slice_tr);
 	}
-	Free_cVector(slice);
-	Free_cVector(slice_tr);
+#ifdef OPENCL
+	else { // only copy the loaded matrices to OpenCL buffers
+		CL_CH_ERR(clEnqueueWriteBuffer(command_queue,bufDmatrix,CL_TRUE,0,Dsize*sizeof(*Dmatrix),Dmatrix,0,NULL,NULL));
+		Free_cVector(Dmatrix);
+		if (surface) RmatrixToOCL();
+	}
+#endif
 #ifdef PARALLEL
 	// allocate buffers for BlockTranspose
 	MALLOC_VECTOR(BT_buffer,double,BTsize,ALL);
 	MALLOC_VECTOR(BT_rbuffer,double,BTsize,ALL);
 #endif
 #ifndef OPENCL
-	// allocate memory for Xmatrix, slices and slices_tr - used in matvec
-	MALLOC_VECTOR(Xmatrix,complex,3*local_Nsmall,ALL);
-	MALLOC_VECTOR(slices,complex,3*gridYZ,ALL);
-	MALLOC_VECTOR(slices_tr,complex,3*gridYZ,ALL);
+	// allocate memory for Xmatrix, slices and slices_tr (separate for each thread) - used in matvec
+	MALLOC_VECTOR(Xmatrix,complex,3*mvBatch*local_Nsmall,ALL);
+	MALLOC_VECTOR(slices,complex,3*mvBatch*nthreads*gridYZ,ALL);
+	if (yz_transpose) MALLOC_VECTOR(slices_tr,complex,3*mvBatch*nthreads*gridYZ,ALL);
 	if (surface) { // additional slices for reflection interaction
-		MALLOC_VECTOR(slicesR,complex,3*gridYZ,ALL);
-		MALLOC_VECTOR(slicesR_tr,complex,3*gridYZ,ALL);
+		MALLOC_VECTOR(slicesR,complex,3*mvBatch*nthreads*gridYZ,ALL);
+		if (yz_transpose) MALLOC_VECTOR(slicesR_tr,complex,3*mvBatch*nthreads*gridYZ,ALL);
+	}
+#	ifdef OPENMP
+	/* timing of each thread in MatVec; it is freed in FinalStatistics. Allocated only once, since InitDmatrix can be
+	 * called several times (with '-sweep')
+	 */
+	if (Timing_MVThread==NULL) {
+		MALLOC_VECTOR(Timing_MVThread,double,nthreads,ALL);
+		for (i=0;i<nthreads;i++) Timing_MVThread[i]=0;
 	}
+#	endif
 #endif
 	time1=GET_TIME();
-	Timing_Dm_Init=time1-start;
+	Timing_Dm_Init+=time1-start;
 
 #ifdef PRECISE_TIMING
 	GET_SYSTEM_TIME(tvp+14);
@@ -1457,12 +2402,18 @@ void Free_FFT_Dmat(void)
 #	endif
 	if (oclMem>0) LogWarning(EC_WARN,ALL_POS,"Possible leak of OpenCL memory (size %zu bytes) detected",oclMem);
 #else
-	Free_cVector(Dmatrix);
+#	ifdef DM_CACHE_MMAP
+	if (dmCacheMap!=NULL) munmap(dmCacheMap,dmCacheMapSize); // this covers both Dmatrix and Rmatrix
+	else
+#	endif
+	{
+		Free_cVector(Dmatrix);
+		if (surface) Free_cVector(Rmatrix);
+	}
 	Free_cVector(Xmatrix);
 	Free_cVector(slices);
 	Free_cVector(slices_tr);
 	if (surface) {
-		Free_cVector(Rmatrix);
 		Free_cVector(slicesR);
 		Free_cVector(slicesR_tr);
 	}
@@ -1470,24 +2421,38 @@ void Free_FFT_Dmat(void)
 	Free_general(BT_buffer);
 	Free_general(BT_rbuffer);
 #	endif
-#	ifdef FFTW3 // these plans are defined only when OpenCL is not used
-	fftw_destroy_plan(planXf);
-	fftw_destroy_plan(planXb);
-	fftw_destroy_plan(planYf);
-	fftw_destroy_plan(planYb);
-	fftw_destroy_plan(planZf);
-	fftw_destroy_plan(planZb);
+#	ifdef FFTW3 // these plans are defined only when OpenCL is not used (and FFTW3 is chosen, otherwise nPlans=0)
+	int p;
+	for (p=0;p<nPlans;p++) {
+		if (planXf[p]!=NULL) { // empty chunks have no X plans
+			fftw_destroy_plan(planXf[p]);
+			fftw_destroy_plan(planXb[p]);
+		}
+		fftw_destroy_plan(planYf[p]);
+		fftw_destroy_plan(planYb[p]);
+		fftw_destroy_plan(planZf[p]);
+		fftw_destroy_plan(planZb[p]);
+		if (surface) {
+			fftw_destroy_plan(planYRf[p]);
+			fftw_destroy_plan(planZRf[p]);
+		}
+	}
+	Free_general(planXf);
+	Free_general(planXb);
+	Free_general(planYf);
+	Free_general(planYb);
+	Free_general(planZf);
+	Free_general(planZb);
 	if (surface) {
-		fftw_destroy_plan(planYRf);
-		fftw_destroy_plan(planZRf);
+		Free_general(planYRf);
+		Free_general(planZRf);
 	}
 	fftw_cleanup();
 #	endif
 #endif
-#ifdef FFT_TEMPERTON // these vectors are used even with OpenCL
+// these vectors are used for line-based routines (Temperton or built-in) even with OpenCL; otherwise they are NULL
 	Free_general(work);
 	Free_general(trigsX);
 	Free_general(trigsY);
 	Free_general(trigsZ);
-#endif
 }
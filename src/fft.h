@@ -32,13 +32,24 @@
 #define FFT_FORWARD -1
 #define FFT_BACKWARD 1
 
-void fftX(int isign);
-void fftY(int isign);
-void fftZ(int isign);
-void TransposeYZ(int direction);
+/* In OpenMP mode each thread processes its own x-slices in MatVec, using a separate set of slices (and FFT plans). The
+ * following gives the index of this set (matvec.c and fft.c should be consistent in that).
+ */
+#ifdef OPENMP
+#	include <omp.h>
+#	define THREAD_ID omp_get_thread_num()
+#else
+#	define THREAD_ID 0
+#endif
+
+void fftX(int isign,int nv);
+void fftY(int isign,int nv);
+void fftZ(int isign,int nv);
+void TransposeYZ(int direction,int nv);
 void InitDmatrix(void);
 void Free_FFT_Dmat(void);
 int fftFit(int size, int _div);
+void TuneFFTGrid(void);
 void CheckNprocs(void);
 
 #endif // __fft_h
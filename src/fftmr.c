@@ -0,0 +1,415 @@
+/* File: fftmr.c
+ * $Date::                            $
+ * Descr: built-in mixed-radix FFT, used when neither FFTW3 nor Temperton FFT is desired (or available)
+ *
+ *        The interface is similar to that of cfft99 by C. Temperton (a set of lot complex vectors of length n,
+ *        separated by jump, with elements separated by inc), so it can directly replace the latter. The transforms are
+ *        unnormalized, isign=-1 (FFT_FORWARD) corresponds to exp(-i...).
+ *
+ *        Self-sorting Stockham algorithm (decimation in frequency) is used with radices 4, 2, 3, 5, and any other odd
+ *        prime (the latter is efficient only for small primes, like 7). Up to FFTMR_BATCH vectors are processed
+ *        simultaneously - they are copied into the work array with interleaved elements, which then are processed as
+ *        an additional (innermost) dimension of the Stockham algorithm. Thus, all the inner loops are over contiguous
+ *        memory with the same twiddle factor, and can be vectorized by the compiler (SIMD). Real and imaginary parts
+ *        are stored separately for the same reason.
+ *
+ * Copyright (C) 2013 ADDA contributors
+ * This file is part of ADDA.
+ *
+ * ADDA is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ *
+ * ADDA is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with ADDA. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include "const.h" // keep this first
+// project headers
+#include "cmplx.h"
+#include "io.h"
+// system headers
+#include <math.h>
+
+#define FFTMR_BATCH 8        // number of vectors processed simultaneously
+#define FFTMR_MAX_FACTORS 19 // maximum number of factors of n (ifax should have FFTMR_MAX_FACTORS+1 elements)
+
+//======================================================================================================================
+
+void fftmrInit(const int n,int * restrict ifax,double * restrict trigs)
+/* initializes factors of n (ifax[0] is the number of factors, followed by the factors themselves) and twiddle factors
+ * (trigs, 2*n doubles are enough) for the transforms of size n
+ */
+{
+	int nf,m,p,i,q,j,len;
+	size_t k;
+
+	// factorization; radix 4 goes first, since it is the most efficient
+	nf=0;
+	m=n;
+	p=4;
+	while (m>1) {
+		if (m%p==0) {
+			if (nf==FFTMR_MAX_FACTORS) LogError(ONE_POS,"Too many factors of FFT size %d",n);
+			ifax[++nf]=p;
+			m/=p;
+		}
+		else if (p==4) p=2;
+		else if (p==2) p=3;
+		else p+=2; // composite p never divides m at this point
+	}
+	ifax[0]=nf;
+	// twiddle factors for each stage, indexed by (q,j) for 0<=q<len/p, 1<=j<p
+	k=0;
+	len=n;
+	for (i=1;i<=nf;i++) {
+		p=ifax[i];
+		m=len/p;
+		for (q=0;q<m;q++) for (j=1;j<p;j++) {
+			trigs[k++]=cos(TWO_PI*(j*q)/len);
+			trigs[k++]=sin(TWO_PI*(j*q)/len);
+		}
+		len=m;
+	}
+}
+
+//======================================================================================================================
+
+size_t fftmrWorkSize(const int n)
+// size of work array (in doubles), required by fftmr for transforms of size n
+{
+	return 4*(size_t)n*FFTMR_BATCH;
+}
+
+//======================================================================================================================
+
+/* In all the stage functions below, the input (xr,xi) is considered as a set of p subsequences x[u+s*(q+k*m)], k<p,
+ * while the output is y[u+s*(p*q+j)], j<p (for each u<s and q<m). Input and output are different arrays. tw points to
+ * twiddle factors of the current stage, sg is the sign of the exponent (isign).
+ */
+
+static inline void Twiddle(double * restrict yr,double * restrict yi,const double * restrict tw,const double sg,
+	const int s)
+// multiplies s complex values by twiddle factor tw (real and imaginary parts)
+{
+	const double wr=tw[0],wi=sg*tw[1];
+	double tr;
+	int u;
+
+	for (u=0;u<s;u++) {
+		tr=yr[u]*wr-yi[u]*wi;
+		yi[u]=yr[u]*wi+yi[u]*wr;
+		yr[u]=tr;
+	}
+}
+
+//======================================================================================================================
+
+static void Stage2(const double * restrict xr,const double * restrict xi,double * restrict yr,double * restrict yi,
+	const double * restrict tw,const double sg,const int s,const int m)
+{
+	int q,u;
+	const double *x0r,*x0i,*x1r,*x1i;
+	double *y0r,*y0i,*y1r,*y1i;
+
+	for (q=0;q<m;q++) {
+		x0r=xr+s*q;
+		x0i=xi+s*q;
+		x1r=x0r+s*m;
+		x1i=x0i+s*m;
+		y0r=yr+2*s*q;
+		y0i=yi+2*s*q;
+		y1r=y0r+s;
+		y1i=y0i+s;
+		for (u=0;u<s;u++) {
+			y0r[u]=x0r[u]+x1r[u];
+			y0i[u]=x0i[u]+x1i[u];
+			y1r[u]=x0r[u]-x1r[u];
+			y1i[u]=x0i[u]-x1i[u];
+		}
+		if (q!=0) Twiddle(y1r,y1i,tw+2*q,sg,s);
+	}
+}
+
+//======================================================================================================================
+
+static void Stage3(const double * restrict xr,const double * restrict xi,double * restrict yr,double * restrict yi,
+	const double * restrict tw,const double sg,const int s,const int m)
+{
+	const double c=-0.5,s3=sg*sqrt(3)/2;
+	int q,u;
+	double t1r,t1i,t2r,t2i,t3r,t3i;
+	const double *x0r,*x0i,*x1r,*x1i,*x2r,*x2i;
+	double *y0r,*y0i,*y1r,*y1i,*y2r,*y2i;
+
+	for (q=0;q<m;q++) {
+		x0r=xr+s*q;
+		x0i=xi+s*q;
+		x1r=x0r+s*m;
+		x1i=x0i+s*m;
+		x2r=x1r+s*m;
+		x2i=x1i+s*m;
+		y0r=yr+3*s*q;
+		y0i=yi+3*s*q;
+		y1r=y0r+s;
+		y1i=y0i+s;
+		y2r=y1r+s;
+		y2i=y1i+s;
+		for (u=0;u<s;u++) {
+			t1r=x1r[u]+x2r[u];
+			t1i=x1i[u]+x2i[u];
+			t2r=x0r[u]+c*t1r;
+			t2i=x0i[u]+c*t1i;
+			// t3=i*s3*(x1-x2)
+			t3r=-s3*(x1i[u]-x2i[u]);
+			t3i=s3*(x1r[u]-x2r[u]);
+			y0r[u]=x0r[u]+t1r;
+			y0i[u]=x0i[u]+t1i;
+			y1r[u]=t2r+t3r;
+			y1i[u]=t2i+t3i;
+			y2r[u]=t2r-t3r;
+			y2i[u]=t2i-t3i;
+		}
+		if (q!=0) {
+			Twiddle(y1r,y1i,tw+4*q,sg,s);
+			Twiddle(y2r,y2i,tw+4*q+2,sg,s);
+		}
+	}
+}
+
+//======================================================================================================================
+
+static void Stage4(const double * restrict xr,const double * restrict xi,double * restrict yr,double * restrict yi,
+	const double * restrict tw,const double sg,const int s,const int m)
+{
+	int q,u;
+	double t0r,t0i,t1r,t1i,t2r,t2i,t3r,t3i;
+	const double *x0r,*x0i,*x1r,*x1i,*x2r,*x2i,*x3r,*x3i;
+	double *y0r,*y0i,*y1r,*y1i,*y2r,*y2i,*y3r,*y3i;
+
+	for (q=0;q<m;q++) {
+		x0r=xr+s*q;
+		x0i=xi+s*q;
+		x1r=x0r+s*m;
+		x1i=x0i+s*m;
+		x2r=x1r+s*m;
+		x2i=x1i+s*m;
+		x3r=x2r+s*m;
+		x3i=x2i+s*m;
+		y0r=yr+4*s*q;
+		y0i=yi+4*s*q;
+		y1r=y0r+s;
+		y1i=y0i+s;
+		y2r=y1r+s;
+		y2i=y1i+s;
+		y3r=y2r+s;
+		y3i=y2i+s;
+		for (u=0;u<s;u++) {
+			t0r=x0r[u]+x2r[u];
+			t0i=x0i[u]+x2i[u];
+			t1r=x0r[u]-x2r[u];
+			t1i=x0i[u]-x2i[u];
+			t2r=x1r[u]+x3r[u];
+			t2i=x1i[u]+x3i[u];
+			// t3=i*sg*(x1-x3)
+			t3r=-sg*(x1i[u]-x3i[u]);
+			t3i=sg*(x1r[u]-x3r[u]);
+			y0r[u]=t0r+t2r;
+			y0i[u]=t0i+t2i;
+			y1r[u]=t1r+t3r;
+			y1i[u]=t1i+t3i;
+			y2r[u]=t0r-t2r;
+			y2i[u]=t0i-t2i;
+			y3r[u]=t1r-t3r;
+			y3i[u]=t1i-t3i;
+		}
+		if (q!=0) {
+			Twiddle(y1r,y1i,tw+6*q,sg,s);
+			Twiddle(y2r,y2i,tw+6*q+2,sg,s);
+			Twiddle(y3r,y3i,tw+6*q+4,sg,s);
+		}
+	}
+}
+
+//======================================================================================================================
+
+static void Stage5(const double * restrict xr,const double * restrict xi,double * restrict yr,double * restrict yi,
+	const double * restrict tw,const double sg,const int s,const int m)
+{
+	const double c1=cos(TWO_PI/5),c2=cos(2*TWO_PI/5),s1=sg*sin(TWO_PI/5),s2=sg*sin(2*TWO_PI/5);
+	int q,u,j;
+	double t1r,t1i,t2r,t2i,t3r,t3i,t4r,t4i,u1r,u1i,u2r,u2i,v1r,v1i,v2r,v2i;
+	const double *x0r,*x0i,*x1r,*x1i,*x2r,*x2i,*x3r,*x3i,*x4r,*x4i;
+	double *y0r,*y0i,*y1r,*y1i,*y2r,*y2i,*y3r,*y3i,*y4r,*y4i;
+
+	for (q=0;q<m;q++) {
+		x0r=xr+s*q;
+		x0i=xi+s*q;
+		x1r=x0r+s*m;
+		x1i=x0i+s*m;
+		x2r=x1r+s*m;
+		x2i=x1i+s*m;
+		x3r=x2r+s*m;
+		x3i=x2i+s*m;
+		x4r=x3r+s*m;
+		x4i=x3i+s*m;
+		y0r=yr+5*s*q;
+		y0i=yi+5*s*q;
+		y1r=y0r+s;
+		y1i=y0i+s;
+		y2r=y1r+s;
+		y2i=y1i+s;
+		y3r=y2r+s;
+		y3i=y2i+s;
+		y4r=y3r+s;
+		y4i=y3i+s;
+		for (u=0;u<s;u++) {
+			t1r=x1r[u]+x4r[u];
+			t1i=x1i[u]+x4i[u];
+			t2r=x2r[u]+x3r[u];
+			t2i=x2i[u]+x3i[u];
+			t3r=x1r[u]-x4r[u];
+			t3i=x1i[u]-x4i[u];
+			t4r=x2r[u]-x3r[u];
+			t4i=x2i[u]-x3i[u];
+			u1r=x0r[u]+c1*t1r+c2*t2r;
+			u1i=x0i[u]+c1*t1i+c2*t2i;
+			u2r=x0r[u]+c2*t1r+c1*t2r;
+			u2i=x0i[u]+c2*t1i+c1*t2i;
+			// v1=i*(s1*t3+s2*t4), v2=i*(s2*t3-s1*t4)
+			v1r=-(s1*t3i+s2*t4i);
+			v1i=s1*t3r+s2*t4r;
+			v2r=-(s2*t3i-s1*t4i);
+			v2i=s2*t3r-s1*t4r;
+			y0r[u]=x0r[u]+t1r+t2r;
+			y0i[u]=x0i[u]+t1i+t2i;
+			y1r[u]=u1r+v1r;
+			y1i[u]=u1i+v1i;
+			y4r[u]=u1r-v1r;
+			y4i[u]=u1i-v1i;
+			y2r[u]=u2r+v2r;
+			y2i[u]=u2i+v2i;
+			y3r[u]=u2r-v2r;
+			y3i[u]=u2i-v2i;
+		}
+		if (q!=0) for (j=1;j<5;j++) Twiddle(yr+(5*q+j)*s,yi+(5*q+j)*s,tw+2*(4*q+j-1),sg,s);
+	}
+}
+
+//======================================================================================================================
+
+static inline void StageOdd(const int p,const double * restrict xr,const double * restrict xi,double * restrict yr,
+	double * restrict yi,const double * restrict tw,const double sg,const int s,const int m)
+/* general odd radix p; the values are combined in pairs (k,p-k) to halve the number of multiplications. It is inlined,
+ * so that the compiler can specialize it for p=7 (see fftmr)
+ */
+{
+	const int h=(p-1)/2;
+	double rc[p],rs[p],sr[h+1],si[h+1],dr[h+1],di[h+1],ur,ui,er,ei;
+	int q,u,j,k,r;
+	const double *x0r,*x0i;
+	double *y0r,*y0i;
+
+	for (r=0;r<p;r++) {
+		rc[r]=cos(TWO_PI*r/p);
+		rs[r]=sg*sin(TWO_PI*r/p);
+	}
+	for (q=0;q<m;q++) {
+		x0r=xr+s*q;
+		x0i=xi+s*q;
+		y0r=yr+p*s*q;
+		y0i=yi+p*s*q;
+		for (u=0;u<s;u++) {
+			y0r[u]=x0r[u];
+			y0i[u]=x0i[u];
+			for (k=1;k<=h;k++) {
+				sr[k]=x0r[u+k*s*m]+x0r[u+(p-k)*s*m];
+				si[k]=x0i[u+k*s*m]+x0i[u+(p-k)*s*m];
+				dr[k]=x0r[u+k*s*m]-x0r[u+(p-k)*s*m];
+				di[k]=x0i[u+k*s*m]-x0i[u+(p-k)*s*m];
+				y0r[u]+=sr[k];
+				y0i[u]+=si[k];
+			}
+			for (j=1;j<=h;j++) {
+				ur=x0r[u];
+				ui=x0i[u];
+				er=ei=0;
+				for (k=1;k<=h;k++) {
+					r=(j*k)%p;
+					ur+=rc[r]*sr[k];
+					ui+=rc[r]*si[k];
+					er+=rs[r]*dr[k];
+					ei+=rs[r]*di[k];
+				}
+				// y_j=u+i*e, y_(p-j)=u-i*e
+				y0r[u+j*s]=ur-ei;
+				y0i[u+j*s]=ui+er;
+				y0r[u+(p-j)*s]=ur+ei;
+				y0i[u+(p-j)*s]=ui-er;
+			}
+		}
+		if (q!=0) for (j=1;j<p;j++) Twiddle(y0r+j*s,y0i+j*s,tw+2*((p-1)*q+j-1),sg,s);
+	}
+}
+
+//======================================================================================================================
+
+void fftmr(doublecomplex * restrict data,double * restrict work,const double * restrict trigs,const int * restrict ifax,
+	const int inc,const int jump,const int n,const int lot,const int isign)
+/* performs lot complex FFTs of size n on data (in-place). Vector l starts at data[l*jump], its elements are separated
+ * by inc. work should have size of at least fftmrWorkSize(n); ifax and trigs should be initialized by fftmrInit.
+ */
+{
+	const double sg=isign;
+	const double *tw;
+	double *xr,*xi,*yr,*yi,*tmp;
+	doublecomplex *line;
+	int l0,nb,b,e,i,p,m,s,len;
+
+	for (l0=0;l0<lot;l0+=FFTMR_BATCH) {
+		nb=MIN(FFTMR_BATCH,lot-l0);
+		xr=work;
+		xi=xr+n*nb;
+		yr=xi+n*nb;
+		yi=yr+n*nb;
+		// copy nb vectors into the work array, interleaving their elements
+		for (b=0;b<nb;b++) {
+			line=data+(size_t)(l0+b)*jump;
+			for (e=0;e<n;e++) {
+				xr[e*nb+b]=creal(line[(size_t)e*inc]);
+				xi[e*nb+b]=cimag(line[(size_t)e*inc]);
+			}
+		}
+		// Stockham stages; vectors are the innermost dimension (the initial stride is nb)
+		tw=trigs;
+		s=nb;
+		len=n;
+		for (i=1;i<=ifax[0];i++) {
+			p=ifax[i];
+			m=len/p;
+			switch (p) {
+				case 2: Stage2(xr,xi,yr,yi,tw,sg,s,m); break;
+				case 3: Stage3(xr,xi,yr,yi,tw,sg,s,m); break;
+				case 4: Stage4(xr,xi,yr,yi,tw,sg,s,m); break;
+				case 5: Stage5(xr,xi,yr,yi,tw,sg,s,m); break;
+				case 7: StageOdd(7,xr,xi,yr,yi,tw,sg,s,m); break;
+				default: StageOdd(p,xr,xi,yr,yi,tw,sg,s,m); break;
+			}
+			tw+=2*m*(p-1);
+			tmp=xr;
+			xr=yr;
+			yr=tmp;
+			tmp=xi;
+			xi=yi;
+			yi=tmp;
+			s*=p;
+			len=m;
+		}
+		// copy the result back
+		for (b=0;b<nb;b++) {
+			line=data+(size_t)(l0+b)*jump;
+			for (e=0;e<n;e++) line[(size_t)e*inc]=xr[e*nb+b]+I*xi[e*nb+b];
+		}
+	}
+}
@@ -68,6 +68,13 @@
 #	define ATT_UNUSED
 #endif
 
+// UOIO - Used Only In OpenMP; to remove spurious 'unused' warnings when compiled without OpenMP
+#ifdef OPENMP
+#	define UOIO
+#else
+#	define UOIO ATT_UNUSED
+#endif
+
 #ifdef __ICC
 #	define LARGE_LOOP _Pragma ("loop_count (10000)")
 #else
@@ -0,0 +1,532 @@
+/* File: hmatrix.c
+ * $Date::                            $
+ * Descr: hierarchical matrix (H-matrix) representation of the interaction matrix in sparse mode
+ *
+ *        The dipoles are organized into cluster trees by recursive bisection of their bounding boxes (one tree for
+ *        local dipoles, i.e. rows, and another for all dipoles, i.e. columns). Each block of the interaction matrix
+ *        between two clusters, which are well separated (admissibility condition min(diam)<=HM_ETA*dist), is
+ *        approximated by a low-rank product U.V, computed by adaptive cross approximation (ACA) with partial pivoting
+ *        (Bebendorf M. "Approximation of boundary element matrices," Numer. Math. 86, 565-589 (2000)). The remaining
+ *        (near-field) blocks are stored as is. Both memory and time of the matrix-vector product then scale as
+ *        O(N*log(N)) for fixed accuracy and particle size (in units of wavelength), which is especially relevant for
+ *        large sparse aggregates.
+ *
+ *        Entries of the matrix are 3x3 blocks of the total interaction (including reflection from the surface), so
+ *        rows and columns of the approximated matrix correspond to individual components of dipoles.
+ *
+ * Copyright (C) 2013 ADDA contributors
+ * This file is part of ADDA.
+ *
+ * ADDA is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ *
+ * ADDA is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with ADDA. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include "const.h" // keep this first
+// project headers
+#include "cmplx.h"
+#include "comm.h"
+#include "interaction.h"
+#include "io.h"
+#include "memory.h"
+#include "vars.h"
+// system headers
+#include <math.h>
+#include <stdlib.h>
+
+#ifdef SPARSE // the whole file is relevant only in sparse mode
+
+// SEMI-GLOBAL VARIABLES
+
+// defined and initialized in calculator.c
+extern const int mvBatch;
+extern doublecomplex * restrict arg_full;
+// defined and initialized in param.c
+extern const double aca_eps;
+
+// LOCAL VARIABLES
+
+/* The following values minimize both memory and time of the construction and of the matrix-vector product for random
+ * aggregates of a few thousand dipoles. Smaller leaves and stricter admissibility lead to many small blocks, in which
+ * ACA fails to compress the 3x3 tensor (the rank exceeds half of the block size), so they end up stored as dense ones.
+ */
+#define HM_LEAF 64  // maximum number of dipoles in a leaf cluster
+#define HM_ETA  3.0 // parameter of the admissibility condition
+
+#ifdef OPENMP
+#	include <omp.h>
+#	define THREAD_ID omp_get_thread_num()
+#else
+#	define THREAD_ID 0
+#endif
+
+typedef struct {
+	size_t start,n;     // range of the cluster in the permutation array
+	double lo[3],hi[3]; // bounding box (in units of dipole size)
+	int child;          // index of the first child (the second one follows it), -1 for leaves
+} hcluster;
+
+typedef struct {
+	int r,c;  // row and column clusters
+	int rank; // rank of the approximation or -1 for a dense block
+	/* for low-rank blocks U (3nr x rank, column-major) and V (rank x 3nc, row-major), where nr and nc are the number of
+	 * dipoles in the clusters; for dense blocks U is the full block (3nr x 3nc, row-major) and V is not used
+	 */
+	doublecomplex *U,*V;
+} hblock;
+
+static hcluster *rowTree,*colTree; // cluster trees for rows (local dipoles) and columns (all dipoles)
+static size_t *rowPerm,*colPerm;  // permutations of local and all dipoles, corresponding to the trees
+static hblock *blocks;            // list of leaf blocks
+static size_t nblocks;            // number of blocks
+static size_t workSize;           // size of the working buffer of each thread
+static doublecomplex *hmWork;     // working buffers of all threads (for argument, intermediate, and result vectors)
+// variables used in comparison function for qsort, which has no argument for them
+static const int *sortPos;
+static int sortAxis;
+
+//======================================================================================================================
+
+static int ComparePos(const void *a,const void *b)
+// compares two dipoles (given by indices) by their coordinate along sortAxis
+{
+	const int pa=sortPos[3*(*(const size_t *)a)+sortAxis],pb=sortPos[3*(*(const size_t *)b)+sortAxis];
+	return (pa>pb) - (pa<pb);
+}
+
+//======================================================================================================================
+
+static void BuildTree(hcluster * restrict tree,int *ntree,const int node,size_t * restrict perm,
+	const int * restrict pos)
+/* Recursively builds the cluster tree, starting from node (with start and n already set). pos are the positions of
+ * dipoles, which indices are stored in perm. Clusters are bisected along the largest dimension of their bounding box,
+ * so that the sizes of the children differ by at most one.
+ */
+{
+	int k,axis;
+	size_t i;
+	hcluster *cl=tree+node;
+
+	for (k=0;k<3;k++) cl->lo[k]=cl->hi[k]=pos[3*perm[cl->start]+k];
+	for (i=cl->start+1;i<cl->start+cl->n;i++) for (k=0;k<3;k++) {
+		if (pos[3*perm[i]+k]<cl->lo[k]) cl->lo[k]=pos[3*perm[i]+k];
+		if (pos[3*perm[i]+k]>cl->hi[k]) cl->hi[k]=pos[3*perm[i]+k];
+	}
+	if (cl->n<=HM_LEAF) {
+		cl->child=-1;
+		return;
+	}
+	axis=0;
+	for (k=1;k<3;k++) if (cl->hi[k]-cl->lo[k] > cl->hi[axis]-cl->lo[axis]) axis=k;
+	sortPos=pos;
+	sortAxis=axis;
+	qsort(perm+cl->start,cl->n,sizeof(size_t),ComparePos);
+	cl->child=*ntree;
+	(*ntree)+=2;
+	tree[cl->child].start=cl->start;
+	tree[cl->child].n=cl->n/2;
+	tree[cl->child+1].start=cl->start+cl->n/2;
+	tree[cl->child+1].n=cl->n-cl->n/2;
+	BuildTree(tree,ntree,cl->child,perm,pos);
+	BuildTree(tree,ntree,cl->child+1,perm,pos);
+}
+
+//======================================================================================================================
+
+static hcluster *InitTree(const size_t n,size_t * restrict *perm,const int * restrict pos)
+// allocates and builds the cluster tree for n dipoles, also allocates and initializes the permutation
+{
+	hcluster *tree;
+	int ntree=1;
+	size_t i;
+
+	MALLOC_VECTOR(*perm,sizet,n,ALL);
+	for (i=0;i<n;i++) (*perm)[i]=i;
+	// since sizes of children differ by at most one, all leaves contain at least HM_LEAF/2 dipoles
+	tree=(hcluster *)voidVector(MultOverflow(4*(n/HM_LEAF)+1,sizeof(hcluster),ONE_POS_FUNC),ALL,POSIT,"tree");
+	tree[0].start=0;
+	tree[0].n=n;
+	BuildTree(tree,&ntree,0,*perm,pos);
+	return tree;
+}
+
+//======================================================================================================================
+
+static bool Admissible(const hcluster * restrict r,const hcluster * restrict c)
+// tests whether two clusters are well separated, so that their interaction can be approximated by a low-rank matrix
+{
+	int k;
+	double d,diamR=0,diamC=0,dist=0;
+
+	for (k=0;k<3;k++) {
+		diamR+=(r->hi[k]-r->lo[k])*(r->hi[k]-r->lo[k]);
+		diamC+=(c->hi[k]-c->lo[k])*(c->hi[k]-c->lo[k]);
+		d=MAX(r->lo[k]-c->hi[k],c->lo[k]-r->hi[k]);
+		if (d>0) dist+=d*d;
+	}
+	return dist>0 && MIN(diamR,diamC)<=HM_ETA*HM_ETA*dist;
+}
+
+//======================================================================================================================
+
+static void SplitBlocks(const int r,const int c,const bool fill)
+/* Recursively splits the block (r,c) until it is either admissible or both clusters are leaves. The leaf blocks are
+ * counted (in nblocks) and, if fill is true, stored in blocks.
+ */
+{
+	const hcluster *rc=rowTree+r,*cc=colTree+c;
+
+	if (Admissible(rc,cc) || (rc->child<0 && cc->child<0)) {
+		if (fill) {
+			blocks[nblocks].r=r;
+			blocks[nblocks].c=c;
+			blocks[nblocks].rank=Admissible(rc,cc) ? 0 : -1;
+			blocks[nblocks].U=blocks[nblocks].V=NULL;
+		}
+		nblocks++;
+	}
+	else if (rc->child<0) {
+		SplitBlocks(r,cc->child,fill);
+		SplitBlocks(r,cc->child+1,fill);
+	}
+	else if (cc->child<0) {
+		SplitBlocks(rc->child,c,fill);
+		SplitBlocks(rc->child+1,c,fill);
+	}
+	else {
+		SplitBlocks(rc->child,cc->child,fill);
+		SplitBlocks(rc->child,cc->child+1,fill);
+		SplitBlocks(rc->child+1,cc->child,fill);
+		SplitBlocks(rc->child+1,cc->child+1,fill);
+	}
+}
+
+//======================================================================================================================
+
+static void PairBlock(const size_t i,const size_t j,doublecomplex res[static 9])
+/* Computes the 3x3 block (row-major) of the interaction matrix (including the reflection from the surface) between
+ * local dipole i and dipole j (index among all dipoles)
+ */
+{
+	doublecomplex t[6];
+	const size_t i3=3*i,j3=3*j;
+	int k;
+
+	if (j!=local_nvoid_d0+i) { // main interaction is not computed for coinciding dipoles
+		(*InterTerm_int)(position[i3]-position_full[j3],position[i3+1]-position_full[j3+1],
+			position[i3+2]-position_full[j3+2],t);
+		res[0]=t[0]; res[1]=t[1]; res[2]=t[2];
+		res[3]=t[1]; res[4]=t[3]; res[5]=t[4];
+		res[6]=t[2]; res[7]=t[4]; res[8]=t[5];
+	}
+	else for (k=0;k<9;k++) res[k]=0;
+	if (surface) { // the symmetry of the reflection term is described in cReflMatrVec
+		(*ReflTerm_int)(position[i3]-position_full[j3],position[i3+1]-position_full[j3+1],
+			position[i3+2]+position_full[j3+2],t);
+		res[0]+=t[0]; res[1]+=t[1]; res[2]+=t[2];
+		res[3]+=t[1]; res[4]+=t[3]; res[5]+=t[4];
+		res[6]-=t[2]; res[7]-=t[4]; res[8]+=t[5];
+	}
+}
+
+//======================================================================================================================
+
+static void GetRow(const hblock * restrict b,const size_t p,doublecomplex * restrict row)
+// computes row p (of 3*nc elements) of the block b
+{
+	const hcluster *rc=rowTree+b->r,*cc=colTree+b->c;
+	const size_t i=rowPerm[rc->start+p/3],a=p%3;
+	size_t jj;
+	doublecomplex blk[9];
+
+	for (jj=0;jj<cc->n;jj++) {
+		PairBlock(i,colPerm[cc->start+jj],blk);
+		row[3*jj]=blk[3*a];
+		row[3*jj+1]=blk[3*a+1];
+		row[3*jj+2]=blk[3*a+2];
+	}
+}
+
+//======================================================================================================================
+
+static void GetCol(const hblock * restrict b,const size_t q,doublecomplex * restrict col)
+// computes column q (of 3*nr elements) of the block b
+{
+	const hcluster *rc=rowTree+b->r,*cc=colTree+b->c;
+	const size_t j=colPerm[cc->start+q/3],a=q%3;
+	size_t ii;
+	doublecomplex blk[9];
+
+	for (ii=0;ii<rc->n;ii++) {
+		PairBlock(rowPerm[rc->start+ii],j,blk);
+		col[3*ii]=blk[a];
+		col[3*ii+1]=blk[3+a];
+		col[3*ii+2]=blk[6+a];
+	}
+}
+
+//======================================================================================================================
+
+static void DenseBlock(hblock * restrict b)
+// computes and stores the full block b
+{
+	const size_t m=3*rowTree[b->r].n,n=3*colTree[b->c].n;
+	size_t p;
+
+	b->rank=-1;
+	b->U=complexVector(m*n,ALL,POSIT,"dense block");
+	for (p=0;p<m;p++) GetRow(b,p,b->U+p*n);
+}
+
+//======================================================================================================================
+
+static void ACABlock(hblock * restrict b)
+/* Approximates the block b by adaptive cross approximation with partial pivoting, until the norm of the last cross
+ * (relative to the estimate of the norm of the whole block) is below aca_eps. If the rank becomes so large, that the
+ * low-rank representation requires more memory than the full block, the latter is computed instead.
+ */
+{
+	const size_t m=3*rowTree[b->r].n,n=3*colTree[b->c].n,kmax=m*n/(m+n);
+	size_t i,j,p,q,k,l;
+	double norm2,max,nu,nv;
+	doublecomplex pivot,cr,cc;
+	doublecomplex *U,*V;
+	bool *used,conv;
+
+	U=complexVector(m*kmax,ALL,POSIT,"U");
+	V=complexVector(kmax*n,ALL,POSIT,"V");
+	used=boolVector(m,ALL,POSIT,"used");
+	for (i=0;i<m;i++) used[i]=false;
+	norm2=0;
+	conv=false;
+	k=0;
+	p=0;
+	while (k<kmax) {
+		used[p]=true;
+		// compute residual row p and search for the pivot in it
+		GetRow(b,p,V+k*n);
+		for (l=0;l<k;l++) for (j=0;j<n;j++) V[k*n+j]-=U[l*m+p]*V[l*n+j];
+		q=0;
+		max=0;
+		for (j=0;j<n;j++) if (cabs(V[k*n+j])>max) {
+			max=cabs(V[k*n+j]);
+			q=j;
+		}
+		if (max==0) { // the row is (numerically) zero, so proceed to the next unused row
+			for (p=0;p<m && used[p];p++);
+			if (p==m) {
+				conv=true;
+				break;
+			}
+			continue;
+		}
+		pivot=V[k*n+q];
+		for (j=0;j<n;j++) V[k*n+j]/=pivot;
+		// compute residual column q
+		GetCol(b,q,U+k*m);
+		for (l=0;l<k;l++) for (i=0;i<m;i++) U[k*m+i]-=V[l*n+q]*U[l*m+i];
+		// update the estimate of the Frobenius norm of the approximation
+		nu=nv=0;
+		for (i=0;i<m;i++) nu+=cAbs2(U[k*m+i]);
+		for (j=0;j<n;j++) nv+=cAbs2(V[k*n+j]);
+		for (l=0;l<k;l++) {
+			cr=cc=0;
+			for (i=0;i<m;i++) cr+=conj(U[l*m+i])*U[k*m+i];
+			for (j=0;j<n;j++) cc+=conj(V[l*n+j])*V[k*n+j];
+			norm2+=2*creal(cr*cc);
+		}
+		norm2+=nu*nv;
+		k++;
+		if (nu*nv<=aca_eps*aca_eps*norm2) {
+			conv=true;
+			break;
+		}
+		// next row is chosen by the largest element of the last column among unused rows
+		max=-1;
+		for (i=0;i<m;i++) if (!used[i] && cabs(U[(k-1)*m+i])>max) {
+			max=cabs(U[(k-1)*m+i]);
+			p=i;
+		}
+		if (max<0) {
+			conv=true;
+			break;
+		}
+	}
+	Free_general(used);
+	if (!conv) { // low-rank approximation is not efficient
+		Free_cVector(U);
+		Free_cVector(V);
+		DenseBlock(b);
+		return;
+	}
+	// store the factors with exact sizes
+	b->rank=(int)k;
+	b->U=b->V=NULL;
+	if (k>0) {
+		b->U=complexVector(m*k,ALL,POSIT,"U");
+		b->V=complexVector(k*n,ALL,POSIT,"V");
+		for (i=0;i<m*k;i++) b->U[i]=U[i];
+		for (j=0;j<k*n;j++) b->V[j]=V[j];
+	}
+	Free_cVector(U);
+	Free_cVector(V);
+}
+
+//======================================================================================================================
+
+void InitHmatrix(const bool thrSafe UOIO)
+/* Builds the H-matrix representation of the local rows of the interaction matrix. Computation of blocks is shared
+ * among OpenMP threads, if thrSafe. Should not be called in prognosis mode, since the required memory can only be
+ * determined during the construction.
+ */
+{
+	size_t ib,maxRank=0;
+	size_t stats[3]={0,0,0}; // number of blocks, number of dense blocks, and number of stored matrix elements
+	double memTot,memMax,rankMax;
+
+	if (IFROOT) printf("Building hierarchical (H-) matrix\n");
+	rowTree=InitTree(local_nvoid_Ndip,&rowPerm,position);
+	colTree=InitTree(nvoid_Ndip,&colPerm,position_full);
+	// block tree is traversed twice: for counting and for filling the blocks
+	nblocks=0;
+	SplitBlocks(0,0,false);
+	blocks=(hblock *)voidVector(MultOverflow(nblocks,sizeof(hblock),ONE_POS_FUNC),ALL,POSIT,"blocks");
+	nblocks=0;
+	SplitBlocks(0,0,true);
+#pragma omp parallel for schedule(dynamic) if(thrSafe)
+	for (ib=0;ib<nblocks;ib++) {
+		if (blocks[ib].rank<0) DenseBlock(blocks+ib);
+		else ACABlock(blocks+ib);
+	}
+	// collect statistics
+	stats[0]=nblocks;
+	for (ib=0;ib<nblocks;ib++) {
+		const size_t m=3*rowTree[blocks[ib].r].n,n=3*colTree[blocks[ib].c].n;
+		if (blocks[ib].rank<0) {
+			stats[1]++;
+			stats[2]+=m*n;
+		}
+		else {
+			stats[2]+=blocks[ib].rank*(m+n);
+			if ((size_t)blocks[ib].rank>maxRank) maxRank=blocks[ib].rank;
+		}
+	}
+	// working buffers for argument and result of a block, intermediate vector, and local result for mvBatch vectors
+	workSize=3*nvoid_Ndip+3*local_nvoid_Ndip+maxRank+3*mvBatch*local_nvoid_Ndip;
+	MALLOC_VECTOR(hmWork,complex,MultOverflow(nthreads,workSize,ONE_POS_FUNC),ALL);
+	memory+=(stats[2]+nthreads*workSize)*sizeof(doublecomplex);
+	memTot=AccumulateMax((stats[2]+nthreads*workSize)*sizeof(doublecomplex),&memMax);
+	rankMax=maxRank;
+	AccumulateMax(maxRank,&rankMax);
+	MyInnerProduct(stats,sizet_type,3,NULL);
+	if (IFROOT) {
+		PrintBoth(logfile,"H-matrix (ACA accuracy "GFORMDEF"): %zu blocks (%zu dense), maximum rank %.0f, %.3g%% of "
+			"elements of the full matrix\n",aca_eps,stats[0],stats[1],rankMax,
+			100.0*stats[2]/(9.0*nvoid_Ndip*nvoid_Ndip));
+#ifdef PARALLEL
+		PrintBoth(logfile,"Memory usage for H-matrix: total - "FFORMM" MB, maximum per processor - "FFORMM" MB\n",
+			memTot/MBYTE,memMax/MBYTE);
+#else
+		PrintBoth(logfile,"Memory usage for H-matrix: "FFORMM" MB\n",memTot/MBYTE);
+#endif
+	}
+}
+
+//======================================================================================================================
+
+void HmatProd(const int nv,doublecomplex * const * restrict resultvecs)
+/* Computes the products of the local rows of the interaction matrix (in H-matrix representation) with nv vectors in
+ * arg_full (one after another, each of size 3*nvoid_Ndip) and stores them in resultvecs. The blocks are shared among
+ * OpenMP threads, each of them accumulates the results in its own buffer, which are summed up afterwards.
+ */
+{
+	const size_t len=3*local_nvoid_Ndip,resOff=workSize-3*mvBatch*local_nvoid_Ndip; // offset of results in buffer
+	size_t ib,i;
+	int v,t;
+
+	// all buffers are zeroed, since the following parallel region may use less threads
+	for (t=0;t<nthreads;t++) {
+#pragma omp parallel for
+		for (i=0;i<nv*len;i++) hmWork[t*workSize+resOff+i]=0;
+	}
+#pragma omp parallel
+	{
+		doublecomplex * restrict x=hmWork+THREAD_ID*workSize;
+		doublecomplex * restrict y=x+3*nvoid_Ndip;
+		doublecomplex * restrict tmp=y+3*local_nvoid_Ndip;
+		doublecomplex * restrict res=x+resOff;
+		size_t ii,jj,m,n;
+		int w,l;
+
+#pragma omp for schedule(dynamic)
+		for (ib=0;ib<nblocks;ib++) {
+			const hblock *b=blocks+ib;
+			const hcluster *rc=rowTree+b->r,*cc=colTree+b->c;
+			m=3*rc->n;
+			n=3*cc->n;
+			if (b->rank==0) continue;
+			for (w=0;w<nv;w++) {
+				const doublecomplex *arg=arg_full+w*3*nvoid_Ndip;
+				for (jj=0;jj<cc->n;jj++) {
+					const size_t j3=3*colPerm[cc->start+jj];
+					x[3*jj]=arg[j3];
+					x[3*jj+1]=arg[j3+1];
+					x[3*jj+2]=arg[j3+2];
+				}
+				if (b->rank<0) for (ii=0;ii<m;ii++) {
+					y[ii]=0;
+					for (jj=0;jj<n;jj++) y[ii]+=b->U[ii*n+jj]*x[jj];
+				}
+				else {
+					for (l=0;l<b->rank;l++) {
+						tmp[l]=0;
+						for (jj=0;jj<n;jj++) tmp[l]+=b->V[l*n+jj]*x[jj];
+					}
+					for (ii=0;ii<m;ii++) y[ii]=0;
+					for (l=0;l<b->rank;l++) for (ii=0;ii<m;ii++) y[ii]+=b->U[l*m+ii]*tmp[l];
+				}
+				for (ii=0;ii<rc->n;ii++) {
+					const size_t i3=w*len+3*rowPerm[rc->start+ii];
+					res[i3]+=y[3*ii];
+					res[i3+1]+=y[3*ii+1];
+					res[i3+2]+=y[3*ii+2];
+				}
+			}
+		}
+	}
+	// sum up the results of all threads
+	for (v=0;v<nv;v++) {
+		doublecomplex * restrict res=hmWork+resOff+v*len;
+#pragma omp parallel for private(t)
+		for (i=0;i<len;i++) {
+			resultvecs[v][i]=res[i];
+			for (t=1;t<nthreads;t++) resultvecs[v][i]+=res[t*workSize+i];
+		}
+	}
+}
+
+//======================================================================================================================
+
+void FreeHmatrix(void)
+// frees all memory allocated in InitHmatrix
+{
+	size_t ib;
+
+	for (ib=0;ib<nblocks;ib++) {
+		Free_cVector(blocks[ib].U);
+		Free_cVector(blocks[ib].V);
+	}
+	Free_general(blocks);
+	Free_general(rowTree);
+	Free_general(colTree);
+	Free_general(rowPerm);
+	Free_general(colPerm);
+	Free_cVector(hmWork);
+	nblocks=0;
+}
+
+#endif // SPARSE
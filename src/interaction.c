@@ -23,14 +23,29 @@
 #include "vars.h"
 // system headers
 #include <float.h> // for DBL_EPSILON
+#include <limits.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+// cache of Sommerfeld integrals is memory-mapped, when possible
+#ifdef POSIX
+#	define SOM_CACHE_MMAP
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <unistd.h>
+#endif
+
+// parameters of on-disk cache of Sommerfeld integrals
+#define SOM_CACHE_HEADER 1024 // size of the header (in bytes), the data starts right after it
+#define SOM_CACHE_MAGIC "ADDA Sommerfeld cache, version 1" // first line of the header
 
 // SEMI-GLOBAL VARIABLES
 
 // defined and initialized in make_particle.c
 extern const double ZsumShift;
 // defined and initialized in param.c
-extern const double igt_lim,igt_eps,nloc_Rp;
+extern const double igt_lim,igt_eps,nloc_Rp,som_eps;
+extern const char *som_cache;
 extern const bool InteractionRealArgs;
 
 // used in fft.c
@@ -57,6 +72,33 @@ static doublecomplex surfRCn; // reflection coefficient for normal incidence
 static bool XlessY; // whether boxX is not larger than boxY (used for SomTable)
 static doublecomplex * restrict somTable; // table of Sommerfeld integrals
 static size_t * restrict somIndex; // array for indexing somTable (in the xy-plane)
+#ifdef SPARSE
+/* In sparse mode somTable contains values only for distinct keys (indices in the full table), which are actually used,
+ * see CalcSomTable. The keys are sorted, and positions in this array are found through a hash table with open
+ * addressing (somHash), which contains 1+position for each key (0 denotes an empty slot).
+ */
+static size_t * restrict somKeys;
+static size_t * restrict somHash;
+static size_t somHashMask; // size of somHash minus 1 (size is a power of two)
+#endif
+
+static bool somGrid; // whether interpolation grid for Sommerfeld integrals was built
+/* On-disk cache of Sommerfeld integrals (see SomCacheInit). The cached block is indexed by K (layer index shifted by
+ * integer part of ZsumShift, somZint) and by P=j(j+1)/2+i for i<=j (independent of the particle box). Missing values
+ * have all bits set (see SomMissing).
+ */
+static char somCacheKey[SOM_CACHE_HEADER]; // description of all parameters, on which the integrals depend
+static char somCacheFname[MAX_FNAME];      // name of the cache file
+static const doublecomplex *somCacheData;  // cached block (NULL if cache is not loaded)
+static int somCacheK0,somCacheNK,somCacheNJ; // range of the block: K in [K0,K0+nK), j<nJ
+static int somZint;                        // integer part (rounded) of ZsumShift
+static size_t *somNewKeys;                 // (K,P) pairs of computed values, which are absent in cache
+static doublecomplex *somNewVals;          // corresponding values
+static size_t somNnew,somSizeNew,somNcached; // number of new and cached values, and size of the above arrays
+#ifdef SOM_CACHE_MMAP
+static void *somCacheMap;                  // memory-mapped cache file (NULL if memory mapping is not used)
+static size_t somCacheMapSize;             // size of the memory-mapped file
+#endif
 
 #ifdef USE_SSE3
 static __m128d c1, c2, c3, zo, inv_2pi, p360, prad_to_deg;
@@ -75,6 +117,11 @@ void cisi(double x,double *ci,double *si);
 // somnec.c
 void som_init(complex double epscf);
 void evlua(double zphIn,double rhoIn,complex double *erv, complex double *ezv,complex double *erh, complex double *eph);
+// somgrid.c
+void InitSomGrid(double rhoMax,double zMin,double zMax,double eps,
+	void (*exact)(double rho,double z,doublecomplex vals[static 4]));
+bool SomGridInterp(double rho,double z,doublecomplex vals[static 4]);
+void FreeSomGrid(void);
 
 // this is used for debugging, should be empty define, when not required
 #define PRINT_GVAL /*printf("%s: %d,%d,%d: %g%+gi, %g%+gi, %g%+gi,\n%g%+gi, %g%+gi, %g%+gi\n",__func__,i,j,k,\
@@ -1154,10 +1201,323 @@ WRAPPERS_REFL(ReflTerm_img)
 
 //=====================================================================================================================
 
-static inline void SingleSomIntegral(double rho,const double z,doublecomplex vals[static 4])
-/* computes a single Sommerfeld integral (4-element array); arguments are in real units (um)
- * currently it is a wrapper around evlua, but in the future it may be replaced by use of interpolation table
+static inline size_t SomFullIndex(const int i,const int j,const int k)
+/* Index in the full table of Sommerfeld integrals (in units of 4 elements) for displacement (i,j,k), where k is the
+ * index of the sum of heights of two dipoles
+ */
+{
+	const size_t iT=abs(i),jT=abs(j);
+	size_t ind;
+
+	if (XlessY) {
+		if (iT<=jT) ind=somIndex[jT]+iT;
+		else ind=somIndex[iT]+jT; // effectively swap iT and jT
+	}
+	else {
+		if (iT>=jT) ind=somIndex[jT]+iT-jT;
+		else ind=somIndex[iT]+jT-iT; // effectively swap iT and jT
+	}
+	return ind+k*somIndex[boxY];
+}
+
+//=====================================================================================================================
+
+#ifdef SPARSE
+
+static inline size_t SomHashSlot(const size_t key,const size_t mask)
+// initial slot in a hash table (of size mask+1) for a given key; Fibonacci hashing is used
+{
+	const uint64_t h=(uint64_t)key*UINT64_C(11400714819323198485);
+	return (size_t)(h^(h>>32)) & mask;
+}
+
+//=====================================================================================================================
+
+static void SomKeyInsert(size_t * restrict *set,size_t *size,size_t *n,const size_t key)
+/* inserts key into the hash set (of size *size, containing *n keys, empty slots are SIZE_MAX); if the set becomes more
+ * than half full, it is doubled
+ */
+{
+	size_t slot,i,*old;
+
+	slot=SomHashSlot(key,*size-1);
+	while ((*set)[slot]!=SIZE_MAX) {
+		if ((*set)[slot]==key) return;
+		slot=(slot+1)&(*size-1);
+	}
+	(*set)[slot]=key;
+	(*n)++;
+	if (2*(*n)>*size) {
+		old=*set;
+		*size*=2;
+		MALLOC_VECTOR(*set,sizet,*size,ALL);
+		for (i=0;i<*size;i++) (*set)[i]=SIZE_MAX;
+		for (i=0;i<*size/2;i++) if (old[i]!=SIZE_MAX) {
+			slot=SomHashSlot(old[i],*size-1);
+			while ((*set)[slot]!=SIZE_MAX) slot=(slot+1)&(*size-1);
+			(*set)[slot]=old[i];
+		}
+		Free_general(old);
+	}
+}
+
+//=====================================================================================================================
+
+static int CompareSizet(const void *a,const void *b)
+// compares two size_t values, for qsort
+{
+	const size_t x=*(const size_t *)a,y=*(const size_t *)b;
+	return (x>y) - (x<y);
+}
+
+//=====================================================================================================================
+
+static inline size_t SomTablePos(const size_t key)
+// finds the position of key in the sparse table of Sommerfeld integrals
+{
+	size_t slot,pos;
+
+	slot=SomHashSlot(key,somHashMask);
+	while (somHash[slot]!=0) {
+		pos=somHash[slot]-1;
+		if (somKeys[pos]==key) return pos;
+		slot=(slot+1)&somHashMask;
+	}
+	LogError(ONE_POS,"Sommerfeld integral with index %zu is missing in the lookup table",key);
+}
+
+#endif // SPARSE
+
+//=====================================================================================================================
+
+static inline size_t SomTriIndex(const int i,const int j)
+// index P of the pair (i,j) of non-negative integers (the order is irrelevant) in the cache of Sommerfeld integrals
+{
+	const size_t a=MIN(i,j),b=MAX(i,j);
+	return b*(b+1)/2+a;
+}
+
+//=====================================================================================================================
+
+static inline bool SomMissing(const doublecomplex *v)
+/* tests whether the value in the cache is missing (has all bits set, which is a NaN). The test is done bitwise, since
+ * isnan() may be optimized away due to '-ffast-math'.
+ */
+{
+	const unsigned char *c=(const unsigned char *)v;
+	size_t i;
+
+	for (i=0;i<sizeof(doublecomplex);i++) if (c[i]!=UCHAR_MAX) return false;
+	return true;
+}
+
+//=====================================================================================================================
+
+static void SomCacheInit(void)
+/* builds the description of all parameters, on which the Sommerfeld integrals depend, and the name of the cache
+ * file; then loads the cached block (if present). The integrals depend only on the substrate, wavelength, and dipole
+ * size, but not on the particle itself. Only the fractional part of ZsumShift enters the description, since the
+ * integer part only shifts the layer index. So the same file serves different particles above the same substrate and
+ * any number of processors, and the block can be extended (in K and in j) by subsequent runs. The file name is
+ * determined by (64-bit FNV-1a) hash of the description. The file is either memory-mapped or read into allocated
+ * memory (see SOM_CACHE_MMAP).
+ */
+{
+	FILE * restrict file;
+	char header[SOM_CACHE_HEADER];
+	size_t i,len,fsize;
+	uint64_t hash;
+	double zfrac;
+	bool ok;
+
+	somZint=(int)floor(ZsumShift+0.5);
+	zfrac=ZsumShift-somZint;
+	if (fabs(zfrac)<ROUND_ERR) zfrac=0; // also gets rid of '-0' in the description
+	SnprintfErr(ALL_POS,somCacheKey,SOM_CACHE_HEADER,SOM_CACHE_MAGIC"\n"
+		"WaveNum="GFORM_EXACT" gridspace="GFORM_EXACT" msub=("GFORM_EXACT","GFORM_EXACT") Zfrac=%.9f\n"
+		"som_eps="GFORM_EXACT" doublecomplex=%zu\n",WaveNum,gridspace,REIM(msub),zfrac,som_eps,sizeof(doublecomplex));
+	hash=UINT64_C(14695981039346656037);
+	for (i=0;somCacheKey[i]!='\0';i++) {
+		hash^=(unsigned char)somCacheKey[i];
+		hash*=UINT64_C(1099511628211);
+	}
+	SnprintfErr(ALL_POS,somCacheFname,MAX_FNAME,"%s/"F_SOMCACHE,som_cache,(unsigned long)(hash>>32),
+		(unsigned long)(hash&UINT32_MAX));
+	somCacheData=NULL;
+	somNewKeys=NULL;
+	somNewVals=NULL;
+	somNnew=somSizeNew=somNcached=0;
+	// header is read by standard functions; it consists of the description and the range of the block
+	if ((file=fopen(somCacheFname,"rb"))==NULL) return;
+	len=strlen(somCacheKey);
+	fsize=0;
+	ok=(fread(header,1,SOM_CACHE_HEADER,file)==SOM_CACHE_HEADER && strncmp(header,somCacheKey,len)==0
+		&& sscanf(header+len,"K0=%d nK=%d nJ=%d",&somCacheK0,&somCacheNK,&somCacheNJ)==3 && somCacheNK>0
+		&& somCacheNJ>0);
+	if (ok) {
+		fsize=SOM_CACHE_HEADER+MultOverflow(4*(size_t)somCacheNK,SomTriIndex(0,somCacheNJ),ONE_POS_FUNC)
+			*sizeof(doublecomplex);
+		ok=TestFileSize(somCacheFname,fsize);
+	}
+	if (!ok) LogWarning(EC_WARN,ALL_POS,"Cache file '%s' does not match current parameters (or is corrupted). It will "
+		"be overwritten",somCacheFname);
+#ifndef SOM_CACHE_MMAP
+	if (ok) {
+		doublecomplex *data;
+		const size_t n=(fsize-SOM_CACHE_HEADER)/sizeof(doublecomplex);
+		MALLOC_VECTOR(data,complex,n,ALL);
+		fseek(file,SOM_CACHE_HEADER,SEEK_SET);
+		if (fread(data,sizeof(doublecomplex),n,file)!=n)
+			LogError(ALL_POS,"Failed to read cache file '%s'",somCacheFname);
+		somCacheData=data;
+	}
+#endif
+	FCloseErr(file,somCacheFname,ALL_POS);
+#ifdef SOM_CACHE_MMAP
+	if (ok) {
+		int fd;
+		// read-only private mapping is sufficient, since the values are copied into somTable
+		if ((fd=open(somCacheFname,O_RDONLY))==-1 ||
+			(somCacheMap=mmap(NULL,fsize,PROT_READ,MAP_PRIVATE,fd,0))==MAP_FAILED) {
+			LogWarning(EC_WARN,ALL_POS,"Failed to map cache file '%s' into memory",somCacheFname);
+			somCacheMap=NULL;
+		}
+		else {
+			somCacheMapSize=fsize;
+			somCacheData=(const doublecomplex *)((char *)somCacheMap+SOM_CACHE_HEADER);
+		}
+		if (fd!=-1) close(fd);
+	}
+	else somCacheMap=NULL;
+#endif
+}
+
+//=====================================================================================================================
+
+static bool SomCacheGet(const int i,const int j,const int k,doublecomplex vals[static 4])
+// tries to get the Sommerfeld integrals for pair (i,j) and layer k from the cache; returns true if successful
+{
+	const int K=k+somZint-somCacheK0;
+	const doublecomplex *v;
+
+	if (somCacheData==NULL || K<0 || K>=somCacheNK || MAX(i,j)>=somCacheNJ) return false;
+	v=somCacheData+4*((size_t)K*SomTriIndex(0,somCacheNJ)+SomTriIndex(i,j));
+	if (SomMissing(v)) return false;
+	memcpy(vals,v,4*sizeof(doublecomplex));
+	somNcached++;
+	return true;
+}
+
+//=====================================================================================================================
+
+static void SomCacheAdd(const int i,const int j,const int k,const doublecomplex vals[static 4])
+// adds computed Sommerfeld integrals for pair (i,j) and layer k to the list of new values (to be saved in the cache)
+{
+	if (somNnew==somSizeNew) {
+		somSizeNew=2*somSizeNew+64;
+		somNewKeys=(size_t *)voidRealloc(somNewKeys,MultOverflow(2*somSizeNew,sizeof(size_t),ONE_POS_FUNC),ALL_POS,
+			"somNewKeys");
+		somNewVals=(doublecomplex *)voidRealloc(somNewVals,MultOverflow(4*somSizeNew,sizeof(doublecomplex),
+			ONE_POS_FUNC),ALL_POS,"somNewVals");
+	}
+	somNewKeys[2*somNnew]=k+somZint;
+	somNewKeys[2*somNnew+1]=SomTriIndex(i,j);
+	memcpy(somNewVals+4*somNnew,vals,4*sizeof(doublecomplex));
+	somNnew++;
+}
+
+//=====================================================================================================================
+
+static void SomCacheFinish(void)
+/* gathers the new values (absent in the cache) from all processors; the root processor merges them with the cached
+ * block (extending its range, if needed) and writes the result into the cache file. The file is written under
+ * temporary name, which is renamed in the end, so that it is never left partially written. Finally, the cache is
+ * released.
  */
+{
+	size_t *keys,nkeys,nvals,ptOld,pt,ind,n[2];
+	doublecomplex *vals,*block;
+	int K0,K1,nJ,K;
+	FILE * restrict file;
+	char header[SOM_CACHE_HEADER],tmpFname[MAX_FNAME];
+
+	n[0]=somNcached;
+	n[1]=somNnew;
+	MyInnerProduct(n,sizet_type,2,NULL);
+	if (IFROOT) PrintBoth(logfile,"Sommerfeld integrals: %zu values loaded from cache file '%s', %zu computed\n",n[0],
+		somCacheFname,n[1]);
+#ifdef PARALLEL
+	keys=AllGatherVar(somNewKeys,2*somNnew,sizet_type,&nkeys,NULL);
+	vals=AllGatherVar(somNewVals,4*somNnew,cmplx_type,&nvals,NULL);
+	Free_general(somNewKeys);
+	Free_cVector(somNewVals);
+#else
+	keys=somNewKeys;
+	vals=somNewVals;
+	nkeys=2*somNnew;
+#endif
+	if (IFROOT && nkeys>0) {
+		// range of the new block includes the old one and all new values
+		if (somCacheData!=NULL) {
+			K0=somCacheK0;
+			K1=K0+somCacheNK;
+			nJ=somCacheNJ;
+		}
+		else {
+			K0=(int)keys[0];
+			K1=K0+1;
+			nJ=0;
+		}
+		for (ind=0;ind<nkeys;ind+=2) {
+			K=(int)keys[ind];
+			K0=MIN(K0,K);
+			K1=MAX(K1,K+1);
+			while (SomTriIndex(0,nJ)<=keys[ind+1]) nJ++;
+		}
+		pt=SomTriIndex(0,nJ);
+		nvals=MultOverflow(4*(size_t)(K1-K0),pt,ONE_POS_FUNC);
+		MALLOC_VECTOR(block,complex,nvals,ONE);
+		memset(block,UCHAR_MAX,nvals*sizeof(doublecomplex)); // marks all values as missing
+		// since P does not depend on nJ, each layer of the old block is a prefix of the new one
+		if (somCacheData!=NULL) {
+			ptOld=SomTriIndex(0,somCacheNJ);
+			for (K=0;K<somCacheNK;K++) memcpy(block+4*((size_t)(K+somCacheK0-K0)*pt),somCacheData+4*(size_t)K*ptOld,
+				4*ptOld*sizeof(doublecomplex));
+		}
+		for (ind=0;ind<nkeys/2;ind++)
+			memcpy(block+4*((keys[2*ind]-K0)*pt+keys[2*ind+1]),vals+4*ind,4*sizeof(doublecomplex));
+		// write the file; directory is created only if needed
+		memset(header,0,SOM_CACHE_HEADER);
+		SnprintfErr(ONE_POS,header,SOM_CACHE_HEADER,"%sK0=%d nK=%d nJ=%d\n",somCacheKey,K0,K1-K0,nJ);
+		SnprintfErr(ONE_POS,tmpFname,MAX_FNAME,"%s"F_DMCACHE_TMP,somCacheFname);
+		if ((file=fopen(tmpFname,"wb"))==NULL) {
+			MkDirErr(som_cache,ONE_POS);
+			file=FOpenErr(tmpFname,"wb",ONE_POS);
+		}
+		if (fwrite(header,1,SOM_CACHE_HEADER,file)!=SOM_CACHE_HEADER
+			|| fwrite(block,sizeof(doublecomplex),nvals,file)!=nvals)
+			LogError(ONE_POS,"Failed writing to file '%s'",tmpFname);
+		FCloseErr(file,tmpFname,ONE_POS);
+		if (rename(tmpFname,somCacheFname)!=0)
+			LogWarning(EC_WARN,ONE_POS,"Failed to rename file '%s' into '%s'",tmpFname,somCacheFname);
+		else fprintf(logfile,"Sommerfeld integrals saved to cache file '%s'\n",somCacheFname);
+		Free_cVector(block);
+	}
+	Free_general(keys);
+	Free_cVector(vals);
+	// release the cached block
+#ifdef SOM_CACHE_MMAP
+	if (somCacheMap!=NULL) munmap(somCacheMap,somCacheMapSize);
+#else
+	Free_cVector((doublecomplex *)somCacheData);
+#endif
+	somCacheData=NULL;
+}
+
+//=====================================================================================================================
+
+static void ExactSomIntegral(double rho,const double z,doublecomplex vals[static 4])
+// computes a single Sommerfeld integral (4-element array) by direct evaluation; arguments are in real units (um)
 {
 	// TODO: these scales can be removed by changes in som_init to use proper wavenumber instead of 2*pi
 	const double scale=WaveNum/TWO_PI;
@@ -1173,6 +1533,36 @@ static inline void SingleSomIntegral(double rho,const double z,doublecomplex val
 
 //=====================================================================================================================
 
+static inline void SingleSomIntegral(const double rho,const double z,doublecomplex vals[static 4])
+/* computes a single Sommerfeld integral (4-element array); arguments are in real units (um)
+ * uses interpolation grid (if enabled by som_eps) and falls back to direct evaluation outside of its domain
+ */
+{
+	if (somGrid && SomGridInterp(rho,z,vals)) return;
+	ExactSomIntegral(rho,z,vals);
+}
+
+//=====================================================================================================================
+
+static void SomTableEntry(const int i,const int j,const int k,doublecomplex vals[static 4])
+/* obtains Sommerfeld integrals for displacement (i,j) in the xy-plane (the order is irrelevant) and layer k; either
+ * loads them from the cache or computes them (then they are added to the cache). The interpolation grid (if enabled)
+ * is built upon first need, so it is not built at all when all values are cached. The grid covers all values of
+ * (rho,Z) used in CalcSomTable (both in FFT and sparse modes).
+ */
+{
+	if (som_cache!=NULL && SomCacheGet(i,j,k,vals)) return;
+	if (som_eps!=UNDEF && !somGrid) {
+		InitSomGrid(hypot(boxX-1,boxY-1)*gridspace,ZsumShift*gridspace,(ZsumShift+local_Nz_Rm-1)*gridspace,som_eps,
+			ExactSomIntegral);
+		somGrid=true;
+	}
+	SingleSomIntegral(hypot(i,j)*gridspace,(k+ZsumShift)*gridspace,vals);
+	if (som_cache!=NULL) SomCacheAdd(i,j,k,vals);
+}
+
+//=====================================================================================================================
+
 static void CalcSomTable(void)
 /* calculates a table of (essential Sommerfeld integrals), which are further combined into reflected Green's tensor
  * For z values - all local grid; for x- and y-values only positive values are considered and additionally y<=x.
@@ -1180,26 +1570,31 @@ static void CalcSomTable(void)
  * That is good for FFT code, since all these values are required anyway. A minor improvement can be achieved by
  * locating different pairs of i,j that lead to the same rho (like 3,4 and 5,0), but the fraction of such matching pairs
  * is very small (also see below). Another way for improvement is to set a (coarser) 2D grid in plane of z-rho and
- * perform interpolation on it (as done in Schmehl's thesis). But that will add another free parameter affecting the
- * final accuracy.
+ * perform interpolation on it (similar to Schmehl's thesis). This is done (optionally) in somgrid.c with adaptive grid
+ * spacing controlled by the required accuracy (som_eps), then only the grid points are computed directly.
  *
  * However, in sparse mode this procedure is inefficient, since incurs (potentially) a lot of unnecessary evaluations
- * of Sommerfeld integrals. For really sparse aggregates the better way is to buildup a lookup table, using only
- * actually used pairs of (z,rho), as is done in DDA-SI code. A hash table can be used for that.
- * TODO: Implement such improvement for the sparse mode (issue 175)
+ * of Sommerfeld integrals. So a lookup table is built, using only actually used pairs of (z,rho), as is done in DDA-SI
+ * code. The distinct keys (indices in the full table) are collected through a hash set by looking over all pairs of
+ * local and all dipoles (O(N^2) operation, but it is comparable to a single MatVec). In parallel mode the keys of all
+ * processors are combined, the integrals are computed in chunks by different processors and then gathered on each
+ * processor.
+ *
+ * With '-som_cache' the values are also stored on disk and reused in subsequent runs (see SomCacheInit), then only
+ * the missing values are computed.
  *
  * Using only actually used value of (z,rho) can be also relevant for FFT mode (consider, e.g. a sphere and z close to 0
  * and to 2*boxZ-1). However, searching through such pairs seems to be O(N^2) operation, which is unacceptable in FFT
  * mode.
- *
- * Another problem in SPARSE mode is that currently all values of z are computed on each processor (in MPI mode). This
- * is related to the current parallelization mode (issue 160), but it can be improved by computing all values in chunks
- * and then gathering them on each processor. Better to combine it with the hash table above.
  */
 {
 	int i,j,k;
-	double z;
 	size_t ind;
+#ifdef SPARSE
+	size_t *set,setSize,nkeys,nloc,pos,start,hsize;
+	size_t * restrict keys;
+	doublecomplex * restrict vals;
+#endif
 
 	XlessY=(boxX<=boxY);
 	// create index for plane x,y; if boxX<=boxY the space above the main diagonal is indexed (so x<=y) and vice versa
@@ -1207,21 +1602,88 @@ static void CalcSomTable(void)
 	memory+=(boxY+1)*sizeof(size_t);
 	somIndex[0]=0;
 	for (j=0;j<boxY;j++) somIndex[j+1]=somIndex[j] + (XlessY ? MIN(j+1,boxX) : (boxX-j));
+#ifdef SPARSE
+	// collect distinct keys, used by local dipoles; done even during prognosis for exact memory estimate
+	setSize=1024;
+	nloc=0;
+	MALLOC_VECTOR(set,sizet,setSize,ALL);
+	for (ind=0;ind<setSize;ind++) set[ind]=SIZE_MAX;
+	for (ind=0;ind<local_nvoid_Ndip;ind++) for (pos=0;pos<nvoid_Ndip;pos++) {
+		const int *pi=position+3*ind,*pj=position_full+3*pos;
+		SomKeyInsert(&set,&setSize,&nloc,SomFullIndex(pi[0]-pj[0],pi[1]-pj[1],pi[2]+pj[2]));
+	}
+	MALLOC_VECTOR(keys,sizet,MAX(nloc,1),ALL);
+	nkeys=0;
+	for (ind=0;ind<setSize;ind++) if (set[ind]!=SIZE_MAX) keys[nkeys++]=set[ind];
+	Free_general(set);
+#	ifdef PARALLEL
+	// combine keys from all processors; duplicates are removed after sorting
+	set=AllGatherVar(keys,nloc,sizet_type,&nkeys,NULL);
+	Free_general(keys);
+	keys=set;
+#	endif
+	qsort(keys,nkeys,sizeof(size_t),CompareSizet);
+	if (nkeys>0) {
+		for (ind=1,pos=1;ind<nkeys;ind++) if (keys[ind]!=keys[pos-1]) keys[pos++]=keys[ind];
+		nkeys=pos;
+	}
+	for (hsize=2;hsize<2*nkeys;hsize*=2);
+	const size_t tmp=4*nkeys;
+	memory+=(nkeys+hsize)*sizeof(size_t);
+	if (IFROOT) PrintBoth(logfile,"Sommerfeld integrals are computed for %zu distinct pairs of (rho,z), %.3g%% of the "
+		"full table\n",nkeys,100.0*nkeys/((double)local_Nz_Rm*somIndex[boxY]));
+#else
 	// allocate and fill the table
 	const size_t tmp=4*local_Nz_Rm*somIndex[boxY];
+#endif
 	memory+=tmp*sizeof(doublecomplex);
+#ifdef SPARSE
+	somKeys=keys;
+	if (prognosis) return;
+	// each processor computes its chunk of keys
+	start=nkeys*ringid/nprocs;
+	nloc=nkeys*(ringid+1)/nprocs-start;
+	MALLOC_VECTOR(vals,complex,MAX(4*nloc,1),ALL);
+	if (som_cache!=NULL) SomCacheInit();
+	if (IFROOT) printf("Calculating table of Sommerfeld integrals\n");
+	for (pos=0;pos<nloc;pos++) {
+		// invert SomFullIndex; the order of x and y is irrelevant, since only rho matters
+		k=(keys[start+pos])/somIndex[boxY];
+		ind=(keys[start+pos])%somIndex[boxY];
+		for (j=0;somIndex[j+1]<=ind;j++);
+		i=ind-somIndex[j];
+		if (!XlessY) i+=j;
+		SomTableEntry(i,j,k,vals+4*pos);
+	}
+	if (som_cache!=NULL) SomCacheFinish();
+#	ifdef PARALLEL
+	somTable=AllGatherVar(vals,4*nloc,cmplx_type,&pos,NULL);
+	Free_cVector(vals);
+#	else
+	somTable=vals;
+#	endif
+	// build the hash index
+	somHashMask=hsize-1;
+	MALLOC_VECTOR(somHash,sizet,hsize,ALL);
+	for (ind=0;ind<hsize;ind++) somHash[ind]=0;
+	for (pos=0;pos<nkeys;pos++) {
+		ind=SomHashSlot(keys[pos],somHashMask);
+		while (somHash[ind]!=0) ind=(ind+1)&somHashMask;
+		somHash[ind]=pos+1;
+	}
+#else
 	if (!prognosis) {
 		MALLOC_VECTOR(somTable,complex,tmp,ALL);
+		if (som_cache!=NULL) SomCacheInit();
 		if (IFROOT) printf("Calculating table of Sommerfeld integrals\n");
 		ind=0;
-		for (k=0;k<local_Nz_Rm;k++) {
-			z=(k+ZsumShift)*gridspace;
-			for (j=0;j<boxY;j++) {
-				if (XlessY) for (i=0;i<=j && i<boxX;i++,ind++) SingleSomIntegral(hypot(i,j)*gridspace,z,somTable+4*ind);
-				else for (i=j;i<boxX;i++,ind++) SingleSomIntegral(hypot(i,j)*gridspace,z,somTable+4*ind);
-			}
+		for (k=0;k<local_Nz_Rm;k++) for (j=0;j<boxY;j++) {
+			if (XlessY) for (i=0;i<=j && i<boxX;i++,ind++) SomTableEntry(i,j,k,somTable+4*ind);
+			else for (i=j;i<boxX;i++,ind++) SomTableEntry(i,j,k,somTable+4*ind);
 		}
+		if (som_cache!=NULL) SomCacheFinish();
 	}
+#endif
 }
 
 //=====================================================================================================================
@@ -1278,20 +1740,11 @@ void ReflTerm_som_int(const int i,const int j,const int k,doublecomplex result[s
 	ReflTerm_core(kr,kr2,invr3,qmunu,&expval,result);
 
 	// second, Sommerfeld integral part
-	// compute table index
-	int iT=abs(i);
-	int jT=abs(j);
-	size_t ind;
-	// index for the table
-	if (XlessY) {
-		if (iT<=jT) ind=somIndex[jT]+iT;
-		else ind=somIndex[iT]+jT; // effectively swap iT and jT
-	}
-	else {
-		if (iT>=jT) ind=somIndex[jT]+iT-jT;
-		else ind=somIndex[iT]+jT-iT; // effectively swap iT and jT
-	}
-	ind=4*(ind+k*somIndex[boxY]);
+#ifdef SPARSE
+	const size_t ind=4*SomTablePos(SomFullIndex(i,j,k));
+#else
+	const size_t ind=4*SomFullIndex(i,j,k);
+#endif
 	double x=qvec[0];
 	double y=qvec[1];
 	double rho=hypot(x,y);
@@ -1394,6 +1847,7 @@ void InitInteraction(void)
 			case GR_SOM:
 				SET_FUNC_POINTERS(ReflTerm,som);
 				if (!prognosis) som_init(msub*msub);
+				somGrid=false; // it is built in CalcSomTable, if needed
 				CalcSomTable();
 				break;
 			/* TO ADD NEW REFLECTION FORMULATION
@@ -1438,6 +1892,11 @@ void FreeInteraction(void)
 	if (surface && ReflRelation==GR_SOM) {
 		Free_general(somIndex);
 		Free_cVector(somTable);
+		if (somGrid) FreeSomGrid();
+#ifdef SPARSE
+		Free_general(somKeys);
+		Free_general(somHash);
+#endif
 	}
 	/* TO ADD NEW INTERACTION FORMULATION
 	 * TO ADD NEW REFLECTION FORMULATION
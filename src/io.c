@@ -24,12 +24,13 @@
 // system headers
 #include <errno.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
-// the following is for MkDirErr
-#ifdef POSIX
+// the following is for MkDirErr and TestFileSize
+#if defined(POSIX) || defined(WINDOWS)
 #	include <sys/stat.h>
 #	include <sys/types.h>
 #endif
@@ -491,6 +492,33 @@ void MkDirErr(const char * restrict dir,ERR_LOC_DECL)
 
 //======================================================================================================================
 
+bool TestFileSize(const char * restrict fname,const size_t size)
+/* tests whether the file exists and has the given size (in bytes). Unlike ftell, this works for files larger than 2 GB
+ * also when long is 32-bit (e.g., on Windows)
+ */
+{
+#ifdef WINDOWS
+	struct __stat64 st;
+
+	return _stat64(fname,&st)==0 && (unsigned __int64)st.st_size==size;
+#elif defined(POSIX) // off_t is 64-bit on 32-bit systems due to _FILE_OFFSET_BITS, defined in const.h
+	struct stat st;
+
+	return stat(fname,&st)==0 && st.st_size>=0 && (uintmax_t)st.st_size==size;
+#else
+	FILE *file;
+	long pos=-1;
+
+	if ((file=fopen(fname,"rb"))!=NULL) {
+		if (fseek(file,0,SEEK_END)==0) pos=ftell(file);
+		fclose(file);
+	}
+	return pos>=0 && (size_t)pos==size;
+#endif
+}
+
+//======================================================================================================================
+
 static inline void SkipFullLine(FILE * restrict file,char * restrict buf,const int buf_size)
 // skips full line in the file, starting from current position; uses buffer 'buf' with size 'buf_size'
 {
@@ -23,6 +23,7 @@
 // system headers
 #include <stdio.h>    // for file
 #include <stdarg.h>   // for va_list
+#include <stdbool.h>  // for bool
 
 /* File locking is made quite robust, however it is a complex operation that can cause unexpected behavior (permanent
  * locks) especially when program is terminated externally (e.g. because of MPI failure). Moreover, it is not ANSI C,
@@ -71,6 +72,7 @@ FILE *FOpenErr(const char * restrict fname,const char * restrict mode,ERR_LOC_DE
 void FCloseErr(FILE * restrict file,const char * restrict fname,ERR_LOC_DECL);
 void RemoveErr(const char * restrict fname,ERR_LOC_DECL);
 void MkDirErr(const char * restrict dirname,ERR_LOC_DECL);
+bool TestFileSize(const char * restrict fname,const size_t size);
 
 char *FGetsError(FILE * restrict file,const char * restrict fname,size_t *line,char * restrict buf,const int buf_size,
 	ERR_LOC_DECL);
@@ -46,15 +46,18 @@
 // defined and initialized in calculator.c
 extern doublecomplex *rvec; // can't be declared restrict due to SwapPointers
 extern doublecomplex * restrict vec1,* restrict vec2,* restrict vec3,* restrict vec4,* restrict Avecbuffer;
+extern doublecomplex * restrict sweepEY,* restrict sweepEX;
+extern const bool sweepPrev;
+extern doublecomplex * restrict recycleU,* restrict recycleC;
 // defined and initialized in fft.c
 #if !defined(OPENCL) && !defined(SPARSE)
 extern doublecomplex * restrict Xmatrix; // used as storage for arrays in WKB init field
 #endif
 // defined and initialized in param.c
 extern const double iter_eps;
-extern const enum init_field InitField;
 extern const char *infi_fnameY,*infi_fnameX;
 extern const bool recalc_resid;
+extern const int recycle_size;
 extern const enum chpoint chp_type;
 extern const time_t chp_time;
 extern const char *chp_dir;
@@ -62,12 +65,17 @@ extern const char *chp_dir;
 extern time_t last_chp_wt;
 extern TIME_TYPE Timing_OneIter,Timing_OneIterComm,Timing_InitIter,Timing_InitIterComm,Timing_IntFieldOneComm,
 	Timing_MVP,Timing_MVPComm,Timing_OneIterMVP,Timing_OneIterMVPComm;
-extern size_t TotalIter;
+extern size_t TotalIter,TotalMatVec;
+
+// used in calculator.c
+double recycleSaved; // estimated number of matrix-vector products saved by recycling (since the last reset by caller)
 
 // LOCAL VARIABLES
 
 #define RESID_STRING "RE_%03d = "EFORM // string containing residual value
 #define FFORM_PROG "% .6f"  // format for progress value
+#define MAX_NRHS 4          // maximum number of right-hand sides in lock-step mode (IterativeSolverBlock)
+#define RECYCLE_DROP 1e-12  // relative squared norm, below which a vector is not added to the recycled subspace
 
 static double inprodR;     // used as |r_0|^2 and best squared norm of residual up to some iteration
 static double inprodRp1;   // used as |r_k+1|^2 and squared norm of current residual
@@ -100,6 +108,39 @@ struct iter_params_struct {
 	void (*func)(const enum phase); // pointer to implementation of the iterative solver
 };
 static doublecomplex dumb ATT_UNUSED; // dumb variable, used in workaround for issue 146
+/* Recycled subspace (used only when recycle_size>0), similar to GCRO-type methods. Vectors u_i (recycleU) are linear
+ * combinations of previous solutions of the linear system, c_i=A.u_i (recycleC), and c_i are orthonormal. The subspace
+ * is used to construct the initial vector and, for some iterative solvers, to deflate the matrix during the iterations.
+ * The oldest vector is replaced when the subspace is full.
+ */
+static int recN;                       // number of vectors in the recycled subspace
+static int recNext;                    // index of the vector to be replaced next
+static doublecomplex recCC[MAX_NMAT][3]; // cc_sqrt, for which A.u_i=c_i
+static doublecomplex recB[MAX_RECYCLE]; // c_i^H.b, used to obtain the final solution after deflated iterations
+static bool recUsed;                   // whether the initial vector was obtained from the recycled subspace
+static bool recDeflate;                // whether iterations are performed with the deflated matrix
+static size_t recExtraMV;              // number of matvecs spent on recycling during the current solution
+static double recRefMV;                // mean number of matvecs per solution without recycling (for estimates)
+static int recRefN;                    // number of solutions, over which recRefMV is averaged
+/* state of the iterative solver for one right-hand side in lock-step mode (IterativeSolverBlock); the vectors are parts
+ * of the corresponding global vectors, and scalars have the same meaning as in the usual implementation of the solvers
+ */
+typedef struct {
+	enum incpol which;                  // incident polarization
+	doublecomplex *x,*r,*p,*Einc,*Av;   // parts of xvec, rvec, pvec, Einc, and Avecbuffer
+	doublecomplex *v1,*v2,*v3;          // parts of vec1, vec2, and vec3 (renamed inside specific solvers)
+	double inprodR,inprodRp1,epsB,resid_scale,prev_err; // analogous to the (static) global variables
+	int counter;       // number of successive iterations without residual decrease
+	bool active;       // whether the iterations for this right-hand side are continued
+	bool matvec_ready; // whether Av contains A.r_0 after initialization
+	bool mv_pending;   // whether the current iteration requires (second) matrix-vector product
+	double dtmp;       // auxiliary value, produced by MatVecBatch
+	// QMR_CS
+	double c_old,c_new,omega_old,omega_new;
+	doublecomplex beta,tautilda,s_old,s_new;
+	// BiCGStab
+	doublecomplex ro_old,ro_new,omega,alpha;
+} rhs_state;
 
 #define ITER_FUNC(name) static void name(const enum phase ph)
 
@@ -136,6 +177,8 @@ static const struct iter_params_struct params[]={
 // matvec.c
 void MatVec(doublecomplex * restrict in,doublecomplex * restrict out,double * inprod,bool her,TIME_TYPE *timing,
 	TIME_TYPE *comm_timing);
+void MatVecBatch(int k,doublecomplex * const * restrict in,doublecomplex * const * restrict out,
+	double * restrict inprod,bool her,TIME_TYPE *timing,TIME_TYPE *comm_timing);
 
 //======================================================================================================================
 
@@ -305,8 +348,10 @@ static void ProgressReport(void)
 	}
 	niter++;
 	TotalIter++;
-	// check condition for checkpoint; checkpoint is saved at first time
-	if (chp_type!=CHP_NONE && chp_time!=UNDEF && complete) {
+	/* check condition for checkpoint; checkpoint is saved at first time. Orientation averaging saves its own
+	 * checkpoints between orientations (in calculator.c)
+	 */
+	if (chp_type!=CHP_NONE && chp_time!=UNDEF && complete && !orient_avg) {
 		time(&wt);
 		elapsed=difftime(wt,last_chp_wt);
 		if (chp_time<elapsed) {
@@ -339,6 +384,216 @@ static double ResidualNorm2(doublecomplex * restrict x,doublecomplex * restrict
 
 //======================================================================================================================
 
+void ResetRecycling(void)
+// empties the recycled subspace; should be called when the interaction matrix changes (apart from cc_sqrt)
+{
+	recN=recNext=0;
+	recRefN=0; // the number of iterations also depends on the matrix
+}
+
+//======================================================================================================================
+
+static bool RecycleOrth(const int s,const int m,TIME_TYPE *comm_timing)
+/* makes c_s orthogonal to c_i with indices from 0 to m-1 (except s) and normalizes it, applying the same linear
+ * operations to u_s to keep A.u_s=c_s. Returns false if c_s is (almost) a linear combination of other c_i, then the
+ * pair should be discarded.
+ */
+{
+	int i;
+	doublecomplex g;
+	double norm0,norm;
+	doublecomplex * restrict u=recycleU+s*local_nRows;
+	doublecomplex * restrict c=recycleC+s*local_nRows;
+
+	norm0=nNorm2(c,comm_timing);
+	for (i=0;i<m;i++) if (i!=s) {
+		g=nDotProd(c,recycleC+i*local_nRows,comm_timing);
+		nIncrem01_cmplx(c,recycleC+i*local_nRows,-g,NULL,NULL);
+		nIncrem01_cmplx(u,recycleU+i*local_nRows,-g,NULL,NULL);
+	}
+	norm=nNorm2(c,comm_timing);
+	if (norm<=RECYCLE_DROP*norm0) return false;
+	norm=1/sqrt(norm);
+	nMultSelf(u,norm);
+	nMultSelf(c,norm);
+	return true;
+}
+
+//======================================================================================================================
+
+static void RecycleUpdateCC(TIME_TYPE *comm_timing)
+/* adapts the recycled subspace to the current cc_sqrt (e.g., it depends on the incident direction for LDR), if needed.
+ * The matrix is A=I+S.D.S, where S is diagonal (cc_sqrt), hence for new S'=R.S the pair u'=R^-1.u, c'=u'+R.(c-u)
+ * satisfies A'.u'=c'. The orthonormality of c_i is then restored.
+ */
+{
+	int i,j,k;
+	doublecomplex R[MAX_NMAT][3],Rinv[MAX_NMAT][3];
+	doublecomplex * restrict u,* restrict c;
+
+	if (recN>0 && memcmp(recCC,cc_sqrt,Nmat*sizeof(recCC[0]))!=0) {
+		for (i=0;i<Nmat;i++) for (k=0;k<3;k++) {
+			// can happen only for m=1, then the subspace is discarded
+			if (recCC[i][k]==0 || cc_sqrt[i][k]==0) ResetRecycling();
+			else {
+				R[i][k]=cc_sqrt[i][k]/recCC[i][k];
+				Rinv[i][k]=1/R[i][k];
+			}
+		}
+		for (i=0;i<recN;i++) {
+			u=recycleU+i*local_nRows;
+			c=recycleC+i*local_nRows;
+			nIncrem01(c,u,-1,NULL,NULL);
+			nMultSelf_mat(c,R);
+			nMultSelf_mat(u,Rinv);
+			nIncrem01(c,u,1,NULL,NULL);
+		}
+		for (i=j=0;i<recN;i++) {
+			if (i!=j) {
+				nCopy(recycleU+j*local_nRows,recycleU+i*local_nRows);
+				nCopy(recycleC+j*local_nRows,recycleC+i*local_nRows);
+			}
+			if (RecycleOrth(j,j,comm_timing)) j++;
+		}
+		if (j<recN) recN=recNext=j;
+	}
+	memcpy(recCC,cc_sqrt,Nmat*sizeof(recCC[0]));
+}
+
+//======================================================================================================================
+
+static bool RecycleInitField(const double zero_resid)
+/* sets x_0 as a combination of b and recycled solutions, which minimizes |r_0|, together with r_0=b-A.x_0 and
+ * inprodR; returns whether it is better than x_0=0. First, w=A.t, where t=b-sum(g_i*u_i), is made orthogonal to all
+ * c_i. Then x_0=sum(a_i*u_i)+beta*t, where a_i and beta are the projections of b on c_i and w. Thus, this requires the
+ * same single matvec as the choice between x_0=0 and x_0=b, but is usually much better. Moreover, r_0 is orthogonal to
+ * all c_i, as required for deflation. xvec is used to store t, and Avecbuffer - w.
+ */
+{
+	int i;
+	doublecomplex g;
+	double norm;
+
+	RecycleUpdateCC(&Timing_InitIterComm);
+	if (recN==0) return false;
+	nCopy(xvec,pvec);
+	MatVec(pvec,Avecbuffer,NULL,false,&Timing_MVP,&Timing_MVPComm);
+	for (i=0;i<recN;i++) {
+		g=nDotProd(Avecbuffer,recycleC+i*local_nRows,&Timing_InitIterComm);
+		nIncrem01_cmplx(Avecbuffer,recycleC+i*local_nRows,-g,NULL,NULL);
+		nIncrem01_cmplx(xvec,recycleU+i*local_nRows,-g,NULL,NULL);
+	}
+	norm=nNorm2(Avecbuffer,&Timing_InitIterComm);
+	// projections of b (computed in the modified Gram-Schmidt manner for stability)
+	nCopy(rvec,pvec);
+	for (i=0;i<recN;i++) {
+		recB[i]=nDotProd(rvec,recycleC+i*local_nRows,&Timing_InitIterComm);
+		nIncrem01_cmplx(rvec,recycleC+i*local_nRows,-recB[i],NULL,NULL);
+	}
+	if (norm>0) g=nDotProd(rvec,Avecbuffer,&Timing_InitIterComm)/norm;
+	else g=0; // can happen only if b is exactly a combination of c_i
+	nIncrem01_cmplx(rvec,Avecbuffer,-g,&inprodR,&Timing_InitIterComm);
+	nMultSelf_cmplx(xvec,g);
+	for (i=0;i<recN;i++) nIncrem01_cmplx(xvec,recycleU+i*local_nRows,recB[i],NULL,NULL);
+	if (inprodR<zero_resid) return true;
+	recExtraMV++; // the above matvec is wasted, since the caller has to compute A.b anyway
+	return false;
+}
+
+//======================================================================================================================
+
+static void DeflatedMatVec(doublecomplex * restrict in,doublecomplex * restrict out,double * inprod,
+	TIME_TYPE *timing,TIME_TYPE *comm_timing)
+/* MatVec for the iterations. If recDeflate, computes P.A.in instead, where P=I-C.C^H is the orthogonal projector onto
+ * the complement of the recycled subspace, as in GCRO-type methods. P.A is singular on the recycled subspace, which is
+ * thus removed from the iterations. The solution of P.A.y=r_0 then leads to x=x_0+y-U.C^H.A.y and b-A.x=r_0-P.A.y (see
+ * RecycleFinalize). Since P.A is not complex symmetric, this can be used only with general iterative solvers.
+ */
+{
+	int i;
+	doublecomplex g;
+
+	if (recDeflate) {
+		MatVec(in,out,NULL,false,timing,comm_timing);
+		for (i=0;i<recN;i++) {
+			g=nDotProd(out,recycleC+i*local_nRows,&Timing_OneIterComm);
+			nIncrem01_cmplx(out,recycleC+i*local_nRows,-g,(i==recN-1) ? inprod : NULL,&Timing_OneIterComm);
+		}
+	}
+	else MatVec(in,out,inprod,false,timing,comm_timing);
+}
+
+//======================================================================================================================
+
+static void RecycleFinalize(void)
+/* transforms the result of deflated iterations x_0+y into x=x_0+y-U.C^H.A.y. Since C^H.A.x_0=C^H.b (r_0 is orthogonal
+ * to all c_i), C^H.A.y=C^H.A.(x_0+y)-C^H.b. At the end Avecbuffer contains A.x.
+ */
+{
+	int i;
+	doublecomplex d;
+
+	MatVec(xvec,Avecbuffer,NULL,false,&Timing_MVP,&Timing_MVPComm);
+	for (i=0;i<recN;i++) {
+		d=nDotProd(Avecbuffer,recycleC+i*local_nRows,&Timing_IntFieldOneComm)-recB[i];
+		nIncrem01_cmplx(xvec,recycleU+i*local_nRows,-d,NULL,NULL);
+		nIncrem01_cmplx(Avecbuffer,recycleC+i*local_nRows,-d,NULL,NULL);
+	}
+}
+
+//======================================================================================================================
+
+static void RecycleSolution(void)
+/* adds the solution (xvec) to the recycled subspace, replacing the oldest vector, if the subspace is full; assumes that
+ * if recalc_resid or recDeflate, then Avecbuffer contains A.x
+ */
+{
+	const int s=recNext;
+
+	RecycleUpdateCC(&Timing_IntFieldOneComm);
+	nCopy(recycleU+s*local_nRows,xvec);
+	if (recalc_resid || recDeflate) nCopy(recycleC+s*local_nRows,Avecbuffer);
+	else MatVec(xvec,recycleC+s*local_nRows,NULL,false,&Timing_MVP,&Timing_MVPComm);
+	// the solution, which is (almost) a linear combination of the recycled ones, is not added
+	if (!RecycleOrth(s,recN,&Timing_IntFieldOneComm)) return;
+	if (recN<recycle_size) recN++;
+	recNext=(recNext+1)%recycle_size;
+}
+
+//======================================================================================================================
+
+static void RecycleReport(const size_t nmvSolve,const size_t nmvTotal)
+/* estimates the number of matvecs saved by recycling and shows it. The reference is the mean number of matvecs for the
+ * previous solutions, for which the recycled subspace was not used (either the first ones or when it was not better
+ * than x_0=0 or x_0=b), excluding the overhead of recycling. Thus, both the better initial vector and the deflation
+ * during iterations are accounted for, but the estimate is only approximate, since the convergence also depends on the
+ * right-hand side. nmvSolve is the number of matvecs for the solution itself, and nmvTotal - together with the update
+ * of the recycled subspace.
+ */
+{
+	double saved;
+	char tmp_str[MAX_LINE];
+
+	if (!recUsed) { // update the reference
+		recRefN++;
+		recRefMV+=((double)(nmvSolve-recExtraMV)-recRefMV)/recRefN;
+		return;
+	}
+	if (recRefN==0) return; // nothing to compare with
+	saved=recRefMV-(double)nmvTotal;
+	recycleSaved+=saved;
+	if (IFROOT) {
+		if (saved>=0.5) SnprintfErr(ONE_POS,tmp_str,MAX_LINE,"Recycling saved about %.0f matrix-vector products "
+			"(%zu vs. mean of %.1f without it)\n",saved,nmvTotal,recRefMV);
+		else SnprintfErr(ONE_POS,tmp_str,MAX_LINE,"Recycling saved no matrix-vector products (%zu vs. mean of %.1f "
+			"without it)\n",nmvTotal,recRefMV);
+		if (!orient_avg) fprintf(logfile,"%s",tmp_str);
+		printf("%s",tmp_str);
+	}
+}
+
+//======================================================================================================================
+
 ITER_FUNC(BCGS2)
 /* Enhanced Bi-CGStab(2) method.
  * Based on the code by M.A. Botchev and D.R. Fokkema - http://www.math.uu.nl/people/vorst/zbcg2.f90 and
@@ -411,7 +666,7 @@ ITER_FUNC(BCGS2)
 				rho0=rho1;
 				// u_j+1 = A.u_j
 				if (niter==1 && j==0 && matvec_ready) {} // do nothing; u[1]<=>Avecbuffer already contains matvec result
-				else MatVec(u[j],u[j+1],NULL,false,&Timing_OneIterMVP,&Timing_OneIterMVPComm);
+				else DeflatedMatVec(u[j],u[j+1],NULL,&Timing_OneIterMVP,&Timing_OneIterMVPComm);
 				sigma=nDotProd(u[j+1],pvec,&Timing_OneIterComm); // sigma = u_j+1.r~0
 				// test for zero sigma (1/alpha)
 				dtmp=cabs(sigma)/cabs(rho1); // assume that rho1 is not exactly zero
@@ -423,7 +678,7 @@ ITER_FUNC(BCGS2)
 				// r_i = r_i - alpha*u_i+1
 				temp1=-alpha;
 				for (i=0;i<=j;i++) nIncrem01_cmplx(r[i],u[i+1],temp1,NULL,NULL);
-				MatVec(r[j],r[j+1],NULL,false,&Timing_OneIterMVP,&Timing_OneIterMVPComm);
+				DeflatedMatVec(r[j],r[j+1],NULL,&Timing_OneIterMVP,&Timing_OneIterMVPComm);
 			}
 			// --- The convex polynomial part ---
 			// Z = R'R
@@ -689,7 +944,7 @@ ITER_FUNC(BiCGStab)
 			}
 			// calculate v_k=A.p_k
 			if (niter==1 && matvec_ready) nCopy(v,Avecbuffer);
-			else MatVec(pvec,v,NULL,false,&Timing_OneIterMVP,&Timing_OneIterMVPComm);
+			else DeflatedMatVec(pvec,v,NULL,&Timing_OneIterMVP,&Timing_OneIterMVPComm);
 			// alpha_k=ro_new/(v_k.r~)
 			temp1=nDotProd(v,rtilda,&Timing_OneIterComm);
 			dtmp=cabs(temp1)/cabs(ro_new); // assume that ro_new is not exactly zero
@@ -700,14 +955,14 @@ ITER_FUNC(BiCGStab)
 			temp1=-alpha;
 			nLinComb1_cmplx(s,v,rvec,temp1,&inprodRp1,&Timing_OneIterComm);
 			// check convergence at this step; if yes, checkpoint should not be saved afterwards
-			if (inprodRp1<epsB && chp_type!=CHP_ALWAYS) {
+			if (inprodRp1<epsB && (chp_type!=CHP_ALWAYS || orient_avg)) {
 				// x_k=x_k-1+alpha_k*p_k
 				nIncrem01_cmplx(xvec,pvec,alpha,NULL,NULL);
 				complete=false;
 			}
 			else {
 				// t=Avecbuffer=A.s
-				MatVec(s,Avecbuffer,&denumOmega,false,&Timing_OneIterMVP,&Timing_OneIterMVPComm);
+				DeflatedMatVec(s,Avecbuffer,&denumOmega,&Timing_OneIterMVP,&Timing_OneIterMVPComm);
 				// omega_k=s.t/|t|^2
 				omega=nDotProd(s,Avecbuffer,&Timing_OneIterComm)/denumOmega;
 				// x_k=x_k-1+alpha_k*p_k+omega_k*s
@@ -1203,7 +1458,7 @@ ITER_FUNC(_name_) // only '_name_' should be changed, the macro expansion will d
 			 * particular, the intermediate test will be skipped if final checkpoint is required (checkpoint of type
 			 * 'always').
 			 */
-			if (inprodRp1<epsB && chp_type!=CHP_ALWAYS) {
+			if (inprodRp1<epsB && (chp_type!=CHP_ALWAYS || orient_avg)) {
 				// Additional code, e.g. to set xvec to the final value
 				complete=false; // this is required to skip saving checkpoint and some timing
 			}
@@ -1348,6 +1603,17 @@ static const char *CalcInitField(double zero_resid,const enum incpol which)
 {
 	switch (InitField) {
 		case IF_AUTO:
+			// in sweep, try the field for the previous point first; it is used if it is better than x_0=0
+			if (sweepPrev) {
+				nCopy(xvec,(which==INCPOL_Y) ? sweepEY : sweepEX);
+				InitFieldfromE(); // transform it into starting vector
+				if (inprodR<zero_resid) return "x_0 = result for previous sweep point\n";
+			}
+			// with recycling, the best combination of b and previous solutions is used, if it is better than x_0=0
+			if (recycle_size>0 && RecycleInitField(zero_resid)) {
+				recUsed=true;
+				return dyn_sprintf("x_0 = combination of E_inc and %d recycled solutions\n",recN);
+			}
 			/* This code is somewhat inelegant, but there seem to be no easy way to completely reuse code for other
 			 * cases. Moreover, this option will probably be changed afterwards.
 			 */
@@ -1397,12 +1663,13 @@ static const char *CalcInitField(double zero_resid,const enum incpol which)
 
 int IterativeSolver(const enum iter method_in,const enum incpol which)
 /* choose required iterative method; do common initialization part;
- * 'which' is used only if the initial field is read from file
+ * 'which' is used only if the initial field is read from file or taken from the previous sweep point
  */
 {
 	double temp;
 	char tmp_str[MAX_LINE];
 	TIME_TYPE tstart,time_tmp,time_tmp2,time_tmp3;
+	size_t mv_solve; // number of matvecs during the whole solution
 
 	// redundant initialization to remove warnings
 	time_tmp=time_tmp2=time_tmp3=0;
@@ -1418,6 +1685,9 @@ int IterativeSolver(const enum iter method_in,const enum incpol which)
 	Timing_InitIterComm=Timing_MVP=Timing_MVPComm=0;
 	tstart=GET_TIME();
 	matvec_ready=false; // can be set to true only in CalcInitField (if !load_chpoint)
+	recUsed=recDeflate=false; // can be set to true only if !load_chpoint
+	recExtraMV=0;
+	mv_solve=TotalMatVec;
 	if (!load_chpoint) {
 		nMult_mat(pvec,Einc,cc_sqrt);
 		temp=nNorm2(pvec,&Timing_InitIterComm); // |r_0|^2 when x_0=0
@@ -1425,6 +1695,8 @@ int IterativeSolver(const enum iter method_in,const enum incpol which)
 		epsB=iter_eps*iter_eps*temp;
 		// Calculate initial field
 		const char *descr=CalcInitField(temp,which);
+		// deflation can be used only with iterative solvers for general matrices (CGNR also requires A^H)
+		recDeflate=(recUsed && (method_in==IT_BICGSTAB || method_in==IT_BCGS2));
 		// print start values
 		if (IFROOT) {
 			prev_err=sqrt(resid_scale*inprodR);
@@ -1493,8 +1765,9 @@ int IterativeSolver(const enum iter method_in,const enum incpol which)
 		 */
 		ProgressReport();
 	}
+	if (recDeflate) RecycleFinalize();
 	// Save checkpoint of type always
-	if (chp_type==CHP_ALWAYS && !chp_exit) SaveIterChpoint();
+	if (chp_type==CHP_ALWAYS && !chp_exit && !orient_avg) SaveIterChpoint();
 	/* process incomplete convergence
 	 * Since maxiter can be used in several reasonable ways, e.g. to control execution time, we allow calculation of
 	 * (potentially inaccurate) scattering quantities, when it is reached. We leave the warning although it may be
@@ -1518,6 +1791,11 @@ int IterativeSolver(const enum iter method_in,const enum incpol which)
 			printf("%s",tmp_str);
 		}
 	}
+	if (recycle_size>0 && !chp_exit) {
+		const size_t nmv=TotalMatVec-mv_solve;
+		RecycleSolution();
+		RecycleReport(nmv,TotalMatVec-mv_solve);
+	}
 	// post-processing
 	if (params[ind_m].sc_N>0) Free_general(scalars);
 	if (params[ind_m].vec_N>0) Free_general(vectors);
@@ -1525,6 +1803,360 @@ int IterativeSolver(const enum iter method_in,const enum incpol which)
 	 * technique (as starting vector for next system)
 	 */
 	nMult_mat(pvec,xvec,cc_sqrt); // p now contains polarizations. Can be used to calculate e.g. scattered field faster.
+	// save internal field (e_field=chi_inv*P) to start the iterative solver for the next sweep point
+	if (sweepEY!=NULL) nMult_mat((which==INCPOL_Y) ? sweepEY : sweepEX,pvec,chi_inv);
 	if (chp_exit) return CHP_EXIT; // check if exiting after checkpoint
 	return (niter-1); // the number of iterations elapsed
 }
+
+//======================================================================================================================
+
+/* Lock-step (block) mode of iterative solvers. Linear systems with the same matrix and several right-hand sides (e.g.
+ * two incident polarizations) are solved simultaneously. Each right-hand side follows its own recurrence of the
+ * iterative solver (so the convergence of each of them is exactly the same as in a separate run), but all
+ * matrix-vector products of a single step are computed by a single call to MatVecBatch. Thus, the interaction matrix
+ * is read from memory once for all right-hand sides. When one system converges, it is excluded from further products.
+ *
+ * Only a few iterative solvers are implemented in this mode, the selection is checked in param.c. Checkpoints are not
+ * supported.
+ */
+
+static void BlockMatVec(rhs_state * restrict st,const int nrhs,const bool second,const bool ipr)
+/* computes matrix-vector products for all active right-hand sides with pending flag (the latter is not reset, when the
+ * iterations for a right-hand side stop); first stage (second=false) - v1=A.p (for BiCGStab) or Av=A.v1 (for QMR_CS),
+ * second stage (only for BiCGStab) - Av=A.v2; ipr determines whether the inner products (squared norms of the results)
+ * are computed (then stored in dtmp)
+ */
+{
+	doublecomplex *in[MAX_NRHS],*out[MAX_NRHS];
+	double inprod[MAX_NRHS];
+	int j,k,ind[MAX_NRHS];
+
+	k=0;
+	for (j=0;j<nrhs;j++) if (st[j].active && st[j].mv_pending) {
+		if (IterMethod==IT_BICGSTAB && !second) {
+			in[k]=st[j].p;
+			out[k]=st[j].v1;
+		}
+		else {
+			in[k]=(IterMethod==IT_BICGSTAB) ? st[j].v2 : st[j].v1;
+			out[k]=st[j].Av;
+		}
+		ind[k]=j;
+		k++;
+	}
+	if (k==0) return;
+	MatVecBatch(k,in,out,ipr ? inprod : NULL,false,&Timing_OneIterMVP,&Timing_OneIterMVPComm);
+	if (ipr) for (j=0;j<k;j++) st[ind[j]].dtmp=inprod[j];
+}
+
+//======================================================================================================================
+
+static void BlockBiCGStab(rhs_state * restrict st,const int nrhs)
+// one iteration of BiCGStab (see function BiCGStab for details) for all active right-hand sides
+{
+#define EPS1 1E-10 // for 1/|beta|
+#define EPS2 1E-10 // for |v.r~|/|r.r~|
+	int j;
+	double dtmp;
+	doublecomplex beta,temp1,temp2;
+	rhs_state *t;
+
+	// v1 - v, v2 - s, v3 - rtilda, Av - t
+	for (j=0;j<nrhs;j++) if (st[j].active) {
+		t=st+j;
+		if (niter==1) nCopy(t->v3,t->r); // r~=r_0
+		t->ro_new=nDotProd(t->r,t->v3,&Timing_OneIterComm);
+		if (niter==1) nCopy(t->p,t->r); // p_1=r_0
+		else {
+			temp1=t->ro_new*t->alpha;
+			temp2=t->ro_old*t->omega;
+			dtmp=cabs(temp2)/cabs(temp1);
+			Dz("1/|beta|="GFORM_DEBUG,dtmp);
+			if (dtmp<EPS1) LogError(ONE_POS,"BiCGStab fails: 1/|beta| is too small ("GFORM_DEBUG").",dtmp);
+			beta=temp1/temp2;
+			temp1=-beta*t->omega;
+			nIncrem110_cmplx(t->p,t->v1,t->r,beta,temp1);
+		}
+		t->mv_pending=!(niter==1 && t->matvec_ready);
+		if (!t->mv_pending) nCopy(t->v1,t->Av);
+	}
+	BlockMatVec(st,nrhs,false,false); // v_k=A.p_k
+	for (j=0;j<nrhs;j++) if (st[j].active) {
+		t=st+j;
+		temp1=nDotProd(t->v1,t->v3,&Timing_OneIterComm);
+		dtmp=cabs(temp1)/cabs(t->ro_new);
+		Dz("|v.r~|/|r.r~|="GFORM_DEBUG,dtmp);
+		if (dtmp<EPS2) LogError(ONE_POS,"BiCGStab fails: |v.r~|/|r.r~| is too small ("GFORM_DEBUG").",dtmp);
+		t->alpha=t->ro_new/temp1;
+		temp1=-t->alpha;
+		nLinComb1_cmplx(t->v2,t->v1,t->r,temp1,&(t->inprodRp1),&Timing_OneIterComm);
+		t->mv_pending=(t->inprodRp1>=t->epsB);
+		if (!t->mv_pending) nIncrem01_cmplx(t->x,t->p,t->alpha,NULL,NULL); // converged at half step
+	}
+	BlockMatVec(st,nrhs,true,true); // t=A.s and |t|^2
+	for (j=0;j<nrhs;j++) if (st[j].active && st[j].mv_pending) {
+		t=st+j;
+		t->omega=nDotProd(t->v2,t->Av,&Timing_OneIterComm)/t->dtmp;
+		nIncrem011_cmplx(t->x,t->p,t->v2,t->alpha,t->omega);
+		temp1=-t->omega;
+		nLinComb1_cmplx(t->r,t->Av,t->v2,temp1,&(t->inprodRp1),&Timing_OneIterComm);
+		t->ro_old=t->ro_new;
+	}
+}
+#undef EPS1
+#undef EPS2
+
+//======================================================================================================================
+
+static void BlockQMR_CS(rhs_state * restrict st,const int nrhs)
+// one iteration of QMR_CS (see function QMR_CS for details) for all active right-hand sides
+{
+#define EPS1 1E-10 // for (vT.v)/(v.v)
+#define EPS2 1E-40 // for overflow of exponent number
+	int j;
+	double zetaabs,dtmp1,dtmp2;
+	doublecomplex alpha,theta,eta,zeta,zetatilda,tau,temp1,temp2,temp4;
+	rhs_state *t;
+
+	// v1 - v, v2 - v~, p - p_new, v3 - p_old
+	for (j=0;j<nrhs;j++) if (st[j].active) {
+		t=st+j;
+		if (niter==1) { // initialization is performed here to keep all the code in one place
+			t->omega_old=0.0;
+			t->beta=csqrt(nDotProdSelf_conj(t->r,&Timing_OneIterComm));
+			t->omega_new=sqrt(t->inprodR)/cabs(t->beta);
+			temp1=1/t->beta;
+			nMult_cmplx(t->v1,t->r,temp1);
+			t->tautilda=t->omega_new*t->beta;
+			t->c_new=t->c_old=1.0;
+			t->s_new=t->s_old=0.0;
+		}
+		dtmp1=1/(t->omega_new*t->omega_new);
+		Dz("|vT.v|/(v.v)="GFORM_DEBUG,dtmp1);
+		if (dtmp1<EPS1) LogError(ONE_POS,"QMR_CS fails: |vT.v|/(v.v) is too small ("GFORM_DEBUG").",dtmp1);
+		t->mv_pending=!(niter==1 && t->matvec_ready);
+		if (!t->mv_pending) { // uses that v_1=r_0/beta
+			temp1=1/t->beta;
+			nMultSelf_cmplx(t->Av,temp1);
+		}
+	}
+	BlockMatVec(st,nrhs,false,false); // A.v_k
+	for (j=0;j<nrhs;j++) if (st[j].active) {
+		t=st+j;
+		alpha=nDotProd_conj(t->v1,t->Av,&Timing_OneIterComm);
+		temp2=-alpha;
+		if (niter==1) nLinComb1_cmplx(t->v2,t->v1,t->Av,temp2,NULL,NULL);
+		else {
+			temp1=-t->beta;
+			nIncrem110_cmplx(t->v2,t->v1,t->Av,temp1,temp2);
+		}
+		theta=conj(t->s_old)*t->omega_old*t->beta;
+		eta=t->c_old*t->c_new*t->omega_old*t->beta;
+		eta+=alpha*conj(t->s_new)*t->omega_new;
+		zetatilda=t->c_new*t->omega_new*alpha - t->s_new*t->c_old*t->omega_old*t->beta;
+		t->omega_old=t->omega_new;
+		temp1=nDotProdSelf_conj_Norm2(t->v2,&dtmp1,&Timing_OneIterComm);
+		t->beta=csqrt(temp1);
+		t->omega_new=sqrt(dtmp1)/cabs(t->beta);
+		dtmp2=cAbs2(zetatilda);
+		zetaabs=sqrt(dtmp2+dtmp1);
+		dtmp1=sqrt(dtmp2);
+		if (dtmp1<EPS2) zeta=zetaabs;
+		else zeta=(zetaabs/dtmp1)*zetatilda;
+		t->c_old=t->c_new;
+		t->c_new=dtmp1/zetaabs;
+		t->s_old=t->s_new;
+		t->s_new=t->omega_new*t->beta/zeta;
+		temp4=1/zeta;
+		if (niter==1) nMult_cmplx(t->p,t->v1,temp4);
+		else {
+			temp2=-eta*temp4;
+			if (niter==2) nLinComb_cmplx(t->v3,t->p,t->v1,temp2,temp4,NULL,NULL);
+			else {
+				temp1=-theta*temp4;
+				nIncrem111_cmplx(t->v3,t->p,t->v1,temp1,temp2,temp4);
+			}
+			SwapPointers(&(t->v3),&(t->p));
+		}
+		tau=t->c_new*t->tautilda;
+		t->tautilda=-t->s_new*t->tautilda;
+		nIncrem01_cmplx(t->x,t->p,tau,NULL,NULL);
+		temp1=1/t->beta;
+		nMultSelf_cmplx(t->v2,temp1);
+		SwapPointers(&(t->v1),&(t->v2));
+		temp1=(t->c_new/t->omega_new)*t->tautilda;
+		nIncrem11_d_c(t->r,t->v1,cAbs2(t->s_new),temp1,&(t->inprodRp1),&Timing_OneIterComm);
+	}
+}
+#undef EPS1
+#undef EPS2
+
+//======================================================================================================================
+
+static void SelectRHS(const rhs_state * restrict t)
+// points main vectors of the iterative solver to the parts, corresponding to a given right-hand side
+{
+	xvec=t->x;
+	rvec=t->r;
+	pvec=t->p;
+	Einc=t->Einc;
+	Avecbuffer=t->Av;
+}
+
+//======================================================================================================================
+
+static void BlockProgressReport(rhs_state * restrict st,const int nrhs)
+// analogous to ProgressReport, but for all active right-hand sides; shows residuals for all of them in one line
+{
+	int j;
+	double err;
+	size_t len;
+	char progr_string[MAX_LINE];
+	const char *temp;
+
+	len=0;
+	if (IFROOT) len=SnprintfErr(ONE_POS,progr_string,MAX_LINE,"RE_%03d =",niter);
+	for (j=0;j<nrhs;j++) if (st[j].active) {
+		rhs_state *t=st+j;
+		if (t->inprodRp1<=t->inprodR) {
+			t->inprodR=t->inprodRp1;
+			t->counter=0;
+		}
+		else t->counter++;
+		TotalIter++;
+		if (IFROOT) {
+			err=sqrt(t->resid_scale*t->inprodRp1);
+			if (t->counter==0) temp="+ ";
+			else if (1-err/t->prev_err>0) temp="-+";
+			else temp="- ";
+			len=SnprintfShiftErr(ONE_POS,len,progr_string,MAX_LINE," %c: "EFORM" %s",
+				(t->which==INCPOL_Y) ? 'Y' : 'X',err,temp);
+			t->prev_err=err;
+		}
+		t->active=(t->inprodR>t->epsB && t->counter<=params[ind_m].mc);
+	}
+	if (IFROOT) {
+		if (!orient_avg) fprintf(logfile,"%s\n",progr_string);
+		printf("%s\n",progr_string);
+	}
+	niter++;
+}
+
+//======================================================================================================================
+
+int IterativeSolverBlock(const enum iter method_in,const enum incpol * restrict which,const int nrhs)
+/* Solves the linear systems for nrhs right-hand sides (incident polarizations 'which') in lock-step mode. Main vectors
+ * (xvec, rvec, pvec, Einc, Avecbuffer) and additional vectors of the iterative solver (vec1, vec2, vec3) should be
+ * allocated to contain nrhs parts of size local_nRows each; the part j corresponds to right-hand side j. Einc should
+ * contain the incident fields for all parts. At the end pvec contains polarizations for all parts, and all global
+ * vectors point to the beginning of the corresponding arrays (part 0).
+ */
+{
+	int j;
+	bool any_active;
+	double temp;
+	char tmp_str[MAX_LINE];
+	rhs_state *st,*t;
+	TIME_TYPE tstart;
+	// original values of global pointers; those are changed during the solution (see SelectRHS)
+	doublecomplex * const x0=xvec,* const r0=rvec,* const p0=pvec,* const E0=Einc,* const A0=Avecbuffer;
+
+	if (nrhs>MAX_NRHS) LogError(ONE_POS,"Number of right-hand sides (%d) exceeds maximum allowed (%d)",nrhs,MAX_NRHS);
+	ind_m=0;
+	while (params[ind_m].meth!=method_in) {
+		ind_m++;
+		if (ind_m>=LENGTH(params))
+			LogError(ONE_POS,"Parameters for the given iterative solver are not found in list 'params'");
+	}
+	Timing_InitIterComm=Timing_MVP=Timing_MVPComm=0;
+	tstart=GET_TIME();
+	st=(rhs_state *)voidVector(nrhs*sizeof(rhs_state),ALL_POS,"states of the iterative solver");
+	// initialize states and compute initial fields; it employs the usual functions, operating on global vectors
+	for (j=0;j<nrhs;j++) {
+		t=st+j;
+		t->which=which[j];
+		t->x=x0+j*local_nRows;
+		t->r=r0+j*local_nRows;
+		t->p=p0+j*local_nRows;
+		t->Einc=E0+j*local_nRows;
+		t->Av=A0+j*local_nRows;
+		t->v1=vec1+j*local_nRows;
+		t->v2=vec2+j*local_nRows;
+		t->v3=vec3+j*local_nRows;
+		SelectRHS(t);
+		matvec_ready=false;
+		nMult_mat(pvec,Einc,cc_sqrt);
+		temp=nNorm2(pvec,&Timing_InitIterComm);
+		t->resid_scale=1/temp;
+		t->epsB=iter_eps*iter_eps*temp;
+		const char *descr=CalcInitField(temp,t->which);
+		t->inprodR=inprodR;
+		t->matvec_ready=matvec_ready;
+		t->counter=0;
+		t->active=(t->inprodR>t->epsB);
+		if (IFROOT) {
+			t->prev_err=sqrt(t->resid_scale*t->inprodR);
+			sprintf(tmp_str,"%c: %s"RESID_STRING"\n",(t->which==INCPOL_Y) ? 'Y' : 'X',descr,0,t->prev_err);
+			if (!orient_avg) fprintf(logfile,"%s",tmp_str);
+			printf("%s",tmp_str);
+		}
+	}
+	SelectRHS(st);
+	niter=1;
+	Timing_InitIter = GET_TIME() - tstart;
+	Timing_InitIterComm += Timing_MVPComm;
+	Timing_IntFieldOneComm=Timing_InitIterComm;
+	// main iteration cycle
+	any_active=true;
+	while (any_active && niter<=maxiter) {
+		Timing_OneIterComm=Timing_OneIterMVP=Timing_OneIterMVPComm=0;
+		tstart=GET_TIME();
+		switch (method_in) {
+			case IT_BICGSTAB: BlockBiCGStab(st,nrhs); break;
+			case IT_QMR_CS: BlockQMR_CS(st,nrhs); break;
+			default: LogError(ONE_POS,"Lock-step mode is not implemented for the given iterative solver");
+		}
+		Timing_OneIterComm+=Timing_OneIterMVPComm;
+		Timing_IntFieldOneComm+=Timing_OneIterComm;
+		Timing_MVP+=Timing_OneIterMVP;
+		Timing_MVPComm+=Timing_OneIterMVPComm;
+		Timing_OneIter=GET_TIME()-tstart;
+		BlockProgressReport(st,nrhs);
+		any_active=false;
+		for (j=0;j<nrhs;j++) any_active|=st[j].active;
+	}
+	// process incomplete convergence (see IterativeSolver for details), final residual, and polarizations
+	for (j=0;j<nrhs;j++) {
+		t=st+j;
+		if (t->inprodR>t->epsB) {
+			if (niter>maxiter) LogWarning(EC_WARN,ONE_POS,"Iterations haven't converged in %d iterations. Further "
+				"calculated scattering quantities may be less accurate.",maxiter);
+			else if (t->counter>params[ind_m].mc) LogError(ONE_POS,"Residual norm haven't decreased for maximum "
+				"allowed number of iterations (%d)",params[ind_m].mc);
+		}
+		SelectRHS(t);
+		if (recalc_resid) {
+			t->inprodR=ResidualNorm2(xvec,rvec,Avecbuffer,&Timing_MVP,&Timing_MVPComm,&Timing_IntFieldOneComm);
+			if (IFROOT) {
+				temp=sqrt(t->resid_scale*t->inprodR);
+				SnprintfErr(ONE_POS,tmp_str,MAX_LINE,"%c: Final (recalculated) residual norm: "EFORM"\n",
+					(t->which==INCPOL_Y) ? 'Y' : 'X',temp);
+				if (!orient_avg) fprintf(logfile,"%s",tmp_str);
+				printf("%s",tmp_str);
+			}
+		}
+		/* pointers to pvec part may have been swapped with v3 part (in QMR_CS), so the polarization is explicitly
+		 * stored in the proper part
+		 */
+		nMult_mat(p0+j*local_nRows,xvec,cc_sqrt);
+		if (sweepEY!=NULL) nMult_mat((t->which==INCPOL_Y) ? sweepEY : sweepEX,p0+j*local_nRows,chi_inv);
+	}
+	xvec=x0;
+	rvec=r0;
+	pvec=p0;
+	Einc=E0;
+	Avecbuffer=A0;
+	Free_general(st);
+	return (niter-1);
+}
@@ -31,6 +31,8 @@
  * - If usage of some function has coinciding arguments, than a special function for such case is created. In
  * particular, this allows consistent usage of 'restrict' keyword almost for all function arguments.
  * - Deeper optimizations, such as loop unrolling, are left to the compiler.
+ * - With OPENMP all loops over the local part of the vector are shared among threads (reductions are performed
+ * locally before communication). Without it, the pragmas are simply ignored.
  *
  * !!! TODO: Further optimizations (pragmas, or gcc attributes, e.g. 'expect') should be done only together with
  * profiling to see the actual difference
@@ -43,6 +45,7 @@ void nInit(doublecomplex * restrict a)
 	register size_t i;
 	register const size_t n=local_nRows;
 	LARGE_LOOP;
+#pragma omp parallel for
 	for (i=0;i<n;i++) a[i]=0;
 }
 
@@ -64,6 +67,7 @@ double nNorm2(const doublecomplex * restrict a,TIME_TYPE *comm_timing)
 	double sum=0;
 
 	LARGE_LOOP;
+#pragma omp parallel for reduction(+:sum)
 	for (i=0;i<n;i++) sum+=cAbs2(a[i]);
 	// this function is not called inside the main iteration loop
 	MyInnerProduct(&sum,double_type,1,comm_timing);
@@ -82,6 +86,7 @@ doublecomplex nDotProd(const doublecomplex * restrict a,const doublecomplex * re
 	doublecomplex sum=0;
 
 	LARGE_LOOP;
+#pragma omp parallel for reduction(+:sum)
 	for (i=0;i<n;i++) sum+=a[i]*conj(b[i]);
 	MyInnerProduct(&sum,cmplx_type,1,comm_timing);
 	return sum;
@@ -99,6 +104,7 @@ doublecomplex nDotProd_conj(const doublecomplex * restrict a,const doublecomplex
 	doublecomplex sum=0;
 
 	LARGE_LOOP;
+#pragma omp parallel for reduction(+:sum)
 	for (i=0;i<n;i++) sum+=a[i]*b[i];
 	MyInnerProduct(&sum,cmplx_type,1,comm_timing);
 	return sum;
@@ -117,6 +123,7 @@ doublecomplex nDotProdSelf_conj(const doublecomplex * restrict a,TIME_TYPE *comm
 	/* Explicit writing the following through real and imaginary types can lead to delaying the multiplication by two
 	 * until the sum is complete. But that is not believed to be significant
 	 */
+#pragma omp parallel for reduction(+:sum)
 	for (i=0;i<n;i++) sum+=a[i]*a[i];
 	MyInnerProduct(&sum,cmplx_type,1,comm_timing);
 	return sum;
@@ -129,15 +136,20 @@ doublecomplex nDotProdSelf_conj_Norm2(const doublecomplex * restrict a,double *
 {
 	register size_t i;
 	register const size_t n=local_nRows;
-	double buf[3]={0,0,0};
+	double buf[3];
+	double re2=0,im2=0,reim=0; // separate scalars, since OpenMP reduction over array elements is not portable
 
 	LARGE_LOOP;
 	// Here the optimization for explicit treatment seems significant, so we keep the old code
+#pragma omp parallel for reduction(+:re2,im2,reim)
 	for (i=0;i<n;i++) {
-		buf[0]+=creal(a[i])*creal(a[i]);
-		buf[1]+=cimag(a[i])*cimag(a[i]);
-		buf[2]+=creal(a[i])*cimag(a[i]);
+		re2+=creal(a[i])*creal(a[i]);
+		im2+=cimag(a[i])*cimag(a[i]);
+		reim+=creal(a[i])*cimag(a[i]);
 	}
+	buf[0]=re2;
+	buf[1]=im2;
+	buf[2]=reim;
 	MyInnerProduct(buf,double_type,3,comm_timing);
 	*norm=buf[0]+buf[1];
 	return buf[0] - buf[1] + I*2*buf[2];
@@ -153,6 +165,7 @@ void nIncrem110_cmplx(doublecomplex * restrict a,const doublecomplex * restrict
 	register const size_t n=local_nRows;
 
 	LARGE_LOOP;
+#pragma omp parallel for
 	for (i=0;i<n;i++) a[i] = c1*a[i] + c2*b[i] + c[i];
 }
 
@@ -166,6 +179,7 @@ void nIncrem011_cmplx(doublecomplex * restrict a,const doublecomplex * restrict
 	register const size_t n=local_nRows;
 
 	LARGE_LOOP;
+#pragma omp parallel for
 	for (i=0;i<n;i++) a[i] += c1*b[i] + c2*c[i];
 }
 
@@ -183,10 +197,12 @@ void nIncrem110_d_c_conj(doublecomplex * restrict a,const doublecomplex * restri
 
 	if (inprod==NULL) {
 		LARGE_LOOP;
+#pragma omp parallel for
 		for (i=0;i<n;i++) a[i] = c1*conj(a[i]) + c2*conj(b[i]) + c[i];
 	}
 	else {
 		LARGE_LOOP;
+#pragma omp parallel for reduction(+:sum)
 		for (i=0;i<n;i++) {
 			a[i] = c1*conj(a[i]) + c2*conj(b[i]) + c[i];
 			sum += cAbs2(a[i]);
@@ -206,6 +222,7 @@ void nIncrem111_cmplx(doublecomplex * restrict a,const doublecomplex * restrict
 	register const size_t n=local_nRows;
 
 	LARGE_LOOP;
+#pragma omp parallel for
 	for (i=0;i<n;i++) a[i] = c1*a[i] + c2*b[i] + c3*c[i];
 }
 
@@ -221,10 +238,12 @@ void nIncrem(doublecomplex * restrict a,const doublecomplex * restrict b,double
 
 	if (inprod==NULL) {
 		LARGE_LOOP;
+#pragma omp parallel for
 		for (i=0;i<n;i++) a[i] += b[i];
 	}
 	else {
 		LARGE_LOOP;
+#pragma omp parallel for reduction(+:sum)
 		for (i=0;i<n;i++) {
 			a[i] += b[i];
 			sum += cAbs2(a[i]);
@@ -246,10 +265,12 @@ void nDecrem(doublecomplex * restrict a,const doublecomplex * restrict b,double
 
 	if (inprod==NULL) {
 		LARGE_LOOP;
+#pragma omp parallel for
 		for (i=0;i<n;i++) a[i] -= b[i];
 	}
 	else {
 		LARGE_LOOP;
+#pragma omp parallel for reduction(+:sum)
 		for (i=0;i<n;i++) {
 			a[i] -= b[i];
 			sum += cAbs2(a[i]);
@@ -271,10 +292,12 @@ void nIncrem01(doublecomplex * restrict a,const doublecomplex * restrict b,const
 
 	if (inprod==NULL) {
 		LARGE_LOOP;
+#pragma omp parallel for
 		for (i=0;i<n;i++) a[i] += c*b[i];
 	}
 	else {
 		LARGE_LOOP;
+#pragma omp parallel for reduction(+:sum)
 		for (i=0;i<n;i++) {
 			a[i] += c*b[i];
 			sum += cAbs2(a[i]);
@@ -296,10 +319,12 @@ void nIncrem10(doublecomplex * restrict a,const doublecomplex * restrict b,const
 
 	if (inprod==NULL) {
 		LARGE_LOOP;
+#pragma omp parallel for
 		for (i=0;i<n;i++) a[i] = c*a[i] + b[i];
 	}
 	else {
 		LARGE_LOOP;
+#pragma omp parallel for reduction(+:sum)
 		for (i=0;i<n;i++) {
 			a[i] = c*a[i] + b[i];
 			sum += cAbs2(a[i]);
@@ -321,11 +346,13 @@ void nIncrem11_d_c(doublecomplex * restrict a,const doublecomplex * restrict b,c
 
 	if (inprod==NULL) {
 		LARGE_LOOP;
+#pragma omp parallel for
 		for (i=0;i<n;i++) a[i] = c1*a[i] + c2*b[i];
 	}
 	else {
 		*inprod=0.0;
 		LARGE_LOOP;
+#pragma omp parallel for reduction(+:sum)
 		for (i=0;i<n;i++) {
 			a[i] = c1*a[i] + c2*b[i];
 			sum += cAbs2(a[i]);
@@ -347,10 +374,12 @@ void nIncrem01_cmplx(doublecomplex * restrict a,const doublecomplex * restrict b
 
 	if (inprod==NULL) {
 		LARGE_LOOP;
+#pragma omp parallel for
 		for (i=0;i<n;i++) a[i] += c*b[i];
 	}
 	else {
 		LARGE_LOOP;
+#pragma omp parallel for reduction(+:sum)
 		for (i=0;i<n;i++) {
 			a[i] += c*b[i];
 			sum += cAbs2(a[i]);
@@ -372,10 +401,12 @@ void nIncrem10_cmplx(doublecomplex * restrict a,const doublecomplex * restrict b
 
 	if (inprod==NULL) {
 		LARGE_LOOP;
+#pragma omp parallel for
 		for (i=0;i<n;i++) a[i] = c*a[i] + b[i];
 	}
 	else {
 		LARGE_LOOP;
+#pragma omp parallel for reduction(+:sum)
 		for (i=0;i<n;i++) {
 			a[i] = c*a[i] + b[i];
 			sum += cAbs2(a[i]);
@@ -397,10 +428,12 @@ void nLinComb_cmplx(doublecomplex * restrict a,const doublecomplex * restrict b,
 
 	if (inprod==NULL) {
 		LARGE_LOOP;
+#pragma omp parallel for
 		for (i=0;i<n;i++) a[i] = c1*b[i] + c2*c[i];
 	}
 	else {
 		LARGE_LOOP;
+#pragma omp parallel for reduction(+:sum)
 		for (i=0;i<n;i++) {
 			a[i] = c1*b[i] + c2*c[i];
 			sum += cAbs2(a[i]);
@@ -422,10 +455,12 @@ void nLinComb1_cmplx(doublecomplex * restrict a,const doublecomplex * restrict b
 
 	if (inprod==NULL) {
 		LARGE_LOOP;
+#pragma omp parallel for
 		for (i=0;i<n;i++) a[i] = c1*b[i] + c[i];
 	}
 	else {
 		LARGE_LOOP;
+#pragma omp parallel for reduction(+:sum)
 		for (i=0;i<n;i++) {
 			a[i] = c1*b[i] + c[i];
 			sum += cAbs2(a[i]);
@@ -447,10 +482,12 @@ void nLinComb1_cmplx_conj(doublecomplex * restrict a,const doublecomplex * restr
 
 	if (inprod==NULL) {
 		LARGE_LOOP;
+#pragma omp parallel for
 		for (i=0;i<n;i++) a[i] = c1*conj(b[i]) + c[i];
 	}
 	else {
 		LARGE_LOOP;
+#pragma omp parallel for reduction(+:sum)
 		for (i=0;i<n;i++) {
 			a[i] = c1*conj(b[i]) + c[i];
 			sum += cAbs2(a[i]);
@@ -473,10 +510,12 @@ void nSubtr(doublecomplex * restrict a,const doublecomplex * restrict b,const do
 
 	if (inprod==NULL) {
 		LARGE_LOOP;
+#pragma omp parallel for
 		for (i=0;i<n;i++) a[i] = b[i] - c[i];
 	}
 	else {
 		LARGE_LOOP;
+#pragma omp parallel for reduction(+:sum)
 		for (i=0;i<n;i++) {
 			a[i] = b[i] - c[i];
 			sum += cAbs2(a[i]);
@@ -495,6 +534,7 @@ void nMult(doublecomplex * restrict a,const doublecomplex * restrict b,const dou
 	register size_t i;
 
 	LARGE_LOOP;
+#pragma omp parallel for
 	for (i=0;i<n;i++) a[i] = c*b[i];
 }
 
@@ -507,6 +547,7 @@ void nMult_cmplx(doublecomplex * restrict a,const doublecomplex * restrict b,con
 	register size_t i;
 
 	LARGE_LOOP;
+#pragma omp parallel for
 	for (i=0;i<n;i++) a[i] = c*b[i];
 }
 //======================================================================================================================
@@ -518,6 +559,7 @@ void nMultSelf(doublecomplex * restrict a,const double c)
 	register size_t i;
 
 	LARGE_LOOP;
+#pragma omp parallel for
 	for (i=0;i<n;i++) a[i] *= c;
 }
 //======================================================================================================================
@@ -529,6 +571,7 @@ void nMultSelf_conj(doublecomplex * restrict a,const double c)
 	register size_t i;
 
 	LARGE_LOOP;
+#pragma omp parallel for
 	for (i=0;i<n;i++) a[i] = c*conj(a[i]);
 }
 
@@ -541,6 +584,7 @@ void nMultSelf_cmplx(doublecomplex * restrict a,const doublecomplex c)
 	register size_t i;
 
 	LARGE_LOOP;
+#pragma omp parallel for
 	for (i=0;i<n;i++) a[i] *= c;
 }
 
@@ -560,7 +604,9 @@ void nMult_mat(doublecomplex * restrict a,const doublecomplex * restrict b,/*con
 	const doublecomplex * restrict val;
 
 	LARGE_LOOP;
-	for (i=0,k=0;i<nd;i++,k+=3) {
+#pragma omp parallel for private(k,val)
+	for (i=0;i<nd;i++) {
+		k=3*i;
 		val=c[material[i]];
 		a[k] = val[0]*b[k];
 		a[k+1] = val[1]*b[k+1];
@@ -584,7 +630,9 @@ void nMultSelf_mat(doublecomplex * restrict a,/*const*/ doublecomplex (* restric
 	const doublecomplex * restrict val;
 
 	LARGE_LOOP;
-	for (i=0,k=0;i<nd;i++,k+=3) {
+#pragma omp parallel for private(k,val)
+	for (i=0;i<nd;i++) {
+		k=3*i;
 		val=c[material[i]];
 		a[k] *= val[0];
 		a[k+1] *= val[1];
@@ -601,5 +649,6 @@ void nConj(doublecomplex * restrict a)
 	register size_t i;
 
 	LARGE_LOOP;
+#pragma omp parallel for
 	for (i=0;i<n;i++) a[i]=conj(a[i]);
 }
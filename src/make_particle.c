@@ -1322,7 +1322,7 @@ void InitShape(void)
 	double tmp3;
 #endif
 	TIME_TYPE tstart;
-	int Nmat_need,i,temp;
+	int Nmat_need,i,j,temp;
 	int small_Nmat=UNDEF; // is set to Nmat, when it is smaller than needed (during prognosis)
 	bool size_given_cmd;  // if size is given in the command line
 	const char *sizename; // type of input size, used in diagnostic messages
@@ -1350,6 +1350,11 @@ void InitShape(void)
 		tmp1=cAbs2(ref_index[i]);
 		if (tmp2<tmp1) tmp2=tmp1;
 	}
+	// for sweep, the same dipole size should satisfy the default dpl for all points (scaled to the current lambda)
+	for (j=1;j<sweep_N;j++) for (i=0;i<Ncomp*Nmat;i++) {
+		tmp1=cAbs2(sweep_m[j][i])*(lambda/sweep_lambda[j])*(lambda/sweep_lambda[j]);
+		if (tmp2<tmp1) tmp2=tmp1;
+	}
 	dpl_def=10*sqrt(tmp2);
 	// initialization of global option index for error messages
 	opt=opt_sh;
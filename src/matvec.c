@@ -23,14 +23,19 @@
 #include "io.h"
 #include "interaction.h"
 #include "linalg.h"
+#include "memory.h"
 #include "prec_time.h"
 #include "sparse_ops.h"
 #include "vars.h"
+// system headers
+#include <stdlib.h>
+#include <string.h>
 
 // SEMI-GLOBAL VARIABLES
 
-#ifdef SPARSE
 // defined and initialized in calculator.c
+extern const int mvBatch;
+#ifdef SPARSE
 extern doublecomplex * restrict arg_full;
 #else
 // defined and initialized in fft.c
@@ -39,8 +44,62 @@ extern doublecomplex * restrict Xmatrix,* restrict slices,* restrict slices_tr,*
 extern const size_t DsizeY,DsizeZ;
 #endif // !SPARSE
 extern const size_t RsizeY;
+// defined and initialized in param.c
+#ifdef SPARSE
+extern const enum sparse_store sparse_store;
+#else
+extern const bool yz_transpose;
+#endif
 // defined and initialized in timing.c
 extern size_t TotalMatVec;
+#if defined(OPENMP) && !defined(SPARSE)
+extern double * restrict Timing_MVThread;
+#endif
+
+#ifdef SPARSE
+/* Sizes of blocks of dipoles in the sparse MatVec. The pass over j (for all vectors) is split into blocks, which are
+ * processed for a block of i before proceeding to the next one. Thus, the parts of arg_full and of the result vectors
+ * are reused from L2 and L1 cache respectively. Blocks of i are also the units of work for OpenMP threads.
+ */
+#define SP_BLOCK_I 32
+#define SP_BLOCK_J 1024
+// hmatrix.c
+void InitHmatrix(bool thrSafe);
+void HmatProd(int nv,doublecomplex * const * restrict resultvecs);
+void FreeHmatrix(void);
+// aim.c
+void InitAIM(bool thrSafe);
+void AIMProd(int nv,doublecomplex * const * restrict resultvecs);
+void FreeAIM(void);
+// index of the OpenMP thread, the same as in fft.h
+#ifdef OPENMP
+#	include <omp.h>
+#	define THREAD_ID omp_get_thread_num()
+#else
+#	define THREAD_ID 0
+#endif
+
+// LOCAL VARIABLES
+
+static enum sparse_store ssType; // actually used storage of interaction terms (never SS_AUTO)
+static bool tabSym; // whether the displacement table covers only non-negative displacements (using symmetry of G)
+static int tabY,tabZ; // dimensions of the displacement table along y and z
+/* Table of interaction terms (6 per element) either over displacements or over all pairs of local and all dipoles (for
+ * SS_DISP and SS_FULL respectively); the same for reflection terms (only if surface)
+ */
+static doublecomplex * restrict intTable,* restrict reflTable;
+static bool thrSafe; // whether interaction terms can be computed by several OpenMP threads simultaneously
+static bool symPass; // whether each pair of dipoles is processed once (symmetric traversal, see SymPairsProd)
+/* buffer of full-size result vectors (mvBatch vectors, each of 3*nvoid_Ndip elements) for each thread, used in
+ * symmetric traversal
+ */
+static doublecomplex * restrict symBuf;
+/* whether the argument is passed around the ring of processors in chunks (RingShift), overlapping communication with
+ * computation, instead of being gathered into arg_full
+ */
+static bool ringPass;
+static doublecomplex * restrict ringBuf[2]; // two chunks (mvBatch vectors of the largest local size) for ringPass
+#endif // SPARSE
 
 // EXTERNAL FUNCTIONS
 
@@ -125,25 +184,27 @@ static inline size_t IndexRmatrix_mv(size_t x,size_t y,size_t z,const bool trans
 //======================================================================================================================
 
 #ifndef SPARSE
-void MatVec (doublecomplex * restrict argvec,    // the argument vector
-             doublecomplex * restrict resultvec, // the result vector
-             double *inprod,         // the resulting inner product
-             const bool her,         // whether Hermitian transpose of the matrix is used
-             TIME_TYPE *timing,      // this variable is incremented by total time
-             TIME_TYPE *comm_timing) // this variable is incremented by communication time
-/* This function implements matrix-vector product. If we want to calculate the inner product as well, we pass 'inprod'
- * as a non-NULL pointer. if 'inprod' is NULL, we don't calculate it. 'argvec' always remains unchanged afterwards,
- * however it is not strictly const - some manipulations may occur during the execution. comm_timing can be NULL, then
- * it is ignored.
+static void MatVecPass(const int nv,                                // number of vectors
+                       doublecomplex * const * restrict argvecs,    // the argument vectors
+                       doublecomplex * const * restrict resultvecs, // the result vectors
+                       double * restrict inprods, // the resulting inner products
+                       const bool her,            // whether Hermitian transpose of the matrix is used
+                       TIME_TYPE *comm_timing)    // this variable is incremented by communication time
+/* Computes matrix-vector products with nv vectors (either 1 or mvBatch) in a single pass. Components of all vectors are
+ * stored together in Xmatrix and slices (3*nv in total), so that each FFT is performed by a single batched plan and
+ * each element of Dmatrix (and Rmatrix) is read once for all vectors. The meaning of other arguments is the same as for
+ * MatVecBatch, but the total timing and the counter of matvecs are handled by the caller.
  */
 {
-	size_t j,x;
+	size_t j;
 	bool ipr,transposed;
 	size_t boxY_st=boxY,boxZ_st=boxZ; // copies with different type
 	size_t i;
-	doublecomplex fmat[6],xv[3],yv[3],xvR[3],yvR[3];
-	size_t index,y,z,Xcomp;
+	size_t index,Xcomp;
 	unsigned char mat;
+	int v;
+	const size_t nc=3*nv; // total number of components
+	double sum; // accumulates inner product
 #ifdef PRECISE_TIMING
 	SYSTEM_TIME tvp[18];
 	SYSTEM_TIME Timing_FFTXf,Timing_FFTYf,Timing_FFTZf,Timing_FFTXb,Timing_FFTYb,Timing_FFTZb,Timing_Mult1,Timing_Mult2,
@@ -178,9 +239,8 @@ void MatVec (doublecomplex * restrict argvec,    // the argument vector
 	 * For (her) three additional operations of nConj are used. Should not be a problem, but can be avoided by a more
 	 * complex code.
 	 */
-	TIME_TYPE tstart=GET_TIME();
 	transposed=(!reduced_FFT) && her;
-	ipr=(inprod!=NULL);
+	ipr=(inprods!=NULL);
 	if (ipr && !ipr_required) LogError(ONE_POS,"Incompatibility error in MatVec");
 #ifdef PRECISE_TIMING
 	InitTime(&Timing_FFTYf);
@@ -195,39 +255,63 @@ void MatVec (doublecomplex * restrict argvec,    // the argument vector
 	GET_SYSTEM_TIME(tvp);
 #endif
 	// FFT_matvec code
-	if (ipr) *inprod = 0.0;
 	// fill Xmatrix with 0.0
-	for (i=0;i<3*local_Nsmall;i++) Xmatrix[i]=0.0;
+#pragma omp parallel for
+	for (i=0;i<nc*local_Nsmall;i++) Xmatrix[i]=0.0;
 
 	// transform from coordinates to grid and multiply with coupling constant
-	if (her) nConj(argvec); // conjugated back afterwards
-
+	if (her) for (v=0;v<nv;v++) nConj(argvecs[v]); // conjugated back afterwards
+	// different dipoles correspond to different elements of Xmatrix, so the following loop can be done in parallel
+#pragma omp parallel for private(j,mat,index,Xcomp,v)
 	for (i=0;i<local_nvoid_Ndip;i++) {
 		// fill grid with argvec*sqrt_cc
 		j=3*i;
 		mat=material[i];
 		index=IndexXmatrix(position[j],position[j+1],position[j+2]);
-		// Xmat=cc_sqrt*argvec
-		for (Xcomp=0;Xcomp<3;Xcomp++) Xmatrix[index+Xcomp*local_Nsmall]=cc_sqrt[mat][Xcomp]*argvec[j+Xcomp];
+		// Xmat=cc_sqrt*argvec; components of vector v are stored at 3*v,3*v+1,3*v+2
+		for (v=0;v<nv;v++) for (Xcomp=0;Xcomp<3;Xcomp++)
+			Xmatrix[index+(3*v+Xcomp)*local_Nsmall]=cc_sqrt[mat][Xcomp]*argvecs[v][j+Xcomp];
 	}
 #ifdef PRECISE_TIMING
 	GET_SYSTEM_TIME(tvp+1);
 	Elapsed(tvp,tvp+1,&Timing_Mult1);
 #endif
 	// FFT X
-	fftX(FFT_FORWARD); // fftX (buf)Xmatrix
+	fftX(FFT_FORWARD,nv); // fftX (buf)Xmatrix
 #ifdef PRECISE_TIMING
 	GET_SYSTEM_TIME(tvp+2);
 	Elapsed(tvp+1,tvp+2,&Timing_FFTXf);
 #endif
 #ifdef PARALLEL
-	BlockTranspose(Xmatrix,comm_timing);
+	BlockTranspose(Xmatrix,nv,comm_timing);
 #endif
 #ifdef PRECISE_TIMING
 	GET_SYSTEM_TIME(tvp+3);
 	Elapsed(tvp+2,tvp+3,&Timing_BTf);
 #endif
-	// following is done by slices
+	/* following is done by slices. In OpenMP mode each thread processes its own range of x, using its own slices (and
+	 * corresponding FFT plans). Therefore all variables used inside the loop are either declared locally or private.
+	 */
+#pragma omp parallel private(i,j,Xcomp)
+	{
+	size_t x,y,z,iv;
+	int w;
+	doublecomplex fmat[6],fmatR[6],xv[3],yv[3],xvR[3],yvR[3];
+	const size_t sh=3*mvBatch*THREAD_ID*gridYZ; // shift of slices of the current thread
+	doublecomplex * restrict sl=slices+sh;
+	/* slices after FFT over y, which are multiplied by Dmatrix (and Rmatrix); they coincide with sl (and slR) for
+	 * '-no_yz_transpose', hence are not restrict (that of Dmatrix and Rmatrix is sufficient for optimization)
+	 */
+	doublecomplex *sl_tr=yz_transpose ? slices_tr+sh : sl;
+	doublecomplex * restrict slR=NULL,*slR_tr=NULL;
+#ifdef OPENMP
+	const double tstart_thr=omp_get_wtime();
+#endif
+	if (surface) {
+		slR=slicesR+sh;
+		slR_tr=yz_transpose ? slicesR_tr+sh : slR;
+	}
+#pragma omp for schedule(static) nowait
 	for(x=local_x0;x<local_x1;x++) {
 		/* TODO: if z and y FFTs are interchanged, then computing reflected interaction can be optimized even further.
 		 * Moreover, the typical situation of particles near surfaces, like large particulate slabs, correspond to the
@@ -237,40 +321,46 @@ void MatVec (doublecomplex * restrict argvec,    // the argument vector
 #ifdef PRECISE_TIMING
 		GET_SYSTEM_TIME(tvp+4);
 #endif
-		// clear slice
-		for(i=0;i<3*gridYZ;i++) slices[i]=0.0;
-		// fill slices with values from Xmatrix
-		for(y=0;y<boxY_st;y++) for(z=0;z<boxZ_st;z++) {
-			i=IndexSliceYZ(y,z);
-			j=IndexGarbledX(x,y,z);
-			for (Xcomp=0;Xcomp<3;Xcomp++) slices[i+Xcomp*gridYZ]=Xmatrix[j+Xcomp*local_Nsmall];
+		/* fill slices with values from Xmatrix and zero padding along z; only rows with y<boxY are used by FFTs and
+		 * transposes (see TransposeYZ), so the rest is not cleared
+		 */
+		for(y=0;y<boxY_st;y++) {
+			for(z=0;z<boxZ_st;z++) {
+				i=IndexSliceYZ(y,z);
+				j=IndexGarbledX(x,y,z);
+				for (Xcomp=0;Xcomp<nc;Xcomp++) sl[i+Xcomp*gridYZ]=Xmatrix[j+Xcomp*local_Nsmall];
+			}
+			for(z=boxZ_st;z<gridZ;z++) {
+				i=IndexSliceYZ(y,z);
+				for (Xcomp=0;Xcomp<nc;Xcomp++) sl[i+Xcomp*gridYZ]=0.0;
+			}
 		}
-		// create a copy of slice, which is further transformed differently
-		if (surface) memcpy(slicesR,slices,3*gridYZ*sizeof(doublecomplex));
+		// create a copy of slice (only the used rows), which is further transformed differently
+		if (surface) for (Xcomp=0;Xcomp<nc;Xcomp++)
+			memcpy(slR+Xcomp*gridYZ,sl+Xcomp*gridYZ,boxY_st*gridZ*sizeof(doublecomplex));
 #ifdef PRECISE_TIMING
 		GET_SYSTEM_TIME(tvp+5);
 		ElapsedInc(tvp+4,tvp+5,&Timing_Mult2);
 #endif
 		// FFT z&y
-		fftZ(FFT_FORWARD); // fftZ (buf)slices (and reflected terms)
+		fftZ(FFT_FORWARD,nv); // fftZ (buf)slices (and reflected terms)
 #ifdef PRECISE_TIMING
 		GET_SYSTEM_TIME(tvp+6);
 		ElapsedInc(tvp+5,tvp+6,&Timing_FFTZf);
 #endif
-		TransposeYZ(FFT_FORWARD); // including reflecting terms
+		TransposeYZ(FFT_FORWARD,nv); // including reflecting terms
 #ifdef PRECISE_TIMING
 		GET_SYSTEM_TIME(tvp+7);
 		ElapsedInc(tvp+6,tvp+7,&Timing_TYZf);
 #endif
-		fftY(FFT_FORWARD); // fftY (buf)slices_tr (and reflected terms)
+		fftY(FFT_FORWARD,nv); // fftY (buf)slices_tr (and reflected terms)
 #ifdef PRECISE_TIMING//
 		GET_SYSTEM_TIME(tvp+8);
 		ElapsedInc(tvp+7,tvp+8,&Timing_FFTYf);
 #endif//
-		// do the product D~*X~  and R~*X'~
+		// do the product D~*X~  and R~*X'~; elements of D~ and R~ are loaded once for all vectors
 		for(z=0;z<gridZ;z++) for(y=0;y<gridY;y++) {
-			i=IndexSliceZY(y,z);
-			for (Xcomp=0;Xcomp<3;Xcomp++) xv[Xcomp]=slices_tr[i+Xcomp*gridYZ];
+			i=yz_transpose ? IndexSliceZY(y,z) : IndexSliceYZ(y,z);
 			j=IndexDmatrix_mv(x-local_x0,y,z,transposed);
 			memcpy(fmat,Dmatrix+j,6*sizeof(doublecomplex));
 			if (reduced_FFT) { // symmetry with respect to reflection (x_i -> x_2N-i) is the same as in r-space
@@ -284,41 +374,47 @@ void MatVec (doublecomplex * restrict argvec,    // the argument vector
 					fmat[4]*=-1;
 				}
 			}
-			cSymMatrVec(fmat,xv,yv); // yv=fmat.xv
 			if (surface) {
-				for (Xcomp=0;Xcomp<3;Xcomp++) xvR[Xcomp]=slicesR_tr[i+Xcomp*gridYZ];
 				j=IndexRmatrix_mv(x-local_x0,y,z,transposed);
-				memcpy(fmat,Rmatrix+j,6*sizeof(doublecomplex));
+				memcpy(fmatR,Rmatrix+j,6*sizeof(doublecomplex));
 				if (reduced_FFT && y>=RsizeY) {
-					fmat[1]*=-1;
-					fmat[4]*=-1;
+					fmatR[1]*=-1;
+					fmatR[4]*=-1;
 				}
 				if (transposed) { // corresponds to transpose of 3x3 matrix
-					fmat[2]*=-1;
-					fmat[4]*=-1;
+					fmatR[2]*=-1;
+					fmatR[4]*=-1;
+				}
+			}
+			for (w=0;w<nv;w++) {
+				iv=i+3*w*gridYZ;
+				for (Xcomp=0;Xcomp<3;Xcomp++) xv[Xcomp]=sl_tr[iv+Xcomp*gridYZ];
+				cSymMatrVec(fmat,xv,yv); // yv=fmat.xv
+				if (surface) {
+					for (Xcomp=0;Xcomp<3;Xcomp++) xvR[Xcomp]=slR_tr[iv+Xcomp*gridYZ];
+					// yv+=fmatR.xvR
+					cReflMatrVec(fmatR,xvR,yvR);
+					cvAdd(yvR,yv,yv);
 				}
-				// yv+=fmat.xvR
-				cReflMatrVec(fmat,xvR,yvR);
-				cvAdd(yvR,yv,yv);
+				for (Xcomp=0;Xcomp<3;Xcomp++) sl_tr[iv+Xcomp*gridYZ]=yv[Xcomp];
 			}
-			for (Xcomp=0;Xcomp<3;Xcomp++) slices_tr[i+Xcomp*gridYZ]=yv[Xcomp];
 		}
 #ifdef PRECISE_TIMING
 		GET_SYSTEM_TIME(tvp+9);
 		ElapsedInc(tvp+8,tvp+9,&Timing_Mult3);
 #endif
 		// inverse FFT y&z
-		fftY(FFT_BACKWARD); // fftY (buf)slices_tr
+		fftY(FFT_BACKWARD,nv); // fftY (buf)slices_tr
 #ifdef PRECISE_TIMING
 		GET_SYSTEM_TIME(tvp+10);
 		ElapsedInc(tvp+9,tvp+10,&Timing_FFTYb);
 #endif
-		TransposeYZ(FFT_BACKWARD);
+		TransposeYZ(FFT_BACKWARD,nv);
 #ifdef PRECISE_TIMING
 		GET_SYSTEM_TIME(tvp+11);
 		ElapsedInc(tvp+10,tvp+11,&Timing_TYZb);
 #endif
-		fftZ(FFT_BACKWARD); // fftZ (buf)slices
+		fftZ(FFT_BACKWARD,nv); // fftZ (buf)slices
 #ifdef PRECISE_TIMING
 		GET_SYSTEM_TIME(tvp+12);
 		ElapsedInc(tvp+11,tvp+12,&Timing_FFTZb);
@@ -328,45 +424,56 @@ void MatVec (doublecomplex * restrict argvec,    // the argument vector
 		for(y=0;y<boxY_st;y++) for(z=0;z<boxZ_st;z++) {
 			i=IndexSliceYZ(y,z);
 			j=IndexGarbledX(x,y,z);
-			for (Xcomp=0;Xcomp<3;Xcomp++) Xmatrix[j+Xcomp*local_Nsmall]=slices[i+Xcomp*gridYZ];
+			for (Xcomp=0;Xcomp<nc;Xcomp++) Xmatrix[j+Xcomp*local_Nsmall]=sl[i+Xcomp*gridYZ];
 		}
 #ifdef PRECISE_TIMING
 		GET_SYSTEM_TIME(tvp+13);
 		ElapsedInc(tvp+12,tvp+13,&Timing_Mult4);
 #endif
 	} // end of loop over slices
+#ifdef OPENMP
+	Timing_MVThread[THREAD_ID]+=omp_get_wtime()-tstart_thr;
+#endif
+	} // end of parallel region
 	// FFT-X back the result
 #ifdef PARALLEL
-	BlockTranspose(Xmatrix,comm_timing);
+	BlockTranspose(Xmatrix,nv,comm_timing);
 #endif
 #ifdef PRECISE_TIMING
 	GET_SYSTEM_TIME(tvp+14);
 	Elapsed(tvp+13,tvp+14,&Timing_BTb);
 #endif
-	fftX(FFT_BACKWARD); // fftX (buf)Xmatrix
+	fftX(FFT_BACKWARD,nv); // fftX (buf)Xmatrix
 #ifdef PRECISE_TIMING
 	GET_SYSTEM_TIME(tvp+15);
 	Elapsed(tvp+14,tvp+15,&Timing_FFTXb);
 #endif
-	// fill resultvec
-	for (i=0;i<local_nvoid_Ndip;i++) {
-		j=3*i;
-		mat=material[i];
-		index=IndexXmatrix(position[j],position[j+1],position[j+2]);
-		for (Xcomp=0;Xcomp<3;Xcomp++) // result=argvec+cc_sqrt*Xmat
-			resultvec[j+Xcomp]=argvec[j+Xcomp]+cc_sqrt[mat][Xcomp]*Xmatrix[index+Xcomp*local_Nsmall];
-		// norm is unaffected by conjugation, hence can be computed here
-		if (ipr) *inprod+=cvNorm2(resultvec+j);
-	}
-	if (her) {
-		nConj(resultvec);
-		nConj(argvec); // conjugate back argvec, so it remains unchanged after MatVec
+	// fill resultvecs
+	for (v=0;v<nv;v++) {
+		doublecomplex * restrict argvec=argvecs[v],* restrict resultvec=resultvecs[v];
+		const doublecomplex * restrict Xvec=Xmatrix+3*v*local_Nsmall; // part of Xmatrix for the current vector
+		sum=0;
+#pragma omp parallel for private(j,mat,index,Xcomp) reduction(+:sum)
+		for (i=0;i<local_nvoid_Ndip;i++) {
+			j=3*i;
+			mat=material[i];
+			index=IndexXmatrix(position[j],position[j+1],position[j+2]);
+			for (Xcomp=0;Xcomp<3;Xcomp++) // result=argvec+cc_sqrt*Xmat
+				resultvec[j+Xcomp]=argvec[j+Xcomp]+cc_sqrt[mat][Xcomp]*Xvec[index+Xcomp*local_Nsmall];
+			// norm is unaffected by conjugation, hence can be computed here
+			if (ipr) sum+=cvNorm2(resultvec+j);
+		}
+		if (ipr) inprods[v]=sum;
+		if (her) {
+			nConj(resultvec);
+			nConj(argvec); // conjugate back argvec, so it remains unchanged after MatVec
+		}
 	}
 #ifdef PRECISE_TIMING
 	GET_SYSTEM_TIME(tvp+16);
 	Elapsed(tvp+15,tvp+16,&Timing_Mult5);
 #endif
-	if (ipr) MyInnerProduct(inprod,double_type,1,comm_timing);
+	if (ipr) MyInnerProduct(inprods,double_type,nv,comm_timing);
 #ifdef PRECISE_TIMING
 	GET_SYSTEM_TIME(tvp+17);
 	Elapsed(tvp+16,tvp+17,&Timing_ipr);
@@ -420,48 +527,464 @@ void MatVec (doublecomplex * restrict argvec,    // the argument vector
 	FreeEverything();
 	Stop(EXIT_SUCCESS);
 #endif
-	(*timing) += GET_TIME() - tstart;
-	TotalMatVec++;
 }
 
 #else // SPARSE is defined
 
 //======================================================================================================================
 
+static inline const doublecomplex *IntTableTerm(const int x,const int y,const int z,doublecomplex buf[static 6])
+/* Returns the interaction term for (integer) displacement {x,y,z} from the displacement table. When the table covers
+ * only non-negative displacements, the signs of off-diagonal elements are changed (then the result is stored in buf),
+ * which is based on the fact that G is a combination of tensors I and RR/|R|^2 (the same as for reduced_FFT).
+ */
+{
+	if (!tabSym) return intTable+6*(((size_t)(x+boxX-1)*tabY+(y+boxY-1))*tabZ+(z+boxZ-1));
+	const doublecomplex *term=intTable+6*(((size_t)abs(x)*tabY+abs(y))*tabZ+abs(z));
+	if (x>=0 && y>=0 && z>=0) return term;
+	buf[0]=term[0];
+	buf[1]=((x<0)!=(y<0)) ? -term[1] : term[1];
+	buf[2]=((x<0)!=(z<0)) ? -term[2] : term[2];
+	buf[3]=term[3];
+	buf[4]=((y<0)!=(z<0)) ? -term[4] : term[4];
+	buf[5]=term[5];
+	return buf;
+}
+
+//======================================================================================================================
+
+static inline const doublecomplex *ReflTableTerm(const int x,const int y,const int zsum,doublecomplex buf[static 6])
+/* Returns the reflection term for displacement {x,y} and sum of z-coordinates zsum from the table, which covers only
+ * non-negative x and y. The reflection from the surface preserves the symmetry with respect to x->-x and y->-y, under
+ * which GR12 and GR13 (GR12 and GR23) change sign respectively.
+ */
+{
+	const doublecomplex *term=reflTable+6*(((size_t)abs(x)*boxY+abs(y))*(2*boxZ-1)+zsum);
+	if (x>=0 && y>=0) return term;
+	buf[0]=term[0];
+	buf[1]=((x<0)!=(y<0)) ? -term[1] : term[1];
+	buf[2]=(x<0) ? -term[2] : term[2];
+	buf[3]=term[3];
+	buf[4]=(y<0) ? -term[4] : term[4];
+	buf[5]=term[5];
+	return buf;
+}
+
+//======================================================================================================================
+
+void InitSparseTerms(void)
+/* Computes and stores the interaction terms before the iterations according to sparse_store, and allocates buffers
+ * for the argument (arg_full or ring buffers) and the results of MatVec. The displacement table
+ * (SS_DISP) is computed fully on each processor, while the full matrix (SS_FULL) is distributed over processors in the
+ * same way as the vectors. The computation is shared among OpenMP threads (if possible). Honors the 'prognosis' flag
+ * (then only memory is counted). Should be called after InitInteraction().
+ */
+{
+	int x;
+	size_t i,tabSize,reflSize;
+	double mem;
+
+	// IGT relies on Fortran routines with static variables, which can't be called from several threads
+	thrSafe=true;
+#ifndef NO_FORTRAN
+	if (IntRelation==G_IGT) thrSafe=false;
+#endif
+	tabSym=reduced_FFT;
+	tabY=tabSym ? boxY : 2*boxY-1;
+	tabZ=tabSym ? boxZ : 2*boxZ-1;
+	tabSize=MultOverflow(MultOverflow(tabSym ? boxX : 2*boxX-1,tabY,ONE_POS_FUNC),tabZ,ONE_POS_FUNC);
+	reflSize=surface ? MultOverflow(MultOverflow(boxX,boxY,ONE_POS_FUNC),2*boxZ-1,ONE_POS_FUNC) : 0;
+	if (sparse_store==SS_AUTO) ssType = (tabSize+reflSize<=SS_AUTO_RATIO*nvoid_Ndip) ? SS_DISP : SS_NONE;
+	else ssType=sparse_store;
+	intTable=reflTable=symBuf=NULL;
+	/* When the terms are computed on the fly, each of them is used for both G_ij and G_ji, which requires that G is
+	 * symmetric with respect to inversion of the displacement (the same as reduced_FFT)
+	 */
+	symPass=(ssType==SS_NONE && reduced_FFT);
+	/* In parallel mode the stored terms are always multiplied by chunks of the argument, passed around the ring. When
+	 * the terms are computed on the fly, this is done only if required by '-opt mem' (or when symmetric traversal is
+	 * not possible), since the symmetric traversal takes half the time. H-matrix and AIM require the whole argument.
+	 */
+	ringPass=false;
+	ringBuf[0]=ringBuf[1]=arg_full=NULL;
+#ifdef PARALLEL
+	if (nprocs>1 && (ssType==SS_DISP || ssType==SS_FULL || (ssType==SS_NONE && (save_memory || !symPass)))) {
+		size_t maxn=0,d0,n;
+		int k;
+		ringPass=true;
+		symPass=false;
+		for (k=0;k<nprocs;k++) {
+			RingChunk(k,&d0,&n);
+			if (n>maxn) maxn=n;
+		}
+		const size_t chunkSize=MultOverflow(mvBatch,3*maxn,ONE_POS_FUNC);
+		memory+=2*chunkSize*sizeof(doublecomplex);
+		if (!prognosis) {
+			MALLOC_VECTOR(ringBuf[0],complex,chunkSize,ALL);
+			MALLOC_VECTOR(ringBuf[1],complex,chunkSize,ALL);
+		}
+	}
+	else
+#endif
+	{ // overflow of 3*nvoid_Ndip is tested in MakeParticle()
+		memory+=3*mvBatch*nvoid_Ndip*sizeof(doublecomplex);
+		if (!prognosis) MALLOC_VECTOR(arg_full,complex,MultOverflow(mvBatch,3*nvoid_Ndip,ONE_POS_FUNC),ALL);
+	}
+	if (symPass) {
+		const size_t symSize=MultOverflow(nthreads,MultOverflow(mvBatch,3*nvoid_Ndip,ONE_POS_FUNC),ONE_POS_FUNC);
+		memory+=symSize*sizeof(doublecomplex);
+		if (!prognosis) MALLOC_VECTOR(symBuf,complex,symSize,ALL);
+	}
+	if (ssType==SS_NONE) return;
+	if (ssType==SS_ACA) {
+		if (prognosis) {
+			/* the upper bound corresponds to all blocks being dense, i.e. 9 complex numbers per pair of dipoles (1.5
+			 * times more than for SS_FULL). It is approached by compact particles of a few wavelengths in size, for
+			 * which most blocks are either not admissible or have large ranks
+			 */
+			mem=9*(double)nvoid_Ndip*nvoid_Ndip*sizeof(doublecomplex);
+			if (IFROOT) PrintBoth(logfile,"Memory usage for H-matrix can not be estimated in advance, upper bound (in "
+				"total) - "FFORMM" MB\n",mem/MBYTE);
+			LogWarning(EC_WARN,ONE_POS,"Memory usage for H-matrix is not included in the total estimate. For compact "
+				"particles it can approach the above upper bound, i.e. that of the full interaction matrix");
+		}
+		else InitHmatrix(thrSafe);
+		return;
+	}
+	if (ssType==SS_AIM) { // honors prognosis itself
+		InitAIM(thrSafe);
+		return;
+	}
+	if (ssType==SS_FULL) tabSize=reflSize=MultOverflow(local_nvoid_Ndip,nvoid_Ndip,ONE_POS_FUNC);
+	mem=6*((double)tabSize+reflSize)*sizeof(doublecomplex);
+	if (IFROOT) {
+#ifdef PARALLEL
+		PrintBoth(logfile,"Memory usage for stored interaction terms (%s, per processor): "FFORMM" MB\n",
+			(ssType==SS_DISP) ? "displacement table" : "full matrix",mem/MBYTE);
+#else
+		PrintBoth(logfile,"Memory usage for stored interaction terms (%s): "FFORMM" MB\n",
+			(ssType==SS_DISP) ? "displacement table" : "full matrix",mem/MBYTE);
+#endif
+	}
+	memory+=mem;
+	if (prognosis) return;
+	MALLOC_VECTOR(intTable,complex,MultOverflow(6,tabSize,ONE_POS_FUNC),ALL);
+	if (surface) MALLOC_VECTOR(reflTable,complex,MultOverflow(6,reflSize,ONE_POS_FUNC),ALL);
+	if (IFROOT) printf("Calculating interaction terms for all MatVecs\n");
+	if (ssType==SS_DISP) {
+		const int x0=tabSym ? 0 : 1-boxX, y0=tabSym ? 0 : 1-boxY, z0=tabSym ? 0 : 1-boxZ;
+#pragma omp parallel for schedule(dynamic) if(thrSafe)
+		for (x=x0;x<boxX;x++) {
+			doublecomplex *term=intTable+6*(size_t)(x-x0)*tabY*tabZ;
+			for (int y=y0;y<boxY;y++) for (int z=z0;z<boxZ;z++,term+=6) {
+				if (x!=0 || y!=0 || z!=0) (*InterTerm_int)(x,y,z,term);
+				else for (int k=0;k<6;k++) term[k]=0;
+			}
+		}
+		if (surface) {
+			/* Only the reflection terms, which are actually used by local dipoles, are computed. This matters for
+			 * Sommerfeld integrals, whose lookup table contains only such values (see CalcSomTable in interaction.c)
+			 */
+			unsigned char * restrict used;
+			MALLOC_VECTOR(used,uchar,reflSize,ALL);
+			for (i=0;i<reflSize;i++) used[i]=0;
+			for (i=0;i<local_nvoid_Ndip;i++) for (size_t j=0;j<nvoid_Ndip;j++) {
+				const int *pi=position+3*i,*pj=position_full+3*j;
+				used[((size_t)abs(pi[0]-pj[0])*boxY+abs(pi[1]-pj[1]))*(2*boxZ-1)+pi[2]+pj[2]]=1;
+			}
+#pragma omp parallel for schedule(dynamic)
+			for (x=0;x<boxX;x++) {
+				size_t ind=(size_t)x*boxY*(2*boxZ-1);
+				for (int y=0;y<boxY;y++) for (int z=0;z<2*boxZ-1;z++,ind++) {
+					if (used[ind]) (*ReflTerm_int)(x,y,z,reflTable+6*ind);
+					else for (int k=0;k<6;k++) reflTable[6*ind+k]=0;
+				}
+			}
+			Free_general(used);
+		}
+	}
+	else { // SS_FULL
+#pragma omp parallel for schedule(dynamic) if(thrSafe)
+		for (i=0;i<local_nvoid_Ndip;i++) for (size_t j=0;j<nvoid_Ndip;j++) {
+			const size_t i3=3*i,j3=3*j;
+			doublecomplex *term=intTable+6*(i*nvoid_Ndip+j);
+			if (j!=local_nvoid_d0+i) (*InterTerm_int)(position[i3]-position_full[j3],
+				position[i3+1]-position_full[j3+1],position[i3+2]-position_full[j3+2],term);
+			else for (int k=0;k<6;k++) term[k]=0;
+			if (surface) (*ReflTerm_int)(position[i3]-position_full[j3],position[i3+1]-position_full[j3+1],
+				position[i3+2]+position_full[j3+2],reflTable+6*(i*nvoid_Ndip+j));
+		}
+	}
+}
+
+//======================================================================================================================
+
+void FreeSparseTerms(void)
+// frees the tables allocated in InitSparseTerms()
+{
+	Free_cVector(intTable);
+	Free_cVector(reflTable);
+	Free_cVector(symBuf);
+	Free_cVector(arg_full);
+	Free_cVector(ringBuf[0]);
+	Free_cVector(ringBuf[1]);
+	if (ssType==SS_ACA) FreeHmatrix();
+	else if (ssType==SS_AIM) FreeAIM();
+}
+
+//======================================================================================================================
+
+static inline void RowProd(const int nv,const doublecomplex * restrict argvec,const size_t stride,const size_t d0,
+	doublecomplex * const * restrict resultvecs,const size_t i,const size_t j0,const size_t j1)
+/* Adds the products of blocks G_ij (j0<=j<j1) with the corresponding blocks of nv vectors to the i'th blocks of
+ * resultvecs, using the stored interaction terms (if available). Vectors contain blocks starting from d0; argvec points
+ * to the first of them (for the first vector), stride is the distance between vectors.
+ */
+{
+	size_t j;
+	const size_t i3=3*i;
+	doublecomplex buf[6]; // buffer for interaction terms from the displacement table
+
+	switch (ssType) {
+		case SS_DISP:
+			for (j=j0; j<j1; j++) {
+				const size_t j3 = 3*j;
+				// the zero element of the table is used for coinciding dipoles
+				SymProdAddBatch(nv,IntTableTerm(position[i3]-position_full[j3],position[i3+1]-position_full[j3+1],
+					position[i3+2]-position_full[j3+2],buf),argvec+3*(j-d0),stride,resultvecs,i3);
+				if (surface) ReflProdAddBatch(nv,ReflTableTerm(position[i3]-position_full[j3],
+					position[i3+1]-position_full[j3+1],position[i3+2]+position_full[j3+2],buf),
+					argvec+3*(j-d0),stride,resultvecs,i3);
+			}
+			break;
+		case SS_FULL:
+			for (j=j0; j<j1; j++) {
+				SymProdAddBatch(nv,intTable+6*(i*nvoid_Ndip+j),argvec+3*(j-d0),stride,resultvecs,i3);
+				if (surface) ReflProdAddBatch(nv,reflTable+6*(i*nvoid_Ndip+j),argvec+3*(j-d0),stride,resultvecs,i3);
+			}
+			break;
+		default: // SS_NONE
+			for (j=j0; j<j1; j++) AijProd(nv,argvec+3*(j-d0),stride,resultvecs,i,j);
+			break;
+	}
+}
+
+//======================================================================================================================
+
+static void RowsProd(const int nv,const doublecomplex * restrict argvec,const size_t stride,const size_t d0,
+	const size_t n,doublecomplex * const * restrict resultvecs,const bool init)
+/* Adds the products of the local rows of the interaction matrix with the blocks d0<=j<d0+n of nv vectors (see RowProd
+ * for the meaning of argvec and stride) to resultvecs, which are first initialized to zero if init. The loops over i
+ * and j are blocked (see SP_BLOCK_I and SP_BLOCK_J), and blocks of i are shared among OpenMP threads.
+ */
+{
+	size_t ib;
+	const size_t nbi=DIV_CEILING(local_nvoid_Ndip,SP_BLOCK_I); // number of blocks of i
+
+#pragma omp parallel for schedule(dynamic) if(thrSafe || ssType!=SS_NONE)
+	for (ib=0; ib<nbi; ib++) {
+		const size_t i0=ib*SP_BLOCK_I, i1=MIN(i0+SP_BLOCK_I,local_nvoid_Ndip);
+		size_t ii,j0;
+		int w;
+		if (init) for (ii=i0; ii<i1; ii++) for (w=0;w<nv;w++) cvInit(resultvecs[w]+3*ii);
+		for (j0=d0; j0<d0+n; j0+=SP_BLOCK_J) for (ii=i0; ii<i1; ii++)
+			RowProd(nv,argvec,stride,d0,resultvecs,ii,j0,MIN(j0+SP_BLOCK_J,d0+n));
+	}
+}
+
+//======================================================================================================================
+
+static void SymPairsProd(const int nv,doublecomplex * restrict res,const size_t i)
+/* Computes the interaction terms between the i'th dipole (global index) and dipoles j=i+1,...,i+nvoid_Ndip/2 (modulo
+ * nvoid_Ndip, for even nvoid_Ndip the last one is taken only if i<nvoid_Ndip/2). Thus, each pair of dipoles is
+ * considered exactly once, while all dipoles get almost the same amount of work. Each term is used twice: the product
+ * of G_ij with the j'th blocks of nv vectors in arg_full is added to the i'th blocks of res, and vice versa. res
+ * contains nv full-size vectors (of 3*nvoid_Ndip elements) one after another. The reflection term for the dipole with
+ * itself is also handled here.
+ */
+{
+	doublecomplex iterm[6];
+	const size_t i3=3*i,len=3*nvoid_Ndip;
+	size_t k,nj,j,j3;
+	int v;
+
+	nj=(nvoid_Ndip-1)/2;
+	if (IS_EVEN(nvoid_Ndip) && i<nvoid_Ndip/2) nj++;
+	for (k=1;k<=nj;k++) {
+		j=i+k;
+		if (j>=nvoid_Ndip) j-=nvoid_Ndip;
+		j3=3*j;
+		// G_ji = G_ij, since all its components are even functions of the displacement
+		(*InterTerm_int)(position_full[i3]-position_full[j3],position_full[i3+1]-position_full[j3+1],
+			position_full[i3+2]-position_full[j3+2],iterm);
+		for (v=0;v<nv;v++) {
+			SymProdAdd(iterm,arg_full+v*len+j3,res+v*len+i3);
+			SymProdAdd(iterm,arg_full+v*len+i3,res+v*len+j3);
+		}
+		if (surface) {
+			(*ReflTerm_int)(position_full[i3]-position_full[j3],position_full[i3+1]-position_full[j3+1],
+				position_full[i3+2]+position_full[j3+2],iterm);
+			for (v=0;v<nv;v++) ReflProdAdd(iterm,arg_full+v*len+j3,res+v*len+i3);
+			// GR_ji is obtained by changing the sign of x and y components of the displacement (see interaction.h)
+			iterm[2]=-iterm[2];
+			iterm[4]=-iterm[4];
+			for (v=0;v<nv;v++) ReflProdAdd(iterm,arg_full+v*len+i3,res+v*len+j3);
+		}
+	}
+	if (surface) {
+		(*ReflTerm_int)(0,0,2*position_full[i3+2],iterm);
+		for (v=0;v<nv;v++) ReflProdAdd(iterm,arg_full+v*len+i3,res+v*len+i3);
+	}
+}
+
+//======================================================================================================================
+
 /* The sparse MatVec is implemented completely separately from the non-sparse version. Although there is some code
  * duplication, this probably makes the both versions easier to maintain.
 */
+static void MatVecPass(const int nv,                                // number of vectors
+                       doublecomplex * const * restrict argvecs,    // the argument vectors
+                       doublecomplex * const * restrict resultvecs, // the result vectors
+                       double * restrict inprods, // the resulting inner products
+                       const bool her,            // whether Hermitian transpose of the matrix is used
+                       TIME_TYPE *comm_timing)    // this variable is incremented by communication time
+/* Computes matrix-vector products with nv vectors (at most mvBatch) in a single pass. Each interaction term (which
+ * evaluation dominates the computational time, unless the terms are stored) is computed once for all vectors. The
+ * loops over i and j are blocked (see RowsProd). When the terms are computed on the fly, they are used for both G_ij
+ * and G_ji (symmetric traversal). Then each thread accumulates full-size results in its own buffer, which are summed
+ * up afterwards (and over processors). In parallel mode (ringPass) the chunks of the argument, local to each
+ * processor, are passed around the ring, so that the next chunk is received while the current one is processed. The
+ * meaning of other arguments is the same as for MatVecBatch, but the total timing and the counter of matvecs are
+ * handled by the caller.
+ */
+{
+	const bool ipr = (inprods != NULL);
+	size_t i,j;
+	int v;
+	doublecomplex * restrict arg_part; // part of arg_full (or of the ring buffer) for the current vector
+
+	for (v=0;v<nv;v++) {
+		if (her) nConj(argvecs[v]);
+		arg_part = ringPass ? ringBuf[0]+v*3*local_nvoid_Ndip : arg_full+v*3*nvoid_Ndip+3*local_nvoid_d0;
+		// TODO: can be replaced by nMult_mat
+#pragma omp parallel for
+		for (j=0; j<local_nvoid_Ndip; j++) CcMul(argvecs[v],arg_part,j);
+#	ifdef PARALLEL
+		if (!ringPass) AllGather(NULL,arg_full+v*3*nvoid_Ndip,cmplx3_type,comm_timing);
+#	endif
+	}
+	if (symPass) {
+		const size_t len=3*nvoid_Ndip,stride=mvBatch*len; // stride between buffers of different threads
+		int t;
+		// all buffers are zeroed, since the following parallel region may use less threads
+#pragma omp parallel for
+		for (j=0; j<nthreads*stride; j++) symBuf[j]=0;
+#pragma omp parallel if(thrSafe)
+		{
+			doublecomplex * restrict res=symBuf+THREAD_ID*stride;
+#pragma omp for schedule(dynamic,SP_BLOCK_I)
+			for (i=0; i<local_nvoid_Ndip; i++) SymPairsProd(nv,res,local_nvoid_d0+i);
+		}
+		for (v=0;v<nv;v++) {
+			doublecomplex * restrict res=symBuf+v*len;
+			for (t=1;t<nthreads;t++) {
+#pragma omp parallel for
+				for (j=0; j<len; j++) res[j]+=res[t*stride+j];
+			}
+#ifdef PARALLEL
+			ReduceScatter(res,resultvecs[v],comm_timing);
+#else
+			memcpy(resultvecs[v],res,len*sizeof(doublecomplex));
+#endif
+		}
+	}
+	else if (ssType==SS_ACA) HmatProd(nv,resultvecs);
+	else if (ssType==SS_AIM) AIMProd(nv,resultvecs);
+#ifdef PARALLEL
+	else if (ringPass) {
+		int s,owner;
+		size_t d0,n,d0_next,n_next;
+		doublecomplex *cur=ringBuf[0],*next=ringBuf[1],*tmp;
+
+		// at step s the chunk, local to processor ringid+s, is processed
+		for (s=0;s<nprocs;s++) {
+			owner=(ringid+s)%nprocs;
+			RingChunk(owner,&d0,&n);
+			if (s<nprocs-1) {
+				RingChunk((owner+1)%nprocs,&d0_next,&n_next);
+				RingShift(cur,nv*3*n,next,nv*3*n_next,comm_timing);
+			}
+			RowsProd(nv,cur,3*n,d0,n,resultvecs,s==0);
+			if (s<nprocs-1) {
+				RingWait(comm_timing);
+				tmp=cur;
+				cur=next;
+				next=tmp;
+			}
+		}
+	}
+#endif
+	else RowsProd(nv,arg_full,3*nvoid_Ndip,0,nvoid_Ndip,resultvecs,true);
+	for (v=0;v<nv;v++) {
+		// TODO: can be replaced by a specially designed function from linalg.c
+#pragma omp parallel for
+		for (i=0; i<local_nvoid_Ndip; i++) DiagProd(argvecs[v],resultvecs[v],i);
+		if (her) {
+			nConj(resultvecs[v]);
+			nConj(argvecs[v]);
+		}
+		if (ipr) inprods[v]=nNorm2(resultvecs[v],comm_timing);
+	}
+}
+
+#endif // SPARSE
+
+//======================================================================================================================
+
 void MatVec (doublecomplex * restrict argvec,    // the argument vector
              doublecomplex * restrict resultvec, // the result vector
              double *inprod,         // the resulting inner product
              const bool her,         // whether Hermitian transpose of the matrix is used
              TIME_TYPE *timing,      // this variable is incremented by total time
              TIME_TYPE *comm_timing) // this variable is incremented by communication time
+/* This function implements matrix-vector product. If we want to calculate the inner product as well, we pass 'inprod'
+ * as a non-NULL pointer. if 'inprod' is NULL, we don't calculate it. 'argvec' always remains unchanged afterwards,
+ * however it is not strictly const - some manipulations may occur during the execution. comm_timing can be NULL, then
+ * it is ignored.
+ */
 {
-	const bool ipr = (inprod != NULL);
-	size_t i,j,i3;
+	doublecomplex *arg[1]={argvec},*res[1]={resultvec};
 
 	TIME_TYPE tstart=GET_TIME();
-	if (her) nConj(argvec);
-	// TODO: can be replaced by nMult_mat
-	for (j=0; j<local_nvoid_Ndip; j++) CcMul(argvec,arg_full+3*local_nvoid_d0,j);
-#	ifdef PARALLEL
-	AllGather(NULL,arg_full,cmplx3_type,comm_timing);
-#	endif
-	for (i=0; i<local_nvoid_Ndip; i++) {
-		i3 = 3*i;
-		cvInit(resultvec+i3);
-		for (j=0; j<nvoid_Ndip; j++) AijProd(arg_full,resultvec,i,j);
-	}
-	// TODO: can be replaced by a specially designed function from linalg.c
-	for (i=0; i<local_nvoid_Ndip; i++) DiagProd(argvec,resultvec,i);
-	if (her) {
-		nConj(resultvec);
-		nConj(argvec);
-	}
-	if (ipr) (*inprod)=nNorm2(resultvec,comm_timing);
+	MatVecPass(1,arg,res,inprod,her,comm_timing);
 	(*timing) += GET_TIME() - tstart;
 	TotalMatVec++;
 }
 
-#endif // SPARSE
+//======================================================================================================================
+
+void MatVecBatch(const int k,                                 // number of vectors
+                 doublecomplex * const * restrict argvecs,    // the argument vectors
+                 doublecomplex * const * restrict resultvecs, // the result vectors
+                 double * restrict inprods, // the resulting inner products
+                 const bool her,            // whether Hermitian transpose of the matrix is used
+                 TIME_TYPE *timing,         // this variable is incremented by total time
+                 TIME_TYPE *comm_timing)    // this variable is incremented by communication time
+/* Computes matrix-vector products of the same matrix with k vectors, result[i]=A.arg[i]. Inner products are computed
+ * only if 'inprods' is not NULL (then it should have k elements). Otherwise, the meaning of arguments is the same as
+ * for MatVec, each product is counted separately in TotalMatVec.
+ *
+ * The vectors are processed in groups of mvBatch (the remaining ones - one by one), each group in a single pass over
+ * the interaction matrix. Buffers and FFT plans are prepared only for these two group sizes.
+ */
+{
+	int i,nv;
+
+	TIME_TYPE tstart=GET_TIME();
+	for (i=0;i<k;i+=nv) {
+		nv=(k-i>=mvBatch) ? mvBatch : 1;
+		MatVecPass(nv,argvecs+i,resultvecs+i,(inprods==NULL) ? NULL : inprods+i,her,comm_timing);
+	}
+	(*timing) += GET_TIME() - tstart;
+	TotalMatVec+=k;
+}
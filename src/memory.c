@@ -117,6 +117,18 @@ double *doubleRealloc(double *ptr,const size_t size,OTHER_ARGUMENTS)
 
 //======================================================================================================================
 
+void *voidRealloc(void *ptr,const size_t size,OTHER_ARGUMENTS)
+// reallocates void vector ptr to a larger size (in bytes)
+{
+	void *v;
+
+	v=realloc(ptr,size);
+	CHECK_NULL(size,v);
+	return v;
+}
+
+//======================================================================================================================
+
 double *doubleVector2(const size_t nl,const size_t nh,OTHER_ARGUMENTS)
 // allocates double vector with indices from nl to nh; all arguments must be non-negative and nh>=nl
 {
@@ -45,9 +45,10 @@ unsigned char *ucharVector(size_t size,OTHER_ARGUMENTS) ATT_MALLOC;
 bool *boolVector(size_t size,OTHER_ARGUMENTS) ATT_MALLOC;
 size_t *sizetVector(size_t size,OTHER_ARGUMENTS) ATT_MALLOC;
 void *voidVector(size_t size,OTHER_ARGUMENTS) ATT_MALLOC;
-// reallocate; only two for now, more can be easily added
+// reallocate; only a few for now, more can be easily added
 double *doubleRealloc(double *ptr,const size_t size,OTHER_ARGUMENTS) ATT_MALLOC;
 char *charRealloc(char *ptr,const size_t size,OTHER_ARGUMENTS) ATT_MALLOC;
+void *voidRealloc(void *ptr,const size_t size,OTHER_ARGUMENTS) ATT_MALLOC;
 // free
 void Free_cVector(doublecomplex * restrict v);
 void Free_dMatrix(double ** restrict m,size_t rows);
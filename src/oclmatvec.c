@@ -110,7 +110,7 @@ void MatVec (doublecomplex * restrict argvec,    // the argument vector
 	CL_CH_ERR(clEnqueueNDRangeKernel(command_queue,clzero,1,NULL,&xmsize,NULL,0,NULL,NULL));
 	CL_CH_ERR(clEnqueueNDRangeKernel(command_queue,clarith1,1,NULL,&local_nvoid_Ndip,NULL,0,NULL,NULL));
 	// FFT X
-	fftX(FFT_FORWARD); // fftX (buf)Xmatrix
+	fftX(FFT_FORWARD,1); // fftX (buf)Xmatrix
 
 	/* In OpenCL mode the free memory on the GPU was determined during fft.c and if enough memory is available slices
 	 * contain the full fft grid. If not, FFT grid is split into "clxslices" parts with "local_gridX" length and kernels
@@ -141,24 +141,24 @@ void MatVec (doublecomplex * restrict argvec,    // the argument vector
 		if (surface) CL_CH_ERR(clEnqueueCopyBuffer(command_queue,bufslices,bufslicesR,0,0,
 			slicesize*sizeof(doublecomplex),0,NULL,NULL));
 
-		fftZ(FFT_FORWARD); // fftZ (buf)slices (and reflected terms)
-		TransposeYZ(FFT_FORWARD); // including reflecting terms
-		fftY(FFT_FORWARD); // fftY (buf)slices_tr (and reflected terms)
+		fftZ(FFT_FORWARD,1); // fftZ (buf)slices (and reflected terms)
+		TransposeYZ(FFT_FORWARD,1); // including reflecting terms
+		fftY(FFT_FORWARD,1); // fftY (buf)slices_tr (and reflected terms)
 		// arith3 on Device
 		if (surface) 
 			CL_CH_ERR(clEnqueueNDRangeKernel(command_queue,clarith3_surface,3,gwo3,gwsclarith3,lws3,0,NULL,NULL));
 		else 
 			CL_CH_ERR(clEnqueueNDRangeKernel(command_queue,clarith3,3,gwo3,gwsclarith3,lws3,0,NULL,NULL));
 		// inverse FFT y&z
-		fftY(FFT_BACKWARD); // fftY (buf)slices_tr
-		TransposeYZ(FFT_BACKWARD);
-		fftZ(FFT_BACKWARD); // fftZ (buf)slices
+		fftY(FFT_BACKWARD,1); // fftY (buf)slices_tr
+		TransposeYZ(FFT_BACKWARD,1);
+		fftZ(FFT_BACKWARD,1); // fftZ (buf)slices
 
 		CL_CH_ERR(clEnqueueNDRangeKernel(command_queue,clarith4,3,gwo24,gwsarith24,lws24,0,NULL,NULL));
 	}
 
 	// FFT-X back the result
-	fftX(FFT_BACKWARD); // fftX (buf)Xmatrix
+	fftX(FFT_BACKWARD,1); // fftX (buf)Xmatrix
 	CL_CH_ERR(clEnqueueNDRangeKernel(command_queue,clarith5,1,NULL,&local_nvoid_Ndip,NULL,0,NULL,NULL));
 	if (ipr) {
 		/* calculating inner product in OpenCL is more complicated than usually. The norm for each element is calculated
@@ -182,3 +182,25 @@ void MatVec (doublecomplex * restrict argvec,    // the argument vector
 	(*timing) += GET_TIME() - tstart;
 	TotalMatVec++;
 }
+
+//======================================================================================================================
+
+void MatVecBatch(const int k,                          // number of vectors
+                 doublecomplex * const * restrict argvecs,    // the argument vectors
+                 doublecomplex * const * restrict resultvecs, // the result vectors
+                 double * restrict inprods, // the resulting inner products
+                 const bool her,            // whether Hermitian transpose of the matrix is used
+                 TIME_TYPE *timing,         // this variable is incremented by total time
+                 TIME_TYPE *comm_timing)    // this variable is incremented by communication time
+/* Computes matrix-vector products of the same matrix with k vectors, result[i]=A.arg[i]. Inner products are computed
+ * only if 'inprods' is not NULL (then it should have k elements). Otherwise, the meaning of arguments is the same as
+ * for MatVec, each product is counted separately in TotalMatVec.
+ *
+ * In OpenCL mode it is a simple loop over MatVec, since the device buffers are allocated for a single vector (mvBatch
+ * is always 1). Still, it provides the same entry point for solvers, which advance several right-hand sides at once.
+ */
+{
+	int i;
+
+	for (i=0;i<k;i++) MatVec(argvecs[i],resultvecs[i],(inprods==NULL) ? NULL : inprods+i,her,timing,comm_timing);
+}
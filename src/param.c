@@ -25,6 +25,7 @@
 #include "fft.h"
 #include "function.h"
 #include "io.h"
+#include "memory.h"
 #include "oclcore.h"
 #include "os.h"
 #include "parbas.h"
@@ -117,9 +118,26 @@ bool avg_inc_pol;                 // whether to average CC over incident polariz
 double polNlocRp;                 // Gaussian width for non-local polarizability
 const char *alldir_parms;         // name of file with alldir parameters
 const char *scat_grid_parms;      // name of file with parameters of scattering grid
+bool iter_block;                  // whether to solve for both incident polarizations simultaneously
+int recycle_size;                 // maximum number of previous solutions, recycled in the iterative solver
+// used in comm.c
+int orient_groups; // number of process groups, which compute different orientations concurrently
 // used in crosssec.c
 double incPolX_0[3],incPolY_0[3]; // initial incident polarizations (in lab RF)
 enum scat ScatRelation;           // type of formulae for scattering quantities
+// used in fft.c
+#ifndef SPARSE
+const char *dm_cache; // name of Dmatrix cache file or directory (NULL - cache is not used)
+bool dm_cache_dir;    // whether dm_cache is a directory (then file names are constructed automatically)
+enum fftback fftBackend; // FFT routines used for matrix-vector product and initialization of Dmatrix
+bool fft_tune;            // whether to choose FFT grid by benchmarking
+const char *fft_tune_dir; // directory for cache of the tuned FFT grid (NULL - cache is not used)
+bool yz_transpose;        // whether slices are transposed between FFTs over z and y (otherwise fftY is strided)
+#endif
+#ifdef FFTW3
+const char *wisdom_dir; // directory for FFTW wisdom cache (NULL - cache is not used)
+bool wisdom_patient;    // whether to use FFTW_PATIENT planner flag (instead of FFTW_MEASURE)
+#endif
 // used in GenerateB.c
 int beam_Npars;
 double beam_pars[MAX_N_BEAM_PARMS]; // beam parameters
@@ -130,18 +148,28 @@ const char *beam_fnameX;
 double igt_lim; // limit (threshold) for integration in IGT
 double igt_eps; // relative error of integration in IGT
 double nloc_Rp; // Gaussian width for non-local interaction
+double som_eps; // relative accuracy of interpolation grid for Sommerfeld integrals (UNDEF - direct evaluation)
+const char *som_cache; // name of directory for cache of Sommerfeld integrals (NULL - cache is not used)
 bool InteractionRealArgs; // whether interaction (or reflection) routines can be called with real arguments
 // used in io.c
 char logfname[MAX_FNAME]=""; // name of logfile
 // used in iterative.c
 double iter_eps;           // relative error to reach
-enum init_field InitField; // how to calculate initial field for the iterative solver
 const char *infi_fnameY;   // names of files, defining the initial field (for two polarizations)
 const char *infi_fnameX;
 bool recalc_resid;         // whether to recalculate residual at the end of iterative solver
 enum chpoint chp_type;     // type of checkpoint (to save)
 time_t chp_time;           // time of checkpoint (in sec)
 char const *chp_dir;       // directory name to save/load checkpoint
+#ifdef SPARSE
+// used in matvec.c
+enum sparse_store sparse_store; // which interaction terms are stored before the iterations
+// used in hmatrix.c
+double aca_eps; // relative error of adaptive cross approximation of the H-matrix
+// used in aim.c
+int aim_coarse; // ratio of the spacing of the auxiliary grid to the dipole size
+int aim_order;  // order of Lagrange interpolation between dipoles and the auxiliary grid
+#endif
 // used in make_particle.c
 enum sh shape;                   // particle shape definition
 int sh_Npars;                    // number of shape parameters
@@ -180,6 +208,10 @@ static bool orient_used;        // whether '-orient ...' was used in the command
 static bool yz_used;            // whether '-yz ...' was used in the command line
 static bool scat_plane_used;    // whether '-scat_plane ...' was used in the command line
 static bool int_surf_used;      // whether '-int_surf ...' was used in the command line
+static const char *sweep_fname; // name of file with sweep points
+static double *sweep_vals;      // list of wavelengths or refractive indices given to '-sweep' in the command line
+static int sweep_Nvals;         // number of values in sweep_vals
+static bool sweep_vals_m;       // whether sweep_vals contains refractive indices (instead of wavelengths)
 
 /* TO ADD NEW COMMAND LINE OPTION
  * If you need new variables or flags to implement effect of the new command line option, define them here. If a
@@ -338,9 +370,19 @@ PARSE_FUNC(chpoint);
 PARSE_FUNC(Cpr);
 PARSE_FUNC(Csca);
 PARSE_FUNC(dir);
+#ifndef SPARSE
+PARSE_FUNC(dm_cache);
+#endif
 PARSE_FUNC(dpl);
 PARSE_FUNC(eps);
 PARSE_FUNC(eq_rad);
+#ifndef SPARSE
+PARSE_FUNC(fft);
+PARSE_FUNC(fft_tune);
+#endif
+#ifdef FFTW3
+PARSE_FUNC(fftw_wisdom);
+#endif
 #ifdef OPENCL
 PARSE_FUNC(gpu);
 #endif
@@ -353,20 +395,26 @@ PARSE_FUNC(init_field);
 PARSE_FUNC(int);
 PARSE_FUNC(int_surf);
 PARSE_FUNC(iter);
+PARSE_FUNC(iter_block);
 PARSE_FUNC(jagged);
 PARSE_FUNC(lambda);
 PARSE_FUNC(m);
 PARSE_FUNC(maxiter);
 PARSE_FUNC(no_reduced_fft);
 PARSE_FUNC(no_vol_cor);
+#ifndef SPARSE
+PARSE_FUNC(no_yz_transpose);
+#endif
 PARSE_FUNC(ntheta);
 PARSE_FUNC(opt);
 PARSE_FUNC(orient);
+PARSE_FUNC(orient_groups);
 PARSE_FUNC(phi_integr);
 PARSE_FUNC(pol);
 PARSE_FUNC(prognosis);
 PARSE_FUNC(prop);
 PARSE_FUNC(recalc_resid);
+PARSE_FUNC(recycle);
 #ifndef SPARSE
 PARSE_FUNC(save_geom);
 #endif
@@ -379,6 +427,10 @@ PARSE_FUNC(sg_format);
 #endif
 PARSE_FUNC(shape);
 PARSE_FUNC(size);
+PARSE_FUNC(som_cache);
+#ifdef SPARSE
+PARSE_FUNC(sparse_store);
+#endif
 PARSE_FUNC(store_beam);
 PARSE_FUNC(store_dip_pol);
 PARSE_FUNC(store_force);
@@ -388,6 +440,7 @@ PARSE_FUNC(store_grans);
 PARSE_FUNC(store_int_field);
 PARSE_FUNC(store_scat_grid);
 PARSE_FUNC(surf);
+PARSE_FUNC(sweep);
 PARSE_FUNC(sym);
 PARSE_FUNC(test);
 PARSE_FUNC(V) ATT_NORETURN;
@@ -411,9 +464,12 @@ static struct opt_struct options[]={
 		"Default: plane",UNDEF,beam_opt},
 	{PAR(chp_dir),"<dirname>","Sets directory for the checkpoint (both for saving and loading).\n"
 		"Default: "FD_CHP_DIR,1,NULL},
-	{PAR(chp_load),"","Restart a simulation from a checkpoint",0,NULL},
+	{PAR(chp_load),"","Restart a simulation from a checkpoint. For orientation averaging, already computed "
+		"orientations are skipped.",0,NULL},
 	{PAR(chp_type),"{normal|regular|always}",
-		"Sets type of the checkpoint. All types, except 'always', require '-chpoint'.\n"
+		"Sets type of the checkpoint. All types, except 'always', require '-chpoint'. For orientation averaging, "
+		"checkpoints are saved only between orientations and contain the results for all orientations computed so "
+		"far.\n"
 		"Default: normal",1,NULL},
 	{PAR(chpoint),"<time>","Specifies the time for checkpoints in format '#d#h#m#s'. All fields are optional, numbers "
 		"are integers, 's' can be omitted, the format is not case sensitive.\n"
@@ -422,6 +478,16 @@ static struct opt_struct options[]={
 	{PAR(Csca),"","Calculate scattering cross section (by integrating the scattered field)",0,NULL},
 	{PAR(dir),"<dirname>","Sets directory for output files.\n"
 		"Default: constructed automatically",1,NULL},
+#ifndef SPARSE
+	{PAR(dm_cache),"{dir <dirname>|file <filename>}","Stores the Fourier-transformed interaction matrix (and the "
+		"reflection one, if '-surf' is used) in a binary cache and reuses it in subsequent runs with the same grid, "
+		"particle box, wavelength, dipole size, interaction (and reflection) formulation, and number of processors. "
+		"Refractive index of the particle does not enter the matrix (except for 'so' and 'igt_so' interactions), so "
+		"a single cache serves the whole sweep over it. 'dir' uses a content-addressed file name inside <dirname>, "
+		"while 'file' uses the given name and overwrites it on mismatch. In parallel mode, each processor uses a "
+		"separate file (with suffix '.<ringid>').\n"
+		"Default: not used",2,NULL},
+#endif
 	{PAR(dpl),"<arg>","Sets parameter 'dipoles per lambda', float.\n"
 		"Default: 10|m|, where |m| is the maximum of all given refractive indices.",1,NULL},
 	{PAR(eps),"<arg>","Specifies the stopping criterion for the iterative solver by setting the relative norm of the "
@@ -432,6 +498,34 @@ static struct opt_struct options[]={
 		"defined by some shapes themselves, then this option can be used to override the internal specification and "
 		"scale the shape.\n"
 		"Default: determined by the value of '-size' or by '-grid', '-dpl', and '-lambda'.",1,NULL},
+#ifndef SPARSE
+	{PAR(fft),"{fftw|temperton|builtin}","Specifies the FFT routines for the matrix-vector product and the "
+		"initialization of the interaction matrix. Only the routines, compiled into ADDA, are available: FFTW3 (unless "
+		"compiled with FFT_TEMPERTON) or Temperton FFT (otherwise). Built-in mixed-radix FFT is always available; it "
+		"does not depend on external libraries, while its performance is usually between that of the other two.\n"
+#	ifdef FFTW3
+		"Default: fftw",1,NULL},
+#	else
+		"Default: temperton",1,NULL},
+#	endif
+	{PAR(fft_tune),"[<dirname>]","Chooses the dimensions of the FFT grid among the admissible ones, which are up to "
+		"25% larger than the minimal ones, to minimize the predicted time of the matrix-vector product. The latter is "
+		"estimated by benchmarking the current FFT routines (see '-fft') for each candidate size with the same data "
+		"layout as in the matrix-vector product, which takes a few seconds. If <dirname> is given, the choice is "
+		"cached in a file in this directory (created, if needed) and reused by all subsequent runs with the same "
+		"particle box, number of processors, FFT routines, and presence of surface. The cache is specific to a "
+		"machine, so a separate directory should be used for each machine. Incompatible with OpenCL.\n"
+		"Default: minimal admissible grid, no tuning",UNDEF,NULL},
+#endif
+#ifdef FFTW3
+	{PAR(fftw_wisdom),"<dirname> [{measure|patient}]","Use persistent cache of FFTW wisdom in the specified directory "
+		"(created, if needed). Wisdom is stored in a separate file for each combination of grid dimensions, number of "
+		"processors, and version of FFTW library, and it is reused by all subsequent runs with the same combination. "
+		"Then the planning of FFTs becomes almost instantaneous, which allows using more rigorous planning also for "
+		"the Fourier transform of the interaction matrix. The second argument specifies the planning level (FFTW "
+		"flag); 'patient' takes much longer for the first run, but may result in faster FFTs.\n"
+		"Default: no cache, 'measure' planning ('estimate' for the interaction matrix)",UNDEF,NULL},
+#endif
 #ifdef OPENCL
 	{PAR(gpu),"<index>","Specifies index of GPU that should be used (starting from 0). Relevant only for OpenCL "
 		"version of ADDA, running on a system with several GPUs.\n"
@@ -493,20 +587,20 @@ static struct opt_struct options[]={
 		 * {...} and its description to the next string. If the new interaction formulation requires unusually large
 		 * computational time, add a special note for sparse mode (after '#ifdef SPARSE').
 		 */
-	{PAR(int_surf),"{img|som}",
+	{PAR(int_surf),"{img|som [<prec>]}",
 		"Sets prescription to calculate the reflection term.\n"
 		"'img' - approximation based on a single image dipole (fast but inaccurate).\n"
-		"'som' - direct evaluation of Sommerfeld integrals.\n"
+		"'som' - direct evaluation of Sommerfeld integrals. If <prec> is given, the integrals are instead interpolated "
+		"from an adaptive grid in the plane of (rho,z), built with relative accuracy 10^(-<prec>). <prec> should be "
+		"from 1 to 3, since the accuracy of the direct evaluation is about 10^(-4).\n"
 	#ifdef SPARSE
 		"!!! In sparse mode 'som' is expected to be very slow.\n"
 	#endif
-		"Default: som (but 'img' if surface is perfectly reflecting)",1,NULL},
+		"Default: som (but 'img' if surface is perfectly reflecting)",UNDEF,NULL},
 		/* TO ADD NEW REFLECTION FORMULATION
 		 * Modify string constants after 'PAR(int_surf)': add new argument (possibly with additional sub-arguments) to
 		 * list {...} and its description to the next string. If the new reflection formulation requires unusually
 		 * large computational time, add a special note for sparse mode (after '#ifdef SPARSE').
-		 * !!! If subarguments are added, second-to-last argument should be changed from 1 to UNDEF, and consistency
-		 * test for number of arguments should be implemented in PARSE_FUNC(int_surf) below.
 		 */
 	{PAR(iter),"{bcgs2|bicg|bicgstab|cgnr|csym|qmr|qmr2}","Sets the iterative solver.\n"
 		"Default: qmr",1,NULL},
@@ -514,6 +608,13 @@ static struct opt_struct options[]={
 		 * add the short name, used to define the new iterative solver in the command line, to the list "{...}" in the
 		 * alphabetical order.
 		 */
+	{PAR(iter_block),"","Solve the linear systems for both incident polarizations simultaneously. The iterations for "
+		"both systems are advanced in lock-step, so that each pass of the matrix-vector product processes two vectors "
+		"at once. Each system stops independently, when it reaches the required residual. Requires twice more memory "
+		"for vectors of the iterative solver. Ignored, when only one incident polarization is computed (e.g. for "
+		"rotationally symmetric particles) or when the polarizability depends on the incident polarization.\n"
+		"Currently supported only for iterative solvers 'bicgstab' and 'qmr', and incompatible with checkpoints.",0,
+		NULL},
 	{PAR(jagged),"<arg>","Sets a size of a big dipole in units of small dipoles, integer. It is used to improve the "
 		"discretization of the particle without changing the shape.\n"
 		"Default: 1",1,NULL},
@@ -534,6 +635,13 @@ static struct opt_struct options[]={
 		"the dipole grid along x-axis to that of the particle, either given by '-size' or calculated analytically from "
 		"'-eq_rad'. Otherwise (by default) ADDA will try to match the volumes, using either '-eq_rad' or the value "
 		"calculated analytically from '-size'.",0,NULL},
+#ifndef SPARSE
+	{PAR(no_yz_transpose),"","Do not transpose the data between FFTs along z and y in the matrix-vector product. "
+		"Instead, FFTs along y are applied with a stride directly to the original data. This saves the time of the "
+		"transposes and the memory for transposed data, but makes FFTs along y and the multiplication by the "
+		"interaction matrix less cache-friendly. So the net effect depends on the FFT routines, the grid, and the "
+		"machine (compare the time of matrix-vector products in the log). Incompatible with OpenCL.",0,NULL},
+#endif
 	{PAR(ntheta),"<arg>","Sets the number of intervals, into which the range of scattering angles [0,180] (degrees) is "
 		"equally divided, integer. This is used for scattering angles in yz-plane. If particle is not symmetric and "
 		"orientation averaging is not used, the range is extended to 360 degrees (with the same length of elementary "
@@ -541,6 +649,10 @@ static struct opt_struct options[]={
 		"Default: from 90 to 720 depending on the size of the computational grid.",1,NULL},
 	{PAR(opt),"{speed|mem}",
 		"Sets whether ADDA should optimize itself for maximum speed or for minimum memory usage.\n"
+#if defined(SPARSE) && defined(PARALLEL)
+		"In sparse mode with interaction terms computed on the fly, 'mem' avoids storing the full argument vector on "
+		"each processor, at the cost of two times more computations.\n"
+#endif
 		"Default: speed",1,NULL},
 	{PAR(orient),"{<alpha> <beta> <gamma>|avg [<filename>]}","Either sets an orientation of the particle by three "
 		"Euler angles 'alpha','beta','gamma' (in degrees) or specifies that orientation averaging should be "
@@ -548,6 +660,14 @@ static struct opt_struct options[]={
 		"y-convention) is used for Euler angles.\n"
 		"Default orientation: 0 0 0\n"
 		"Default <filename>: "FD_AVG_PARMS,UNDEF,NULL},
+	{PAR(orient_groups),"<num>","Splits all MPI processes into <num> groups of equal size, which compute different "
+		"orientations (during orientation averaging) concurrently. Each group keeps its own copy of the interaction "
+		"matrix, while the root process collects the results and performs the adaptive integration. This is more "
+		"efficient than distributing a single (small) particle over many processes. Roots of all groups, except the "
+		"first one, write their logs and standard output into files '"F_LOG_GROUP"' and '"F_STDOUT_GROUP"' in the "
+		"output directory, where %d is the group number. Total number of processes must be divisible by <num>. "
+		"Requires '-orient avg'.\n"
+		"Default: 1",1,NULL},
 	{PAR(phi_integr),"<arg>","Turns on and specifies the type of Mueller matrix integration over azimuthal angle "
 		"'phi'. <arg> is an integer from 1 to 31, each bit of which, from lowest to highest, indicates whether the "
 		"integration should be performed with multipliers 1, cos(2*phi), sin(2*phi), cos(4*phi), and sin(4*phi) "
@@ -580,6 +700,15 @@ static struct opt_struct options[]={
 		"vector) is performed automatically. For point-dipole incident beam this determines its direction.\n"
 		"Default: 0 0 1",3,NULL},
 	{PAR(recalc_resid),"","Recalculate residual at the end of iterative solver.",0,NULL},
+	{PAR(recycle),"<num>","Keep up to <num> previous solutions of the linear system (for all previous incident "
+		"polarizations and orientations, the oldest ones are replaced) together with their products with the "
+		"interaction matrix. They are used to construct the initial vector of the iterative solver, and, only for "
+		"'bicgstab' and 'bcgs2', to deflate the matrix during iterations (GCRO-type recycling). With other solvers, "
+		"including the default 'qmr', only the initial vector is changed. Its smaller residual does not necessarily "
+		"lead to faster convergence, so the total number of iterations may even increase. This is mostly useful for "
+		"orientation averaging. Requires one additional matrix-vector product per solution and memory for 2*<num> "
+		"vectors. Only applicable with '-init_field auto'.\n"
+		"Default: 0 (no recycling), maximum: 20",1,NULL},
 #ifndef SPARSE
 	{PAR(save_geom),"[<filename>]","Save dipole configuration to a file <filename> (a path relative to the output "
 		"directory). Can be used with '-prognosis'.\n"
@@ -622,6 +751,47 @@ static struct opt_struct options[]={
 		"'-eq_rad'. Size is defined by some shapes themselves, then this option can be used to override the internal "
 		"specification and scale the shape.\n"
 		"Default: determined by the value of '-eq_rad' or by '-grid', '-dpl', and '-lambda'.",1,NULL},
+	{PAR(som_cache),"<dirname>","Stores the table of Sommerfeld integrals (used by '-int_surf som') in a binary cache "
+		"inside <dirname> and reuses it in subsequent runs with the same substrate, wavelength, dipole size, and "
+		"fractional part of the particle height (in units of dipole size). The particle itself (shape, refractive "
+		"index, number of processors) does not enter, and only the values missing in the cache are computed (then the "
+		"cache is extended).\n"
+		"Default: not used",1,NULL},
+#ifdef SPARSE
+	{PAR(sparse_store),"{aca [<prec>]|aim [<coarse> [<order>]]|auto|disp|full|none}","Specifies which interaction "
+		"terms are computed once before the iterations and stored in memory, so that each matrix-vector product "
+		"consists only of multiply-adds.\n"
+		"'aca' - hierarchical (H-) matrix, in which interactions between well-separated clusters of dipoles are "
+		"approximated by low-rank matrices (using adaptive cross approximation). Both memory and time of each "
+		"matrix-vector product scale as O(N*log(N)) for particles of fixed size (in units of wavelength). Relative "
+		"accuracy of the approximation is 10^(-<prec>) (default - equal to the stopping criterion of the iterative "
+		"solver). The compression is efficient only for large and porous particles, such as fractal aggregates. For "
+		"compact particles of a few wavelengths in size the ranks of blocks are large (all 3x3 components of the "
+		"interaction tensor are approximated together) and many blocks are not separated enough to be approximated, "
+		"so the memory can approach that of the full matrix (more precisely, 144*N^2 bytes in total). The required "
+		"memory is determined only during the construction, so '-prognosis' reports only this upper bound.\n"
+		"'aim' - adaptive integral (precorrected-FFT) method. Dipoles are projected onto an auxiliary grid, which is "
+		"<coarse> times coarser than the dipole lattice (default - 1), using Lagrange interpolation of order <order> "
+		"(default - 3). Interaction between the grid nodes is computed by FFT, while that between close dipoles is "
+		"corrected to the exact value using a table over displacements (its size depends only on <coarse> and "
+		"<order>). For <coarse>=1 the nodes coincide with the dipoles, so the result is exact (and <order> is "
+		"irrelevant), while the memory is determined by the number of dipoles and by the volume of the box. Larger "
+		"<coarse> decreases the latter part by a factor of <coarse>^3 at the cost of approximation error (relative "
+		"error of cross sections is about 10^-3 for default <order> and '-dpl') and of longer correction. However, "
+		"the size of the correction table (and the time to compute it) grows as <coarse>^6, so <coarse>>1 pays off "
+		"only for very porous particles, such as fractal aggregates (a warning is given otherwise). Incompatible "
+		"with '-surf'.\n"
+		"'auto' - 'disp' if the table has at most 16 entries per dipole, 'none' otherwise.\n"
+		"'disp' - table over all possible displacements between dipoles (inside the box), together with the "
+		"reflected terms for '-surf'. It requires 96 bytes per voxel of the box on each processor (8 times more if the "
+		"interaction tensor is not symmetric, e.g. for '-int so') and additional 192 bytes per voxel for '-surf'.\n"
+		"'full' - all blocks of the interaction matrix, corresponding to local dipoles (twice more for '-surf'). It "
+		"requires 96*N^2/nprocs bytes per processor (N - number of dipoles) and is mostly useful for relatively small "
+		"number of dipoles inside a large box.\n"
+		"'none' - all terms are recomputed in each matrix-vector product. Each of them is used for both pairs (i,j) "
+		"and (j,i), unless the interaction tensor is not symmetric.\n"
+		"Default: auto",UNDEF,NULL},
+#endif
 	{PAR(store_beam),"","Save incident beam to a file",0,NULL},
 	{PAR(store_dip_pol),"","Save dipole polarizations to a file",0,NULL},
 	{PAR(store_force),"","Calculate the radiation force on each dipole. Implies '-Cpr'",0,NULL},
@@ -636,9 +806,21 @@ static struct opt_struct options[]={
 		"(below the surface), assuming that the vacuum is above the surface. It is done either by two values (real and "
 		"imaginary parts of the complex value) or as effectively infinite 'inf' which corresponds to perfectly"
 		"reflective surface. The latter implies certain simplifications during calculations.",UNDEF,NULL},
+	{PAR(sweep),"{lambda <arg1> [...]|m <mRe1> <mIm1> [...]|file <filename>}","Performs calculations for a sequence "
+		"of wavelengths and/or refractive indices in a single run. 'lambda' and 'm' specify a list of wavelengths (in "
+		"um) or refractive indices (only for a single isotropic domain) respectively, while the other parameter is "
+		"given by '-lambda' or '-m'. Each line of <filename> specifies one point by a wavelength, a set of refractive "
+		"indices (in the same format as for '-m'), or both (wavelength first). The particle geometry and dipole size "
+		"are fixed for the whole sweep; the default dpl is satisfied for all points. Interaction matrix is recomputed "
+		"only when wavelength changes (or refractive index for 'so' and 'igt_so' interactions). The iterative solver "
+		"for each point (except the first) is started from the solution for the previous one, unless '-init_field' "
+		"other than 'auto' is given. Results for each point are saved in subdirectories "F_SWEEP_DIR" (point number "
+		"as argument) of the output directory, while cross sections for all points are collected in file "F_SWEEP". "
+		"Incompatible with '-orient avg' and checkpoints.\n"
+		"Default: not used",UNDEF,NULL},
 	{PAR(sym),"{auto|no|enf}","Automatically determine particle symmetries ('auto'), do not take them into account "
 		"('no'), or enforce them ('enf').\n"
-		"Default: auto",1,NULL},
+		"Default: auto",UNDEF,NULL},
 	{PAR(test),"","Begin name of the output directory with 'test' instead of 'run'",0,NULL},
 	{PAR(V),"","Show ADDA version, compiler used to build this executable, build options, and copyright information",
 		0,NULL},
@@ -1027,6 +1209,18 @@ PARSE_FUNC(dir)
 {
 	directory=ScanStrError(argv[1],MAX_DIRNAME);
 }
+#ifndef SPARSE
+PARSE_FUNC(dm_cache)
+{
+#	ifdef PRECISE_TIMING
+	PrintErrorHelp("'-dm_cache' is incompatible with compilation option PRECISE_TIMING");
+#	endif
+	if (strcmp(argv[1],"dir")==0) dm_cache_dir=true;
+	else if (strcmp(argv[1],"file")==0) dm_cache_dir=false;
+	else NotSupported("Dmatrix cache type",argv[1]);
+	dm_cache=ScanStrError(argv[2],dm_cache_dir ? MAX_DIRNAME : MAX_FNAME);
+}
+#endif
 PARSE_FUNC(dpl)
 {
 	ScanDoubleError(argv[1],&dpl);
@@ -1045,6 +1239,48 @@ PARSE_FUNC(eq_rad)
 	ScanDoubleError(argv[1],&a_eq);
 	TestPositive(a_eq,"dpl");
 }
+#ifndef SPARSE
+PARSE_FUNC(fft)
+{
+	if (strcmp(argv[1],"fftw")==0) {
+#	ifdef FFTW3
+		fftBackend=FFTB_FFTW;
+#	else
+		PrintErrorHelp("FFTW3 is not available, since ADDA was compiled with FFT_TEMPERTON option");
+#	endif
+	}
+	else if (strcmp(argv[1],"temperton")==0) {
+#	ifdef FFT_TEMPERTON
+		fftBackend=FFTB_TEMPERTON;
+#	else
+		PrintErrorHelp("Temperton FFT is available only if ADDA is compiled with FFT_TEMPERTON option");
+#	endif
+	}
+	else if (strcmp(argv[1],"builtin")==0) fftBackend=FFTB_BUILTIN;
+	else NotSupported("FFT routines",argv[1]);
+}
+PARSE_FUNC(fft_tune)
+{
+#	ifdef OPENCL
+	PrintErrorHelp("'-fft_tune' is incompatible with OpenCL, since it benchmarks only FFT routines on the host");
+#	endif
+	if (Narg>1) NargError(Narg,"0 or 1");
+	fft_tune=true;
+	if (Narg==1) fft_tune_dir=ScanStrError(argv[1],MAX_DIRNAME);
+}
+#endif
+#ifdef FFTW3
+PARSE_FUNC(fftw_wisdom)
+{
+	if (Narg!=1 && Narg!=2) NargError(Narg,"1 or 2");
+	wisdom_dir=ScanStrError(argv[1],MAX_DIRNAME);
+	if (Narg==2) {
+		if (strcmp(argv[2],"measure")==0) wisdom_patient=false;
+		else if (strcmp(argv[2],"patient")==0) wisdom_patient=true;
+		else NotSupported("Planning level",argv[2]);
+	}
+}
+#endif
 #ifdef OPENCL
 PARSE_FUNC(gpu)
 {
@@ -1216,9 +1452,23 @@ PARSE_FUNC(int)
 }
 PARSE_FUNC(int_surf)
 {
+	double tmp;
+	bool noExtraArgs=true;
+
+	if (Narg<1 || Narg>2) NargError(Narg,"from 1 to 2");
 	if (strcmp(argv[1],"img")==0) ReflRelation=GR_IMG;
-	else if (strcmp(argv[1],"som")==0) ReflRelation=GR_SOM;
+	else if (strcmp(argv[1],"som")==0) {
+		ReflRelation=GR_SOM;
+		if (Narg==2) {
+			ScanDoubleError(argv[2],&tmp);
+			// the accuracy of direct evaluation itself is about 1e-4, so higher precision of the grid is meaningless
+			TestRangeII(tmp,"precision of Sommerfeld integrals",1,3);
+			som_eps=pow(10,-tmp);
+		}
+		noExtraArgs=false;
+	}
 	else NotSupported("Interaction term prescription",argv[1]);
+	TestExtraNarg(Narg,noExtraArgs,argv[1]);
 	int_surf_used=true;
 	/* TO ADD NEW REFLECTION FORMULATION
 	 * add the line to else-if sequence above in the alphabetical order, analogous to the ones already present. The
@@ -1242,6 +1492,10 @@ PARSE_FUNC(iter)
 	 */
 	else NotSupported("Iterative method",argv[1]);
 }
+PARSE_FUNC(iter_block)
+{
+	iter_block=true;
+}
 PARSE_FUNC(jagged)
 {
 	ScanIntError(argv[1],&jagged);
@@ -1282,6 +1536,15 @@ PARSE_FUNC(no_vol_cor)
 {
 	volcor=false;
 }
+#ifndef SPARSE
+PARSE_FUNC(no_yz_transpose)
+{
+#	ifdef OPENCL
+	PrintErrorHelp("'-no_yz_transpose' is incompatible with OpenCL, which uses its own transpose kernels");
+#	endif
+	yz_transpose=false;
+}
+#endif
 PARSE_FUNC(ntheta)
 {
 	ScanIntError(argv[1],&nTheta);
@@ -1313,6 +1576,11 @@ PARSE_FUNC(orient)
 	 */
 	orient_used=true;
 }
+PARSE_FUNC(orient_groups)
+{
+	ScanIntError(argv[1],&orient_groups);
+	TestPositive_i(orient_groups,"number of process groups");
+}
 PARSE_FUNC(phi_integr)
 {
 	phi_integr = true;
@@ -1385,6 +1653,11 @@ PARSE_FUNC(recalc_resid)
 {
 	recalc_resid=true;
 }
+PARSE_FUNC(recycle)
+{
+	ScanIntError(argv[1],&recycle_size);
+	TestRange_i(recycle_size,"size of recycled subspace",0,MAX_RECYCLE);
+}
 #ifndef SPARSE
 PARSE_FUNC(save_geom)
 {
@@ -1480,6 +1753,47 @@ PARSE_FUNC(size)
 	ScanDoubleError(argv[1],&sizeX);
 	TestPositive(sizeX,"particle size");
 }
+PARSE_FUNC(som_cache)
+{
+	som_cache=ScanStrError(argv[1],MAX_DIRNAME);
+}
+#ifdef SPARSE
+PARSE_FUNC(sparse_store)
+{
+	double tmp;
+	bool noExtraArgs=true;
+
+	if (Narg<1 || Narg>3) NargError(Narg,"from 1 to 3");
+	if (strcmp(argv[1],"aca")==0) {
+		sparse_store=SS_ACA;
+		if (Narg>2) NargErrorSub(Narg,"sparse_store aca","0 or 1");
+		if (Narg==2) {
+			ScanDoubleError(argv[2],&tmp);
+			TestPositive(tmp,"ACA precision");
+			aca_eps=pow(10,-tmp);
+		}
+		noExtraArgs=false;
+	}
+	else if (strcmp(argv[1],"aim")==0) {
+		sparse_store=SS_AIM;
+		if (Narg>=2) {
+			ScanIntError(argv[2],&aim_coarse);
+			TestPositive_i(aim_coarse,"AIM grid coarsening");
+			if (Narg==3) {
+				ScanIntError(argv[3],&aim_order);
+				TestRange_i(aim_order,"AIM interpolation order",0,AIM_MAX_ORDER);
+			}
+		}
+		noExtraArgs=false;
+	}
+	else if (strcmp(argv[1],"auto")==0) sparse_store=SS_AUTO;
+	else if (strcmp(argv[1],"disp")==0) sparse_store=SS_DISP;
+	else if (strcmp(argv[1],"full")==0) sparse_store=SS_FULL;
+	else if (strcmp(argv[1],"none")==0) sparse_store=SS_NONE;
+	else NotSupported("Type of stored interaction terms",argv[1]);
+	TestExtraNarg(Narg,noExtraArgs,argv[1]);
+}
+#endif
 PARSE_FUNC(store_beam)
 {
 	store_beam = true;
@@ -1526,6 +1840,31 @@ PARSE_FUNC(surf)
 	surface = true;
 	symZ=false;
 }
+PARSE_FUNC(sweep)
+{
+	int i;
+
+	if (Narg<2) NargError(Narg,"at least 2");
+	if (strcmp(argv[1],"file")==0) {
+		if (Narg!=2) NargError(Narg,"2");
+		sweep_fname=ScanStrError(argv[2],MAX_FNAME);
+	}
+	else {
+		if (strcmp(argv[1],"lambda")==0) sweep_vals_m=false;
+		else if (strcmp(argv[1],"m")==0) {
+			if (!IS_EVEN(Narg-1)) PrintErrorHelp(
+				"Refractive indices should be given by pairs of real and imaginary parts");
+			sweep_vals_m=true;
+		}
+		else NotSupported("Sweep type",argv[1]);
+		sweep_Nvals=Narg-1;
+		MALLOC_VECTOR(sweep_vals,double,sweep_Nvals,ALL);
+		for (i=0;i<sweep_Nvals;i++) {
+			ScanDoubleError(argv[i+2],sweep_vals+i);
+			if (!sweep_vals_m) TestPositive(sweep_vals[i],"wavelength");
+		}
+	}
+}
 PARSE_FUNC(sym)
 {
 	if (strcmp(argv[1],"auto")==0) sym_type=SYM_AUTO;
@@ -1704,6 +2043,9 @@ PARSE_FUNC(V)
 #endif
 #ifdef NO_SVNREV
 		"NO_SVNREV, "
+#endif
+#ifdef OPENMP
+		"OPENMP, "
 #endif
 		"";
 		printf("Extra build options: ");
@@ -1863,6 +2205,9 @@ void InitVariables(void)
 	ScatRelation=SQ_DRAINE;
 	IntRelation=G_POINT_DIP;
 	IterMethod=IT_QMR_CS;
+	iter_block=false;
+	recycle_size=0;
+	orient_groups=1;
 	sym_type=SYM_AUTO;
 	prognosis=false;
 	maxiter=UNDEF;
@@ -1909,16 +2254,45 @@ void InitVariables(void)
 	Ncomp=1;
 	igt_lim=UNDEF;
 	igt_eps=UNDEF;
+	som_eps=UNDEF;
+	som_cache=NULL;
 	InitField=IF_AUTO;
 	recalc_resid=false;
 	surface=false;
 	msubInf=false;
 	int_surf_used=false;
+	sweep_N=0;
+	sweep_fname=NULL;
+	sweep_vals=NULL;
+	sweep_lambda=NULL;
+	sweep_m=NULL;
 	// sometimes the following two are left uninitialized
 	beam_fnameX=NULL;
 	infi_fnameX=NULL;
 #ifdef OPENCL
 	gpuInd=0;
+#endif
+#ifndef SPARSE
+	dm_cache=NULL;
+	dm_cache_dir=false;
+#	ifdef FFTW3
+	fftBackend=FFTB_FFTW;
+#	else
+	fftBackend=FFTB_TEMPERTON;
+#	endif
+	fft_tune=false;
+	fft_tune_dir=NULL;
+	yz_transpose=true;
+#endif
+#ifdef SPARSE
+	sparse_store=SS_AUTO;
+	aca_eps=UNDEF;
+	aim_coarse=1;
+	aim_order=3;
+#endif
+#ifdef FFTW3
+	wisdom_dir=NULL;
+	wisdom_patient=false;
 #endif
 	/* TO ADD NEW COMMAND LINE OPTION
 	 * If you use some new variables, flags, etc. you should specify their default values here. This value will be used
@@ -1976,11 +2350,122 @@ void ParseParameters(const int argc,char **argv)
 
 //======================================================================================================================
 
+static void SetSweepPoint(const int k,const double * restrict val,const int n)
+/* sets sweep point k from n values: either wavelength (n=1), or refractive indices (n=2*Nmat_given), or both
+ * (wavelength first); unspecified parameters are taken from the command line
+ */
+{
+	int i;
+	const int Nm=2*Nmat_given;
+
+	sweep_lambda[k]=lambda;
+	memcpy(sweep_m[k],ref_index,sizeof(ref_index));
+	if (n==1 || n==Nm+1) {
+		sweep_lambda[k]=val[0];
+		if (val[0]<=0) PrintError("Wavelength for sweep point %d ("GFORMDEF") must be positive",k+1,val[0]);
+	}
+	if (n>=Nm) for (i=0;i<Nmat_given;i++) {
+		sweep_m[k][i]=val[n-Nm+2*i] + I*val[n-Nm+2*i+1];
+		if (sweep_m[k][i]==1) PrintError("Refractive index #%d for sweep point %d is that of vacuum, which is not "
+			"supported. Consider using, for instance, 1.0001 instead.",i+1,k+1);
+	}
+}
+
+//======================================================================================================================
+
+static int ScanSweepLine(const char * restrict fname,const size_t line,const char * restrict linebuf,
+	double val[static restrict 2*MAX_NMAT+1])
+// scans a line of sweep file into val, returns number of values scanned (0 for blank line)
+{
+	int n;
+	const int Nm=2*Nmat_given;
+	double tmp;
+	const char *p;
+	char *end;
+
+	p=linebuf;
+	n=0;
+	while (true) {
+		tmp=strtod(p,&end);
+		if (end==p) break;
+		if (n<=Nm) val[n]=tmp; // extra values are counted but not stored
+		p=end;
+		n++;
+	}
+	while (isspace(*p)) p++;
+	if (*p!='\0') PrintError("Error occurred during scanning of line %zu in sweep file '%s'",line,fname);
+	if (n!=0 && n!=1 && n!=Nm && n!=Nm+1) PrintError("Line %zu of sweep file '%s' contains %d values, while 1 "
+		"(wavelength), %d (refractive indices), or %d (both) are expected",line,fname,n,Nm,Nm+1);
+	return n;
+}
+
+//======================================================================================================================
+
+static void InitSweep(void)
+/* initializes sweep points from the list given in the command line or from file, and sets lambda and ref_index to the
+ * first point. File is read twice: first to count the points, then to actually read them.
+ */
+{
+	int i,k,n;
+	double val[2*MAX_NMAT+1];
+	FILE *file;
+	size_t line;
+	char linebuf[BUF_LINE];
+
+	file=NULL; // redundant initialization to remove warnings
+	if (sweep_fname!=NULL) {
+		TIME_TYPE tstart=GET_TIME();
+		file=FOpenErr(sweep_fname,"r",ALL_POS);
+		line=SkipComments(file);
+		while (FGetsError(file,sweep_fname,&line,linebuf,BUF_LINE,ONE_POS)!=NULL)
+			if (ScanSweepLine(sweep_fname,line,linebuf,val)!=0) sweep_N++;
+		if (sweep_N==0) PrintError("No sweep points are found in file '%s'",sweep_fname);
+		rewind(file);
+		Timing_FileIO+=GET_TIME()-tstart;
+	}
+	else if (sweep_vals_m) {
+		if (Nmat_given!=1) PrintError("'-sweep m ...' can be used only with a single isotropic refractive index. Use "
+			"'-sweep file ...' instead.");
+		sweep_N=sweep_Nvals/2;
+	}
+	else sweep_N=sweep_Nvals;
+	MALLOC_VECTOR(sweep_lambda,double,sweep_N,ALL);
+	sweep_m=voidVector(sweep_N*sizeof(*sweep_m),ALL_POS,"sweep_m");
+	if (sweep_fname!=NULL) {
+		TIME_TYPE tstart=GET_TIME();
+		line=SkipComments(file);
+		k=0;
+		while (FGetsError(file,sweep_fname,&line,linebuf,BUF_LINE,ONE_POS)!=NULL) {
+			n=ScanSweepLine(sweep_fname,line,linebuf,val);
+			if (n!=0) SetSweepPoint(k++,val,n);
+		}
+		FCloseErr(file,sweep_fname,ALL_POS);
+		Timing_FileIO+=GET_TIME()-tstart;
+	}
+	else {
+		for (k=0;k<sweep_N;k++) {
+			if (sweep_vals_m) SetSweepPoint(k,sweep_vals+2*k,2);
+			else SetSweepPoint(k,sweep_vals+k,1);
+		}
+		Free_general(sweep_vals);
+	}
+	// the first point is used for initialization
+	lambda=sweep_lambda[0];
+	memcpy(ref_index,sweep_m[0],sizeof(ref_index));
+	// incident beam given by a file can't be consistently used for different wavelengths
+	if (beamtype==B_READ) for (i=1;i<sweep_N;i++) if (sweep_lambda[i]!=lambda)
+		PrintError("'-beam read' can not be used with '-sweep' over wavelengths");
+}
+
+//======================================================================================================================
+
 void VariablesInterconnect(void)
 // finish parameters initialization based on their interconnections
 {
 	double temp;
 
+	// initialize sweep points, which may change lambda and ref_index
+	if (sweep_fname!=NULL || sweep_vals!=NULL) InitSweep();
 	// initialize WaveNum ASAP
 	WaveNum = TWO_PI/lambda;
 	// set default incident direction, which is +z for all configurations
@@ -2006,6 +2491,10 @@ void VariablesInterconnect(void)
 	}
 	// if not initialized before, IGT precision is set to that of the iterative solver
 	if (igt_eps==UNDEF) igt_eps=iter_eps;
+#ifdef SPARSE
+	// by default, H-matrix is approximated with the same accuracy as required from the iterative solver
+	if (aca_eps==UNDEF) aca_eps=iter_eps;
+#endif
 	// parameter incompatibilities
 	if (scat_plane && yzplane) PrintError("Currently '-scat_plane' and '-yz' cannot be used together.");
 	if (orient_avg) {
@@ -2055,10 +2544,43 @@ void VariablesInterconnect(void)
 			PrintError("When '-anisotr' is used 6 numbers (3 complex values) should be given per each domain");
 		else Nmat=Nmat/3;
 	}
+	if (sweep_N>0) {
+		if (orient_avg) PrintError("'-sweep' is incompatible with '-orient avg'");
+		if (chp_type!=CHP_NONE || load_chpoint) PrintError("Currently checkpoints are incompatible with '-sweep'");
+	}
+	if (iter_block) {
+		if (IterMethod!=IT_BICGSTAB && IterMethod!=IT_QMR_CS)
+			PrintError("'-iter_block' is currently supported only for iterative solvers 'bicgstab' and 'qmr'");
+		if ((chp_type!=CHP_NONE || load_chpoint) && !orient_avg)
+			PrintError("Currently checkpoints are incompatible with '-iter_block'");
+		/* TO ADD NEW ITERATIVE SOLVER
+		 * update the test above, if lock-step version of the new iterative solver is implemented in iterative.c
+		 */
+	}
+	if (recycle_size>0) {
+		if (InitField!=IF_AUTO) PrintError("'-recycle' can be used only with '-init_field auto'");
+		if (iter_block) PrintError("'-recycle' is incompatible with '-iter_block'");
+		/* checkpoint would contain intermediate vector of deflated iterations, and no recycled subspace. By contrast,
+		 * checkpoints of orientation averaging are saved between orientations, and do not interfere with recycling.
+		 */
+		if (chp_type!=CHP_NONE && !orient_avg) PrintError("'-recycle' is incompatible with checkpoints");
+		if (IterMethod!=IT_BICGSTAB && IterMethod!=IT_BCGS2) LogWarning(EC_WARN,ONE_POS,"Recycling with this iterative "
+			"solver affects only the initial vector, which usually gives little gain. Use '-iter bicgstab' or "
+			"'-iter bcgs2' to also deflate the matrix during iterations.");
+	}
+	if (orient_groups>1) {
+		if (!orient_avg) PrintError("'-orient_groups' can be used only with '-orient avg'");
+		if (nprocs%orient_groups!=0) PrintError("Total number of processes (%d) must be divisible by the number of "
+			"process groups (%d)",nprocs,orient_groups);
+		// all groups would write the same files simultaneously
+		if (save_geom) PrintError("'-save_geom' is incompatible with '-orient_groups'");
+#ifndef SPARSE
+		// granules are placed randomly, so different groups would obtain different particles
+		if (sh_granul) PrintError("Granule generator ('-granul') is incompatible with '-orient_groups'");
+#endif
+	}
 	if (chp_type!=CHP_NONE) {
 		if (chp_time==UNDEF && chp_type!=CHP_ALWAYS) PrintError("You must specify time for this checkpoint type");
-		// TODO: this limitation should be removed in the future
-		if (orient_avg) PrintError("Currently checkpoint is incompatible with '-orient avg'");
 	}
 	if (sizeX!=UNDEF && a_eq!=UNDEF) PrintError("'-size' and '-eq_rad' can not be used together");
 	if (calc_mat_force && beamtype!=B_PLANE)
@@ -2081,6 +2603,7 @@ void VariablesInterconnect(void)
 	InteractionRealArgs=(beamtype==B_DIPOLE); // other cases may be added here in the future (e.g. nearfields)
 #ifdef SPARSE
 	if (shape==SH_SPHERE) PrintError("Sparse mode requires shape to be read from file (-shape read ...)");
+	if (surface && sparse_store==SS_AIM) PrintError("'-sparse_store aim' is incompatible with '-surf'");
 #endif
 #if defined(PARALLEL) && !defined(SPARSE)
 	/* Transpose of the non-symmetric interaction matrix can't be done in MPI mode, due to existing memory distribution
@@ -2169,9 +2692,9 @@ void FinalizeSymmetry(void) {
 			PrintError("Only one beam file is specified, while two incident polarizations need to be considered");
 		if (InitField==IF_READ && infi_fnameX==NULL) PrintError("Only one file with initial field is specified, while "
 			"two incident polarizations need to be considered");
-		// the following limitation should be removed in the future
-		if (chp_type!=CHP_NONE) PrintError("Currently checkpoints can be used when internal fields are calculated only "
-			"once, i.e. for a single incident polarization");
+		// the following limitation should be removed in the future; orientation averaging uses its own checkpoints
+		if (chp_type!=CHP_NONE && !orient_avg) PrintError("Currently checkpoints can be used when internal fields are "
+			"calculated only once, i.e. for a single incident polarization");
 	}
 }
 
@@ -2258,6 +2781,13 @@ void DirectoryLog(const int argc,char **argv)
 		else fprintf(logfile,"\n");
 #else // sequential
 		if (compname!=NULL) fprintf(logfile,"The program was run on: %s\n",compname);
+#endif
+#ifdef OPENMP
+#	ifdef PARALLEL
+		fprintf(logfile,"Hybrid mode: %d processes x %d OpenMP threads\n",nprocs,nthreads);
+#	else
+		fprintf(logfile,"Number of OpenMP threads: %d\n",nthreads);
+#	endif
 #endif
 		// log command line
 		fprintf(logfile,"command: '");
@@ -2276,7 +2806,8 @@ void PrintInfo(void)
 	int i;
 	char sbuffer[MAX_LINE];
 
-	if (IFROOT) {
+	// roots of other process groups do not have all descriptive strings, and their logs are auxiliary anyway
+	if (IFROOT && group_id==0) {
 		// print basic parameters
 		printf("box dimensions: %ix%ix%i\n",boxX,boxY,boxZ);
 		printf("lambda: "GFORM"   Dipoles/lambda: "GFORMDEF"\n",lambda,dpl);
@@ -2318,6 +2849,8 @@ void PrintInfo(void)
 			fprintf(logfile,"  height of the particle center: "GFORMDEF"\n",hsub);
 		}
 		fprintf(logfile,"Dipoles/lambda: "GFORMDEF"\n",dpl);
+		if (sweep_N>0) fprintf(logfile,"Sweep over %d points (the above values correspond to the first one)\n",
+			sweep_N);
 		if (volcor_used) fprintf(logfile,"\t(Volume correction used)\n");
 		fprintf(logfile,"Required relative residual norm: "GFORMDEF"\n",iter_eps);
 		fprintf(logfile,"Total number of occupied dipoles: %zu\n",nvoid_Ndip);
@@ -2433,7 +2966,10 @@ void PrintInfo(void)
 			fprintf(logfile,"Reflected Green's tensor formulae: ");
 			switch (ReflRelation) {
 				case GR_IMG: fprintf(logfile,"'Image-dipole approximation'\n"); break;
-				case GR_SOM: fprintf(logfile,"'Sommerfeld integrals'\n"); break;
+				case GR_SOM:
+					if (som_eps==UNDEF) fprintf(logfile,"'Sommerfeld integrals'\n");
+					else fprintf(logfile,"'Sommerfeld integrals' (interpolated, accuracy "GFORMDEF")\n",som_eps);
+					break;
 			}
 		}
 		/* TO ADD NEW REFLECTION FORMULATION
@@ -2442,12 +2978,21 @@ void PrintInfo(void)
 		 */
 		// log FFT and (if needed) clFFT method
 		fprintf(logfile,"FFT algorithm: ");
-#ifdef FFTW3
-		fprintf(logfile,"FFTW3\n");
-#elif defined(FFT_TEMPERTON)
-		fprintf(logfile,"by C.Temperton\n");
-#elif defined(SPARSE)
+#ifdef SPARSE
 		fprintf(logfile,"none (sparse mode)\n");
+#else
+		switch (fftBackend) {
+			case FFTB_FFTW:
+				fprintf(logfile,"FFTW3\n");
+#	ifdef FFTW3
+				if (wisdom_dir!=NULL) fprintf(logfile,"  wisdom cache in '%s', planning level: %s\n",wisdom_dir,
+					wisdom_patient ? "patient" : "measure");
+#	endif
+				break;
+			case FFTB_TEMPERTON: fprintf(logfile,"by C.Temperton\n"); break;
+			case FFTB_BUILTIN: fprintf(logfile,"built-in mixed-radix\n"); break;
+		}
+		if (!yz_transpose) fprintf(logfile,"  strided FFTs along y (no transpose of slices)\n");
 #endif
 #if defined(OPENCL) && !defined(SPARSE)
 		fprintf(logfile,"OpenCL FFT algorithm: ");
@@ -2468,6 +3013,8 @@ void PrintInfo(void)
 			case IT_QMR_CS: fprintf(logfile,"QMR (complex symmetric)\n"); break;
 			case IT_QMR_CS_2: fprintf(logfile,"2-term QMR (complex symmetric)\n"); break;
 		}
+		if (iter_block) fprintf(logfile,"  (lock-step for both incident polarizations)\n");
+		if (recycle_size>0) fprintf(logfile,"  (recycling up to %d previous solutions)\n",recycle_size);
 		/* TO ADD NEW ITERATIVE SOLVER
 		 * add a case above in the alphabetical order, analogous to the ones already present. The variable parts of the
 		 * case are descriptor, defined in const.h, and its plain-text description (to be shown in log).
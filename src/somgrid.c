@@ -0,0 +1,245 @@
+/* File: somgrid.c
+ * $Date::                            $
+ * Descr: adaptive interpolation grid for Sommerfeld integrals
+ *
+ *        The integrals (4 complex values, see evlua in somnec.c) are considered as functions of rho and Z (the sum of
+ *        heights of two dipoles above the surface). The domain of interest is covered by a quadtree of rectangular
+ *        cells, each of which stores the values at 3x3 uniformly spaced points. Inside a cell the values are
+ *        obtained by biquadratic interpolation. A cell is subdivided into four, until the interpolation error at four
+ *        test points (in the centers of quarters) is below the required accuracy (relative to the largest value in the
+ *        cell). The test points and the cell points are reused by the children, so each subdivision requires 16 new
+ *        evaluations. Since the direct evaluation itself has relative accuracy of about 1e-4, the required accuracy
+ *        should be larger than that, otherwise the refinement is driven by noise (and limited only by SG_MAX_DEPTH).
+ *
+ *        Before interpolation the integrals are multiplied by R^3*exp(-ikR) (where R=sqrt(rho^2+Z^2)), which removes
+ *        the main oscillations and the singularity (for small Z), making the functions much smoother. This is similar
+ *        to the approach of Schmehl (PhD thesis, Arizona State University, 1994), but with adaptive grid spacing.
+ *
+ * Copyright (C) 2013 ADDA contributors
+ * This file is part of ADDA.
+ *
+ * ADDA is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ *
+ * ADDA is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with ADDA. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include "const.h" // keep this first
+// project headers
+#include "cmplx.h"
+#include "comm.h"
+#include "io.h"
+#include "memory.h"
+#include "vars.h"
+// system headers
+#include <math.h>
+#include <string.h>
+
+// LOCAL VARIABLES
+
+#define SG_MAX_DEPTH 12 // maximum depth of the quadtree (limits the refinement near problematic points)
+
+typedef struct {
+	double r0,r1,z0,z1; // boundaries of the cell (rho and Z)
+	int child;          // index of the first child (others follow it), -1 for leaves
+	size_t leaf;        // for leaves - index of the values in sgVals (in units of 36 complex numbers)
+} somcell;
+
+static somcell *sgCells;      // cells of the quadtree, the root is the first one
+static size_t sgNcells,sgSizeCells;
+static doublecomplex *sgVals; // values at 3x3 points (4 integrals each, Z index changes faster) for each leaf
+static size_t sgNleaves,sgSizeLeaves;
+static size_t sgNeval;        // number of evaluations of the exact function
+static double sgEps;          // required relative accuracy
+static void (*sgExact)(double rho,double z,doublecomplex vals[static 4]); // function to compute the exact values
+
+//======================================================================================================================
+
+static void Scaled(const double rho,const double z,doublecomplex vals[static 4])
+// computes the exact values of the integrals, multiplied by R^3*exp(-ikR)
+{
+	const double R=hypot(rho,z);
+	const doublecomplex sc=R*R*R*imExp(-WaveNum*R);
+	int k;
+
+	(*sgExact)(rho,z,vals);
+	for (k=0;k<4;k++) vals[k]*=sc;
+	sgNeval++;
+}
+
+//======================================================================================================================
+
+static inline void Lagrange3(const double t,double L[static 3])
+// Lagrange basis at points 0, 0.5, and 1
+{
+	L[0]=2*(t-0.5)*(t-1);
+	L[1]=-4*t*(t-1);
+	L[2]=2*t*(t-0.5);
+}
+
+//======================================================================================================================
+
+static void Interp(const doublecomplex p[static 36],const double t,const double u,doublecomplex vals[static 4])
+// biquadratic interpolation of 3x3 points p (4 values each) at relative coordinates (t,u) inside the cell
+{
+	double Lt[3],Lu[3];
+	int a,b,k;
+
+	Lagrange3(t,Lt);
+	Lagrange3(u,Lu);
+	for (k=0;k<4;k++) vals[k]=0;
+	for (a=0;a<3;a++) for (b=0;b<3;b++) for (k=0;k<4;k++) vals[k]+=Lt[a]*Lu[b]*p[4*(3*a+b)+k];
+}
+
+//======================================================================================================================
+
+static int NewCells(const int n)
+// adds n cells to the tree (enlarging the storage if needed); returns the index of the first of them
+{
+	const int first=sgNcells;
+
+	if (sgNcells+n>sgSizeCells) {
+		sgSizeCells=2*(sgNcells+n);
+		sgCells=(somcell *)voidRealloc(sgCells,MultOverflow(sgSizeCells,sizeof(somcell),ONE_POS_FUNC),ALL_POS,
+			"sgCells");
+	}
+	sgNcells+=n;
+	return first;
+}
+
+//======================================================================================================================
+
+static void BuildCell(const int ic,const doublecomplex p[static 36],const int depth)
+/* Builds the cell ic (with boundaries already set) with known values at 3x3 points p; either stores it as a leaf or
+ * subdivides it recursively
+ */
+{
+	/* the values on a 5x5 lattice (with quarter spacing), which includes the points of all children; the points of the
+	 * cell itself have even indices, test points - odd ones
+	 */
+	doublecomplex q[5][5][4],iv[4];
+	double dr,dz,err,scale;
+	int a,b,k,ch;
+	const int tp[4][2]={{1,1},{3,1},{1,3},{3,3}}; // test points
+
+	dr=sgCells[ic].r1-sgCells[ic].r0;
+	dz=sgCells[ic].z1-sgCells[ic].z0;
+	for (a=0;a<3;a++) for (b=0;b<3;b++) memcpy(q[2*a][2*b],p+4*(3*a+b),4*sizeof(doublecomplex));
+	// compare the interpolation at test points with the exact values
+	err=scale=0;
+	for (a=0;a<3;a++) for (b=0;b<3;b++) for (k=0;k<4;k++) scale=MAX(scale,cabs(q[2*a][2*b][k]));
+	for (ch=0;ch<4;ch++) {
+		a=tp[ch][0];
+		b=tp[ch][1];
+		Scaled(sgCells[ic].r0+a*dr/4,sgCells[ic].z0+b*dz/4,q[a][b]);
+		Interp(p,a/4.0,b/4.0,iv);
+		for (k=0;k<4;k++) {
+			err=MAX(err,cabs(iv[k]-q[a][b][k]));
+			scale=MAX(scale,cabs(q[a][b][k]));
+		}
+	}
+	if (err<=sgEps*scale || depth==SG_MAX_DEPTH) { // store the leaf
+		if (sgNleaves==sgSizeLeaves) {
+			sgSizeLeaves=2*sgSizeLeaves+1;
+			sgVals=(doublecomplex *)voidRealloc(sgVals,MultOverflow(36*sgSizeLeaves,sizeof(doublecomplex),
+				ONE_POS_FUNC),ALL_POS,"sgVals");
+		}
+		sgCells[ic].child=-1;
+		sgCells[ic].leaf=sgNleaves;
+		memcpy(sgVals+36*sgNleaves,p,36*sizeof(doublecomplex));
+		sgNleaves++;
+		return;
+	}
+	// compute remaining points of the lattice (with one odd and one even index)
+	for (a=0;a<5;a++) for (b=0;b<5;b++) if ((a+b)%2==1)
+		Scaled(sgCells[ic].r0+a*dr/4,sgCells[ic].z0+b*dz/4,q[a][b]);
+	// subdivide; note that sgCells can be reallocated inside NewCells and BuildCell
+	ch=NewCells(4);
+	sgCells[ic].child=ch;
+	for (k=0;k<4;k++) {
+		const int ka=k/2,kb=k%2;
+		doublecomplex cp[36];
+		somcell *c=sgCells+ch+k;
+		c->r0=sgCells[ic].r0+ka*dr/2;
+		c->r1=c->r0+dr/2;
+		c->z0=sgCells[ic].z0+kb*dz/2;
+		c->z1=c->z0+dz/2;
+		for (a=0;a<3;a++) for (b=0;b<3;b++) memcpy(cp+4*(3*a+b),q[2*ka+a][2*kb+b],4*sizeof(doublecomplex));
+		BuildCell(ch+k,cp,depth+1);
+	}
+}
+
+//======================================================================================================================
+
+void InitSomGrid(double rhoMax,const double zMin,double zMax,const double eps,
+	void (*exact)(double rho,double z,doublecomplex vals[static 4]))
+/* Builds the interpolation grid for rho in [0,rhoMax] and Z in [zMin,zMax] (in um, zMin should be positive) with
+ * relative accuracy eps. exact is the function to compute the exact values of the integrals. Should not be called in
+ * prognosis mode, since the required memory can only be determined during the construction.
+ */
+{
+	doublecomplex p[36];
+	int a,b;
+	double mem,dr,dz;
+
+	// degenerate domains are slightly extended (then interpolation is exact at the only point)
+	if (rhoMax<=0) rhoMax=gridspace;
+	if (zMax<=zMin) zMax=zMin+gridspace;
+	sgEps=eps;
+	sgExact=exact;
+	sgCells=NULL;
+	sgVals=NULL;
+	sgNcells=sgSizeCells=sgNleaves=sgSizeLeaves=sgNeval=0;
+	if (IFROOT) printf("Building interpolation grid for Sommerfeld integrals\n");
+	NewCells(1);
+	sgCells[0].r0=0;
+	sgCells[0].r1=rhoMax;
+	sgCells[0].z0=zMin;
+	sgCells[0].z1=zMax;
+	dr=rhoMax/2;
+	dz=(zMax-zMin)/2;
+	for (a=0;a<3;a++) for (b=0;b<3;b++) Scaled(a*dr,zMin+b*dz,p+4*(3*a+b));
+	BuildCell(0,p,0);
+	mem=sgNcells*sizeof(somcell)+36*sgNleaves*sizeof(doublecomplex);
+	memory+=mem;
+	if (IFROOT) PrintBoth(logfile,"Interpolation grid for Sommerfeld integrals: %zu cells (%zu leaves), %zu evaluations"
+		", memory "FFORMM" MB\n",sgNcells,sgNleaves,sgNeval,mem/MBYTE);
+}
+
+//======================================================================================================================
+
+bool SomGridInterp(const double rho,const double z,doublecomplex vals[static 4])
+/* Interpolates the Sommerfeld integrals at (rho,z). Returns false if the point is outside the domain of the grid (then
+ * vals is not changed).
+ */
+{
+	const somcell *c=sgCells;
+	double R;
+	doublecomplex sc;
+	int k;
+
+	if (rho<c->r0 || rho>c->r1 || z<c->z0 || z>c->z1) return false;
+	while (c->child>=0) {
+		k=2*(rho>(c->r0+c->r1)/2)+(z>(c->z0+c->z1)/2);
+		c=sgCells+c->child+k;
+	}
+	Interp(sgVals+36*c->leaf,(rho-c->r0)/(c->r1-c->r0),(z-c->z0)/(c->z1-c->z0),vals);
+	R=hypot(rho,z);
+	sc=imExp(WaveNum*R)/(R*R*R);
+	for (k=0;k<4;k++) vals[k]*=sc;
+	return true;
+}
+
+//======================================================================================================================
+
+void FreeSomGrid(void)
+// frees the memory allocated in InitSomGrid
+{
+	Free_general(sgCells);
+	Free_cVector(sgVals);
+	sgCells=NULL;
+	sgVals=NULL;
+}
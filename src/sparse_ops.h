@@ -40,71 +40,74 @@ static inline void CcMul(doublecomplex * restrict argvec_src,doublecomplex * res
 
 //=====================================================================================================================
 
-static inline void AijProd(doublecomplex * restrict argvec,doublecomplex * restrict resultvec,const size_t i,
-	const size_t j)
-/* Handles the multiplication of the j'th block of argvec with the G_ij block of the G-matrix, and adds the result
- * to the i'th block of resultvec.
- */
-{	
-	doublecomplex iterm[6];
-	const size_t i3 = 3*i, j3 = 3*j;
+static inline void SymProdAdd(const doublecomplex * restrict iterm,const doublecomplex * restrict arg,
+	doublecomplex * restrict res)
+// Adds the product of symmetric matrix iterm (6 elements) with arg (3 elements) to res
+{
+	__m128d r, tmp;
+
+	IGNORE_WARNING(-Wstrict-aliasing); // cast from doublecomplex* to double* is perfectly valid in C99
+	const __m128d argX = _mm_load_pd((const double *)(arg));
+	const __m128d argY = _mm_load_pd((const double *)(arg+1));
+	const __m128d argZ = _mm_load_pd((const double *)(arg+2));
+	STOP_IGNORE;
+
+	r = cmul(argX, *(const __m128d *)&(iterm[0]));
+	tmp = cmul(argY, *(const __m128d *)&(iterm[1]));
+	r = cadd(tmp,r);
+	tmp = cmul(argZ, *(const __m128d *)&(iterm[2]));
+	r = cadd(tmp,r);
+	*(__m128d *)&(res[0]) = cadd(r, *(__m128d *)&(res[0]));
+
+	r = cmul(argX, *(const __m128d *)&(iterm[1]));
+	tmp = cmul(argY, *(const __m128d *)&(iterm[3]));
+	r = cadd(tmp,r);
+	tmp = cmul(argZ, *(const __m128d *)&(iterm[4]));
+	r = cadd(tmp,r);
+	*(__m128d *)&(res[1]) = cadd(r, *(__m128d *)&(res[1]));
+
+	r = cmul(argX, *(const __m128d *)&(iterm[2]));
+	tmp = cmul(argY, *(const __m128d *)&(iterm[4]));
+	r = cadd(tmp,r);
+	tmp = cmul(argZ, *(const __m128d *)&(iterm[5]));
+	r = cadd(tmp,r);
+	*(__m128d *)&(res[2]) = cadd(r, *(__m128d *)&(res[2]));
+}
 
-	__m128d res, tmp;
+//=====================================================================================================================
+
+static inline void ReflProdAdd(const doublecomplex * restrict iterm,const doublecomplex * restrict arg,
+	doublecomplex * restrict res)
+// Adds the product of reflection matrix iterm (6 elements, see cReflMatrVec) with arg (3 elements) to res
+{
+	__m128d r, tmp;
 
 	IGNORE_WARNING(-Wstrict-aliasing); // cast from doublecomplex* to double* is perfectly valid in C99
-	const __m128d argX = _mm_load_pd((double *)(argvec+j3));
-	const __m128d argY = _mm_load_pd((double *)(argvec+j3+1));
-	const __m128d argZ = _mm_load_pd((double *)(argvec+j3+2));
+	const __m128d argX = _mm_load_pd((const double *)(arg));
+	const __m128d argY = _mm_load_pd((const double *)(arg+1));
+	const __m128d argZ = _mm_load_pd((const double *)(arg+2));
 	STOP_IGNORE;
 
-	if (j!=local_nvoid_d0+i) { // main interaction is not computed for coinciding dipoles
-		(*InterTerm_int)(position[i3]-position_full[j3], position[i3+1]-position_full[j3+1],
-			position[i3+2]-position_full[j3+2], iterm);
-		res = cmul(argX, *(__m128d *)&(iterm[0]));
-		tmp = cmul(argY, *(__m128d *)&(iterm[1]));
-		res = cadd(tmp,res);
-		tmp = cmul(argZ, *(__m128d *)&(iterm[2]));
-		res = cadd(tmp,res);
-		*(__m128d *)&(resultvec[i3]) = cadd(res, *(__m128d *)&(resultvec[i3]));
-
-		res = cmul(argX, *(__m128d *)&(iterm[1]));
-		tmp = cmul(argY, *(__m128d *)&(iterm[3]));
-		res = cadd(tmp,res);
-		tmp = cmul(argZ, *(__m128d *)&(iterm[4]));
-		res = cadd(tmp,res);
-		*(__m128d *)&(resultvec[i3+1]) = cadd(res, *(__m128d *)&(resultvec[i3+1]));
-
-		res = cmul(argX, *(__m128d *)&(iterm[2]));
-		tmp = cmul(argY, *(__m128d *)&(iterm[4]));
-		res = cadd(tmp,res);
-		tmp = cmul(argZ, *(__m128d *)&(iterm[5]));
-		res = cadd(tmp,res);
-		*(__m128d *)&(resultvec[i3+2]) = cadd(res, *(__m128d *)&(resultvec[i3+2]));
-	}
-	if (surface) { // surface interaction is computed always
-		(*ReflTerm_int)(position[i3]-position_full[j3], position[i3+1]-position_full[j3+1],
-			position[i3+2]+position_full[j3+2], iterm);
-		res = cmul(argX, *(__m128d *)&(iterm[0]));
-		tmp = cmul(argY, *(__m128d *)&(iterm[1]));
-		res = cadd(tmp,res);
-		tmp = cmul(argZ, *(__m128d *)&(iterm[2]));
-		res = cadd(tmp,res);
-		*(__m128d *)&(resultvec[i3]) = cadd(res, *(__m128d *)&(resultvec[i3]));
-
-		res = cmul(argX, *(__m128d *)&(iterm[1]));
-		tmp = cmul(argY, *(__m128d *)&(iterm[3]));
-		res = cadd(tmp,res);
-		tmp = cmul(argZ, *(__m128d *)&(iterm[4]));
-		res = cadd(tmp,res);
-		*(__m128d *)&(resultvec[i3+1]) = cadd(res, *(__m128d *)&(resultvec[i3+1]));
-
-		res = cmul(argZ, *(__m128d *)&(iterm[5]));
-		tmp = cmul(argX, *(__m128d *)&(iterm[2]));
-		res=_mm_sub_pd(res,tmp);
-		tmp = cmul(argY, *(__m128d *)&(iterm[4]));
-		res=_mm_sub_pd(res,tmp);
-		*(__m128d *)&(resultvec[i3+2]) = cadd(res, *(__m128d *)&(resultvec[i3+2]));
-	}
+	r = cmul(argX, *(const __m128d *)&(iterm[0]));
+	tmp = cmul(argY, *(const __m128d *)&(iterm[1]));
+	r = cadd(tmp,r);
+	tmp = cmul(argZ, *(const __m128d *)&(iterm[2]));
+	r = cadd(tmp,r);
+	*(__m128d *)&(res[0]) = cadd(r, *(__m128d *)&(res[0]));
+
+	r = cmul(argX, *(const __m128d *)&(iterm[1]));
+	tmp = cmul(argY, *(const __m128d *)&(iterm[3]));
+	r = cadd(tmp,r);
+	tmp = cmul(argZ, *(const __m128d *)&(iterm[4]));
+	r = cadd(tmp,r);
+	*(__m128d *)&(res[1]) = cadd(r, *(__m128d *)&(res[1]));
+
+	r = cmul(argZ, *(const __m128d *)&(iterm[5]));
+	tmp = cmul(argX, *(const __m128d *)&(iterm[2]));
+	r=_mm_sub_pd(r,tmp);
+	tmp = cmul(argY, *(const __m128d *)&(iterm[4]));
+	r=_mm_sub_pd(r,tmp);
+	*(__m128d *)&(res[2]) = cadd(r, *(__m128d *)&(res[2]));
 }
 
 //=====================================================================================================================
@@ -141,28 +144,26 @@ static inline void CcMul(doublecomplex * restrict argvec_src,doublecomplex * res
 
 //=====================================================================================================================
 
-static inline void AijProd(doublecomplex * restrict argvec,doublecomplex * restrict resultvec,const size_t i,
-	const size_t j)
-/* Handles the multiplication of the j'th block of argvec with the G_ij block of the G-matrix, and adds the result
- * to the i'th block of resultvec.
- */
+static inline void SymProdAdd(const doublecomplex * restrict iterm,const doublecomplex * restrict arg,
+	doublecomplex * restrict res)
+// Adds the product of symmetric matrix iterm (6 elements) with arg (3 elements) to res
 {
-	doublecomplex res[3];
-	doublecomplex iterm[6];
-	const size_t i3=3*i,j3=3*j;
+	doublecomplex tmp[3];
 
-	if (j!=local_nvoid_d0+i) { // main interaction is not computed for coinciding dipoles
-		(*InterTerm_int)(position[i3]-position_full[j3],position[i3+1]-position_full[j3+1],
-			position[i3+2]-position_full[j3+2],iterm);
-		cSymMatrVec(iterm,argvec+j3,res);
-		cvAdd(res,resultvec+i3,resultvec+i3);
-	}
-	if (surface) { // surface interaction is computed always
-		(*ReflTerm_int)(position[i3]-position_full[j3],position[i3+1]-position_full[j3+1],
-			position[i3+2]+position_full[j3+2],iterm);
-		cReflMatrVec(iterm,argvec+j3,res);
-		cvAdd(res,resultvec+i3,resultvec+i3);
-	}
+	cSymMatrVec(iterm,arg,tmp);
+	cvAdd(tmp,res,res);
+}
+
+//=====================================================================================================================
+
+static inline void ReflProdAdd(const doublecomplex * restrict iterm,const doublecomplex * restrict arg,
+	doublecomplex * restrict res)
+// Adds the product of reflection matrix iterm (6 elements, see cReflMatrVec) with arg (3 elements) to res
+{
+	doublecomplex tmp[3];
+
+	cReflMatrVec(iterm,arg,tmp);
+	cvAdd(tmp,res,res);
 }
 
 //=====================================================================================================================
@@ -181,6 +182,56 @@ static inline void DiagProd(doublecomplex * restrict argvec,doublecomplex * rest
 
 #endif // !USE_SSE3
 
+//=====================================================================================================================
+
+static inline void SymProdAddBatch(const int nv,const doublecomplex * restrict iterm,
+	const doublecomplex * restrict argvec,const size_t stride,doublecomplex * const * restrict resultvecs,
+	const size_t i3)
+/* Adds the products of symmetric matrix iterm (6 elements) with the blocks of nv vectors, starting at argvec (with
+ * distance stride between vectors), to the blocks of resultvecs, starting at i3
+ */
+{
+	int v;
+
+	for (v=0;v<nv;v++) SymProdAdd(iterm,argvec+v*stride,resultvecs[v]+i3);
+}
+
+//=====================================================================================================================
+
+static inline void ReflProdAddBatch(const int nv,const doublecomplex * restrict iterm,
+	const doublecomplex * restrict argvec,const size_t stride,doublecomplex * const * restrict resultvecs,
+	const size_t i3)
+// Same as SymProdAddBatch, but for the reflection matrix iterm (6 elements, see cReflMatrVec)
+{
+	int v;
+
+	for (v=0;v<nv;v++) ReflProdAdd(iterm,argvec+v*stride,resultvecs[v]+i3);
+}
+
+//=====================================================================================================================
+
+static inline void AijProd(const int nv,const doublecomplex * restrict argvec,const size_t stride,
+	doublecomplex * const * restrict resultvecs,const size_t i,const size_t j)
+/* Handles the multiplication of the j'th blocks of nv vectors, starting at argvec (with distance stride between
+ * vectors), with the G_ij block of the G-matrix, and adds the results to the i'th blocks of resultvecs. The G_ij block
+ * is computed only once for all vectors.
+ */
+{
+	doublecomplex iterm[6];
+	const size_t i3=3*i,j3=3*j;
+
+	if (j!=local_nvoid_d0+i) { // main interaction is not computed for coinciding dipoles
+		(*InterTerm_int)(position[i3]-position_full[j3],position[i3+1]-position_full[j3+1],
+			position[i3+2]-position_full[j3+2],iterm);
+		SymProdAddBatch(nv,iterm,argvec,stride,resultvecs,i3);
+	}
+	if (surface) { // surface interaction is computed always
+		(*ReflTerm_int)(position[i3]-position_full[j3],position[i3+1]-position_full[j3+1],
+			position[i3+2]+position_full[j3+2],iterm);
+		ReflProdAddBatch(nv,iterm,argvec,stride,resultvecs,i3);
+	}
+}
+
 #endif // __sparse_ops_h
 
 #endif // SPARSE
@@ -18,14 +18,16 @@
 #include "timing.h" // corresponding header
 // project headers
 #include "comm.h"
+#include "fft.h"
 #include "io.h"
+#include "memory.h"
 #include "vars.h"
 // system headers
 #include <math.h>
 #include <time.h>
 #include <stdio.h>
 
-#ifdef ADDA_MPI
+#if defined(ADDA_MPI) || defined(OPENMP)
 #	define TO_SEC(p) (p)
 #else
 #	define TO_SEC(p) ((p) / (double) CLOCKS_PER_SEC)
@@ -33,6 +35,12 @@
 
 // SEMI-GLOBAL VARIABLES
 
+#ifdef FFTW3
+// defined and initialized in param.c
+extern const char *wisdom_dir;
+extern const enum fftback fftBackend;
+#endif
+
 // used in CalculateE.c
 TIME_TYPE Timing_EPlane,Timing_EPlaneComm,    // for Eplane calculation: total and comm
           Timing_IntField,Timing_IntFieldOne, // for internal fields: total & one calculation
@@ -56,6 +64,14 @@ TIME_TYPE Timing_EFieldAD,Timing_EFieldADComm,  // time for all_dir: total & com
 // used in fft.c
 TIME_TYPE Timing_FFT_Init, // for initialization of FFT routines
           Timing_Dm_Init;  // for building Dmatrix
+	/* parts of the latter (including Rmatrix): Green's tensor, FFTs, and transposes (including communication); parts
+	 * computed in parallel by OpenMP threads are averaged over threads
+	 */
+TIME_TYPE Timing_DmGcalc,Timing_DmFFT,Timing_DmTransp;
+#ifdef FFTW3
+double Timing_FFTWPlan,  // wall time (in s) for creating all FFTW plans (part of the above two)
+       Timing_FFTWSaved; // estimated wall time (in s) saved by importing FFTW wisdom
+#endif
 // used in iterative.c
 time_t last_chp_wt; // wall time of the last checkpoint (1s precision is sufficient)
 TIME_TYPE Timing_OneIter,Timing_OneIterComm,       // for one iteration: total & comm
@@ -69,6 +85,10 @@ TIME_TYPE Timing_Particle,                 // for particle construction
           Timing_Granul,Timing_GranulComm; // for granule generation: total & comm
 // used in matvec.c
 size_t TotalMatVec; // total number of matrix-vector products
+#if defined(OPENMP) && !defined(SPARSE) && !defined(OPENCL)
+	// wall time of each thread spent in the loop over slices in MatVec (accumulated); allocated in fft.c
+double * restrict Timing_MVThread;
+#endif
 
 // LOCAL VARIABLES
 SYSTEM_TIME wt_start; // starting wall time
@@ -113,6 +133,9 @@ void InitTiming(void)
 	TotalIter=TotalMatVec=TotalEval=TotalEFieldPlane=0;
 	Timing_EField=Timing_FileIO=Timing_IntField=Timing_ScatQuan=Timing_Integration=0;
 	Timing_ScatQuanComm=Timing_InitDmComm=0;
+#ifdef FFTW3
+	Timing_FFTWPlan=Timing_FFTWSaved=0;
+#endif
 #ifdef SPARSE
 	Timing_Dm_Init=Timing_Granul=Timing_FFT_Init=Timing_GranulComm=0;
 #endif	
@@ -126,9 +149,17 @@ void FinalStatistics(void)
 	SYSTEM_TIME wt_end;
 	double totTime;
 	TIME_TYPE Timing_TotalTime;
+#if defined(OPENMP) && !defined(SPARSE) && !defined(OPENCL)
+	int i;
+#endif
 
 	// wait for all processes to show correct execution time
 	Synchronize();
+	// when several process groups are used, the world root reports the total counts
+	AccumulateGroups(&TotalEval);
+	AccumulateGroups(&TotalIter);
+	AccumulateGroups(&TotalMatVec);
+	AccumulateGroups(&TotalEFieldPlane);
 	if (IFROOT) {
 		// last time measurements
 		Timing_TotalTime = GET_TIME() - tstart_main;
@@ -139,7 +170,7 @@ void FinalStatistics(void)
 			"                Timing Results             \n"
 			"~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\n");
 		if (!prognosis) {
-			if (orient_avg) fprintf(logfile,
+			if (orient_avg || sweep_N>0) fprintf(logfile,
 				"Total number of single particle evaluations: %zu\n",TotalEval);
 			fprintf(logfile,
 				"Total number of iterations: %zu\n"
@@ -153,6 +184,10 @@ void FinalStatistics(void)
 		fprintf(logfile,
 			"--Everything below is also wall times--\n"
 			"Time since MPI_Init: "FFORMT"\n",TO_SEC(Timing_TotalTime));
+#elif defined(OPENMP)
+		fprintf(logfile,
+			"--Everything below is also wall times--\n"
+			"Total time:          "FFORMT"\n",TO_SEC(Timing_TotalTime));
 #else // standard clock
 		fprintf(logfile,
 			"--Everything below is processor times--\n");
@@ -181,8 +216,22 @@ void FinalStatistics(void)
 			fprintf(logfile,
 				"      communication:       "FFORMT"\n",TO_SEC(Timing_InitDmComm));
 #	endif
+			fprintf(logfile,
+				"      Green's tensor:      "FFORMT"\n"
+				"      FFT:                 "FFORMT"\n"
+				"      transposes:          "FFORMT"\n",
+				TO_SEC(Timing_DmGcalc),TO_SEC(Timing_DmFFT),TO_SEC(Timing_DmTransp));
 			fprintf(logfile,
 				"    FFT setup:           "FFORMT"\n",TO_SEC(Timing_FFT_Init));
+#	ifdef FFTW3
+			if (fftBackend==FFTB_FFTW) {
+				// this includes planning for Dmatrix (i.e. part of 'init Dmatrix')
+				fprintf(logfile,
+					"      FFTW planning:       "FFORMT"\n",Timing_FFTWPlan);
+				if (wisdom_dir!=NULL) fprintf(logfile,
+					"      saved by wisdom:     "FFORMT"\n",Timing_FFTWSaved);
+			}
+#	endif
 #endif // !SPARSE
 		}
 		fprintf(logfile,
@@ -229,6 +278,12 @@ void FinalStatistics(void)
 #ifdef PARALLEL
 			fprintf(logfile,
 				"          communication:       "FFORMT"\n",TO_SEC(Timing_OneIterMVPComm));
+#endif
+#if defined(OPENMP) && !defined(SPARSE) && !defined(OPENCL)
+			fprintf(logfile,
+				"    matvec slices per thread (total):\n");
+			for (i=0;i<nthreads;i++) fprintf(logfile,
+				"      %3d:                 "FFORMT"\n",i,Timing_MVThread[i]);
 #endif
 			fprintf(logfile,
 				"  Scattered fields:    "FFORMT"\n",TO_SEC(Timing_EField));
@@ -270,4 +325,8 @@ void FinalStatistics(void)
 		// close logfile
 		FCloseErr(logfile,F_LOG,ONE_POS);
 	}
+#if defined(OPENMP) && !defined(SPARSE) && !defined(OPENCL)
+	// allocated in InitDmatrix, but freed only here, since it is used above
+	Free_general(Timing_MVThread);
+#endif
 }
@@ -24,6 +24,10 @@
 #ifdef ADDA_MPI
 #	define TIME_TYPE double
 #	define GET_TIME() MPI_Wtime()
+#elif defined(OPENMP) // clock() would sum the processor time of all threads
+#	include <omp.h>
+#	define TIME_TYPE double
+#	define GET_TIME() omp_get_wtime()
 #else
 #	include <time.h>
 #	define TIME_TYPE clock_t
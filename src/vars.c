@@ -80,9 +80,15 @@ doublecomplex cc_sqrt[MAX_NMAT][3]; // sqrt of couple constants
 doublecomplex chi_inv[MAX_NMAT][3]; // normalized inverse susceptibility: = 1/(V*chi)
 unsigned char * restrict material;  // material: index for cc
 
+// sweep over wavelength and/or refractive index
+int sweep_N;                                 // number of sweep points (0 - sweep is not used)
+double * restrict sweep_lambda;              // wavelength for each sweep point
+doublecomplex (* restrict sweep_m)[MAX_NMAT]; // set of refractive indices (same as ref_index) for each sweep point
+
 // iterative solver
 enum iter IterMethod; // iterative method to use
 int maxiter;          // maximum number of iterations
+enum init_field InitField; // how to calculate initial field for the iterative solver
 	// the following two can't be declared restrict due to SwapPointers
 doublecomplex *xvec;  // total electric field on the dipoles
 doublecomplex *pvec;  // polarization of dipoles, also an auxiliary vector in iterative solvers
@@ -96,8 +102,10 @@ scat_grid_angles angles;           // angle sets for scat_grid
 	// E calculated on a grid for many different directions (holds Eper and Epar) for two incident polarizations
 doublecomplex * restrict EgridX,* restrict EgridY;
 
-int nprocs;                        // total number of processes
-int ringid;                        // ID of current process
+int nprocs;                        // total number of processes (in the current process group)
+int ringid;                        // ID of current process (in the current process group)
+int group_id;                      // ID of the process group (always 0, unless '-orient_groups' is used)
+int nthreads;                      // number of OpenMP threads per process (1, if OpenMP is not used)
 
 size_t local_Ndip;                 // number of local total dipoles
 size_t local_nvoid_Ndip;           // number of local and ...
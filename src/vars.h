@@ -64,9 +64,15 @@ extern doublecomplex cc_sqrt[MAX_NMAT][3];
 extern doublecomplex chi_inv[MAX_NMAT][3];
 extern unsigned char * restrict material;
 
+// sweep over wavelength and/or refractive index
+extern int sweep_N;
+extern double * restrict sweep_lambda;
+extern doublecomplex (* restrict sweep_m)[MAX_NMAT];
+
 // iterative solver
 extern enum iter IterMethod;
 extern int maxiter;
+extern enum init_field InitField;
 extern doublecomplex *xvec,*pvec,* restrict Einc;
 
 // scattering at different angles
@@ -76,7 +82,7 @@ extern angle_set alpha_int;
 extern scat_grid_angles angles;
 extern doublecomplex * restrict EgridX,* restrict EgridY;
 
-extern int nprocs,ringid;
+extern int nprocs,ringid,group_id,nthreads;
 
 extern size_t local_Ndip,local_nvoid_Ndip,local_nRows,local_nvoid_d0,local_nvoid_d1,nvoid_Ndip;
 